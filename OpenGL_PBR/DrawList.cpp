@@ -0,0 +1,277 @@
+#include <algorithm>
+#include <cstring>
+#include <map>
+#include "DrawList.h"
+#include "GeometryArena.h"
+#include "GLStateCache.h"
+#include "RenderQueue.h"
+
+DrawList::DrawList()
+	: commandBuffer(0), drawDataBuffer(0), culledCommandBuffer(0), batchCountBuffer(0), batchStartBuffer(0), visibleInstanceBuffer(0),
+	pooledDrawBuffer(0), bIsCulling(false),
+	drawCount(0), batchCount(0), unsortedBatchChanges(0)
+{
+}
+
+DrawList::~DrawList()
+{
+	if (commandBuffer)
+	{
+		glDeleteBuffers(1, &commandBuffer);
+		glDeleteBuffers(1, &drawDataBuffer);
+		glDeleteBuffers(1, &culledCommandBuffer);
+		glDeleteBuffers(1, &batchCountBuffer);
+		glDeleteBuffers(1, &batchStartBuffer);
+		glDeleteBuffers(1, &visibleInstanceBuffer);
+		glDeleteBuffers(1, &pooledDrawBuffer);
+	}
+}
+
+void DrawList::Add(const Mesh& mesh, unsigned int lod, const mat4& transform, const InstancePool* instances, float depth)
+{
+	if (instances && instances->GetDrawCount() == 0)
+	{
+		return;
+	}
+	PendingDraw draw;
+	draw.mesh = &mesh;
+	draw.lod = lod;
+	draw.transform = transform;
+	draw.instances = instances;
+	draw.depth = std::max(depth, 0.0f);
+	pendingDraws.push_back(draw);
+}
+
+void DrawList::Submit(Shader& shader)
+{
+	submit(&shader, nullptr);
+}
+
+void DrawList::Submit(ShaderVariants& variants)
+{
+	submit(nullptr, &variants);
+}
+
+void DrawList::submit(Shader* shader, ShaderVariants* variants)
+{
+	drawCount = pendingDraws.size();
+	batchCount = 0;
+	unsortedBatchChanges = 0;
+	if (pendingDraws.empty())
+	{
+		return;
+	}
+	if (!commandBuffer)
+	{
+		glCreateBuffers(1, &commandBuffer);
+		glCreateBuffers(1, &drawDataBuffer);
+		glCreateBuffers(1, &culledCommandBuffer);
+		glCreateBuffers(1, &batchCountBuffer);
+		glCreateBuffers(1, &batchStartBuffer);
+		glCreateBuffers(1, &visibleInstanceBuffer);
+		glCreateBuffers(1, &pooledDrawBuffer);
+	}
+
+	//Group draws that can go into the same multi-draw, batches keep the order they are first used in. Materials come from
+	//the material table by index, so only the program variant and the index type split batches
+	map<pair<unsigned int, GLenum>, unsigned int> batchLookup;
+	vector<unsigned int> drawBatches(pendingDraws.size());
+	vector<GLenum> batchIndexTypes;
+	vector<Shader*> batchShaders;
+	vector<unsigned int> batchStarts;
+	for (size_t i = 0; i < pendingDraws.size(); i++)
+	{
+		GLenum indexType = pendingDraws[i].mesh->GetIndexType();
+		unsigned int features = 0;
+		if (variants)
+		{
+			features = variants->Resolve(pendingDraws[i].mesh->shaderFeatures | (pendingDraws[i].instances ? SHADER_INSTANCED : 0));
+		}
+		pair<unsigned int, GLenum> batchKey(features, indexType);
+		map<pair<unsigned int, GLenum>, unsigned int>::iterator it = batchLookup.find(batchKey);
+		if (it == batchLookup.end())
+		{
+			it = batchLookup.insert(make_pair(batchKey, (unsigned int)batchIndexTypes.size())).first;
+			batchIndexTypes.push_back(indexType);
+			batchShaders.push_back(variants ? &variants->Get(features) : shader);
+			batchStarts.push_back(0);
+		}
+		drawBatches[i] = it->second;
+		batchStarts[it->second]++;
+		if (i == 0 || drawBatches[i] != drawBatches[i - 1])
+		{
+			unsortedBatchChanges++;
+		}
+	}
+	//Turn the per batch counts into offsets
+	unsigned int offset = 0;
+	for (size_t batch = 0; batch < batchStarts.size(); batch++)
+	{
+		unsigned int count = batchStarts[batch];
+		batchStarts[batch] = offset;
+		offset += count;
+	}
+	batchStarts.push_back(offset);
+
+	//Sort by batch, then front to back. Depths are never negative, so their bits compare in the same order as the floats
+	sortKeys.resize(pendingDraws.size());
+	for (size_t i = 0; i < pendingDraws.size(); i++)
+	{
+		unsigned int depthBits;
+		memcpy(&depthBits, &pendingDraws[i].depth, sizeof(depthBits));
+		sortKeys[i] = ((unsigned long long)drawBatches[i] << 32) | depthBits;
+	}
+	RadixSort(sortKeys, sortOrder);
+
+	commands.resize(pendingDraws.size());
+	drawData.resize(pendingDraws.size());
+	pooledDraws.clear();
+	unsigned int pooledInstanceCount = 0;
+	for (unsigned int slot = 0; slot < sortOrder.size(); slot++)
+	{
+		unsigned int i = sortOrder[slot];
+		const PendingDraw& draw = pendingDraws[i];
+		const Mesh& mesh = *draw.mesh;
+		const MeshLod& level = mesh.GetLod(draw.lod);
+		const GeometryRange& geometry = mesh.GetGeometry();
+		unsigned int indexSize = mesh.GetIndexType() == GL_UNSIGNED_SHORT ? sizeof(unsigned short) : sizeof(unsigned int);
+
+		DrawElementsIndirectCommand& command = commands[slot];
+		command.count = level.indexCount;
+		command.instanceCount = draw.instances ? draw.instances->GetDrawCount() : 1;
+		command.firstIndex = (geometry.indexOffset + level.indexOffset) / indexSize;
+		command.baseVertex = geometry.baseVertex;
+		command.baseInstance = slot;
+
+		DrawData& data = drawData[slot];
+		data.transform = InstanceRecord(draw.transform);
+		data.dequantizeOffset = vec4(mesh.boundsMin, 0.0f);
+		data.dequantizeScale = vec4(mesh.boundsMax - mesh.boundsMin, 0.0f);
+		data.materialIndex = mesh.material;
+		data.lod = draw.lod;
+		data.faceMask = 0x3F; //every face until the culling pass says otherwise
+		data.batch = drawBatches[i];
+		data.firstInstance = draw.instances ? (int)draw.instances->GetFirstInstance() : -1;
+		data.visibleInstanceStart = -1;
+		data.visibleInstanceCount = 0;
+		if (draw.instances && bIsCulling)
+		{
+			//Each pooled draw gets a range as long as its pool for the instances that survive culling
+			data.visibleInstanceStart = (int)pooledInstanceCount;
+			pooledInstanceCount += command.instanceCount;
+			pooledDraws.push_back(slot);
+		}
+	}
+
+	//Orphan last pass's storage so the driver does not have to wait for it
+	glNamedBufferData(commandBuffer, commands.size() * sizeof(DrawElementsIndirectCommand), commands.data(), GL_STREAM_DRAW);
+	glNamedBufferData(drawDataBuffer, drawData.size() * sizeof(DrawData), drawData.data(), GL_STREAM_DRAW);
+
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, DRAW_DATA_BINDING, drawDataBuffer);
+
+	if (bIsCulling)
+	{
+		//The culling pass appends the visible commands of every batch to the batch's range and counts them
+		glNamedBufferData(culledCommandBuffer, commands.size() * sizeof(DrawElementsIndirectCommand), nullptr, GL_STREAM_DRAW);
+		glNamedBufferData(batchStartBuffer, batchStarts.size() * sizeof(unsigned int), batchStarts.data(), GL_STREAM_DRAW);
+		glNamedBufferData(batchCountBuffer, batchStarts.size() * sizeof(unsigned int), nullptr, GL_STREAM_DRAW);
+		glClearNamedBufferData(batchCountBuffer, GL_R32UI, GL_RED_INTEGER, GL_UNSIGNED_INT, nullptr);
+		glBindBufferBase(GL_SHADER_STORAGE_BUFFER, CULL_INPUT_COMMAND_BINDING, commandBuffer);
+		glBindBufferBase(GL_SHADER_STORAGE_BUFFER, CULL_OUTPUT_COMMAND_BINDING, culledCommandBuffer);
+		glBindBufferBase(GL_SHADER_STORAGE_BUFFER, CULL_BATCH_COUNT_BINDING, batchCountBuffer);
+		glBindBufferBase(GL_SHADER_STORAGE_BUFFER, CULL_BATCH_START_BINDING, batchStartBuffer);
+		if (!pooledDraws.empty())
+		{
+			//The vertex shaders read the pooled draws' instances through this list, so it stays bound for drawing
+			glNamedBufferData(visibleInstanceBuffer, std::max(pooledInstanceCount, 1u) * sizeof(unsigned int), nullptr, GL_STREAM_DRAW);
+			glNamedBufferData(pooledDrawBuffer, pooledDraws.size() * sizeof(unsigned int), pooledDraws.data(), GL_STREAM_DRAW);
+			glBindBufferBase(GL_SHADER_STORAGE_BUFFER, CULL_VISIBLE_INSTANCE_BINDING, visibleInstanceBuffer);
+			glBindBufferBase(GL_SHADER_STORAGE_BUFFER, CULL_POOLED_DRAW_BINDING, pooledDrawBuffer);
+		}
+		GpuCulling::Get().Cull(cullingView, drawCount, pooledDraws.size(), pooledInstanceCount);
+		glMemoryBarrier(GL_COMMAND_BARRIER_BIT | GL_SHADER_STORAGE_BARRIER_BIT);
+	}
+
+	glBindBuffer(GL_DRAW_INDIRECT_BUFFER, bIsCulling ? culledCommandBuffer : commandBuffer);
+	if (bIsCulling)
+	{
+		glBindBuffer(GL_PARAMETER_BUFFER, batchCountBuffer);
+	}
+	GLStateCache::Get().BindVertexArray(GeometryArena::Get().GetVAO());
+	static const UniformId drawListUniform("bDrawList");
+	Shader* batchShader = nullptr;
+	for (size_t batch = 0; batch + 1 < batchStarts.size(); batch++)
+	{
+		//Batches keep the order they were first used in, so the program is only switched when the variant changes
+		if (batchShaders[batch] != batchShader)
+		{
+			if (batchShader)
+			{
+				batchShader->setBool(drawListUniform, false);
+			}
+			batchShader = batchShaders[batch];
+			batchShader->use();
+			batchShader->setBool(drawListUniform, true);
+		}
+		unsigned int first = batchStarts[batch];
+		unsigned int count = batchStarts[batch + 1] - first;
+		if (bIsCulling)
+		{
+			//The GPU decides how many of the batch's commands are drawn, count is only the upper bound
+			glMultiDrawElementsIndirectCount(GL_TRIANGLES, batchIndexTypes[batch], (void*)(first * sizeof(DrawElementsIndirectCommand)),
+				batch * sizeof(unsigned int), count, sizeof(DrawElementsIndirectCommand));
+		}
+		else
+		{
+			glMultiDrawElementsIndirect(GL_TRIANGLES, batchIndexTypes[batch], (void*)(first * sizeof(DrawElementsIndirectCommand)),
+				count, sizeof(DrawElementsIndirectCommand));
+		}
+	}
+	batchShader->setBool(drawListUniform, false);
+	glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+	glBindBuffer(GL_PARAMETER_BUFFER, 0);
+
+	batchCount = batchStarts.size() - 1;
+	pendingDraws.clear();
+}
+
+void DrawList::SetCullingView(const CullingView& view)
+{
+	cullingView = view;
+	bIsCulling = view.faceCount > 0;
+}
+
+void DrawList::DisableCulling()
+{
+	bIsCulling = false;
+}
+
+const CullingView& DrawList::GetCullingView() const
+{
+	return cullingView;
+}
+
+bool DrawList::IsCulling() const
+{
+	return bIsCulling;
+}
+
+void DrawList::Clear()
+{
+	pendingDraws.clear();
+}
+
+unsigned int DrawList::GetDrawCount() const
+{
+	return drawCount;
+}
+
+unsigned int DrawList::GetBatchCount() const
+{
+	return batchCount;
+}
+
+unsigned int DrawList::GetUnsortedBatchChanges() const
+{
+	return unsortedBatchChanges;
+}
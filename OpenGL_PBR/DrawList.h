@@ -0,0 +1,112 @@
+#pragma once
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+#include <vector>
+
+#include "Mesh.h"
+#include "Shader.h"
+#include "ShaderVariants.h"
+#include "GpuCulling.h"
+
+using namespace std;
+using namespace glm;
+
+//Shader storage binding the per-draw data is read from, binding 1 is taken by the instance transforms
+#define DRAW_DATA_BINDING 2
+
+/* Layout of glMultiDrawElementsIndirect commands */
+struct DrawElementsIndirectCommand
+{
+	GLuint count;
+	GLuint instanceCount;
+	GLuint firstIndex; //in indices, not bytes
+	GLint baseVertex;
+	GLuint baseInstance; //index into the draw data, read back in the vertex shader as gl_BaseInstance
+};
+
+/* Per-draw values the vertex shader reads instead of uniforms, std430 layout */
+struct DrawData
+{
+	InstanceRecord transform; //same packed world and normal matrix as an instance
+	vec4 dequantizeOffset; //w unused
+	vec4 dequantizeScale; //w unused
+	unsigned int materialIndex; //entry in the MaterialTable
+	unsigned int lod;
+	unsigned int faceMask; //cube map faces the draw is visible in, written by the culling pass
+	unsigned int batch; //multi-draw the command belongs to
+	int firstInstance; //start of the draw's instance pool in the instance buffer, -1 when not instanced
+	int visibleInstanceStart; //first of the pool's entries in the visible instance list, -1 when every instance is drawn
+	unsigned int visibleInstanceCount; //counted by the instance culling pass
+	unsigned int padding;
+};
+
+static_assert(sizeof(DrawData) == 160, "DrawData must match the std430 layout in drawData.glsl");
+
+/* Collects mesh draws for a pass and submits them with as few glMultiDrawElementsIndirect calls as possible.
+Draws are batched by index type and, when submitted with shader variants, by the variant the mesh needs. Everything
+else, the material included, comes from the draw data buffer.
+With a culling view set, the draws are culled on the GPU first and only the visible ones are drawn. Pooled draws are
+culled instance by instance and only draw the instances that are left */
+class DrawList
+{
+public:
+	DrawList();
+	~DrawList();
+
+	/* Queue mesh at lod. With instances, every instance in the pool is drawn, each placed by transform * its own transform.
+	depth is the draw's distance from the viewer, draws in a batch go front to back so early depth testing rejects more */
+	void Add(const Mesh& mesh, unsigned int lod, const mat4& transform, const InstancePool* instances = nullptr, float depth = 0.0f);
+	/* Upload the draws and issue them with shader, which must already be in use. The list is cleared afterwards */
+	void Submit(Shader& shader);
+	/* Same as above but every mesh is drawn with the variant for its shader features, one program switch per batch */
+	void Submit(ShaderVariants& variants);
+	void Clear();
+
+	/* Cull every following Submit against view until culling is disabled again */
+	void SetCullingView(const CullingView& view);
+	void DisableCulling();
+	const CullingView& GetCullingView() const;
+	bool IsCulling() const;
+
+	/* Counts from the last Submit, before culling */
+	unsigned int GetDrawCount() const;
+	unsigned int GetBatchCount() const;
+	/* Multi-draw switches drawing the last Submit's draws in the order they were added would have taken */
+	unsigned int GetUnsortedBatchChanges() const;
+
+private:
+	struct PendingDraw
+	{
+		const Mesh* mesh;
+		unsigned int lod;
+		mat4 transform;
+		const InstancePool* instances;
+		float depth;
+	};
+
+	/* Submit with shader, or with the variants of each batch when variants is given */
+	void submit(Shader* shader, ShaderVariants* variants);
+
+	vector<PendingDraw> pendingDraws;
+	vector<DrawElementsIndirectCommand> commands;
+	vector<DrawData> drawData;
+	vector<unsigned long long> sortKeys;
+	vector<unsigned int> sortOrder;
+	unsigned int commandBuffer;
+	unsigned int drawDataBuffer;
+	//only used when culling
+	unsigned int culledCommandBuffer;
+	unsigned int batchCountBuffer;
+	unsigned int batchStartBuffer;
+	unsigned int visibleInstanceBuffer;
+	unsigned int pooledDrawBuffer;
+	vector<unsigned int> pooledDraws; //draw data index of every pooled draw
+	CullingView cullingView;
+	bool bIsCulling;
+	unsigned int drawCount;
+	unsigned int batchCount;
+	unsigned int unsortedBatchChanges;
+
+	DrawList(const DrawList&) = delete;
+	DrawList& operator=(const DrawList&) = delete;
+};
@@ -0,0 +1,92 @@
+#include "EntityStore.h"
+#include "Model.h"
+
+EntityStore::EntityStore()
+	: count(0)
+{
+}
+
+Entity EntityStore::Create()
+{
+	unsigned int index;
+	if (!freeIndices.empty())
+	{
+		index = freeIndices.back();
+		freeIndices.pop_back();
+	}
+	else
+	{
+		index = generations.size();
+		generations.push_back(0);
+	}
+	count++;
+	return (generations[index] << ENTITY_INDEX_BITS) | index;
+}
+
+void EntityStore::Destroy(Entity entity)
+{
+	if (!IsAlive(entity))
+	{
+		return;
+	}
+	if (transforms.Has(entity))
+	{
+		hierarchy.Remove(transforms.Get(entity).node);
+		transforms.Remove(entity);
+	}
+	meshes.Remove(entity);
+	materials.Remove(entity);
+	bounds.Remove(entity);
+	lights.Remove(entity);
+	shadowCasters.Remove(entity);
+
+	unsigned int index = entity & ENTITY_INDEX_MASK;
+	//Wraps around eventually, by then nothing should still hold the old id
+	generations[index] = (generations[index] + 1) & (0xFFFFFFFFu >> ENTITY_INDEX_BITS);
+	freeIndices.push_back(index);
+	count--;
+}
+
+bool EntityStore::IsAlive(Entity entity) const
+{
+	unsigned int index = entity & ENTITY_INDEX_MASK;
+	return entity != INVALID_ENTITY && index < generations.size() && (entity >> ENTITY_INDEX_BITS) == generations[index];
+}
+
+size_t EntityStore::GetCount() const
+{
+	return count;
+}
+
+void EntityStore::AddTransform(Entity entity, Entity parent, vec3 translation, quat rotation, vec3 scale)
+{
+	int parentNode = transforms.Has(parent) ? (int)transforms.Get(parent).node : -1;
+	TransformComponent transform;
+	transform.node = hierarchy.Add(parentNode, translation, rotation, scale);
+	transforms.Add(entity, transform);
+}
+
+const mat4& EntityStore::GetWorld(Entity entity) const
+{
+	static const mat4 identity(1.0f);
+	if (!transforms.Has(entity))
+	{
+		return identity;
+	}
+	return hierarchy.GetWorld(transforms.Get(entity).node);
+}
+
+size_t EntityStore::UpdateTransforms()
+{
+	return hierarchy.Update();
+}
+
+void EntityStore::UpdateBounds(Entity entity)
+{
+	if (!meshes.Has(entity) || !meshes.Get(entity).model)
+	{
+		return;
+	}
+	const MeshComponent& mesh = meshes.Get(entity);
+	bounds.Add(entity, mesh.model->GetBounds(GetWorld(entity), mesh.meshToDraw));
+}
@@ -0,0 +1,197 @@
+#pragma once
+#include <glm/glm.hpp>
+#include <vector>
+
+#include "TransformHierarchy.h"
+#include "FrustumCulling.h"
+
+using namespace std;
+using namespace glm;
+
+class Model;
+
+/* Entities are plain ids, the low bits index the entity and the high bits count how often that index has been reused
+so ids of destroyed entities are never mistaken for the new entity in their slot */
+typedef unsigned int Entity;
+#define INVALID_ENTITY 0xFFFFFFFFu
+#define ENTITY_INDEX_BITS 24
+#define ENTITY_INDEX_MASK ((1u << ENTITY_INDEX_BITS) - 1)
+
+/* Every component of one type packed into an array with no gaps (a sparse set). Looking up an entity's component goes
+through the sparse array, passes iterate the packed arrays from start to end. Removing swaps the last component into the hole */
+template <typename T>
+class ComponentArray
+{
+public:
+	ComponentArray()
+		: version(0)
+	{
+	}
+
+	T& Add(Entity entity, const T& component)
+	{
+		version++;
+		unsigned int index = entity & ENTITY_INDEX_MASK;
+		if (index >= sparse.size())
+		{
+			sparse.resize(index + 1, ~0u);
+		}
+		if (sparse[index] != ~0u)
+		{
+			entities[sparse[index]] = entity;
+			components[sparse[index]] = component;
+			return components[sparse[index]];
+		}
+		sparse[index] = components.size();
+		entities.push_back(entity);
+		components.push_back(component);
+		return components.back();
+	}
+
+	void Remove(Entity entity)
+	{
+		if (!Has(entity))
+		{
+			return;
+		}
+		version++;
+		unsigned int index = entity & ENTITY_INDEX_MASK;
+		unsigned int slot = sparse[index];
+		unsigned int last = components.size() - 1;
+		if (slot != last)
+		{
+			components[slot] = components[last];
+			entities[slot] = entities[last];
+			sparse[entities[slot] & ENTITY_INDEX_MASK] = slot;
+		}
+		components.pop_back();
+		entities.pop_back();
+		sparse[index] = ~0u;
+	}
+
+	bool Has(Entity entity) const
+	{
+		unsigned int index = entity & ENTITY_INDEX_MASK;
+		return index < sparse.size() && sparse[index] != ~0u && entities[sparse[index]] == entity;
+	}
+
+	T& Get(Entity entity)
+	{
+		return components[sparse[entity & ENTITY_INDEX_MASK]];
+	}
+
+	const T& Get(Entity entity) const
+	{
+		return components[sparse[entity & ENTITY_INDEX_MASK]];
+	}
+
+	size_t Size() const
+	{
+		return components.size();
+	}
+
+	/* Changes whenever a component is added, replaced or removed, so anything built over the set can tell it is out of date */
+	unsigned int GetVersion() const
+	{
+		return version;
+	}
+
+	/* Packed arrays, GetEntities()[i] owns GetComponents()[i] */
+	const Entity* GetEntities() const
+	{
+		return entities.data();
+	}
+
+	T* GetComponents()
+	{
+		return components.data();
+	}
+
+	const T* GetComponents() const
+	{
+		return components.data();
+	}
+
+private:
+	vector<unsigned int> sparse; //slot of each entity index, ~0u when it has no component
+	vector<Entity> entities;
+	vector<T> components;
+	unsigned int version;
+};
+
+/* Node in the store's transform hierarchy */
+struct TransformComponent
+{
+	unsigned int node;
+};
+
+/* What gets drawn. Either a model, or all of one mesh of it, or when model is nullptr vertexCount vertices from vao */
+struct MeshComponent
+{
+	Model* model;
+	int meshToDraw;
+	unsigned int vao;
+	unsigned int vertexCount;
+};
+
+/* Surface of entities that are not drawn through a model, which bring their own textures */
+struct MaterialComponent
+{
+	unsigned int texture;
+	unsigned int material; //entry in the MaterialTable for texture
+	bool bIsTransparent; //drawn after every opaque object, back to front
+};
+
+/* Point light at the entity's position, drawn as a small cube of its colour */
+struct LightComponent
+{
+	vec3 color;
+	float markerSize;
+};
+
+/* Tag for entities drawn into the shadow map */
+struct ShadowCasterComponent
+{
+};
+
+/* Every renderable object in the scene, with each component type in its own packed array so render passes walk memory
+in order no matter how many entities there are */
+class EntityStore
+{
+public:
+	EntityStore();
+
+	Entity Create();
+	/* Remove entity and all of its components. Its transform node is freed for the next entity, entities attached to it
+	move up to its parent and stay where they are */
+	void Destroy(Entity entity);
+	bool IsAlive(Entity entity) const;
+	/* Number of live entities */
+	size_t GetCount() const;
+
+	/* Give entity a transform, attached to parent's transform when parent has one */
+	void AddTransform(Entity entity, Entity parent = INVALID_ENTITY, vec3 translation = vec3(0.0f), quat rotation = quat(1.0f, 0.0f, 0.0f, 0.0f),
+		vec3 scale = vec3(1.0f));
+	/* World matrix of entity as of the last UpdateTransforms, identity if it has no transform */
+	const mat4& GetWorld(Entity entity) const;
+	/* Recompute the world matrices of every entity that moved, returns how many were updated */
+	size_t UpdateTransforms();
+	/* World space box around what the entity draws, from its mesh and current world matrix */
+	void UpdateBounds(Entity entity);
+
+	TransformHierarchy hierarchy;
+	ComponentArray<TransformComponent> transforms;
+	ComponentArray<MeshComponent> meshes;
+	ComponentArray<MaterialComponent> materials;
+	ComponentArray<BoundingBox> bounds;
+	ComponentArray<LightComponent> lights;
+	ComponentArray<ShadowCasterComponent> shadowCasters;
+
+private:
+	vector<unsigned int> generations; //of each entity index, bumped when the entity in it is destroyed
+	vector<unsigned int> freeIndices;
+	size_t count;
+
+	EntityStore(const EntityStore&) = delete;
+	EntityStore& operator=(const EntityStore&) = delete;
+};
@@ -0,0 +1,551 @@
+#include <algorithm>
+#include <cfloat>
+#include <chrono>
+#include <cstring>
+#include <iostream>
+#include <random>
+#include <glm/gtc/matrix_transform.hpp>
+#include "FrustumCulling.h"
+
+#ifdef CULLING_SSE
+#include <immintrin.h>
+#endif
+
+BoundingBox::BoundingBox()
+	: min(FLT_MAX), max(-FLT_MAX)
+{
+}
+
+BoundingBox::BoundingBox(vec3 min, vec3 max)
+	: min(min), max(max)
+{
+}
+
+bool BoundingBox::IsEmpty() const
+{
+	return min.x > max.x || min.y > max.y || min.z > max.z;
+}
+
+void BoundingBox::Expand(const BoundingBox& box)
+{
+	min = glm::min(min, box.min);
+	max = glm::max(max, box.max);
+}
+
+BoundingBox BoundingBox::Transformed(const mat4& transform) const
+{
+	if (IsEmpty())
+	{
+		return *this;
+	}
+	//Transform the centre and grow the extent by the absolute value of the rotation and scale (Arvo 1990)
+	vec3 center = (min + max) * 0.5f;
+	vec3 extent = (max - min) * 0.5f;
+	vec3 worldCenter = vec3(transform * vec4(center, 1.0f));
+	mat3 absolute = mat3(abs(vec3(transform[0])), abs(vec3(transform[1])), abs(vec3(transform[2])));
+	vec3 worldExtent = absolute * extent;
+	return BoundingBox(worldCenter - worldExtent, worldCenter + worldExtent);
+}
+
+vec4 ComputeBoundingSphere(const vec3* points, size_t count, size_t stride)
+{
+	if (count == 0)
+	{
+		return vec4(0.0f);
+	}
+	const unsigned char* bytes = (const unsigned char*)points;
+	#define POINT(i) (*(const vec3*)(bytes + (i) * stride))
+
+	//Start from two points that are far apart: the furthest from the first point, then the furthest from that
+	size_t furthest = 0;
+	float furthestDistance = -1.0f;
+	for (size_t i = 0; i < count; i++)
+	{
+		float distance = dot(POINT(i) - POINT(0), POINT(i) - POINT(0));
+		if (distance > furthestDistance)
+		{
+			furthestDistance = distance;
+			furthest = i;
+		}
+	}
+	vec3 a = POINT(furthest);
+	furthestDistance = -1.0f;
+	for (size_t i = 0; i < count; i++)
+	{
+		float distance = dot(POINT(i) - a, POINT(i) - a);
+		if (distance > furthestDistance)
+		{
+			furthestDistance = distance;
+			furthest = i;
+		}
+	}
+	vec3 b = POINT(furthest);
+	vec3 center = (a + b) * 0.5f;
+	float radius = length(b - a) * 0.5f;
+
+	//Grow the sphere just enough to take in every point outside of it
+	for (size_t i = 0; i < count; i++)
+	{
+		float distance = length(POINT(i) - center);
+		if (distance > radius)
+		{
+			float newRadius = (radius + distance) * 0.5f;
+			center += (POINT(i) - center) * ((newRadius - radius) / distance);
+			radius = newRadius;
+		}
+	}
+	#undef POINT
+	return vec4(center, radius);
+}
+
+Frustum::Frustum()
+{
+	for (int i = 0; i < 6; i++)
+	{
+		planes[i] = vec4(0.0f, 0.0f, 0.0f, 1.0f);
+	}
+}
+
+Frustum::Frustum(const mat4& viewProjection)
+{
+	//glm is column major, so the rows of the matrix are gathered from each column
+	vec4 rows[4];
+	for (int i = 0; i < 4; i++)
+	{
+		rows[i] = vec4(viewProjection[0][i], viewProjection[1][i], viewProjection[2][i], viewProjection[3][i]);
+	}
+	planes[0] = rows[3] + rows[0];
+	planes[1] = rows[3] - rows[0];
+	planes[2] = rows[3] + rows[1];
+	planes[3] = rows[3] - rows[1];
+	planes[4] = rows[3] + rows[2];
+	planes[5] = rows[3] - rows[2];
+	for (int i = 0; i < 6; i++)
+	{
+		planes[i] /= length(vec3(planes[i]));
+	}
+}
+
+Frustum::Frustum(Camera& camera, float aspect, float nearPlane, float farPlane)
+	: Frustum(perspective(camera.GetFOV(), aspect, nearPlane, farPlane) * camera.GetViewMatrix())
+{
+}
+
+bool Frustum::Intersects(const BoundingBox& box) const
+{
+	vec3 center = (box.min + box.max) * 0.5f;
+	vec3 extent = (box.max - box.min) * 0.5f;
+	for (int i = 0; i < 6; i++)
+	{
+		vec3 normal = vec3(planes[i]);
+		float distance = dot(normal, center) + planes[i].w;
+		float radius = dot(abs(normal), extent);
+		if (distance < -radius)
+		{
+			return false;
+		}
+	}
+	return true;
+}
+
+void BoundingBoxArray::Clear()
+{
+	centerX.clear();
+	centerY.clear();
+	centerZ.clear();
+	extentX.clear();
+	extentY.clear();
+	extentZ.clear();
+}
+
+void BoundingBoxArray::Add(const BoundingBox& box)
+{
+	vec3 center = (box.min + box.max) * 0.5f;
+	vec3 extent = (box.max - box.min) * 0.5f;
+	centerX.push_back(center.x);
+	centerY.push_back(center.y);
+	centerZ.push_back(center.z);
+	extentX.push_back(extent.x);
+	extentY.push_back(extent.y);
+	extentZ.push_back(extent.z);
+}
+
+size_t BoundingBoxArray::Size() const
+{
+	return centerX.size();
+}
+
+/* Test four boxes against every plane. Bit i of visibleMask is set if box i intersects the frustum, bit i of insideMask
+if it is also entirely inside it */
+static inline void testBoxes4(const Frustum& frustum, const float* centerX, const float* centerY, const float* centerZ,
+	const float* extentX, const float* extentY, const float* extentZ, int& visibleMask, int& insideMask)
+{
+#ifdef CULLING_SSE
+	const __m128 signBit = _mm_set1_ps(-0.0f);
+	__m128 cx = _mm_loadu_ps(centerX);
+	__m128 cy = _mm_loadu_ps(centerY);
+	__m128 cz = _mm_loadu_ps(centerZ);
+	__m128 ex = _mm_loadu_ps(extentX);
+	__m128 ey = _mm_loadu_ps(extentY);
+	__m128 ez = _mm_loadu_ps(extentZ);
+	__m128 outside = _mm_setzero_ps();
+	__m128 crossing = _mm_setzero_ps();
+	for (int i = 0; i < 6; i++)
+	{
+		const vec4& plane = frustum.planes[i];
+		__m128 nx = _mm_set1_ps(plane.x);
+		__m128 ny = _mm_set1_ps(plane.y);
+		__m128 nz = _mm_set1_ps(plane.z);
+		__m128 distance = _mm_add_ps(_mm_add_ps(_mm_mul_ps(nx, cx), _mm_mul_ps(ny, cy)), _mm_add_ps(_mm_mul_ps(nz, cz), _mm_set1_ps(plane.w)));
+		__m128 radius = _mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_andnot_ps(signBit, nx), ex), _mm_mul_ps(_mm_andnot_ps(signBit, ny), ey)),
+			_mm_mul_ps(_mm_andnot_ps(signBit, nz), ez));
+		outside = _mm_or_ps(outside, _mm_cmplt_ps(distance, _mm_xor_ps(radius, signBit)));
+		crossing = _mm_or_ps(crossing, _mm_cmplt_ps(distance, radius));
+	}
+	visibleMask = ~_mm_movemask_ps(outside) & 0xF;
+	insideMask = ~_mm_movemask_ps(crossing) & 0xF;
+#else
+	visibleMask = 0;
+	insideMask = 0;
+	for (int box = 0; box < 4; box++)
+	{
+		bool bIsOutside = false;
+		bool bIsCrossing = false;
+		for (int i = 0; i < 6; i++)
+		{
+			const vec4& plane = frustum.planes[i];
+			float distance = plane.x * centerX[box] + plane.y * centerY[box] + plane.z * centerZ[box] + plane.w;
+			float radius = fabs(plane.x) * extentX[box] + fabs(plane.y) * extentY[box] + fabs(plane.z) * extentZ[box];
+			bIsOutside |= distance < -radius;
+			bIsCrossing |= distance < radius;
+		}
+		visibleMask |= bIsOutside ? 0 : 1 << box;
+		insideMask |= bIsCrossing ? 0 : 1 << box;
+	}
+#endif
+}
+
+void CullBoundingBoxes(const BoundingBoxArray& boxes, const Frustum& frustum, vector<unsigned int>& visible)
+{
+	const size_t count = boxes.Size();
+	size_t i = 0;
+#ifdef CULLING_AVX
+	const __m256 signBit = _mm256_set1_ps(-0.0f);
+	__m256 nx[6], ny[6], nz[6], nw[6];
+	for (int p = 0; p < 6; p++)
+	{
+		nx[p] = _mm256_set1_ps(frustum.planes[p].x);
+		ny[p] = _mm256_set1_ps(frustum.planes[p].y);
+		nz[p] = _mm256_set1_ps(frustum.planes[p].z);
+		nw[p] = _mm256_set1_ps(frustum.planes[p].w);
+	}
+	for (; i + 8 <= count; i += 8)
+	{
+		__m256 cx = _mm256_loadu_ps(&boxes.centerX[i]);
+		__m256 cy = _mm256_loadu_ps(&boxes.centerY[i]);
+		__m256 cz = _mm256_loadu_ps(&boxes.centerZ[i]);
+		__m256 ex = _mm256_loadu_ps(&boxes.extentX[i]);
+		__m256 ey = _mm256_loadu_ps(&boxes.extentY[i]);
+		__m256 ez = _mm256_loadu_ps(&boxes.extentZ[i]);
+		__m256 outside = _mm256_setzero_ps();
+		for (int p = 0; p < 6; p++)
+		{
+			__m256 distance = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(nx[p], cx), _mm256_mul_ps(ny[p], cy)), _mm256_add_ps(_mm256_mul_ps(nz[p], cz), nw[p]));
+			__m256 radius = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(_mm256_andnot_ps(signBit, nx[p]), ex), _mm256_mul_ps(_mm256_andnot_ps(signBit, ny[p]), ey)),
+				_mm256_mul_ps(_mm256_andnot_ps(signBit, nz[p]), ez));
+			outside = _mm256_or_ps(outside, _mm256_cmp_ps(distance, _mm256_xor_ps(radius, signBit), _CMP_LT_OQ));
+		}
+		int mask = ~_mm256_movemask_ps(outside) & 0xFF;
+		while (mask)
+		{
+			int bit = 0;
+			while (!(mask & (1 << bit)))
+			{
+				bit++;
+			}
+			visible.push_back(i + bit);
+			mask &= mask - 1;
+		}
+	}
+#endif
+	for (; i + 4 <= count; i += 4)
+	{
+		int visibleMask, insideMask;
+		testBoxes4(frustum, &boxes.centerX[i], &boxes.centerY[i], &boxes.centerZ[i], &boxes.extentX[i], &boxes.extentY[i], &boxes.extentZ[i],
+			visibleMask, insideMask);
+		for (int bit = 0; bit < 4; bit++)
+		{
+			if (visibleMask & (1 << bit))
+			{
+				visible.push_back(i + bit);
+			}
+		}
+	}
+	//Fewer than four boxes left
+	for (; i < count; i++)
+	{
+		vec3 center = vec3(boxes.centerX[i], boxes.centerY[i], boxes.centerZ[i]);
+		vec3 extent = vec3(boxes.extentX[i], boxes.extentY[i], boxes.extentZ[i]);
+		if (frustum.Intersects(BoundingBox(center - extent, center + extent)))
+		{
+			visible.push_back(i);
+		}
+	}
+}
+
+SceneBVH::SceneBVH()
+{
+}
+
+/* Split order[first, first + count) in half around the median centroid on the axis the centroids spread furthest along */
+static unsigned int splitObjects(vector<unsigned int>& order, const vector<vec3>& centroids, unsigned int first, unsigned int count)
+{
+	vec3 low = vec3(FLT_MAX);
+	vec3 high = vec3(-FLT_MAX);
+	for (unsigned int i = first; i < first + count; i++)
+	{
+		low = glm::min(low, centroids[order[i]]);
+		high = glm::max(high, centroids[order[i]]);
+	}
+	vec3 spread = high - low;
+	int axis = spread.x > spread.y ? (spread.x > spread.z ? 0 : 2) : (spread.y > spread.z ? 1 : 2);
+	unsigned int middle = first + count / 2;
+	nth_element(order.begin() + first, order.begin() + middle, order.begin() + first + count,
+		[&](unsigned int a, unsigned int b) { return centroids[a][axis] < centroids[b][axis]; });
+	return middle;
+}
+
+void SceneBVH::Build(const vector<BoundingBox>& bounds)
+{
+	nodes.clear();
+	objectOrder.resize(bounds.size());
+	if (bounds.empty())
+	{
+		return;
+	}
+	vector<vec3> centroids(bounds.size());
+	for (size_t i = 0; i < bounds.size(); i++)
+	{
+		objectOrder[i] = i;
+		centroids[i] = bounds[i].IsEmpty() ? vec3(0.0f) : (bounds[i].min + bounds[i].max) * 0.5f;
+	}
+	//Roughly one node per three objects
+	nodes.reserve(bounds.size() / 3 + 1);
+	buildNode(bounds, centroids, 0, bounds.size());
+}
+
+int SceneBVH::buildNode(const vector<BoundingBox>& bounds, const vector<vec3>& centroids, unsigned int first, unsigned int count)
+{
+	int index = nodes.size();
+	nodes.push_back(Node());
+
+	//Split into up to four groups, two levels of binary splits at once
+	unsigned int starts[5];
+	unsigned int groupCount = 0;
+	if (count <= 4)
+	{
+		for (unsigned int i = 0; i < count; i++)
+		{
+			starts[groupCount++] = first + i;
+		}
+	}
+	else
+	{
+		unsigned int middle = splitObjects(objectOrder, centroids, first, count);
+		unsigned int halves[2][2] = { { first, middle - first }, { middle, first + count - middle } };
+		for (int half = 0; half < 2; half++)
+		{
+			starts[groupCount++] = halves[half][0];
+			if (halves[half][1] > 1)
+			{
+				starts[groupCount++] = splitObjects(objectOrder, centroids, halves[half][0], halves[half][1]);
+			}
+		}
+	}
+	starts[groupCount] = first + count;
+
+	Node node;
+	memset(&node, 0, sizeof(Node));
+	node.childCount = groupCount;
+	for (unsigned int group = 0; group < groupCount; group++)
+	{
+		unsigned int groupFirst = starts[group];
+		unsigned int objectCount = starts[group + 1] - groupFirst;
+		BoundingBox box;
+		for (unsigned int i = groupFirst; i < groupFirst + objectCount; i++)
+		{
+			box.Expand(bounds[objectOrder[i]]);
+		}
+		setSlotBox(node, group, box);
+		node.first[group] = groupFirst;
+		node.count[group] = objectCount;
+		node.child[group] = objectCount == 1 ? -1 : buildNode(bounds, centroids, groupFirst, objectCount);
+	}
+	//Children were pushed after this node, so only write it back once they are done
+	nodes[index] = node;
+	return index;
+}
+
+void SceneBVH::Refit(const vector<BoundingBox>& bounds)
+{
+	//Children are always built after their parent, so walking backwards reaches each node once all of its children are done
+	nodeBounds.resize(nodes.size());
+	for (int index = (int)nodes.size() - 1; index >= 0; index--)
+	{
+		Node& node = nodes[index];
+		BoundingBox nodeBox;
+		for (unsigned int i = 0; i < node.childCount; i++)
+		{
+			const BoundingBox& box = node.child[i] < 0 ? bounds[objectOrder[node.first[i]]] : nodeBounds[node.child[i]];
+			setSlotBox(node, i, box);
+			nodeBox.Expand(box);
+		}
+		nodeBounds[index] = nodeBox;
+	}
+}
+
+void SceneBVH::setSlotBox(Node& node, unsigned int slot, const BoundingBox& box)
+{
+	vec3 center = box.IsEmpty() ? vec3(0.0f) : (box.min + box.max) * 0.5f;
+	vec3 extent = box.IsEmpty() ? vec3(0.0f) : (box.max - box.min) * 0.5f;
+	node.centerX[slot] = center.x;
+	node.centerY[slot] = center.y;
+	node.centerZ[slot] = center.z;
+	node.extentX[slot] = extent.x;
+	node.extentY[slot] = extent.y;
+	node.extentZ[slot] = extent.z;
+}
+
+void SceneBVH::Cull(const Frustum& frustum, vector<unsigned int>& visible) const
+{
+	if (nodes.empty())
+	{
+		return;
+	}
+	//Each node pushes at most four children, depth is log4 of the object count
+	int stack[256];
+	int stackSize = 0;
+	stack[stackSize++] = 0;
+	while (stackSize > 0)
+	{
+		const Node& node = nodes[stack[--stackSize]];
+		int visibleMask, insideMask;
+		testBoxes4(frustum, node.centerX, node.centerY, node.centerZ, node.extentX, node.extentY, node.extentZ, visibleMask, insideMask);
+		visibleMask &= (1 << node.childCount) - 1;
+		for (unsigned int i = 0; i < node.childCount; i++)
+		{
+			if (!(visibleMask & (1 << i)))
+			{
+				continue;
+			}
+			if (node.child[i] < 0 || (insideMask & (1 << i)))
+			{
+				visible.insert(visible.end(), objectOrder.begin() + node.first[i], objectOrder.begin() + node.first[i] + node.count[i]);
+			}
+			else
+			{
+				stack[stackSize++] = node.child[i];
+			}
+		}
+	}
+}
+
+size_t SceneBVH::GetObjectCount() const
+{
+	return objectOrder.size();
+}
+
+size_t SceneBVH::GetNodeCount() const
+{
+	return nodes.size();
+}
+
+void RunCullingBenchmark()
+{
+	typedef chrono::high_resolution_clock Clock;
+	const size_t objectCounts[] = { 10000, 100000, 1000000 };
+	const int viewCount = 32;
+
+#if defined(CULLING_AVX)
+	cout << "Culling benchmark, AVX" << endl;
+#elif defined(CULLING_SSE)
+	cout << "Culling benchmark, SSE" << endl;
+#else
+	cout << "Culling benchmark, scalar" << endl;
+#endif
+
+	for (size_t objectCount : objectCounts)
+	{
+		//Random boxes spread through a cube, denser scenes for more objects
+		mt19937 random(1234);
+		float sceneSize = 100.0f * pow(float(objectCount) / 10000.0f, 1.0f / 3.0f);
+		uniform_real_distribution<float> position(-sceneSize, sceneSize);
+		uniform_real_distribution<float> size(0.25f, 2.5f);
+		vector<BoundingBox> bounds(objectCount);
+		BoundingBoxArray boxArray;
+		for (size_t i = 0; i < objectCount; i++)
+		{
+			vec3 center = vec3(position(random), position(random), position(random));
+			vec3 extent = vec3(size(random), size(random), size(random));
+			bounds[i] = BoundingBox(center - extent, center + extent);
+			boxArray.Add(bounds[i]);
+		}
+
+		Clock::time_point buildStart = Clock::now();
+		SceneBVH bvh;
+		bvh.Build(bounds);
+		double buildTime = chrono::duration<double, milli>(Clock::now() - buildStart).count();
+
+		//Cameras at the centre looking in different directions
+		vector<Frustum> frustums;
+		mat4 projection = perspective(radians(60.0f), 16.0f / 9.0f, 0.1f, sceneSize);
+		for (int view = 0; view < viewCount; view++)
+		{
+			float yaw = view * (6.2831853f / viewCount);
+			vec3 forward = vec3(cos(yaw), 0.3f * sin(yaw * 3.0f), sin(yaw));
+			frustums.push_back(Frustum(projection * lookAt(vec3(0.0f), forward, vec3(0.0f, 1.0f, 0.0f))));
+		}
+
+		vector<unsigned int> visible;
+		visible.reserve(objectCount);
+		size_t scalarVisible = 0, arrayVisible = 0, bvhVisible = 0;
+
+		Clock::time_point start = Clock::now();
+		for (int view = 0; view < viewCount; view++)
+		{
+			for (size_t i = 0; i < objectCount; i++)
+			{
+				scalarVisible += frustums[view].Intersects(bounds[i]) ? 1 : 0;
+			}
+		}
+		double scalarTime = chrono::duration<double, milli>(Clock::now() - start).count();
+
+		start = Clock::now();
+		for (int view = 0; view < viewCount; view++)
+		{
+			visible.clear();
+			CullBoundingBoxes(boxArray, frustums[view], visible);
+			arrayVisible += visible.size();
+		}
+		double arrayTime = chrono::duration<double, milli>(Clock::now() - start).count();
+
+		start = Clock::now();
+		for (int view = 0; view < viewCount; view++)
+		{
+			visible.clear();
+			bvh.Cull(frustums[view], visible);
+			bvhVisible += visible.size();
+		}
+		double bvhTime = chrono::duration<double, milli>(Clock::now() - start).count();
+
+		double tested = double(objectCount) * viewCount;
+		cout << objectCount << " objects, " << scalarVisible / viewCount << " visible per view, BVH built in " << buildTime << "ms" << endl;
+		cout << "  scalar: " << tested / scalarTime << " instances/ms" << endl;
+		cout << "  SIMD array: " << tested / arrayTime << " instances/ms" << endl;
+		cout << "  SIMD BVH: " << tested / bvhTime << " instances/ms" << endl;
+		if (arrayVisible != scalarVisible || bvhVisible != scalarVisible)
+		{
+			cout << "  ERROR::CULLING::Results differ: scalar " << scalarVisible << ", array " << arrayVisible << ", BVH " << bvhVisible << endl;
+		}
+	}
+}
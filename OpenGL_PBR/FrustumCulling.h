@@ -0,0 +1,104 @@
+#pragma once
+#include <glm/glm.hpp>
+#include <vector>
+
+#include "Camera.h"
+
+using namespace std;
+using namespace glm;
+
+//SSE is always there on x64, AVX only when the compiler is allowed to use it (/arch:AVX or -mavx)
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define CULLING_SSE 1
+#endif
+#if defined(__AVX__)
+#define CULLING_AVX 1
+#endif
+
+/* Axis aligned box */
+struct BoundingBox
+{
+	vec3 min;
+	vec3 max;
+
+	BoundingBox();
+	BoundingBox(vec3 min, vec3 max);
+
+	bool IsEmpty() const;
+	void Expand(const BoundingBox& box);
+	/* Box around this box once it has been transformed */
+	BoundingBox Transformed(const mat4& transform) const;
+};
+
+/* Approximate smallest sphere around points, xyz is the centre and w the radius (Ritter 1990) */
+vec4 ComputeBoundingSphere(const vec3* points, size_t count, size_t stride = sizeof(vec3));
+
+/* Six normalized planes facing into the view volume, a point p is inside a plane when dot(plane.xyz, p) + plane.w >= 0 */
+struct Frustum
+{
+	vec4 planes[6]; //left, right, bottom, top, near, far
+
+	Frustum();
+	/* Planes of a combined projection * view matrix (Gribb and Hartmann 2001) */
+	Frustum(const mat4& viewProjection);
+	/* Planes of what camera sees through a perspective projection */
+	Frustum(Camera& camera, float aspect, float nearPlane, float farPlane);
+
+	bool Intersects(const BoundingBox& box) const;
+};
+
+/* Boxes stored as separate centre and extent arrays so several can be tested at once */
+struct BoundingBoxArray
+{
+	vector<float> centerX, centerY, centerZ;
+	vector<float> extentX, extentY, extentZ;
+
+	void Clear();
+	void Add(const BoundingBox& box);
+	size_t Size() const;
+};
+
+/* Append the index of every box that intersects frustum to visible, 8 boxes at a time with AVX or 4 with SSE */
+void CullBoundingBoxes(const BoundingBoxArray& boxes, const Frustum& frustum, vector<unsigned int>& visible);
+
+/* Bounding volume hierarchy with four children per node. Each node keeps its children's boxes side by side so one
+SIMD test covers the whole node. A child is either another node or a single object */
+class SceneBVH
+{
+public:
+	SceneBVH();
+
+	/* Rebuild over bounds, object ids are indices into bounds */
+	void Build(const vector<BoundingBox>& bounds);
+	/* Move the boxes to bounds, which must hold the same objects Build was given, keeping the tree as it is. Culling gets slower
+	the further objects have moved since they were built, so Build again once the set of objects changes */
+	void Refit(const vector<BoundingBox>& bounds);
+	/* Append every object whose box intersects frustum to visible. Subtrees entirely inside the frustum are taken without testing */
+	void Cull(const Frustum& frustum, vector<unsigned int>& visible) const;
+
+	size_t GetObjectCount() const;
+	size_t GetNodeCount() const;
+
+private:
+	struct Node
+	{
+		float centerX[4], centerY[4], centerZ[4];
+		float extentX[4], extentY[4], extentZ[4];
+		int child[4]; //node index, -1 when the slot holds a single object
+		unsigned int first[4]; //objects below the slot are objectOrder[first, first + count)
+		unsigned int count[4];
+		unsigned int childCount;
+	};
+
+	/* Build the node for objectOrder[first, first + count), returns its index */
+	int buildNode(const vector<BoundingBox>& bounds, const vector<vec3>& centroids, unsigned int first, unsigned int count);
+	/* Store box as the bounds of node's slot */
+	static void setSlotBox(Node& node, unsigned int slot, const BoundingBox& box);
+
+	vector<Node> nodes;
+	vector<unsigned int> objectOrder;
+	vector<BoundingBox> nodeBounds; //box around each node while refitting
+};
+
+/* Time frustum culling of 10k, 100k and 1M random boxes through the BVH and as a flat array and print the results */
+void RunCullingBenchmark();
@@ -0,0 +1,354 @@
+#include <iostream>
+#include "GLStateCache.h"
+
+//Value of state the cache has not seen set yet, never a real name or enum
+#define GL_STATE_UNKNOWN 0xFFFFFFFFu
+
+static const char* categoryNames[GL_STATE_CATEGORY_COUNT] = { "programs", "VAOs", "active texture", "textures", "capabilities", "depth", "stencil",
+	"blend", "cull face", "framebuffers", "viewport" };
+
+GLStateCache& GLStateCache::Get()
+{
+	//Never destroyed, state set by destructors of other globals on shutdown still goes through it
+	static GLStateCache* cache = new GLStateCache();
+	return *cache;
+}
+
+GLStateCache::GLStateCache()
+{
+	Invalidate();
+	ResetStatistics();
+}
+
+void GLStateCache::UseProgram(GLuint program)
+{
+	if (request(GL_STATE_PROGRAM, this->program == program))
+	{
+		glUseProgram(program);
+		this->program = program;
+	}
+}
+
+void GLStateCache::ForgetProgram(GLuint program)
+{
+	if (this->program == program)
+	{
+		glUseProgram(0);
+		this->program = 0;
+	}
+}
+
+void GLStateCache::BindVertexArray(GLuint vao)
+{
+	if (request(GL_STATE_VERTEX_ARRAY, vertexArray == vao))
+	{
+		glBindVertexArray(vao);
+		vertexArray = vao;
+	}
+}
+
+void GLStateCache::ActiveTexture(GLenum unit)
+{
+	if (request(GL_STATE_ACTIVE_TEXTURE, activeUnit == unit))
+	{
+		glActiveTexture(unit);
+		activeUnit = unit;
+	}
+}
+
+void GLStateCache::BindTexture(GLenum target, GLuint texture)
+{
+	int slot = targetIndex(target);
+	unsigned int unit = activeUnit - GL_TEXTURE0;
+	if (slot < 0 || activeUnit == GL_STATE_UNKNOWN || unit >= GL_STATE_TEXTURE_UNITS)
+	{
+		//Somewhere the cache cannot follow, so the call always goes through and the active unit's bindings are forgotten
+		request(GL_STATE_TEXTURE, false);
+		glBindTexture(target, texture);
+		if (slot >= 0 && unit < GL_STATE_TEXTURE_UNITS)
+		{
+			textures[unit][slot] = GL_STATE_UNKNOWN;
+		}
+		return;
+	}
+	if (request(GL_STATE_TEXTURE, textures[unit][slot] == texture))
+	{
+		glBindTexture(target, texture);
+		textures[unit][slot] = texture;
+	}
+}
+
+void GLStateCache::BindTextureUnit(unsigned int unit, GLenum target, GLuint texture)
+{
+	int slot = targetIndex(target);
+	if (slot >= 0 && unit < GL_STATE_TEXTURE_UNITS && textures[unit][slot] == texture)
+	{
+		request(GL_STATE_TEXTURE, true);
+		return;
+	}
+	ActiveTexture(GL_TEXTURE0 + unit);
+	BindTexture(target, texture);
+}
+
+void GLStateCache::ForgetTexture(GLuint texture)
+{
+	for (unsigned int unit = 0; unit < GL_STATE_TEXTURE_UNITS; unit++)
+	{
+		for (int slot = 0; slot < TRACKED_TARGETS; slot++)
+		{
+			if (textures[unit][slot] == texture)
+			{
+				textures[unit][slot] = 0;
+			}
+		}
+	}
+}
+
+void GLStateCache::Enable(GLenum capability)
+{
+	setCapability(capability, true);
+}
+
+void GLStateCache::Disable(GLenum capability)
+{
+	setCapability(capability, false);
+}
+
+void GLStateCache::DepthFunc(GLenum func)
+{
+	if (request(GL_STATE_DEPTH, depthFunc == func))
+	{
+		glDepthFunc(func);
+		depthFunc = func;
+	}
+}
+
+void GLStateCache::DepthMask(GLboolean flag)
+{
+	if (request(GL_STATE_DEPTH, depthMask == (flag ? 1 : 0)))
+	{
+		glDepthMask(flag);
+		depthMask = flag ? 1 : 0;
+	}
+}
+
+void GLStateCache::StencilFunc(GLenum func, GLint ref, GLuint mask)
+{
+	if (request(GL_STATE_STENCIL, stencilFunc == func && stencilRef == ref && stencilFuncMask == mask))
+	{
+		glStencilFunc(func, ref, mask);
+		stencilFunc = func;
+		stencilRef = ref;
+		stencilFuncMask = mask;
+	}
+}
+
+void GLStateCache::StencilMask(GLuint mask)
+{
+	if (request(GL_STATE_STENCIL, bIsStencilMaskKnown && stencilMask == mask))
+	{
+		glStencilMask(mask);
+		stencilMask = mask;
+		bIsStencilMaskKnown = true;
+	}
+}
+
+void GLStateCache::StencilOp(GLenum stencilFail, GLenum depthFail, GLenum depthPass)
+{
+	if (request(GL_STATE_STENCIL, this->stencilFail == stencilFail && stencilDepthFail == depthFail && stencilDepthPass == depthPass))
+	{
+		glStencilOp(stencilFail, depthFail, depthPass);
+		this->stencilFail = stencilFail;
+		stencilDepthFail = depthFail;
+		stencilDepthPass = depthPass;
+	}
+}
+
+void GLStateCache::BlendFunc(GLenum source, GLenum destination)
+{
+	if (request(GL_STATE_BLEND, blendSource == source && blendDestination == destination))
+	{
+		glBlendFunc(source, destination);
+		blendSource = source;
+		blendDestination = destination;
+	}
+}
+
+void GLStateCache::CullFace(GLenum mode)
+{
+	if (request(GL_STATE_CULL_FACE, cullFace == mode))
+	{
+		glCullFace(mode);
+		cullFace = mode;
+	}
+}
+
+void GLStateCache::BindFramebuffer(GLenum target, GLuint framebuffer)
+{
+	bool bIsRedundant = false;
+	if (target == GL_FRAMEBUFFER)
+	{
+		bIsRedundant = drawFramebuffer == framebuffer && readFramebuffer == framebuffer;
+	}
+	else if (target == GL_DRAW_FRAMEBUFFER)
+	{
+		bIsRedundant = drawFramebuffer == framebuffer;
+	}
+	else if (target == GL_READ_FRAMEBUFFER)
+	{
+		bIsRedundant = readFramebuffer == framebuffer;
+	}
+	if (!request(GL_STATE_FRAMEBUFFER, bIsRedundant))
+	{
+		return;
+	}
+	glBindFramebuffer(target, framebuffer);
+	if (target != GL_READ_FRAMEBUFFER)
+	{
+		drawFramebuffer = framebuffer;
+	}
+	if (target != GL_DRAW_FRAMEBUFFER)
+	{
+		readFramebuffer = framebuffer;
+	}
+}
+
+void GLStateCache::Viewport(GLint x, GLint y, GLsizei width, GLsizei height)
+{
+	bool bIsRedundant = bIsViewportKnown && viewport[0] == x && viewport[1] == y && viewport[2] == width && viewport[3] == height;
+	if (request(GL_STATE_VIEWPORT, bIsRedundant))
+	{
+		glViewport(x, y, width, height);
+		viewport[0] = x;
+		viewport[1] = y;
+		viewport[2] = width;
+		viewport[3] = height;
+		bIsViewportKnown = true;
+	}
+}
+
+void GLStateCache::Invalidate()
+{
+	program = GL_STATE_UNKNOWN;
+	vertexArray = GL_STATE_UNKNOWN;
+	activeUnit = GL_STATE_UNKNOWN;
+	for (unsigned int unit = 0; unit < GL_STATE_TEXTURE_UNITS; unit++)
+	{
+		for (int slot = 0; slot < TRACKED_TARGETS; slot++)
+		{
+			textures[unit][slot] = GL_STATE_UNKNOWN;
+		}
+	}
+	for (int i = 0; i < TRACKED_CAPABILITIES; i++)
+	{
+		capabilities[i] = -1;
+	}
+	depthFunc = GL_STATE_UNKNOWN;
+	depthMask = -1;
+	stencilFunc = GL_STATE_UNKNOWN;
+	stencilRef = 0;
+	stencilFuncMask = 0;
+	stencilMask = 0;
+	bIsStencilMaskKnown = false;
+	stencilFail = stencilDepthFail = stencilDepthPass = GL_STATE_UNKNOWN;
+	blendSource = blendDestination = GL_STATE_UNKNOWN;
+	cullFace = GL_STATE_UNKNOWN;
+	drawFramebuffer = GL_STATE_UNKNOWN;
+	readFramebuffer = GL_STATE_UNKNOWN;
+	bIsViewportKnown = false;
+}
+
+unsigned int GLStateCache::GetRequestedCalls(GLStateCategory category) const
+{
+	return requested[category];
+}
+
+unsigned int GLStateCache::GetIssuedCalls(GLStateCategory category) const
+{
+	return issued[category];
+}
+
+void GLStateCache::PrintStatistics() const
+{
+	unsigned int totalRequested = 0, totalIssued = 0;
+	for (int i = 0; i < GL_STATE_CATEGORY_COUNT; i++)
+	{
+		totalRequested += requested[i];
+		totalIssued += issued[i];
+	}
+	cout << "GL state: " << totalRequested - totalIssued << " of " << totalRequested << " calls filtered (";
+	for (int i = 0; i < GL_STATE_CATEGORY_COUNT; i++)
+	{
+		cout << (i ? ", " : "") << categoryNames[i] << " " << requested[i] - issued[i] << "/" << requested[i];
+	}
+	cout << ")" << endl;
+}
+
+void GLStateCache::ResetStatistics()
+{
+	for (int i = 0; i < GL_STATE_CATEGORY_COUNT; i++)
+	{
+		requested[i] = 0;
+		issued[i] = 0;
+	}
+}
+
+int GLStateCache::targetIndex(GLenum target)
+{
+	switch (target)
+	{
+	case GL_TEXTURE_2D: return 0;
+	case GL_TEXTURE_CUBE_MAP: return 1;
+	case GL_TEXTURE_2D_MULTISAMPLE: return 2;
+	case GL_TEXTURE_2D_ARRAY: return 3;
+	default: return -1;
+	}
+}
+
+int GLStateCache::capabilityIndex(GLenum capability)
+{
+	switch (capability)
+	{
+	case GL_DEPTH_TEST: return 0;
+	case GL_STENCIL_TEST: return 1;
+	case GL_BLEND: return 2;
+	case GL_CULL_FACE: return 3;
+	case GL_MULTISAMPLE: return 4;
+	case GL_PROGRAM_POINT_SIZE: return 5;
+	case GL_TEXTURE_CUBE_MAP_SEAMLESS: return 6;
+	case GL_FRAMEBUFFER_SRGB: return 7;
+	default: return -1;
+	}
+}
+
+bool GLStateCache::request(GLStateCategory category, bool bIsRedundant)
+{
+	requested[category]++;
+	if (bIsRedundant)
+	{
+		return false;
+	}
+	issued[category]++;
+	return true;
+}
+
+void GLStateCache::setCapability(GLenum capability, bool bIsEnabled)
+{
+	int index = capabilityIndex(capability);
+	if (!request(GL_STATE_CAPABILITY, index >= 0 && capabilities[index] == (bIsEnabled ? 1 : 0)))
+	{
+		return;
+	}
+	if (bIsEnabled)
+	{
+		glEnable(capability);
+	}
+	else
+	{
+		glDisable(capability);
+	}
+	if (index >= 0)
+	{
+		capabilities[index] = bIsEnabled ? 1 : 0;
+	}
+}
@@ -0,0 +1,110 @@
+#pragma once
+#include <glad/glad.h>
+
+using namespace std;
+
+//Texture units the cache keeps track of, binds to higher units always go through
+#define GL_STATE_TEXTURE_UNITS 32
+
+/* Kinds of state the cache counts calls for */
+enum GLStateCategory
+{
+	GL_STATE_PROGRAM = 0,
+	GL_STATE_VERTEX_ARRAY,
+	GL_STATE_ACTIVE_TEXTURE,
+	GL_STATE_TEXTURE,
+	GL_STATE_CAPABILITY,
+	GL_STATE_DEPTH,
+	GL_STATE_STENCIL,
+	GL_STATE_BLEND,
+	GL_STATE_CULL_FACE,
+	GL_STATE_FRAMEBUFFER,
+	GL_STATE_VIEWPORT,
+	GL_STATE_CATEGORY_COUNT
+};
+
+/* Copy of the GL state the renderer changes, kept on the CPU so calls that would set a value that is already set never
+reach the driver. Everything starts out unknown, so the first call of each kind always goes through.
+State changed without going through the cache has to be forgotten with Invalidate, and deleted textures and programs with
+ForgetTexture and ForgetProgram */
+class GLStateCache
+{
+public:
+	static GLStateCache& Get();
+
+	void UseProgram(GLuint program);
+	/* A deleted program is no longer in use, and its name may be handed out again */
+	void ForgetProgram(GLuint program);
+	void BindVertexArray(GLuint vao);
+
+	/* Same as glActiveTexture and glBindTexture, for code that sets up the texture bound to the active unit */
+	void ActiveTexture(GLenum unit);
+	void BindTexture(GLenum target, GLuint texture);
+	/* Bind texture to unit, only making unit active when the binding actually changes */
+	void BindTextureUnit(unsigned int unit, GLenum target, GLuint texture);
+	/* A deleted texture is unbound from every unit, and its name may be handed out again */
+	void ForgetTexture(GLuint texture);
+
+	void Enable(GLenum capability);
+	void Disable(GLenum capability);
+
+	void DepthFunc(GLenum func);
+	void DepthMask(GLboolean flag);
+	void StencilFunc(GLenum func, GLint ref, GLuint mask);
+	void StencilMask(GLuint mask);
+	void StencilOp(GLenum stencilFail, GLenum depthFail, GLenum depthPass);
+	void BlendFunc(GLenum source, GLenum destination);
+	void CullFace(GLenum mode);
+
+	/* GL_FRAMEBUFFER sets both the draw and the read framebuffer */
+	void BindFramebuffer(GLenum target, GLuint framebuffer);
+	void Viewport(GLint x, GLint y, GLsizei width, GLsizei height);
+
+	/* Mark everything unknown, for after code that changed state directly */
+	void Invalidate();
+
+	/* Calls made and calls that reached GL since the last ResetStatistics */
+	unsigned int GetRequestedCalls(GLStateCategory category) const;
+	unsigned int GetIssuedCalls(GLStateCategory category) const;
+	void PrintStatistics() const;
+	void ResetStatistics();
+
+private:
+	GLStateCache();
+
+	/* Slot of a tracked texture target or capability, -1 when the cache does not follow it */
+	static int targetIndex(GLenum target);
+	static int capabilityIndex(GLenum capability);
+	/* Count a call, returns true when it has to be issued */
+	bool request(GLStateCategory category, bool bIsRedundant);
+	void setCapability(GLenum capability, bool bIsEnabled);
+
+	static const int TRACKED_TARGETS = 4;
+	static const int TRACKED_CAPABILITIES = 8;
+
+	GLuint program;
+	GLuint vertexArray;
+	GLenum activeUnit;
+	GLuint textures[GL_STATE_TEXTURE_UNITS][TRACKED_TARGETS];
+	signed char capabilities[TRACKED_CAPABILITIES]; //-1 unknown, 0 disabled, 1 enabled
+	GLenum depthFunc;
+	int depthMask; //-1 unknown
+	GLenum stencilFunc;
+	GLint stencilRef;
+	GLuint stencilFuncMask;
+	GLuint stencilMask;
+	bool bIsStencilMaskKnown; //every mask is a valid value, so there is no unknown one
+	GLenum stencilFail, stencilDepthFail, stencilDepthPass;
+	GLenum blendSource, blendDestination;
+	GLenum cullFace;
+	GLuint drawFramebuffer;
+	GLuint readFramebuffer;
+	GLint viewport[4];
+	bool bIsViewportKnown;
+
+	unsigned int requested[GL_STATE_CATEGORY_COUNT];
+	unsigned int issued[GL_STATE_CATEGORY_COUNT];
+
+	GLStateCache(const GLStateCache&) = delete;
+	GLStateCache& operator=(const GLStateCache&) = delete;
+};
@@ -0,0 +1,222 @@
+#include <iostream>
+#include <algorithm>
+#include "GeometryArena.h"
+#include "Mesh.h"
+
+//Starting sizes of the arena buffers, they double whenever they run out of space
+#define ARENA_INITIAL_VERTICES (256 * 1024)
+#define ARENA_INITIAL_INDEX_BYTES (4 * 1024 * 1024)
+
+FreeListAllocator::FreeListAllocator()
+	: capacity(0), used(0)
+{
+}
+
+bool FreeListAllocator::Allocate(size_t size, size_t alignment, size_t& offset)
+{
+	for (map<size_t, size_t>::iterator it = freeBlocks.begin(); it != freeBlocks.end(); ++it)
+	{
+		size_t blockOffset = it->first;
+		size_t blockSize = it->second;
+		size_t alignedOffset = (blockOffset + alignment - 1) & ~(alignment - 1);
+		if (alignedOffset + size > blockOffset + blockSize)
+		{
+			continue;
+		}
+
+		//Split off whatever is left in front of and behind the allocation
+		freeBlocks.erase(it);
+		if (alignedOffset > blockOffset)
+		{
+			freeBlocks[blockOffset] = alignedOffset - blockOffset;
+		}
+		if (alignedOffset + size < blockOffset + blockSize)
+		{
+			freeBlocks[alignedOffset + size] = blockOffset + blockSize - (alignedOffset + size);
+		}
+		offset = alignedOffset;
+		used += size;
+		return true;
+	}
+	return false;
+}
+
+void FreeListAllocator::Free(size_t offset, size_t size)
+{
+	if (size == 0)
+	{
+		return;
+	}
+	used -= size;
+	map<size_t, size_t>::iterator it = freeBlocks.insert(make_pair(offset, size)).first;
+
+	//Merge with the following block
+	map<size_t, size_t>::iterator next = std::next(it);
+	if (next != freeBlocks.end() && it->first + it->second == next->first)
+	{
+		it->second += next->second;
+		freeBlocks.erase(next);
+	}
+	//Merge with the preceding block
+	if (it != freeBlocks.begin())
+	{
+		map<size_t, size_t>::iterator previous = std::prev(it);
+		if (previous->first + previous->second == it->first)
+		{
+			previous->second += it->second;
+			freeBlocks.erase(it);
+		}
+	}
+}
+
+void FreeListAllocator::Grow(size_t newCapacity)
+{
+	if (newCapacity <= capacity)
+	{
+		return;
+	}
+	size_t oldCapacity = capacity;
+	capacity = newCapacity;
+	//Freeing the new space merges it with any free block at the old end
+	used += newCapacity - oldCapacity;
+	Free(oldCapacity, newCapacity - oldCapacity);
+}
+
+size_t FreeListAllocator::GetCapacity() const
+{
+	return capacity;
+}
+
+size_t FreeListAllocator::GetUsed() const
+{
+	return used;
+}
+
+GeometryRange::GeometryRange(unsigned int baseVertex, unsigned int vertexCount, unsigned int indexOffset, unsigned int indexSize)
+	: baseVertex(baseVertex), vertexCount(vertexCount), indexOffset(indexOffset), indexSize(indexSize)
+{
+}
+
+GeometryRange::~GeometryRange()
+{
+	GeometryArena::Get().Free(*this);
+}
+
+GeometryArena& GeometryArena::Get()
+{
+	//Never destroyed, meshes held by globals release their ranges after any function static would be gone
+	static GeometryArena* arena = new GeometryArena();
+	return *arena;
+}
+
+GeometryArena::GeometryArena()
+	: VAO(0), VBO(0), EBO(0)
+{
+}
+
+void GeometryArena::create()
+{
+	vertexAllocator.Grow(ARENA_INITIAL_VERTICES);
+	indexAllocator.Grow(ARENA_INITIAL_INDEX_BYTES);
+
+	glCreateBuffers(1, &VBO);
+	glNamedBufferStorage(VBO, vertexAllocator.GetCapacity() * sizeof(PackedVertex), nullptr, GL_DYNAMIC_STORAGE_BIT);
+	glCreateBuffers(1, &EBO);
+	glNamedBufferStorage(EBO, indexAllocator.GetCapacity(), nullptr, GL_DYNAMIC_STORAGE_BIT);
+
+	//Attribute formats are described once and shared by every mesh
+	glCreateVertexArrays(1, &VAO);
+
+	//vertex position, w is the bitangent sign
+	glEnableVertexArrayAttrib(VAO, 0);
+	glVertexArrayAttribFormat(VAO, 0, 4, GL_UNSIGNED_SHORT, GL_TRUE, offsetof(PackedVertex, Position));
+	glVertexArrayAttribBinding(VAO, 0, 0);
+
+	//vertex normals
+	glEnableVertexArrayAttrib(VAO, 1);
+	glVertexArrayAttribFormat(VAO, 1, 2, GL_SHORT, GL_TRUE, offsetof(PackedVertex, Normal));
+	glVertexArrayAttribBinding(VAO, 1, 0);
+
+	//vertex texture coordinates
+	glEnableVertexArrayAttrib(VAO, 2);
+	glVertexArrayAttribFormat(VAO, 2, 2, GL_HALF_FLOAT, GL_FALSE, offsetof(PackedVertex, TexCoords));
+	glVertexArrayAttribBinding(VAO, 2, 0);
+
+	//vertex tangents, bitangents are rebuilt in the vertex shader
+	glEnableVertexArrayAttrib(VAO, 3);
+	glVertexArrayAttribFormat(VAO, 3, 2, GL_SHORT, GL_TRUE, offsetof(PackedVertex, Tangent));
+	glVertexArrayAttribBinding(VAO, 3, 0);
+
+	glVertexArrayVertexBuffer(VAO, 0, VBO, 0, sizeof(PackedVertex));
+	glVertexArrayElementBuffer(VAO, EBO);
+}
+
+unsigned int GeometryArena::growBuffer(unsigned int buffer, size_t oldSize, size_t newSize)
+{
+	unsigned int grown;
+	glCreateBuffers(1, &grown);
+	glNamedBufferStorage(grown, newSize, nullptr, GL_DYNAMIC_STORAGE_BIT);
+	glCopyNamedBufferSubData(buffer, grown, 0, 0, oldSize);
+	glDeleteBuffers(1, &buffer);
+	return grown;
+}
+
+GeometryHandle GeometryArena::Allocate(const PackedVertex* vertices, unsigned int vertexCount, const void* indices, unsigned int indexSize)
+{
+	if (!VAO)
+	{
+		create();
+	}
+
+	size_t baseVertex = 0;
+	while (!vertexAllocator.Allocate(vertexCount, 1, baseVertex))
+	{
+		size_t oldCapacity = vertexAllocator.GetCapacity();
+		size_t newCapacity = std::max(oldCapacity * 2, oldCapacity + vertexCount);
+		VBO = growBuffer(VBO, oldCapacity * sizeof(PackedVertex), newCapacity * sizeof(PackedVertex));
+		vertexAllocator.Grow(newCapacity);
+		glVertexArrayVertexBuffer(VAO, 0, VBO, 0, sizeof(PackedVertex));
+	}
+
+	//Offsets have to be a multiple of the index size, 4 covers both
+	size_t indexOffset = 0;
+	while (!indexAllocator.Allocate(indexSize, 4, indexOffset))
+	{
+		size_t oldCapacity = indexAllocator.GetCapacity();
+		size_t newCapacity = std::max(oldCapacity * 2, oldCapacity + indexSize + 4);
+		EBO = growBuffer(EBO, oldCapacity, newCapacity);
+		indexAllocator.Grow(newCapacity);
+		glVertexArrayElementBuffer(VAO, EBO);
+	}
+
+	glNamedBufferSubData(VBO, baseVertex * sizeof(PackedVertex), vertexCount * sizeof(PackedVertex), vertices);
+	glNamedBufferSubData(EBO, indexOffset, indexSize, indices);
+	return make_shared<GeometryRange>(baseVertex, vertexCount, indexOffset, indexSize);
+}
+
+void GeometryArena::Free(const GeometryRange& range)
+{
+	vertexAllocator.Free(range.baseVertex, range.vertexCount);
+	indexAllocator.Free(range.indexOffset, range.indexSize);
+}
+
+unsigned int GeometryArena::GetVAO() const
+{
+	return VAO;
+}
+
+unsigned int GeometryArena::GetVertexBuffer() const
+{
+	return VBO;
+}
+
+unsigned int GeometryArena::GetIndexBuffer() const
+{
+	return EBO;
+}
+
+void GeometryArena::PrintStatistics() const
+{
+	cout << "Geometry arena: " << vertexAllocator.GetUsed() << "/" << vertexAllocator.GetCapacity() << " vertices, "
+		<< indexAllocator.GetUsed() << "/" << indexAllocator.GetCapacity() << " index bytes" << endl;
+}
@@ -0,0 +1,81 @@
+#pragma once
+#include <glad/glad.h>
+#include <map>
+#include <memory>
+
+using namespace std;
+
+struct PackedVertex;
+
+/* First fit allocator over a linear range. Free blocks are kept sorted by offset and merged with their neighbours when released */
+class FreeListAllocator
+{
+public:
+	FreeListAllocator();
+
+	/* Reserve size units aligned to alignment (a power of two). Returns false if no free block is large enough */
+	bool Allocate(size_t size, size_t alignment, size_t& offset);
+	void Free(size_t offset, size_t size);
+	/* Add the space between the old and new capacity to the free list */
+	void Grow(size_t newCapacity);
+
+	size_t GetCapacity() const;
+	size_t GetUsed() const;
+
+private:
+	map<size_t, size_t> freeBlocks; //offset to size
+	size_t capacity;
+	size_t used;
+};
+
+/* Location of one mesh inside the geometry arena. Released back to the arena with the last handle */
+class GeometryRange
+{
+public:
+	unsigned int baseVertex; //first vertex, added to every index by glDrawElementsBaseVertex
+	unsigned int vertexCount;
+	unsigned int indexOffset; //in bytes from the start of the arena's index buffer
+	unsigned int indexSize; //in bytes
+
+	GeometryRange(unsigned int baseVertex, unsigned int vertexCount, unsigned int indexOffset, unsigned int indexSize);
+	~GeometryRange();
+
+private:
+	GeometryRange(const GeometryRange&) = delete;
+	GeometryRange& operator=(const GeometryRange&) = delete;
+};
+
+typedef shared_ptr<GeometryRange> GeometryHandle;
+
+/* Every mesh's vertices and indices sub-allocated out of one vertex buffer and one index buffer, drawn through a single
+VAO so switching between meshes only changes draw parameters instead of buffer bindings */
+class GeometryArena
+{
+public:
+	static GeometryArena& Get();
+
+	/* Copy a mesh into the arena, growing the buffers if they are full. Index data is raw bytes so 16 and 32 bit indices can share the buffer */
+	GeometryHandle Allocate(const PackedVertex* vertices, unsigned int vertexCount, const void* indices, unsigned int indexSize);
+	void Free(const GeometryRange& range);
+
+	unsigned int GetVAO() const;
+	unsigned int GetVertexBuffer() const;
+	unsigned int GetIndexBuffer() const;
+
+	/* Print how much of each buffer is in use */
+	void PrintStatistics() const;
+
+private:
+	unsigned int VAO, VBO, EBO;
+	FreeListAllocator vertexAllocator; //in vertices
+	FreeListAllocator indexAllocator; //in bytes
+
+	GeometryArena();
+	/* Create the buffers and shared vertex format on first use, needs a current context */
+	void create();
+	/* Reallocate a buffer with a larger capacity, keeping its contents */
+	unsigned int growBuffer(unsigned int buffer, size_t oldSize, size_t newSize);
+
+	GeometryArena(const GeometryArena&) = delete;
+	GeometryArena& operator=(const GeometryArena&) = delete;
+};
@@ -0,0 +1,200 @@
+#include <algorithm>
+#include <string>
+#include "GpuCulling.h"
+#include "GLStateCache.h"
+#include "ShaderReloader.h"
+
+//Threads per work group, must match local_size_x in cullDraws.comp and cullInstances.comp and both sizes in hiZBuild.comp
+#define CULL_GROUP_SIZE 64
+#define HIZ_GROUP_SIZE 8
+
+CullingView::CullingView()
+	: faceCount(0), bUseOcclusion(false)
+{
+}
+
+CullingView::CullingView(const mat4& viewProjection, bool bUseOcclusion)
+	: faceCount(1), bUseOcclusion(bUseOcclusion)
+{
+	viewProjections[0] = viewProjection;
+}
+
+CullingView::CullingView(const vector<mat4>& faceViewProjections)
+	: faceCount(std::min((unsigned int)faceViewProjections.size(), 6u)), bUseOcclusion(false)
+{
+	for (unsigned int i = 0; i < faceCount; i++)
+	{
+		viewProjections[i] = faceViewProjections[i];
+	}
+}
+
+GpuCulling& GpuCulling::Get()
+{
+	//Never destroyed, like the geometry arena, so draw lists held by globals can still use it on shutdown
+	static GpuCulling* culling = new GpuCulling();
+	return *culling;
+}
+
+GpuCulling::GpuCulling()
+	: bIsInitialized(false), depthTexture(0), depthFramebuffer(0), hiZTexture(0), hiZWidth(0), hiZHeight(0), hiZLevels(0),
+	hiZViewProjection(1.0f), bIsHiZValid(false)
+{
+}
+
+GpuCulling::~GpuCulling()
+{
+	if (hiZTexture)
+	{
+		glDeleteFramebuffers(1, &depthFramebuffer);
+		glDeleteTextures(1, &depthTexture);
+		glDeleteTextures(1, &hiZTexture);
+		GLStateCache::Get().ForgetTexture(depthTexture);
+		GLStateCache::Get().ForgetTexture(hiZTexture);
+	}
+}
+
+void GpuCulling::Cull(const CullingView& view, unsigned int drawCount, unsigned int pooledDrawCount, unsigned int instanceCount)
+{
+	//Compiled on first use so the singleton can be touched before the context exists
+	if (!bIsInitialized)
+	{
+		cullShader.LoadComputeShader("shaders/cullDraws.comp");
+		instanceCullShader.LoadComputeShader("shaders/cullInstances.comp");
+		hiZShader.LoadComputeShader("shaders/hiZBuild.comp");
+		ShaderReloader::Get().Watch(cullShader);
+		ShaderReloader::Get().Watch(instanceCullShader);
+		ShaderReloader::Get().Watch(hiZShader);
+		bIsInitialized = true;
+	}
+	if (drawCount == 0)
+	{
+		return;
+	}
+
+	bool bUseOcclusion = view.bUseOcclusion && bIsHiZValid;
+	if (bUseOcclusion)
+	{
+		GLStateCache::Get().BindTextureUnit(HIZ_TEXTURE_UNIT, GL_TEXTURE_2D, hiZTexture);
+	}
+
+	//Instances first, the draw pass sizes pooled draws by how many of their instances are left
+	if (pooledDrawCount > 0 && instanceCount > 0)
+	{
+		instanceCullShader.use();
+		setViewUniforms(instanceCullShader, view, bUseOcclusion);
+		instanceCullShader.setUint("pooledDrawCount", pooledDrawCount);
+		instanceCullShader.setUint("instanceCount", instanceCount);
+		glDispatchCompute((instanceCount + CULL_GROUP_SIZE - 1) / CULL_GROUP_SIZE, 1, 1);
+		glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+	}
+
+	cullShader.use();
+	setViewUniforms(cullShader, view, bUseOcclusion);
+	cullShader.setUint("drawCount", drawCount);
+	glDispatchCompute((drawCount + CULL_GROUP_SIZE - 1) / CULL_GROUP_SIZE, 1, 1);
+}
+
+void GpuCulling::BuildHiZ(unsigned int framebuffer, int width, int height, const mat4& viewProjection)
+{
+	if (!bIsInitialized || width <= 0 || height <= 0)
+	{
+		return;
+	}
+	if (width != hiZWidth || height != hiZHeight)
+	{
+		createHiZ(width, height);
+	}
+
+	//Resolve the depth buffer, a multisampled depth blit keeps one of the samples which is all the pyramid needs
+	glBlitNamedFramebuffer(framebuffer, depthFramebuffer, 0, 0, width, height, 0, 0, width, height, GL_DEPTH_BUFFER_BIT, GL_NEAREST);
+	glMemoryBarrier(GL_FRAMEBUFFER_BARRIER_BIT);
+
+	hiZShader.use();
+	hiZShader.setInt("inputLevel", HIZ_TEXTURE_UNIT);
+
+	//Level 0 is a straight copy of the depth so every level can be sampled from one texture
+	GLStateCache::Get().BindTextureUnit(HIZ_TEXTURE_UNIT, GL_TEXTURE_2D, depthTexture);
+	glBindImageTexture(0, hiZTexture, 0, GL_FALSE, 0, GL_WRITE_ONLY, GL_R32F);
+	hiZShader.setBool("bCopy", true);
+	hiZShader.setInt("inputLod", 0);
+	hiZShader.setVec2("inputSize", vec2(width, height));
+	hiZShader.setVec2("outputSize", vec2(width, height));
+	glDispatchCompute((width + HIZ_GROUP_SIZE - 1) / HIZ_GROUP_SIZE, (height + HIZ_GROUP_SIZE - 1) / HIZ_GROUP_SIZE, 1);
+
+	//Every following level keeps the furthest depth under it
+	GLStateCache::Get().BindTextureUnit(HIZ_TEXTURE_UNIT, GL_TEXTURE_2D, hiZTexture);
+	hiZShader.setBool("bCopy", false);
+	for (int level = 1; level < hiZLevels; level++)
+	{
+		int inputWidth = std::max(width >> (level - 1), 1);
+		int inputHeight = std::max(height >> (level - 1), 1);
+		int outputWidth = std::max(width >> level, 1);
+		int outputHeight = std::max(height >> level, 1);
+		glMemoryBarrier(GL_TEXTURE_FETCH_BARRIER_BIT | GL_SHADER_IMAGE_ACCESS_BARRIER_BIT);
+		glBindImageTexture(0, hiZTexture, level, GL_FALSE, 0, GL_WRITE_ONLY, GL_R32F);
+		hiZShader.setInt("inputLod", level - 1);
+		hiZShader.setVec2("inputSize", vec2(inputWidth, inputHeight));
+		hiZShader.setVec2("outputSize", vec2(outputWidth, outputHeight));
+		glDispatchCompute((outputWidth + HIZ_GROUP_SIZE - 1) / HIZ_GROUP_SIZE, (outputHeight + HIZ_GROUP_SIZE - 1) / HIZ_GROUP_SIZE, 1);
+	}
+	glMemoryBarrier(GL_TEXTURE_FETCH_BARRIER_BIT);
+	glBindImageTexture(0, 0, 0, GL_FALSE, 0, GL_WRITE_ONLY, GL_R32F);
+
+	hiZViewProjection = viewProjection;
+	bIsHiZValid = true;
+}
+
+void GpuCulling::InvalidateHiZ()
+{
+	bIsHiZValid = false;
+}
+
+void GpuCulling::setViewUniforms(Shader& shader, const CullingView& view, bool bUseOcclusion)
+{
+	shader.setUint("faceCount", view.faceCount);
+	shader.setMat4Array("viewProjections", view.viewProjections, view.faceCount);
+	shader.setBool("bUseOcclusion", bUseOcclusion);
+	shader.setInt("hiZ", HIZ_TEXTURE_UNIT);
+	if (bUseOcclusion)
+	{
+		shader.setMat4("hiZViewProjection", hiZViewProjection);
+		shader.setVec2("hiZSize", vec2(hiZWidth, hiZHeight));
+		shader.setInt("hiZLevels", hiZLevels);
+	}
+}
+
+void GpuCulling::createHiZ(int width, int height)
+{
+	if (hiZTexture)
+	{
+		glDeleteFramebuffers(1, &depthFramebuffer);
+		glDeleteTextures(1, &depthTexture);
+		glDeleteTextures(1, &hiZTexture);
+		GLStateCache::Get().ForgetTexture(depthTexture);
+		GLStateCache::Get().ForgetTexture(hiZTexture);
+	}
+	hiZWidth = width;
+	hiZHeight = height;
+	hiZLevels = 1;
+	while ((std::max(width, height) >> hiZLevels) > 0)
+	{
+		hiZLevels++;
+	}
+
+	//Same format as the scene's depth renderbuffer, blits between depth buffers need them to match
+	glCreateTextures(GL_TEXTURE_2D, 1, &depthTexture);
+	glTextureStorage2D(depthTexture, 1, GL_DEPTH24_STENCIL8, width, height);
+	glTextureParameteri(depthTexture, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+	glTextureParameteri(depthTexture, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+	glCreateFramebuffers(1, &depthFramebuffer);
+	glNamedFramebufferTexture(depthFramebuffer, GL_DEPTH_STENCIL_ATTACHMENT, depthTexture, 0);
+
+	glCreateTextures(GL_TEXTURE_2D, 1, &hiZTexture);
+	glTextureStorage2D(hiZTexture, hiZLevels, GL_R32F, width, height);
+	glTextureParameteri(hiZTexture, GL_TEXTURE_MIN_FILTER, GL_NEAREST_MIPMAP_NEAREST);
+	glTextureParameteri(hiZTexture, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+	glTextureParameteri(hiZTexture, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+	glTextureParameteri(hiZTexture, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+
+	bIsHiZValid = false;
+}
@@ -0,0 +1,81 @@
+#pragma once
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+#include <vector>
+
+#include "Shader.h"
+
+using namespace std;
+using namespace glm;
+
+//Shader storage bindings used by the culling pass, binding 2 is the draw data
+#define CULL_INPUT_COMMAND_BINDING 3
+#define CULL_OUTPUT_COMMAND_BINDING 4
+#define CULL_BATCH_COUNT_BINDING 5
+#define CULL_BATCH_START_BINDING 6
+//Instances of pooled draws that survive, read back by the vertex shaders, and which draws are pooled. Binding 7 is the material table
+#define CULL_VISIBLE_INSTANCE_BINDING 8
+#define CULL_POOLED_DRAW_BINDING 9
+//Texture unit the depth pyramid is sampled from, kept clear of the material and IBL units
+#define HIZ_TEXTURE_UNIT 15
+
+/* Views a draw list is culled against. A camera uses one view, a point light cube map one per face.
+Only draws that are inside at least one face survive, and each draw records the faces it touches */
+struct CullingView
+{
+	mat4 viewProjections[6];
+	unsigned int faceCount;
+	bool bUseOcclusion; //also test against the depth pyramid from the previous frame
+
+	CullingView();
+	CullingView(const mat4& viewProjection, bool bUseOcclusion);
+	CullingView(const vector<mat4>& faceViewProjections);
+};
+
+/* Frustum and occlusion culling of draw list commands and the instances of pooled draws on the GPU, plus the
+hierarchical depth buffer it occludes against.
+The depth pyramid is built from the main pass each frame and used by the next one, so objects that come into view
+show up one frame late at worst */
+class GpuCulling
+{
+public:
+	static GpuCulling& Get();
+
+	/* Cull drawCount commands with the buffers at the CULL_ bindings. Surviving commands are appended to their batch's
+	range of the output buffer and counted in the batch count buffer, which must be cleared beforehand.
+	The instanceCount instances of the pooledDrawCount pooled draws are culled first, each one on its own. Survivors go
+	to the draw's range of the visible instance buffer and the draw's instance count becomes how many there are */
+	void Cull(const CullingView& view, unsigned int drawCount, unsigned int pooledDrawCount = 0, unsigned int instanceCount = 0);
+
+	/* Copy the depth of framebuffer, which may be multisampled, and build a max depth pyramid from it.
+	viewProjection is the matrix the depth was rendered with */
+	void BuildHiZ(unsigned int framebuffer, int width, int height, const mat4& viewProjection);
+
+	/* Drop the depth pyramid, for example after the camera cuts or the viewport is resized */
+	void InvalidateHiZ();
+
+private:
+	GpuCulling();
+	~GpuCulling();
+	GpuCulling(const GpuCulling&) = delete;
+	GpuCulling& operator=(const GpuCulling&) = delete;
+
+	void createHiZ(int width, int height);
+	/* Views and depth pyramid both culling passes test against */
+	void setViewUniforms(Shader& shader, const CullingView& view, bool bUseOcclusion);
+
+	Shader cullShader;
+	Shader instanceCullShader;
+	Shader hiZShader;
+	bool bIsInitialized;
+
+	//resolved single sample depth and the pyramid built from it
+	unsigned int depthTexture;
+	unsigned int depthFramebuffer;
+	unsigned int hiZTexture;
+	int hiZWidth;
+	int hiZHeight;
+	int hiZLevels;
+	mat4 hiZViewProjection;
+	bool bIsHiZValid;
+};
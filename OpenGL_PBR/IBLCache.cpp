@@ -0,0 +1,278 @@
+#ifdef _WIN32
+#include <direct.h>
+#else
+#include <sys/stat.h>
+#include <sys/types.h>
+#endif
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include "IBLCache.h"
+#include "GLStateCache.h"
+
+//Identifies a cached bake file
+static const char IBL_CACHE_MAGIC[4] = { 'I', 'B', 'L', 'C' };
+static const unsigned long long FNV_OFFSET_BASIS = 14695981039346656037ull;
+
+/* 64 bit FNV-1a of size bytes of data, carrying on from hash */
+static unsigned long long HashBytes(const void* data, size_t size, unsigned long long hash = FNV_OFFSET_BASIS)
+{
+	const unsigned char* bytes = (const unsigned char*)data;
+	for (size_t i = 0; i < size; i++)
+	{
+		hash = (hash ^ bytes[i]) * 1099511628211ull;
+	}
+	return hash;
+}
+
+/* Hash the path and contents of a file, a missing file hashes as empty */
+static unsigned long long HashFile(const string& path, unsigned long long hash)
+{
+	hash = HashBytes(path.c_str(), path.size() + 1, hash);
+	ifstream file(path, ios::binary);
+	vector<char> buffer(1 << 16);
+	while (file)
+	{
+		file.read(buffer.data(), buffer.size());
+		hash = HashBytes(buffer.data(), (size_t)file.gcount(), hash);
+	}
+	return hash;
+}
+
+/* Pixel format and bytes per pixel of the half float formats a bake uses, 0 for anything else */
+static unsigned int pixelSize(GLenum internalFormat, GLenum& format)
+{
+	switch (internalFormat)
+	{
+	case GL_RG16F:
+		format = GL_RG;
+		return 2 * sizeof(unsigned short);
+	case GL_RGB16F:
+		format = GL_RGB;
+		return 3 * sizeof(unsigned short);
+	case GL_RGBA16F:
+		format = GL_RGBA;
+		return 4 * sizeof(unsigned short);
+	default:
+		return 0;
+	}
+}
+
+static double millisecondsSince(chrono::steady_clock::time_point start)
+{
+	return chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+}
+
+IBLCache& IBLCache::Get()
+{
+	static IBLCache cache;
+	return cache;
+}
+
+IBLCache::IBLCache()
+	: bWasLoaded(false), loadMilliseconds(0.0), storeMilliseconds(0.0)
+{
+}
+
+unsigned long long IBLCache::MakeKey(const string& hdriPath, const vector<string>& sourceFiles) const
+{
+	unsigned int version = IBL_CACHE_VERSION;
+	unsigned long long key = HashBytes(&version, sizeof(version));
+	key = HashFile(hdriPath, key);
+	for (size_t i = 0; i < sourceFiles.size(); i++)
+	{
+		key = HashFile(sourceFiles[i], key);
+	}
+	return key;
+}
+
+bool IBLCache::Load(unsigned long long key, GLuint* textures, unsigned int count, float* constants, unsigned int constantCount)
+{
+	chrono::steady_clock::time_point start = chrono::steady_clock::now();
+	bWasLoaded = false;
+	ifstream in(getPath(key), ios::binary);
+	IBLCacheHeader header;
+	if (!in || !in.read((char*)&header, sizeof(header)) || memcmp(header.magic, IBL_CACHE_MAGIC, sizeof(IBL_CACHE_MAGIC)) != 0 ||
+		header.version != IBL_CACHE_VERSION || header.key != key || header.textureCount != count || header.constantCount != constantCount ||
+		!in.read((char*)constants, constantCount * sizeof(float)))
+	{
+		return false;
+	}
+
+	//Rows of RGB half floats are not 4 byte aligned
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+	vector<unsigned char> pixels;
+	unsigned int created = 0;
+	bool bIsDamaged = false;
+	for (; created < count && !bIsDamaged; created++)
+	{
+		IBLCacheTexture info;
+		GLenum format = 0;
+		if (!in.read((char*)&info, sizeof(info)) || pixelSize(info.internalFormat, format) == 0 || info.levels == 0 ||
+			(info.target == GL_TEXTURE_CUBE_MAP ? info.faces != 6 : info.target != GL_TEXTURE_2D || info.faces != 1))
+		{
+			bIsDamaged = true;
+			break;
+		}
+		GLuint texture = 0;
+		glCreateTextures(info.target, 1, &texture);
+		textures[created] = texture;
+		glTextureStorage2D(texture, info.levels, info.internalFormat, info.width, info.height);
+		glTextureParameteri(texture, GL_TEXTURE_MIN_FILTER, info.minFilter);
+		glTextureParameteri(texture, GL_TEXTURE_MAG_FILTER, info.magFilter);
+		glTextureParameteri(texture, GL_TEXTURE_WRAP_S, info.wrap);
+		glTextureParameteri(texture, GL_TEXTURE_WRAP_T, info.wrap);
+		glTextureParameteri(texture, GL_TEXTURE_WRAP_R, info.wrap);
+
+		for (unsigned int level = 0; level < info.levels; level++)
+		{
+			unsigned int width = std::max(info.width >> level, 1u);
+			unsigned int height = std::max(info.height >> level, 1u);
+			pixels.resize((size_t)width * height * info.faces * pixelSize(info.internalFormat, format));
+			if (!in.read((char*)pixels.data(), pixels.size()))
+			{
+				bIsDamaged = true;
+				break;
+			}
+			//Cube map faces are the layers of a 3D upload
+			if (info.target == GL_TEXTURE_CUBE_MAP)
+			{
+				glTextureSubImage3D(texture, level, 0, 0, 0, width, height, 6, format, GL_HALF_FLOAT, pixels.data());
+			}
+			else
+			{
+				glTextureSubImage2D(texture, level, 0, 0, width, height, format, GL_HALF_FLOAT, pixels.data());
+			}
+		}
+	}
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+
+	if (bIsDamaged)
+	{
+		//A truncated or damaged file is baked again and overwritten
+		glDeleteTextures(created, textures);
+		for (unsigned int i = 0; i < created; i++)
+		{
+			GLStateCache::Get().ForgetTexture(textures[i]);
+			textures[i] = 0;
+		}
+		cout << "ERROR::IBL_CACHE::DAMAGED " << getPath(key) << endl;
+		return false;
+	}
+	bWasLoaded = true;
+	loadMilliseconds = millisecondsSince(start);
+	return true;
+}
+
+bool IBLCache::Store(unsigned long long key, const GLuint* textures, unsigned int count, const float* constants, unsigned int constantCount)
+{
+	chrono::steady_clock::time_point start = chrono::steady_clock::now();
+#ifdef _WIN32
+	_mkdir(IBL_CACHE_DIRECTORY);
+#else
+	mkdir(IBL_CACHE_DIRECTORY, 0755);
+#endif
+	//Write to a temporary file first so a crash never leaves a half written bake behind
+	string path = getPath(key);
+	string tempPath = path + ".tmp";
+	ofstream out(tempPath, ios::binary | ios::trunc);
+	if (!out)
+	{
+		return false;
+	}
+	IBLCacheHeader header;
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, IBL_CACHE_MAGIC, sizeof(IBL_CACHE_MAGIC));
+	header.version = IBL_CACHE_VERSION;
+	header.key = key;
+	header.textureCount = count;
+	header.constantCount = constantCount;
+	out.write((const char*)&header, sizeof(header));
+	out.write((const char*)constants, constantCount * sizeof(float));
+
+	glPixelStorei(GL_PACK_ALIGNMENT, 1);
+	vector<unsigned char> pixels;
+	bool bIsValid = true;
+	for (unsigned int i = 0; i < count && bIsValid; i++)
+	{
+		IBLCacheTexture info;
+		GLint value = 0;
+		glGetTextureParameteriv(textures[i], GL_TEXTURE_TARGET, &value);
+		info.target = value;
+		glGetTextureLevelParameteriv(textures[i], 0, GL_TEXTURE_INTERNAL_FORMAT, &value);
+		info.internalFormat = value;
+		glGetTextureLevelParameteriv(textures[i], 0, GL_TEXTURE_WIDTH, &value);
+		info.width = value;
+		glGetTextureLevelParameteriv(textures[i], 0, GL_TEXTURE_HEIGHT, &value);
+		info.height = value;
+		info.faces = info.target == GL_TEXTURE_CUBE_MAP ? 6 : 1;
+		glGetTextureParameteriv(textures[i], GL_TEXTURE_MIN_FILTER, &info.minFilter);
+		glGetTextureParameteriv(textures[i], GL_TEXTURE_MAG_FILTER, &info.magFilter);
+		glGetTextureParameteriv(textures[i], GL_TEXTURE_WRAP_S, &info.wrap);
+		//Mipmapped textures have the whole chain, whatever the bake rendered into it
+		bool bIsMipmapped = info.minFilter != GL_LINEAR && info.minFilter != GL_NEAREST;
+		info.levels = 1;
+		while (bIsMipmapped && (std::max(info.width, info.height) >> info.levels) > 0)
+		{
+			info.levels++;
+		}
+		GLenum format = 0;
+		unsigned int size = pixelSize(info.internalFormat, format);
+		bIsValid = size > 0 && (info.target == GL_TEXTURE_2D || info.target == GL_TEXTURE_CUBE_MAP) && info.width > 0 && info.height > 0;
+		if (!bIsValid)
+		{
+			break;
+		}
+		out.write((const char*)&info, sizeof(info));
+
+		for (unsigned int level = 0; level < info.levels; level++)
+		{
+			unsigned int width = std::max(info.width >> level, 1u);
+			unsigned int height = std::max(info.height >> level, 1u);
+			pixels.resize((size_t)width * height * info.faces * size);
+			//A cube map comes back with all six faces, one after the other
+			glGetTextureImage(textures[i], level, format, GL_HALF_FLOAT, (GLsizei)pixels.size(), pixels.data());
+			out.write((const char*)pixels.data(), pixels.size());
+		}
+	}
+	glPixelStorei(GL_PACK_ALIGNMENT, 4);
+
+	bIsValid = bIsValid && (bool)out;
+	out.close();
+	if (!bIsValid)
+	{
+		cout << "ERROR::IBL_CACHE::NOT_WRITTEN " << path << endl;
+		remove(tempPath.c_str());
+		return false;
+	}
+	//Only now that the new bake is whole does the old one go, rename() does not overwrite on Windows
+	remove(path.c_str());
+	if (rename(tempPath.c_str(), path.c_str()) != 0)
+	{
+		cout << "ERROR::IBL_CACHE::NOT_WRITTEN " << path << endl;
+		remove(tempPath.c_str());
+		return false;
+	}
+	storeMilliseconds = millisecondsSince(start);
+	return true;
+}
+
+void IBLCache::PrintStatistics() const
+{
+	if (bWasLoaded)
+	{
+		cout << "IBL cache: loaded the bake in " << loadMilliseconds << "ms" << endl;
+		return;
+	}
+	cout << "IBL cache: baked, storing took " << storeMilliseconds << "ms" << endl;
+}
+
+string IBLCache::getPath(unsigned long long key)
+{
+	char name[17];
+	snprintf(name, sizeof(name), "%016llx", key);
+	return string(IBL_CACHE_DIRECTORY) + "/" + name + ".iblbake";
+}
@@ -0,0 +1,69 @@
+#pragma once
+#include <glad/glad.h>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+//Bump whenever the bake itself changes, its sizes or sample counts, or the file layout, so older bakes are ignored
+#define IBL_CACHE_VERSION 2
+//Directory the baked environment is written to, relative to the working directory like the shaders
+#define IBL_CACHE_DIRECTORY "iblcache"
+
+/* Fixed size header at the start of every cached bake, followed by constantCount floats and then textureCount textures */
+struct IBLCacheHeader
+{
+	char magic[4];
+	unsigned int version;
+	unsigned long long key; //files are named after the key, this catches a file written under a different one
+	unsigned int textureCount;
+	unsigned int constantCount; //values worked out on the CPU, like the irradiance spherical harmonic
+};
+
+/* Describes one texture of a bake, followed by the pixels of every level from the largest down. Each level holds every
+face in GL order, tightly packed rows of half floats, the same order as a KTX file */
+struct IBLCacheTexture
+{
+	unsigned int target; //GL_TEXTURE_2D or GL_TEXTURE_CUBE_MAP
+	unsigned int internalFormat; //GL_RG16F, GL_RGB16F or GL_RGBA16F
+	unsigned int width;
+	unsigned int height;
+	unsigned int faces; //6 for a cube map
+	unsigned int levels;
+	int minFilter;
+	int magFilter;
+	int wrap; //used for every direction
+};
+
+/* On-disk cache of the image based lighting bake. The environment cube map, prefiltered map, BRDF lookup table and
+irradiance coefficients only depend on the HDRI and the programs that bake them, so they are keyed by a hash of those
+files and loaded instead of baked whenever nothing changed */
+class IBLCache
+{
+public:
+	static IBLCache& Get();
+
+	/* Key of a bake from the bytes of the HDRI at hdriPath and of every source file of the programs that bake it */
+	unsigned long long MakeKey(const string& hdriPath, const vector<string>& sourceFiles) const;
+
+	/* Create count textures and read constantCount constants from the bake cached for key. Returns false, creating
+	nothing, if there is no usable bake */
+	bool Load(unsigned long long key, GLuint* textures, unsigned int count, float* constants, unsigned int constantCount);
+	/* Write constantCount constants and every level and face of count textures as the bake for key */
+	bool Store(unsigned long long key, const GLuint* textures, unsigned int count, const float* constants, unsigned int constantCount);
+
+	/* Whether the last Load hit, and how long loading or baking and storing took */
+	void PrintStatistics() const;
+
+private:
+	IBLCache();
+
+	static string getPath(unsigned long long key);
+
+	bool bWasLoaded;
+	double loadMilliseconds;
+	double storeMilliseconds;
+
+	IBLCache(const IBLCache&) = delete;
+	IBLCache& operator=(const IBLCache&) = delete;
+};
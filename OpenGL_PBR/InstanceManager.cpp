@@ -0,0 +1,256 @@
+#include <algorithm>
+#include <iostream>
+#include "InstanceManager.h"
+
+//Instances the buffer starts out with, 6MB of records
+#define INSTANCE_INITIAL_CAPACITY 65536
+//Smallest range handed to a pool, so small pools do not move every time they grow
+#define INSTANCE_MIN_POOL_CAPACITY 16
+
+InstanceRecord::InstanceRecord()
+{
+	worldRows[0] = vec4(1.0f, 0.0f, 0.0f, 0.0f);
+	worldRows[1] = vec4(0.0f, 1.0f, 0.0f, 0.0f);
+	worldRows[2] = vec4(0.0f, 0.0f, 1.0f, 0.0f);
+	for (int i = 0; i < 3; i++)
+	{
+		normalColumns[i] = worldRows[i];
+	}
+}
+
+InstanceRecord::InstanceRecord(const mat4& transform)
+{
+	//glm is column major, so a row gathers one component from each column
+	for (int row = 0; row < 3; row++)
+	{
+		worldRows[row] = vec4(transform[0][row], transform[1][row], transform[2][row], transform[3][row]);
+	}
+	//Inverse transpose keeps normals perpendicular under non-uniform scaling
+	mat3 normalMatrix = transpose(inverse(mat3(transform)));
+	for (int column = 0; column < 3; column++)
+	{
+		normalColumns[column] = vec4(normalMatrix[column], 0.0f);
+	}
+}
+
+InstancePool::InstancePool(InstanceManager& manager)
+	: manager(manager), offset(0), capacity(0), drawOffset(0), drawCount(0)
+{
+	for (int i = 0; i < 2; i++)
+	{
+		dirtyBegin[i] = ~0u;
+		dirtyEnd[i] = 0;
+	}
+}
+
+InstanceId InstancePool::Add(const mat4& transform)
+{
+	if (transforms.size() == capacity)
+	{
+		manager.reserve(*this, std::max(capacity * 2, (size_t)INSTANCE_MIN_POOL_CAPACITY));
+	}
+
+	InstanceId id;
+	if (!freeIds.empty())
+	{
+		id = freeIds.back();
+		freeIds.pop_back();
+	}
+	else
+	{
+		id = idSlots.size();
+		idSlots.push_back(0);
+	}
+	unsigned int slot = transforms.size();
+	idSlots[id] = slot;
+	slotIds.push_back(id);
+	transforms.push_back(transform);
+	records.push_back(InstanceRecord(transform));
+	markDirty(slot, slot + 1);
+	return id;
+}
+
+void InstancePool::Remove(InstanceId id)
+{
+	if (!Contains(id))
+	{
+		return;
+	}
+	//Fill the hole with the last instance so the pool stays packed
+	unsigned int slot = idSlots[id];
+	unsigned int last = transforms.size() - 1;
+	if (slot != last)
+	{
+		transforms[slot] = transforms[last];
+		records[slot] = records[last];
+		slotIds[slot] = slotIds[last];
+		idSlots[slotIds[slot]] = slot;
+		markDirty(slot, slot + 1);
+	}
+	transforms.pop_back();
+	records.pop_back();
+	slotIds.pop_back();
+	idSlots[id] = ~0u;
+	freeIds.push_back(id);
+}
+
+void InstancePool::SetTransform(InstanceId id, const mat4& transform)
+{
+	if (!Contains(id))
+	{
+		return;
+	}
+	unsigned int slot = idSlots[id];
+	transforms[slot] = transform;
+	records[slot] = InstanceRecord(transform);
+	markDirty(slot, slot + 1);
+}
+
+const mat4& InstancePool::GetTransform(InstanceId id) const
+{
+	return transforms[idSlots[id]];
+}
+
+bool InstancePool::Contains(InstanceId id) const
+{
+	return id < idSlots.size() && idSlots[id] != ~0u;
+}
+
+unsigned int InstancePool::GetCount() const
+{
+	return transforms.size();
+}
+
+unsigned int InstancePool::GetFirstInstance() const
+{
+	return drawOffset;
+}
+
+unsigned int InstancePool::GetDrawCount() const
+{
+	return drawCount;
+}
+
+const vector<mat4>& InstancePool::GetTransforms() const
+{
+	return transforms;
+}
+
+void InstancePool::markDirty(unsigned int begin, unsigned int end)
+{
+	for (int i = 0; i < 2; i++)
+	{
+		dirtyBegin[i] = std::min(dirtyBegin[i], begin);
+		dirtyEnd[i] = std::max(dirtyEnd[i], end);
+	}
+}
+
+InstanceManager& InstanceManager::Get()
+{
+	//Never destroyed, like the geometry arena, models held by globals may still reference their pools on shutdown
+	static InstanceManager* manager = new InstanceManager();
+	return *manager;
+}
+
+InstanceManager::InstanceManager()
+	: bufferCapacity(0), current(0), uploadedInstances(0)
+{
+	buffers[0] = buffers[1] = 0;
+	allocator.Grow(INSTANCE_INITIAL_CAPACITY);
+}
+
+InstancePool* InstanceManager::CreatePool(unsigned int capacity)
+{
+	pools.push_back(unique_ptr<InstancePool>(new InstancePool(*this)));
+	InstancePool* pool = pools.back().get();
+	if (capacity > 0)
+	{
+		reserve(*pool, capacity);
+	}
+	return pool;
+}
+
+void InstanceManager::DestroyPool(InstancePool* pool)
+{
+	for (size_t i = 0; i < pools.size(); i++)
+	{
+		if (pools[i].get() == pool)
+		{
+			allocator.Free(pool->offset, pool->capacity);
+			pools.erase(pools.begin() + i);
+			return;
+		}
+	}
+}
+
+void InstanceManager::reserve(InstancePool& pool, size_t capacity)
+{
+	if (capacity <= pool.capacity)
+	{
+		return;
+	}
+	//The contents move with the range, which only means uploading the whole pool again
+	allocator.Free(pool.offset, pool.capacity);
+	size_t offset = 0;
+	while (!allocator.Allocate(capacity, 1, offset))
+	{
+		size_t oldCapacity = allocator.GetCapacity();
+		allocator.Grow(std::max(oldCapacity * 2, oldCapacity + capacity));
+	}
+	pool.offset = offset;
+	pool.capacity = capacity;
+	pool.markDirty(0, pool.transforms.size());
+}
+
+void InstanceManager::Update()
+{
+	if (allocator.GetCapacity() > bufferCapacity)
+	{
+		if (buffers[0])
+		{
+			glDeleteBuffers(2, buffers);
+		}
+		bufferCapacity = allocator.GetCapacity();
+		glCreateBuffers(2, buffers);
+		for (int i = 0; i < 2; i++)
+		{
+			glNamedBufferStorage(buffers[i], bufferCapacity * sizeof(InstanceRecord), nullptr, GL_DYNAMIC_STORAGE_BIT);
+		}
+		//Nothing has been written to the new buffers yet
+		for (size_t i = 0; i < pools.size(); i++)
+		{
+			pools[i]->markDirty(0, pools[i]->transforms.size());
+		}
+	}
+
+	//This buffer was last drawn from two frames ago, so writing to it does not have to wait on the GPU
+	current ^= 1;
+	uploadedInstances = 0;
+	for (size_t i = 0; i < pools.size(); i++)
+	{
+		InstancePool& pool = *pools[i];
+		unsigned int begin = pool.dirtyBegin[current];
+		unsigned int end = std::min(pool.dirtyEnd[current], (unsigned int)pool.transforms.size());
+		if (begin < end)
+		{
+			glNamedBufferSubData(buffers[current], (pool.offset + begin) * sizeof(InstanceRecord), (end - begin) * sizeof(InstanceRecord), &pool.records[begin]);
+			uploadedInstances += end - begin;
+		}
+		pool.dirtyBegin[current] = ~0u;
+		pool.dirtyEnd[current] = 0;
+		pool.drawOffset = pool.offset;
+		pool.drawCount = pool.transforms.size();
+	}
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, INSTANCE_BINDING, buffers[current]);
+}
+
+unsigned int InstanceManager::GetBuffer() const
+{
+	return buffers[current];
+}
+
+void InstanceManager::PrintStatistics() const
+{
+	cout << "Instance buffer: " << pools.size() << " pools, " << allocator.GetUsed() << "/" << allocator.GetCapacity() << " instances reserved, "
+		<< uploadedInstances << " uploaded last update" << endl;
+}
@@ -0,0 +1,113 @@
+#pragma once
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+#include <memory>
+#include <vector>
+
+#include "GeometryArena.h"
+
+using namespace std;
+using namespace glm;
+
+//Shader storage binding the instance transforms are read from
+#define INSTANCE_BINDING 1
+
+typedef unsigned int InstanceId;
+
+/* What the shaders read for each instance, std430 layout. Both matrices are worked out once when the transform changes
+so the vertex shader never has to invert anything */
+struct InstanceRecord
+{
+	vec4 worldRows[3]; //rows of the world matrix, the last row is always 0 0 0 1
+	vec4 normalColumns[3]; //columns of the normal matrix, w unused
+
+	InstanceRecord();
+	InstanceRecord(const mat4& transform);
+};
+
+class InstanceManager;
+
+/* World transforms of every instance of one model. Instances are kept packed so the whole pool is drawn with one
+instanced draw: removing an instance moves the last one into its slot. Ids stay valid until they are removed */
+class InstancePool
+{
+public:
+	InstanceId Add(const mat4& transform);
+	void Remove(InstanceId id);
+	void SetTransform(InstanceId id, const mat4& transform);
+	const mat4& GetTransform(InstanceId id) const;
+	bool Contains(InstanceId id) const;
+
+	unsigned int GetCount() const;
+	/* Where the pool starts in the instance buffer and how many instances it had as of the last Update, which is what
+	draws see. The shader reads instance i at GetFirstInstance() + i */
+	unsigned int GetFirstInstance() const;
+	unsigned int GetDrawCount() const;
+	/* Packed transforms in draw order */
+	const vector<mat4>& GetTransforms() const;
+
+private:
+	friend class InstanceManager;
+	InstancePool(InstanceManager& manager);
+
+	/* Widen the range that still has to be written to each of the manager's buffers */
+	void markDirty(unsigned int begin, unsigned int end);
+
+	InstanceManager& manager;
+	vector<mat4> transforms;
+	vector<InstanceRecord> records; //packed from transforms, this is what gets uploaded
+	vector<InstanceId> slotIds; //id of the instance in each slot
+	vector<unsigned int> idSlots; //slot of each id, ~0u once removed
+	vector<InstanceId> freeIds;
+	//range of the instance buffer owned by the pool, in instances
+	size_t offset;
+	size_t capacity;
+	//offset and count that were uploaded by the last Update
+	unsigned int drawOffset;
+	unsigned int drawCount;
+	//slots changed since each buffer was last written
+	unsigned int dirtyBegin[2];
+	unsigned int dirtyEnd[2];
+
+	InstancePool(const InstancePool&) = delete;
+	InstancePool& operator=(const InstancePool&) = delete;
+};
+
+/* Owns the instance pools and the buffer their transforms are drawn from. Each pool gets its own range of the buffer and
+only the slots that changed are uploaded. The buffer is double buffered so a frame never writes to the copy the previous
+frame may still be drawing from */
+class InstanceManager
+{
+public:
+	static InstanceManager& Get();
+
+	/* capacity is a hint, pools grow as instances are added */
+	InstancePool* CreatePool(unsigned int capacity = 0);
+	void DestroyPool(InstancePool* pool);
+
+	/* Switch to the other buffer, write every change it has not seen yet and bind it at INSTANCE_BINDING. Call once per frame before drawing.
+	Changes made after this only show up in draws from the next Update on */
+	void Update();
+
+	/* Buffer of InstanceRecords */
+	unsigned int GetBuffer() const;
+	/* Print how much of the buffer is in use and how much was uploaded by the last Update */
+	void PrintStatistics() const;
+
+private:
+	friend class InstancePool;
+
+	InstanceManager();
+	/* Move pool to a range that holds at least capacity instances */
+	void reserve(InstancePool& pool, size_t capacity);
+
+	vector<unique_ptr<InstancePool>> pools;
+	FreeListAllocator allocator; //in instances
+	unsigned int buffers[2];
+	size_t bufferCapacity; //in instances
+	unsigned int current; //buffer written and bound by the last Update
+	size_t uploadedInstances; //by the last Update
+
+	InstanceManager(const InstanceManager&) = delete;
+	InstanceManager& operator=(const InstanceManager&) = delete;
+};
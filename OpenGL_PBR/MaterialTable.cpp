@@ -0,0 +1,412 @@
+#include <iostream>
+#include <cstring>
+#include <algorithm>
+#include "MaterialTable.h"
+#include "TextureStreamer.h"
+#include "GLStateCache.h"
+
+//ARB_bindless_texture entry points, glad was generated without extensions so they are loaded by hand
+typedef GLuint64 (APIENTRYP PFNGLGETTEXTUREHANDLEARBPROC)(GLuint texture);
+typedef void (APIENTRYP PFNGLMAKETEXTUREHANDLERESIDENTARBPROC)(GLuint64 handle);
+static PFNGLGETTEXTUREHANDLEARBPROC getTextureHandle = nullptr;
+static PFNGLMAKETEXTUREHANDLERESIDENTARBPROC makeTextureHandleResident = nullptr;
+
+//Texture type names Mesh uses, in slot order
+static const char* slotTypes[MATERIAL_SLOT_COUNT] = { "diffuse", "roughness", "emissive", "opacity", "metallic", "normal", "ao" };
+//What a slot samples when the material has no texture for it, or the texture is still streaming
+static const unsigned char slotDefaults[MATERIAL_SLOT_COUNT][4] = {
+	{ 255, 255, 255, 255 }, //diffuse
+	{ 255, 255, 255, 255 }, //roughness
+	{ 0, 0, 0, 255 }, //emissive
+	{ 255, 255, 255, 255 }, //opacity
+	{ 0, 0, 0, 255 }, //metallic
+	{ 128, 128, 255, 255 }, //normal, pointing straight out of the surface
+	{ 255, 255, 255, 255 } //ao
+};
+
+static bool hasExtension(const char* name)
+{
+	GLint count = 0;
+	glGetIntegerv(GL_NUM_EXTENSIONS, &count);
+	for (GLint i = 0; i < count; i++)
+	{
+		const char* extension = (const char*)glGetStringi(GL_EXTENSIONS, i);
+		if (extension && strcmp(extension, name) == 0)
+		{
+			return true;
+		}
+	}
+	return false;
+}
+
+static int mipLevels(int width, int height)
+{
+	int levels = 1;
+	for (int size = std::max(width, height); size > 1; size /= 2)
+	{
+		levels++;
+	}
+	return levels;
+}
+
+MaterialDesc::MaterialDesc()
+{
+	memset(textures, 0, sizeof(textures));
+}
+
+bool MaterialDesc::operator<(const MaterialDesc& other) const
+{
+	return memcmp(textures, other.textures, sizeof(textures)) < 0;
+}
+
+MaterialTable& MaterialTable::Get()
+{
+	static MaterialTable table;
+	return table;
+}
+
+MaterialTable::MaterialTable()
+	: buffer(0), bufferCapacity(0), bIsInitialized(false), bIsBindless(false), bIsDirty(true), bHasPendingTextures(false), maxArrays(0)
+{
+	memset(defaults, 0, sizeof(defaults));
+	copyFramebuffers[0] = copyFramebuffers[1] = 0;
+	Register(MaterialDesc());
+	//GL objects are left for the driver to clean up, the context is already gone by the time statics are destroyed
+}
+
+void MaterialTable::Initialize(GLADloadproc loader, bool bAllowBindless)
+{
+	if (bAllowBindless && hasExtension("GL_ARB_bindless_texture"))
+	{
+		getTextureHandle = (PFNGLGETTEXTUREHANDLEARBPROC)loader("glGetTextureHandleARB");
+		makeTextureHandleResident = (PFNGLMAKETEXTUREHANDLERESIDENTARBPROC)loader("glMakeTextureHandleResidentARB");
+		bIsBindless = getTextureHandle && makeTextureHandleResident;
+	}
+
+	for (int slot = 0; slot < MATERIAL_SLOT_COUNT; slot++)
+	{
+		glCreateTextures(GL_TEXTURE_2D, 1, &defaults[slot]);
+		glTextureStorage2D(defaults[slot], 1, GL_RGBA8, 1, 1);
+		glTextureSubImage2D(defaults[slot], 0, 0, 0, 1, 1, GL_RGBA, GL_UNSIGNED_BYTE, slotDefaults[slot]);
+		glTextureParameteri(defaults[slot], GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+		glTextureParameteri(defaults[slot], GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+	}
+
+	if (bIsBindless)
+	{
+		for (int slot = 0; slot < MATERIAL_SLOT_COUNT; slot++)
+		{
+			GLuint64 handle = getTextureHandle(defaults[slot]);
+			makeTextureHandleResident(handle);
+			handles[defaults[slot]] = handle;
+		}
+	}
+	else
+	{
+		GLint units = 0;
+		glGetIntegerv(GL_MAX_TEXTURE_IMAGE_UNITS, &units);
+		maxArrays = (unsigned int)std::min(MAX_MATERIAL_ARRAYS, units - MATERIAL_ARRAY_UNIT);
+		if (units <= MATERIAL_ARRAY_UNIT)
+		{
+			cout << "ERROR::MATERIAL_TABLE::Only " << units << " texture units, materials need more than " << MATERIAL_ARRAY_UNIT << endl;
+			maxArrays = 1;
+		}
+		glCreateFramebuffers(2, copyFramebuffers);
+		glNamedFramebufferReadBuffer(copyFramebuffers[0], GL_COLOR_ATTACHMENT0);
+		glNamedFramebufferDrawBuffer(copyFramebuffers[1], GL_COLOR_ATTACHMENT0);
+	}
+	bIsInitialized = true;
+
+	//Materials registered before now point at nothing yet
+	bHasPendingTextures = true;
+	if (!bIsBindless)
+	{
+		rebuildArrays();
+	}
+	for (unsigned int material = 0; material < records.size(); material++)
+	{
+		writeRecord(material);
+	}
+	bIsDirty = true;
+}
+
+unsigned int MaterialTable::Register(const MaterialDesc& desc)
+{
+	map<MaterialDesc, unsigned int>::iterator it = lookup.find(desc);
+	if (it != lookup.end())
+	{
+		return it->second;
+	}
+
+	unsigned int material = (unsigned int)descs.size();
+	descs.push_back(desc);
+	records.push_back(MaterialRecord());
+	lookup[desc] = material;
+	writeRecord(material);
+	for (int slot = 0; slot < MATERIAL_SLOT_COUNT; slot++)
+	{
+		if (desc.textures[slot])
+		{
+			bHasPendingTextures = true;
+		}
+	}
+	bIsDirty = true;
+	return material;
+}
+
+int MaterialTable::GetSlot(const string& type)
+{
+	for (int slot = 0; slot < MATERIAL_SLOT_COUNT; slot++)
+	{
+		if (type == slotTypes[slot])
+		{
+			return slot;
+		}
+	}
+	return -1;
+}
+
+void MaterialTable::Update()
+{
+	if (!bIsInitialized)
+	{
+		return;
+	}
+
+	if (bHasPendingTextures)
+	{
+		if (bIsBindless)
+		{
+			resolveBindless();
+		}
+		else if (TextureStreamer::Get().IsIdle())
+		{
+			//Rebuilding copies every texture, so wait for streaming to finish instead of rebuilding as each one lands
+			rebuildArrays();
+		}
+	}
+
+	if (bIsDirty)
+	{
+		if (records.size() > bufferCapacity)
+		{
+			if (buffer)
+			{
+				glDeleteBuffers(1, &buffer);
+			}
+			bufferCapacity = std::max(records.size(), bufferCapacity * 2);
+			glCreateBuffers(1, &buffer);
+			glNamedBufferStorage(buffer, bufferCapacity * sizeof(MaterialRecord), nullptr, GL_DYNAMIC_STORAGE_BIT);
+			glBindBufferBase(GL_SHADER_STORAGE_BUFFER, MATERIAL_BINDING, buffer);
+		}
+		glNamedBufferSubData(buffer, 0, records.size() * sizeof(MaterialRecord), records.data());
+		bIsDirty = false;
+	}
+
+	for (unsigned int i = 0; i < arrays.size(); i++)
+	{
+		GLStateCache::Get().BindTextureUnit(MATERIAL_ARRAY_UNIT + i, GL_TEXTURE_2D_ARRAY, arrays[i]);
+	}
+}
+
+bool MaterialTable::IsBindless() const
+{
+	return bIsBindless;
+}
+
+size_t MaterialTable::GetCount() const
+{
+	return descs.size();
+}
+
+void MaterialTable::PrintStatistics() const
+{
+	if (bIsBindless)
+	{
+		cout << "Materials: " << descs.size() << ", bindless with " << handles.size() << " resident textures" << endl;
+	}
+	else
+	{
+		cout << "Materials: " << descs.size() << ", " << layers.size() << " textures in " << arrays.size() << " arrays" << endl;
+	}
+}
+
+bool MaterialTable::isReady(unsigned int texture) const
+{
+	if (TextureStreamer::Get().IsStreaming(texture))
+	{
+		return false;
+	}
+	GLint width = 0;
+	glGetTextureLevelParameteriv(texture, 0, GL_TEXTURE_WIDTH, &width);
+	return width > 0;
+}
+
+void MaterialTable::resolveBindless()
+{
+	bool bHasNewHandles = false;
+	bHasPendingTextures = false;
+	for (unsigned int material = 0; material < descs.size(); material++)
+	{
+		for (int slot = 0; slot < MATERIAL_SLOT_COUNT; slot++)
+		{
+			unsigned int texture = descs[material].textures[slot];
+			if (!texture || handles.count(texture))
+			{
+				continue;
+			}
+			if (!isReady(texture))
+			{
+				bHasPendingTextures = true;
+				continue;
+			}
+			//A resident texture can no longer change its storage or sampler state, it has to be complete first
+			GLuint64 handle = getTextureHandle(texture);
+			makeTextureHandleResident(handle);
+			handles[texture] = handle;
+			bHasNewHandles = true;
+		}
+	}
+
+	if (bHasNewHandles)
+	{
+		for (unsigned int material = 0; material < records.size(); material++)
+		{
+			writeRecord(material);
+		}
+		bIsDirty = true;
+	}
+}
+
+void MaterialTable::rebuildArrays()
+{
+	//Textures sharing a size and wrap mode go in the same array
+	typedef pair<pair<GLint, GLint>, GLint> GroupKey;
+	map<GroupKey, vector<unsigned int>> groups;
+	vector<unsigned int> textures(defaults, defaults + MATERIAL_SLOT_COUNT);
+	for (unsigned int material = 0; material < descs.size(); material++)
+	{
+		for (int slot = 0; slot < MATERIAL_SLOT_COUNT; slot++)
+		{
+			if (descs[material].textures[slot])
+			{
+				textures.push_back(descs[material].textures[slot]);
+			}
+		}
+	}
+	sort(textures.begin(), textures.end());
+	textures.erase(unique(textures.begin(), textures.end()), textures.end());
+
+	bHasPendingTextures = false;
+	for (unsigned int i = 0; i < textures.size(); i++)
+	{
+		if (!isReady(textures[i]))
+		{
+			bHasPendingTextures = true;
+			continue;
+		}
+		GLint width, height, wrap;
+		glGetTextureLevelParameteriv(textures[i], 0, GL_TEXTURE_WIDTH, &width);
+		glGetTextureLevelParameteriv(textures[i], 0, GL_TEXTURE_HEIGHT, &height);
+		glGetTextureParameteriv(textures[i], GL_TEXTURE_WRAP_S, &wrap);
+		groups[GroupKey(make_pair(width, height), wrap)].push_back(textures[i]);
+	}
+
+	//Largest groups first, there are only maxArrays units so the smallest groups get scaled into the largest array
+	vector<pair<GroupKey, vector<unsigned int>>> sorted(groups.begin(), groups.end());
+	stable_sort(sorted.begin(), sorted.end(), [](const pair<GroupKey, vector<unsigned int>>& a, const pair<GroupKey, vector<unsigned int>>& b)
+	{
+		return a.second.size() > b.second.size();
+	});
+	for (size_t i = maxArrays; i < sorted.size(); i++)
+	{
+		sorted[0].second.insert(sorted[0].second.end(), sorted[i].second.begin(), sorted[i].second.end());
+	}
+	if (sorted.size() > maxArrays)
+	{
+		sorted.resize(maxArrays);
+	}
+
+	for (unsigned int i = 0; i < arrays.size(); i++)
+	{
+		GLStateCache::Get().ForgetTexture(arrays[i]);
+	}
+	if (!arrays.empty())
+	{
+		glDeleteTextures((GLsizei)arrays.size(), arrays.data());
+	}
+	arrays.clear();
+	layers.clear();
+
+	for (unsigned int i = 0; i < sorted.size(); i++)
+	{
+		GLint width = sorted[i].first.first.first;
+		GLint height = sorted[i].first.first.second;
+		const vector<unsigned int>& members = sorted[i].second;
+
+		unsigned int array;
+		glCreateTextures(GL_TEXTURE_2D_ARRAY, 1, &array);
+		glTextureStorage3D(array, mipLevels(width, height), GL_RGBA8, width, height, (GLsizei)members.size());
+		glTextureParameteri(array, GL_TEXTURE_WRAP_S, sorted[i].first.second);
+		glTextureParameteri(array, GL_TEXTURE_WRAP_T, sorted[i].first.second);
+		glTextureParameteri(array, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+		glTextureParameteri(array, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+
+		//Blitting converts from whatever format the source was streamed in, single channel textures keep reading (r, 0, 0, 1)
+		for (unsigned int layer = 0; layer < members.size(); layer++)
+		{
+			GLint sourceWidth, sourceHeight;
+			glGetTextureLevelParameteriv(members[layer], 0, GL_TEXTURE_WIDTH, &sourceWidth);
+			glGetTextureLevelParameteriv(members[layer], 0, GL_TEXTURE_HEIGHT, &sourceHeight);
+			glNamedFramebufferTexture(copyFramebuffers[0], GL_COLOR_ATTACHMENT0, members[layer], 0);
+			glNamedFramebufferTextureLayer(copyFramebuffers[1], GL_COLOR_ATTACHMENT0, array, 0, layer);
+			glBlitNamedFramebuffer(copyFramebuffers[0], copyFramebuffers[1], 0, 0, sourceWidth, sourceHeight, 0, 0, width, height,
+				GL_COLOR_BUFFER_BIT, GL_LINEAR);
+			layers[members[layer]] = make_pair(i, layer);
+		}
+		glGenerateTextureMipmap(array);
+		arrays.push_back(array);
+	}
+	glNamedFramebufferTexture(copyFramebuffers[0], GL_COLOR_ATTACHMENT0, 0, 0);
+	glNamedFramebufferTexture(copyFramebuffers[1], GL_COLOR_ATTACHMENT0, 0, 0);
+
+	for (unsigned int material = 0; material < records.size(); material++)
+	{
+		writeRecord(material);
+	}
+	bIsDirty = true;
+}
+
+void MaterialTable::writeRecord(unsigned int material)
+{
+	MaterialRecord& record = records[material];
+	memset(&record, 0, sizeof(record));
+	for (int slot = 0; slot < MATERIAL_SLOT_COUNT; slot++)
+	{
+		unsigned int texture = descs[material].textures[slot];
+		if (bIsBindless)
+		{
+			map<unsigned int, GLuint64>::const_iterator it = handles.find(texture);
+			if (it == handles.end())
+			{
+				it = handles.find(defaults[slot]);
+			}
+			GLuint64 handle = it != handles.end() ? it->second : 0;
+			record.textures[slot][0] = (unsigned int)(handle & 0xFFFFFFFFu);
+			record.textures[slot][1] = (unsigned int)(handle >> 32);
+		}
+		else
+		{
+			map<unsigned int, pair<unsigned int, unsigned int>>::const_iterator it = layers.find(texture);
+			if (it == layers.end())
+			{
+				it = layers.find(defaults[slot]);
+			}
+			if (it != layers.end())
+			{
+				record.textures[slot][0] = it->second.first;
+				record.textures[slot][1] = it->second.second;
+			}
+		}
+	}
+}
@@ -0,0 +1,98 @@
+#pragma once
+#include <glad/glad.h>
+#include <map>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+//Shader storage binding of the material records, 1 to 6 are taken by instancing, draw data and culling
+#define MATERIAL_BINDING 7
+//First texture unit of the fallback texture arrays and how many there can be, clear of the units the renderer binds by hand
+#define MATERIAL_ARRAY_UNIT 16
+#define MAX_MATERIAL_ARRAYS 8
+
+/* Textures a material can have, in the order PBR.frag indexes them */
+enum MaterialSlot
+{
+	MATERIAL_DIFFUSE = 0,
+	MATERIAL_ROUGHNESS,
+	MATERIAL_EMISSIVE,
+	MATERIAL_OPACITY,
+	MATERIAL_METALLIC,
+	MATERIAL_NORMAL,
+	MATERIAL_AO,
+	MATERIAL_SLOT_COUNT
+};
+
+/* Texture of every slot of a material, 0 where the material has none and the slot's default is used */
+struct MaterialDesc
+{
+	unsigned int textures[MATERIAL_SLOT_COUNT];
+
+	MaterialDesc();
+	bool operator<(const MaterialDesc& other) const;
+};
+
+/* One material as the shaders read it, std430. With bindless textures each slot is a 64 bit texture handle split
+into two words, otherwise x is the texture array and y the layer in it */
+struct MaterialRecord
+{
+	unsigned int textures[8][2]; //MATERIAL_SLOT_COUNT slots padded to 8
+};
+
+/* Every material in one shader storage buffer so drawing with a different material costs nothing but its index.
+Where ARB_bindless_texture is supported the records hold resident texture handles. Otherwise every texture is copied
+into 2D texture arrays grouped by size and the records hold the array and layer. Textures only get a handle, or a
+layer, once they have finished streaming, until then their slot samples the slot's default */
+class MaterialTable
+{
+public:
+	static MaterialTable& Get();
+
+	/* Look for bindless texture support through loader and create the default textures. Needs a current context */
+	void Initialize(GLADloadproc loader, bool bAllowBindless = true);
+
+	/* Index of the material with desc's textures, adding it if no mesh has used that combination yet. Material 0 always
+	exists and uses every slot's default */
+	unsigned int Register(const MaterialDesc& desc);
+	/* Slot a texture type from a model ("diffuse", "normal", ...) goes in, -1 for types the shaders do not use */
+	static int GetSlot(const string& type);
+
+	/* Pick up textures that finished streaming, upload changed records and bind the texture arrays. Call once per frame
+	after the texture streamer has updated */
+	void Update();
+
+	bool IsBindless() const;
+	size_t GetCount() const;
+	void PrintStatistics() const;
+
+private:
+	MaterialTable();
+
+	/* Has texture finished streaming, so it can be given a handle or copied */
+	bool isReady(unsigned int texture) const;
+	void resolveBindless();
+	/* Copy every ready texture into freshly sized arrays and point the records at them */
+	void rebuildArrays();
+	void writeRecord(unsigned int material);
+
+	vector<MaterialDesc> descs;
+	vector<MaterialRecord> records;
+	map<MaterialDesc, unsigned int> lookup;
+	unsigned int defaults[MATERIAL_SLOT_COUNT]; //1x1 textures
+	map<unsigned int, GLuint64> handles; //resident handle of each ready texture, bindless only
+	map<unsigned int, pair<unsigned int, unsigned int>> layers; //array and layer of each copied texture, arrays only
+	vector<unsigned int> arrays;
+	unsigned int buffer;
+	size_t bufferCapacity; //in records
+	unsigned int copyFramebuffers[2]; //read and draw, for copying into the arrays
+	bool bIsInitialized;
+	bool bIsBindless;
+	bool bIsDirty; //records changed since the last upload
+	bool bHasPendingTextures; //some referenced texture has not been resolved yet
+	unsigned int maxArrays;
+
+	MaterialTable(const MaterialTable&) = delete;
+	MaterialTable& operator=(const MaterialTable&) = delete;
+};
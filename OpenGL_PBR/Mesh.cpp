@@ -1,265 +1,135 @@
+#include <algorithm>
 #include "Mesh.h"
+#include "GLStateCache.h"
+#include "ShaderConstants.h"
+#include "MaterialTable.h"
+#include "ShaderVariants.h"
 
-Mesh::Mesh(vector<Vertex> vertices, vector<unsigned int> indices, vector<MTexture> textures, bool bInstanced)
+Mesh::Mesh(const PackedVertex* vertices, unsigned int vertexCount, const void* indices, const MeshLod* lods, unsigned int lodCount, GLenum indexType,
+	vec3 boundsMin, vec3 boundsMax, vector<MTexture> textures)
 {
-	this->vertices = vertices;
-	this->indices = indices;
 	this->textures = textures;
+	this->vertexCount = vertexCount;
+	this->lodCount = std::min(lodCount, (unsigned int)MAX_MESH_LODS);
+	for (unsigned int i = 0; i < this->lodCount; i++)
+	{
+		this->lods[i] = lods[i];
+	}
+	this->indexType = indexType;
+	this->boundsMin = boundsMin;
+	this->boundsMax = boundsMax;
 
 	//Initialize variables
-	EBO = 0;
-	VBO = 0;
-	VAO = 0;
+	materialIndex = 0;
+	material = registerMaterial();
+	boundingSphere = vec4((boundsMin + boundsMax) * 0.5f, length(boundsMax - boundsMin) * 0.5f);
 
-	setupMesh();
-	//if we are instanced, run the instanced code ontop
-	if (bInstanced)
-	{
-		setupInstancedMesh();
-	}
+	setupMesh(vertices, indices);
 }
 
-void Mesh::Draw(Shader& shader, bool bInstanced)
+void Mesh::Draw(unsigned int lod, const InstancePool* instances, const mat4& transform)
 {
-	/* 
-		ADJUST THIS! REQUIRES SPECIFIC STRINGS TO BE SET 
-		IN ORDER FOR IT TO WORK
-	*/
-	unsigned int diffuseNr = 1;
-	unsigned int roughnessNr = 1;
-	unsigned int opacityNr = 1;
-	unsigned int metallicNr = 1;
-	unsigned int normalNr = 1;
-	unsigned int aoNr = 1;
-	unsigned int emissiveNr = 1;
-
-	for (unsigned int i = 0; i < textures.size(); i++)
+	//Positions are stored relative to the mesh bounds. Every instance of the pool goes in one draw, the vertex shader
+	//reads their transforms from the instance buffer. The material is only an index, the textures are already in the material table
+	bool bIsInstanced = instances && instances->GetDrawCount() > 0;
+	GetObjectConstants().Update(ObjectConstants(transform, boundsMin, boundsMax - boundsMin, bIsInstanced ? (int)instances->GetFirstInstance() : -1,
+		material));
+
+	//All meshes share the arena's VAO, only the offsets into it change
+	const MeshLod& level = GetLod(lod);
+	void* indexOffset = (void*)(size_t)(geometry->indexOffset + level.indexOffset);
+	if (!instances)
 	{
-		//Get current texture unit to bind buffer to
-		glActiveTexture(GL_TEXTURE0 + i);
-
-		string number;
-		string name = textures[i].type;
-		//If we want to use multiple of the same texture type
-		if (name == "diffuse")
-		{
-			number = to_string(diffuseNr++);
-		}
-		else if (name == "roughness")
-		{
-			number = to_string(roughnessNr++);
-		}
-		else if (name == "opacity")
-		{
-			number = to_string(opacityNr++);
-		}
-		else if (name == "metallic")
-		{
-			number = to_string(metallicNr++);
-		}
-		else if (name == "normal")
-		{
-			number = to_string(normalNr++);
-		}
-		else if (name == "ao")
-		{
-			number = to_string(aoNr++);
-		}
-		else if (name == "emissive")
-		{
-			number = to_string(emissiveNr++);
-		}
-
-		if (diffuseNr == 1)
-		{
-			shader.setInt(("material.diffuse"), 0);
-		}
-		if (roughnessNr == 1)
-		{
-			shader.setInt(("material.roughness"), 0);
-		}
-		if (opacityNr == 1)
-		{
-			shader.setInt(("material.opacity"), 0);
-		}
-		if (metallicNr == 1)
-		{
-			shader.setInt(("material.metallic"), 0);
-		}
-		if (normalNr == 1)
-		{
-			shader.setInt(("material.normal"), 0);
-		}
-		if (aoNr == 1)
-		{
-			shader.setInt(("material.ao"), 0);
-		}
-		if (emissiveNr == 1)
-		{
-			shader.setInt(("material.emissive"), 0);
-		}
-
-		//Send texture over to fragment shader
-		shader.setInt(("material." + name).c_str(), i);
-		glBindTexture(GL_TEXTURE_2D, textures[i].id);
+		GLStateCache::Get().BindVertexArray(GeometryArena::Get().GetVAO());
+		glDrawElementsBaseVertex(GL_TRIANGLES, level.indexCount, indexType, indexOffset, geometry->baseVertex);
 	}
-	//reset active texture ready for next call
-	glActiveTexture(GL_TEXTURE0);
-
-	if (!bInstanced)
+	else if (instances->GetDrawCount() > 0)
 	{
-		glBindVertexArray(VAO);
-		glDrawElements(GL_TRIANGLES, indices.size(), GL_UNSIGNED_INT, 0);
-		glBindVertexArray(0);
+		GLStateCache::Get().BindVertexArray(GeometryArena::Get().GetVAO());
+		glDrawElementsInstancedBaseVertex(GL_TRIANGLES, level.indexCount, indexType, indexOffset, instances->GetDrawCount(), geometry->baseVertex);
 	}
-	else
+}
+
+unsigned int Mesh::SelectLod(float maxError) const
+{
+	unsigned int lod = 0;
+	while (lod + 1 < lodCount && lods[lod + 1].error <= maxError)
 	{
-		shader.setBool("bInstance", true);
-		glBindVertexArray(VAO);
-		glDrawElementsInstanced(GL_TRIANGLES, indices.size(), GL_UNSIGNED_INT, 0, 100);
-		glBindVertexArray(0);
-		shader.setBool("bInstance", false);
+		lod++;
 	}
+	return lod;
 }
 
-unsigned int Mesh::GetVAO()
+unsigned int Mesh::GetLodCount() const
 {
-	return this->VAO;
+	return lodCount;
 }
 
-vector<unsigned int> Mesh::GetIndices()
+const MeshLod& Mesh::GetLod(unsigned int lod) const
 {
-	return indices;
+	return lods[std::min(lod, lodCount - 1)];
 }
 
-void Mesh::setupMesh()
+GLenum Mesh::GetIndexType() const
 {
-	//Generate VAO, VBO and EBO ready for buffer data
-	glGenVertexArrays(1, &VAO);
-	glGenBuffers(1, &VBO);
-	glGenBuffers(1, &EBO);
-
-	glBindVertexArray(VAO);
-
-	//Bind vertices to VBO
-	glBindBuffer(GL_ARRAY_BUFFER, VBO);
-	glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(Vertex), &vertices[0], GL_STATIC_DRAW);
-
-	/* Fill buffer after initialization
-	glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(Vertex), NULL, GL_STATIC_DRAW);
-	glBufferSubData(GL_ARRAY_BUFFER, 0, vertices.size() * sizeof(Vertex), &vertices[0]);
-	*/
-
-	/* Manually copying data into buffer
-	//pointer to writable buffer
-	void *ptr = glMapBuffer(GL_ARRAY_BUFFER, GL_WRITE_ONLY);
-	//copy data into buffer
-	memcpy(ptr, &vertices[0], vertices.size() * sizeof(Vertex));
-	//unmap buffer
-	glUnmapBuffer(GL_ARRAY_BUFFER);
-	*/
-
-	//Bind indices to EBO
-	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
-	glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(unsigned int), &indices[0], GL_STATIC_DRAW);
-
-	//Bind data buffer to OpenGL
-	//vertex position
-	glEnableVertexAttribArray(0);
-	glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)0);
-
-	//vertex normals
-	glEnableVertexAttribArray(1);
-	glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, Normal));
-
-	//vertex texture coordinates
-	glEnableVertexAttribArray(2);
-	glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, TexCoords));
-
-	//vertex tangents
-	glEnableVertexAttribArray(3);
-	glVertexAttribPointer(3, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, Tangent));
+	return indexType;
+}
 
-	//vertex Bitangents
-	glEnableVertexAttribArray(4);
-	glVertexAttribPointer(4, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, Bitangent));
+const GeometryRange& Mesh::GetGeometry() const
+{
+	return *geometry;
+}
 
-	//Unbind VAO to stop accidental calls to buffer
-	glBindVertexArray(0);
+unsigned int Mesh::GetVAO()
+{
+	return GeometryArena::Get().GetVAO();
+}
 
+vector<unsigned int> Mesh::GetIndices()
+{
+	//Indices are not kept on the CPU once uploaded, only the full detail level is read back
+	unsigned int indexCount = lods[0].indexCount;
+	vector<unsigned int> indices(indexCount);
+	if (indexType == GL_UNSIGNED_SHORT)
+	{
+		vector<unsigned short> shortIndices(indexCount);
+		glGetNamedBufferSubData(GeometryArena::Get().GetIndexBuffer(), geometry->indexOffset + lods[0].indexOffset, indexCount * sizeof(unsigned short), shortIndices.data());
+		indices.assign(shortIndices.begin(), shortIndices.end());
+		return indices;
+	}
+	glGetNamedBufferSubData(GeometryArena::Get().GetIndexBuffer(), geometry->indexOffset + lods[0].indexOffset, indexCount * sizeof(unsigned int), indices.data());
+	return indices;
 }
 
-void Mesh::setupInstancedMesh()
+unsigned int Mesh::registerMaterial()
 {
-	//Temporary way to store the instanced model matrices until a custom instanced class is made
-	vector<vec3> floorVerts;
-	vector<mat4> floorModelMats;
-	//Temp way to initialize floor instance locations
-	int floorWidth = 10; //How wide the floor should be 
-	float vertValue = 1.0; //To place floor left
-	float HoriValue = 1.5; //To place floor behind
-	floorVerts.emplace_back(vec3(5.0, -1.8, 8)); //push starting value
-	for (int i = 0; i < 100; i++) //Create 50 floors
+	//A type that appears more than once uses its last texture, as the per-draw sampler setup used to
+	MaterialDesc desc;
+	for (unsigned int i = 0; i < textures.size(); i++)
 	{
-		float mod = i % floorWidth; //Have we reached maximum width
-		if (mod != 0)
+		int slot = MaterialTable::GetSlot(textures[i].type);
+		if (slot >= 0)
 		{
-			//Add floor horizontally
-			vec3 prev = floorVerts.at(i); //access previous value
-			vec3 newVert = prev;
-			newVert.x -= vertValue;
-			floorVerts.push_back(newVert);
-			//trying with model matrix instead
-			mat4 model = mat4(1.0);
-			model = translate(model, newVert);
-			model = scale(model, vec3(0.3, 0.3, 0.3));
-			floorModelMats.push_back(model);
-		}
-		else
-		{
-			// Add Floor vertically
-			vec3 prev = floorVerts.at(i); //access previous value
-			vec3 newVert = prev;
-			newVert.x = floorVerts.at(0).x; //TEMP WAY TO REVERT HORIZONAL VALUE
-			newVert.z -= HoriValue;
-			floorVerts.push_back(newVert);
-			//trying with model matrix instead
-			mat4 model = mat4(1.0);
-			model = translate(model, newVert);
-			model = scale(model, vec3(0.3, 0.3, 0.3));
-			floorModelMats.push_back(model);
+			desc.textures[slot] = textures[i].id;
 		}
 	}
 
-	/*unsigned int buffer;
-	glGenBuffers(1, &buffer);
-	glBindBuffer(GL_ARRAY_BUFFER, buffer);
-	glBufferData(GL_ARRAY_BUFFER, floorModelMats.size() * sizeof(mat4), &floorModelMats.at(0), GL_STATIC_DRAW);
-
-	//Temp way to pass through vertices to vertex shader
-	glBindVertexArray(VAO);
-	glEnableVertexAttribArray(3);
-	glVertexAttribPointer(3, 4, GL_FLOAT, GL_FALSE, sizeof(mat4), (void*)0);
-	glEnableVertexAttribArray(4);
-	glVertexAttribPointer(4, 4, GL_FLOAT, GL_FALSE, sizeof(mat4), (void*)(sizeof(vec4)));
-	glEnableVertexAttribArray(5);
-	glVertexAttribPointer(5, 4, GL_FLOAT, GL_FALSE, sizeof(mat4), (void*)(2 * sizeof(vec4)));
-	glEnableVertexAttribArray(6);
-	glVertexAttribPointer(6, 4, GL_FLOAT, GL_FALSE, sizeof(mat4), (void*)(3 * sizeof(vec4)));
-
-	//Tell OpenGL that we want to update the value every instance
-	glVertexAttribDivisor(3, 1);
-	glVertexAttribDivisor(4, 1);
-	glVertexAttribDivisor(5, 1);
-	glVertexAttribDivisor(6, 1);
-
-	glBindVertexArray(0);
-	*/
+	//Maps left at their defaults are skipped at compile time, a missing normal map keeps the surface normal
+	shaderFeatures = 0;
+	shaderFeatures |= desc.textures[MATERIAL_NORMAL] ? SHADER_NORMAL_MAP : 0;
+	shaderFeatures |= desc.textures[MATERIAL_AO] ? SHADER_AO : 0;
+	shaderFeatures |= desc.textures[MATERIAL_EMISSIVE] ? SHADER_EMISSIVE : 0;
+	return MaterialTable::Get().Register(desc);
+}
 
-	GLuint ssboModelMatrices;
-	glGenBuffers(1, &ssboModelMatrices);
-	glBindBuffer(GL_SHADER_STORAGE_BUFFER, ssboModelMatrices);
-	glBufferData(GL_SHADER_STORAGE_BUFFER, sizeof(mat4) * floorModelMats.size(), &floorModelMats.at(0), GL_STATIC_DRAW);
-	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, ssboModelMatrices); //Allocate shader storage buffer to binding point 1
-	glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+void Mesh::setupMesh(const PackedVertex* vertices, const void* indices)
+{
+	//Every LOD is copied along with the vertices, offsets stay relative to the start of the range
+	size_t indexSize = indexType == GL_UNSIGNED_SHORT ? sizeof(unsigned short) : sizeof(unsigned int);
+	size_t indexBufferSize = 0;
+	for (unsigned int i = 0; i < lodCount; i++)
+	{
+		indexBufferSize = std::max(indexBufferSize, lods[i].indexOffset + lods[i].indexCount * indexSize);
+	}
+	geometry = GeometryArena::Get().Allocate(vertices, vertexCount, indices, indexBufferSize);
 }
@@ -2,11 +2,15 @@
 #include <glm/glm.hpp>
 #include <vector>
 #include "Texture.h"
+#include "TextureCache.h"
+#include "GeometryArena.h"
 #include "Shader.h"
+#include "InstanceManager.h"
 
 using namespace std;
 using namespace glm;
 
+/* Full precision vertex as it comes out of Assimp, only used while importing */
 struct Vertex
 {
 	vec3 Position;
@@ -16,11 +20,32 @@ struct Vertex
 	vec3 Bitangent;
 };
 
+/* Quantized vertex that is stored in the mesh cache and uploaded to the GPU, 20 bytes instead of 56 */
+struct PackedVertex
+{
+	unsigned short Position[4]; //unorm16 inside the mesh bounds, w holds the bitangent sign (0 = -1, 65535 = +1)
+	short Normal[2]; //octahedral snorm16
+	short Tangent[2]; //octahedral snorm16
+	unsigned short TexCoords[2]; //half floats
+};
+
+//Most index ranges a mesh can have, including the full detail one
+#define MAX_MESH_LODS 5
+
+/* One level of detail of a mesh. Every level indexes the same vertex buffer */
+struct MeshLod
+{
+	unsigned int indexOffset; //in bytes
+	unsigned int indexCount;
+	float error; //largest object space distance from the full detail surface
+};
+
 struct MTexture
 {
 	unsigned int id;
 	string type;
 	string path; //store path of texture to compare with other queries of the same texture
+	TextureHandle handle; //keeps the shared texture alive for as long as a mesh uses it
 	bool operator==(const MTexture& T1)
 	{
 		return this->path == T1.path;
@@ -31,24 +56,47 @@ class Mesh
 {
 public:
 	//mesh data
-	vector<Vertex> vertices;
-	vector<unsigned int> indices;
 	vector<MTexture> textures;
+	unsigned int materialIndex; //material slot from the source file
+	unsigned int material; //entry in the MaterialTable for the mesh's textures
+	unsigned int shaderFeatures; //ShaderFeature bits of the maps the mesh has, picks its shader variant
+	//object space bounds
+	vec3 boundsMin;
+	vec3 boundsMax;
+	vec4 boundingSphere; //xyz centre, w radius
 
-	Mesh(vector<Vertex> vertices, vector<unsigned int> indices, vector<MTexture> textures, bool bInstanced);
-	//Draw mesh to viewport
-	void Draw(Shader& shader, bool bInstanced);
+	/* Vertices and indices are uploaded straight from the passed through memory, which can be a mapped mesh cache.
+	Positions are dequantized with the bounds, so they need to be set to the bounds the vertices were packed with.
+	LOD offsets are relative to indices, starting with the full detail level. indexType is GL_UNSIGNED_SHORT or GL_UNSIGNED_INT */
+	Mesh(const PackedVertex* vertices, unsigned int vertexCount, const void* indices, const MeshLod* lods, unsigned int lodCount, GLenum indexType,
+		vec3 boundsMin, vec3 boundsMax, vector<MTexture> textures);
+	//Draw mesh to viewport with transform, once for every instance in instances if it is given, with the shader already in use
+	void Draw(unsigned int lod = 0, const InstancePool* instances = nullptr, const mat4& transform = mat4(1.0f));
 
+	/* Coarsest LOD whose error is no larger than maxError, in object space */
+	unsigned int SelectLod(float maxError) const;
+	unsigned int GetLodCount() const;
+	const MeshLod& GetLod(unsigned int lod) const;
+	GLenum GetIndexType() const;
+	/* Where the mesh lives inside the geometry arena */
+	const GeometryRange& GetGeometry() const;
+
+	/* The geometry arena's VAO, shared by every mesh */
 	unsigned int GetVAO();
+	/* Reads the index buffer back from the GPU */
 	vector<unsigned int> GetIndices();
 private:
 	//render data
-	unsigned int VAO, VBO, EBO;
-
-	// Setup OpenGL buffers 
-	void setupMesh();
+	GeometryHandle geometry; //vertices and every LOD's indices inside the geometry arena
+	unsigned int vertexCount;
+	MeshLod lods[MAX_MESH_LODS];
+	unsigned int lodCount;
+	GLenum indexType;
 
-	void setupInstancedMesh();
+	// Copy vertices and indices into the geometry arena
+	void setupMesh(const PackedVertex* vertices, const void* indices);
+	// Find or add the material table entry for textures, and set the shader features they need
+	unsigned int registerMaterial();
 
 };
 
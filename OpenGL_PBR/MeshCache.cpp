@@ -0,0 +1,300 @@
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include "MeshCache.h"
+
+//Identifies a cooked mesh file
+static const char COOKED_MAGIC[4] = { 'M', 'S', 'H', 'C' };
+
+/* Size and modification time of a file, used to invalidate caches when the source asset changes */
+static bool GetSourceStamp(const string& path, unsigned long long& size, long long& time)
+{
+#ifdef _WIN32
+	struct _stat64 info;
+	if (_stat64(path.c_str(), &info) != 0)
+	{
+		return false;
+	}
+#else
+	struct stat info;
+	if (stat(path.c_str(), &info) != 0)
+	{
+		return false;
+	}
+#endif
+	size = (unsigned long long)info.st_size;
+	time = (long long)info.st_mtime;
+	return true;
+}
+
+/* Round offset up to the next multiple of alignment */
+static unsigned long long AlignOffset(unsigned long long offset, unsigned long long alignment)
+{
+	return (offset + alignment - 1) & ~(alignment - 1);
+}
+
+MappedFile::MappedFile()
+	: data(nullptr), size(0)
+#ifdef _WIN32
+	, fileHandle(INVALID_HANDLE_VALUE), mappingHandle(nullptr)
+#else
+	, fileDescriptor(-1)
+#endif
+{
+}
+
+MappedFile::~MappedFile()
+{
+	Close();
+}
+
+bool MappedFile::Open(const string& path)
+{
+	Close();
+#ifdef _WIN32
+	fileHandle = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+	if (fileHandle == INVALID_HANDLE_VALUE)
+	{
+		return false;
+	}
+	LARGE_INTEGER fileSize;
+	if (!GetFileSizeEx(fileHandle, &fileSize) || fileSize.QuadPart == 0)
+	{
+		Close();
+		return false;
+	}
+	mappingHandle = CreateFileMappingA(fileHandle, nullptr, PAGE_READONLY, 0, 0, nullptr);
+	if (!mappingHandle)
+	{
+		Close();
+		return false;
+	}
+	data = (const unsigned char*)MapViewOfFile(mappingHandle, FILE_MAP_READ, 0, 0, 0);
+	size = (size_t)fileSize.QuadPart;
+#else
+	fileDescriptor = open(path.c_str(), O_RDONLY);
+	if (fileDescriptor < 0)
+	{
+		return false;
+	}
+	struct stat info;
+	if (fstat(fileDescriptor, &info) != 0 || info.st_size == 0)
+	{
+		Close();
+		return false;
+	}
+	void* mapped = mmap(nullptr, (size_t)info.st_size, PROT_READ, MAP_PRIVATE, fileDescriptor, 0);
+	if (mapped == MAP_FAILED)
+	{
+		Close();
+		return false;
+	}
+	//The whole file is about to be streamed into GL buffers
+	madvise(mapped, (size_t)info.st_size, MADV_WILLNEED);
+	data = (const unsigned char*)mapped;
+	size = (size_t)info.st_size;
+#endif
+	if (!data)
+	{
+		Close();
+		return false;
+	}
+	return true;
+}
+
+void MappedFile::Close()
+{
+#ifdef _WIN32
+	if (data)
+	{
+		UnmapViewOfFile(data);
+	}
+	if (mappingHandle)
+	{
+		CloseHandle(mappingHandle);
+		mappingHandle = nullptr;
+	}
+	if (fileHandle != INVALID_HANDLE_VALUE)
+	{
+		CloseHandle(fileHandle);
+		fileHandle = INVALID_HANDLE_VALUE;
+	}
+#else
+	if (data)
+	{
+		munmap((void*)data, size);
+	}
+	if (fileDescriptor >= 0)
+	{
+		close(fileDescriptor);
+		fileDescriptor = -1;
+	}
+#endif
+	data = nullptr;
+	size = 0;
+}
+
+const unsigned char* MappedFile::GetData() const
+{
+	return data;
+}
+
+size_t MappedFile::GetSize() const
+{
+	return size;
+}
+
+MeshCache::MeshCache()
+	: header(nullptr)
+{
+}
+
+string MeshCache::GetCachePath(const string& sourcePath)
+{
+	return sourcePath + ".meshcache";
+}
+
+bool MeshCache::Open(const string& sourcePath, unsigned int importFlags)
+{
+	Close();
+
+	unsigned long long sourceSize = 0;
+	long long sourceTime = 0;
+	if (!GetSourceStamp(sourcePath, sourceSize, sourceTime))
+	{
+		return false;
+	}
+	if (!file.Open(GetCachePath(sourcePath)) || file.GetSize() < sizeof(CookedHeader))
+	{
+		file.Close();
+		return false;
+	}
+
+	//Reject anything that was not written by this exact version of the cooker for this exact source file
+	const CookedHeader* cooked = (const CookedHeader*)file.GetData();
+	bool bIsValid = memcmp(cooked->magic, COOKED_MAGIC, sizeof(COOKED_MAGIC)) == 0
+		&& cooked->version == MESH_CACHE_VERSION
+		&& cooked->vertexStride == sizeof(PackedVertex)
+		&& cooked->importFlags == importFlags
+		&& cooked->sourceSize == sourceSize
+		&& cooked->sourceTime == sourceTime
+		&& cooked->rangesOffset + cooked->meshCount * sizeof(CookedMeshRange) <= file.GetSize()
+		&& cooked->verticesOffset + (unsigned long long)cooked->vertexCount * sizeof(PackedVertex) <= file.GetSize()
+		&& cooked->indicesOffset + cooked->indexDataSize <= file.GetSize()
+		&& cooked->nodesOffset + cooked->nodeCount * sizeof(CookedNode) <= file.GetSize();
+	if (!bIsValid)
+	{
+		cout << "MESHCACHE::" << GetCachePath(sourcePath) << " is out of date" << endl;
+		file.Close();
+		return false;
+	}
+
+	header = cooked;
+	return true;
+}
+
+void MeshCache::Close()
+{
+	header = nullptr;
+	file.Close();
+}
+
+const CookedHeader& MeshCache::GetHeader() const
+{
+	return *header;
+}
+
+const CookedMeshRange* MeshCache::GetRanges() const
+{
+	return (const CookedMeshRange*)(file.GetData() + header->rangesOffset);
+}
+
+const CookedNode* MeshCache::GetNodes() const
+{
+	return (const CookedNode*)(file.GetData() + header->nodesOffset);
+}
+
+const PackedVertex* MeshCache::GetVertices() const
+{
+	return (const PackedVertex*)(file.GetData() + header->verticesOffset);
+}
+
+const unsigned char* MeshCache::GetIndexData() const
+{
+	return file.GetData() + header->indicesOffset;
+}
+
+bool MeshCache::Write(const string& sourcePath, unsigned int importFlags, const CookedModel& model)
+{
+	const vector<CookedMeshRange>& ranges = model.ranges;
+	const vector<PackedVertex>& vertices = model.vertices;
+	const vector<unsigned char>& indexData = model.indexData;
+	const vector<CookedNode>& nodes = model.nodes;
+
+	CookedHeader cooked;
+	memset(&cooked, 0, sizeof(cooked));
+	memcpy(cooked.magic, COOKED_MAGIC, sizeof(COOKED_MAGIC));
+	cooked.version = MESH_CACHE_VERSION;
+	if (!GetSourceStamp(sourcePath, cooked.sourceSize, cooked.sourceTime))
+	{
+		return false;
+	}
+	cooked.importFlags = importFlags;
+	cooked.vertexStride = sizeof(PackedVertex);
+	cooked.meshCount = (unsigned int)ranges.size();
+	cooked.vertexCount = (unsigned int)vertices.size();
+	cooked.indexDataSize = (unsigned int)indexData.size();
+	cooked.nodeCount = (unsigned int)nodes.size();
+	//Keep every blob 16 byte aligned so the mapped pointers can be used directly
+	cooked.rangesOffset = AlignOffset(sizeof(CookedHeader), 16);
+	cooked.nodesOffset = AlignOffset(cooked.rangesOffset + ranges.size() * sizeof(CookedMeshRange), 16);
+	cooked.verticesOffset = AlignOffset(cooked.nodesOffset + nodes.size() * sizeof(CookedNode), 16);
+	cooked.indicesOffset = AlignOffset(cooked.verticesOffset + vertices.size() * sizeof(PackedVertex), 16);
+
+	//Write to a temporary file first so a crash never leaves a half written cache behind
+	string cachePath = GetCachePath(sourcePath);
+	string tempPath = cachePath + ".tmp";
+	{
+		ofstream out(tempPath, ios::binary | ios::trunc);
+		if (!out)
+		{
+			return false;
+		}
+		const char zeros[16] = {};
+		out.write((const char*)&cooked, sizeof(cooked));
+		out.write(zeros, cooked.rangesOffset - sizeof(cooked));
+		out.write((const char*)ranges.data(), ranges.size() * sizeof(CookedMeshRange));
+		out.write(zeros, cooked.nodesOffset - (cooked.rangesOffset + ranges.size() * sizeof(CookedMeshRange)));
+		out.write((const char*)nodes.data(), nodes.size() * sizeof(CookedNode));
+		out.write(zeros, cooked.verticesOffset - (cooked.nodesOffset + nodes.size() * sizeof(CookedNode)));
+		out.write((const char*)vertices.data(), vertices.size() * sizeof(PackedVertex));
+		out.write(zeros, cooked.indicesOffset - (cooked.verticesOffset + vertices.size() * sizeof(PackedVertex)));
+		out.write((const char*)indexData.data(), indexData.size());
+		if (!out)
+		{
+			out.close();
+			remove(tempPath.c_str());
+			return false;
+		}
+	}
+	remove(cachePath.c_str());
+	if (rename(tempPath.c_str(), cachePath.c_str()) != 0)
+	{
+		remove(tempPath.c_str());
+		return false;
+	}
+
+	cout << cachePath << " written" << endl;
+	return true;
+}
@@ -0,0 +1,122 @@
+#pragma once
+#include <string>
+#include <vector>
+#include <glm/glm.hpp>
+
+#include "Mesh.h"
+
+using namespace std;
+using namespace glm;
+
+//Bump whenever the layout of a cooked file or the way it is cooked changes so older caches get re-imported
+#define MESH_CACHE_VERSION 8
+
+/* Describes one mesh inside a cooked file. Vertex offsets are in vertices, index offsets are in bytes because
+each mesh picks its own index size. The LODs of a mesh are stored back to back, starting with full detail */
+struct CookedMeshRange
+{
+	unsigned int vertexOffset;
+	unsigned int vertexCount;
+	unsigned int lodCount;
+	MeshLod lods[MAX_MESH_LODS]; //offsets are from the start of the index blob
+	unsigned int indexType; //GL_UNSIGNED_SHORT for meshes with fewer than 65536 vertices, otherwise GL_UNSIGNED_INT
+	unsigned int materialIndex; //material slot from the source file
+	vec3 boundsMin; //object space AABB, also the range positions are quantized to
+	vec3 boundsMax;
+	vec4 boundingSphere; //object space, xyz is the centre and w the radius
+	unsigned int node; //node the mesh hangs off, its transform places the mesh in the model
+};
+
+/* One node of the source file's node tree, parents always come before their children */
+struct CookedNode
+{
+	vec4 rotation; //quaternion, xyzw
+	vec3 translation;
+	int parent; //-1 for the root
+	vec3 scale;
+	unsigned int padding;
+};
+
+/* Imported model data in the same layout it is stored on disk */
+struct CookedModel
+{
+	vector<CookedMeshRange> ranges;
+	vector<CookedNode> nodes;
+	vector<PackedVertex> vertices;
+	vector<unsigned char> indexData; //mix of 16 and 32 bit indices, each range starts 4 byte aligned
+};
+
+/* Fixed size header at the start of every cooked file */
+struct CookedHeader
+{
+	char magic[4];
+	unsigned int version;
+	unsigned long long sourceSize; //used to detect that the source asset has changed since it was cooked
+	long long sourceTime;
+	unsigned int importFlags; //Assimp post-process flags the data was generated with
+	unsigned int vertexStride;
+	unsigned int meshCount;
+	unsigned int vertexCount;
+	unsigned int indexDataSize; //in bytes
+	unsigned int nodeCount;
+	//byte offsets from the start of the file
+	unsigned long long rangesOffset;
+	unsigned long long verticesOffset;
+	unsigned long long indicesOffset;
+	unsigned long long nodesOffset;
+};
+
+/* Read-only view of a whole file mapped into memory */
+class MappedFile
+{
+public:
+	MappedFile();
+	~MappedFile();
+
+	bool Open(const string& path);
+	void Close();
+
+	const unsigned char* GetData() const;
+	size_t GetSize() const;
+
+private:
+	const unsigned char* data;
+	size_t size;
+#ifdef _WIN32
+	void* fileHandle;
+	void* mappingHandle;
+#else
+	int fileDescriptor;
+#endif
+
+	MappedFile(const MappedFile&) = delete;
+	MappedFile& operator=(const MappedFile&) = delete;
+};
+
+/* On-disk cache of imported meshes. The first import of a model writes an interleaved vertex blob, an index blob
+and per-mesh ranges next to the source file, later loads map that file and upload it without going through Assimp*/
+class MeshCache
+{
+public:
+	MeshCache();
+
+	/* Location of the cooked file for a source asset */
+	static string GetCachePath(const string& sourcePath);
+
+	/* Map the cooked file for sourcePath. Fails if it is missing, out of date or was cooked with different settings */
+	bool Open(const string& sourcePath, unsigned int importFlags);
+	void Close();
+
+	const CookedHeader& GetHeader() const;
+	const CookedMeshRange* GetRanges() const;
+	const CookedNode* GetNodes() const;
+	const PackedVertex* GetVertices() const;
+	const unsigned char* GetIndexData() const;
+
+	/* Write imported data to the cooked file for sourcePath, replacing any previous version */
+	static bool Write(const string& sourcePath, unsigned int importFlags, const CookedModel& model);
+
+private:
+	MappedFile file;
+	const CookedHeader* header;
+};
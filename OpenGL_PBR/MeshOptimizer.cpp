@@ -0,0 +1,352 @@
+#include <iostream>
+#include <algorithm>
+#include <cstring>
+#include <cmath>
+#include "MeshOptimizer.h"
+
+//Hash of every byte in a vertex, FNV-1a over 32 bit words
+static unsigned int hashVertex(const Vertex& vertex)
+{
+	unsigned int words[sizeof(Vertex) / sizeof(unsigned int)];
+	memcpy(words, &vertex, sizeof(Vertex));
+	unsigned int hash = 2166136261u;
+	for (unsigned int i = 0; i < sizeof(Vertex) / sizeof(unsigned int); i++)
+	{
+		hash ^= words[i];
+		hash *= 16777619u;
+	}
+	return hash;
+}
+
+VertexCacheStatistics AnalyzeVertexCache(const vector<unsigned int>& indices, size_t vertexCount, unsigned int cacheSize)
+{
+	VertexCacheStatistics statistics;
+	statistics.ACMR = 0.0f;
+	statistics.ATVR = 0.0f;
+	if (indices.size() < 3 || vertexCount == 0)
+	{
+		return statistics;
+	}
+
+	//A vertex is still in the cache as long as fewer than cacheSize misses happened since it was last transformed
+	vector<unsigned int> cacheTime(vertexCount, 0);
+	unsigned int time = cacheSize + 1;
+	unsigned int misses = 0;
+	for (size_t i = 0; i < indices.size(); i++)
+	{
+		unsigned int index = indices[i];
+		if (time - cacheTime[index] > cacheSize)
+		{
+			cacheTime[index] = time++;
+			misses++;
+		}
+	}
+
+	statistics.ACMR = float(misses) / float(indices.size() / 3);
+	statistics.ATVR = float(misses) / float(vertexCount);
+	return statistics;
+}
+
+void WeldVertices(vector<Vertex>& vertices, vector<unsigned int>& indices)
+{
+	if (vertices.empty())
+	{
+		return;
+	}
+
+	//Open addressing table sized to the next power of two above twice the vertex count
+	size_t tableSize = 1;
+	while (tableSize < vertices.size() * 2)
+	{
+		tableSize *= 2;
+	}
+	const unsigned int empty = ~0u;
+	vector<unsigned int> table(tableSize, empty);
+
+	vector<unsigned int> remap(vertices.size());
+	unsigned int uniqueCount = 0;
+	for (size_t i = 0; i < vertices.size(); i++)
+	{
+		size_t slot = hashVertex(vertices[i]) & (tableSize - 1);
+		while (table[slot] != empty && memcmp(&vertices[table[slot]], &vertices[i], sizeof(Vertex)) != 0)
+		{
+			slot = (slot + 1) & (tableSize - 1);
+		}
+		if (table[slot] == empty)
+		{
+			//First time this vertex has been seen, compact it down to the end of the unique range
+			vertices[uniqueCount] = vertices[i];
+			table[slot] = uniqueCount++;
+		}
+		remap[i] = table[slot];
+	}
+
+	vertices.resize(uniqueCount);
+	for (size_t i = 0; i < indices.size(); i++)
+	{
+		indices[i] = remap[indices[i]];
+	}
+}
+
+void OptimizeVertexCache(vector<unsigned int>& indices, size_t vertexCount, vector<unsigned int>& clusterStarts)
+{
+	clusterStarts.clear();
+	const size_t triangleCount = indices.size() / 3;
+	if (triangleCount == 0)
+	{
+		return;
+	}
+
+	//Build vertex to triangle adjacency
+	vector<unsigned int> liveTriangles(vertexCount, 0);
+	for (size_t i = 0; i < triangleCount * 3; i++)
+	{
+		liveTriangles[indices[i]]++;
+	}
+	vector<unsigned int> adjacencyOffset(vertexCount + 1, 0);
+	for (size_t i = 0; i < vertexCount; i++)
+	{
+		adjacencyOffset[i + 1] = adjacencyOffset[i] + liveTriangles[i];
+	}
+	vector<unsigned int> adjacency(triangleCount * 3);
+	vector<unsigned int> fill(adjacencyOffset.begin(), adjacencyOffset.end() - 1);
+	for (size_t i = 0; i < triangleCount * 3; i++)
+	{
+		adjacency[fill[indices[i]]++] = i / 3;
+	}
+
+	const unsigned int cacheSize = VERTEX_CACHE_SIZE;
+	vector<unsigned int> cacheTime(vertexCount, 0);
+	vector<bool> bIsEmitted(triangleCount, false);
+	vector<unsigned int> deadEnd; //recently used vertices that may still have triangles left
+	vector<unsigned int> candidates;
+	vector<unsigned int> result;
+	result.reserve(triangleCount * 3);
+
+	unsigned int time = cacheSize + 1;
+	size_t cursor = 0; //next vertex to try once the dead end stack has run dry
+	long long fanning = indices[0];
+	clusterStarts.push_back(0);
+
+	while (fanning >= 0)
+	{
+		//Emit every remaining triangle around the fanning vertex
+		candidates.clear();
+		for (unsigned int a = adjacencyOffset[fanning]; a < adjacencyOffset[fanning + 1]; a++)
+		{
+			unsigned int triangle = adjacency[a];
+			if (bIsEmitted[triangle])
+			{
+				continue;
+			}
+			for (unsigned int k = 0; k < 3; k++)
+			{
+				unsigned int v = indices[triangle * 3 + k];
+				result.push_back(v);
+				deadEnd.push_back(v);
+				candidates.push_back(v);
+				liveTriangles[v]--;
+				if (time - cacheTime[v] > cacheSize)
+				{
+					cacheTime[v] = time++;
+				}
+			}
+			bIsEmitted[triangle] = true;
+		}
+
+		//Pick the candidate that will still be in the cache once all of its triangles are emitted, preferring the oldest
+		long long next = -1;
+		int bestPriority = -1;
+		for (size_t i = 0; i < candidates.size(); i++)
+		{
+			unsigned int v = candidates[i];
+			if (liveTriangles[v] == 0)
+			{
+				continue;
+			}
+			int priority = 0;
+			if (time - cacheTime[v] + 2 * liveTriangles[v] <= cacheSize)
+			{
+				priority = time - cacheTime[v];
+			}
+			if (priority > bestPriority)
+			{
+				bestPriority = priority;
+				next = v;
+			}
+		}
+
+		if (next < 0)
+		{
+			//Dead end, fall back to the most recently used vertex that still has work, else the next in input order
+			while (!deadEnd.empty() && next < 0)
+			{
+				unsigned int v = deadEnd.back();
+				deadEnd.pop_back();
+				if (liveTriangles[v] > 0)
+				{
+					next = v;
+				}
+			}
+			while (next < 0 && cursor < vertexCount)
+			{
+				if (liveTriangles[cursor] > 0)
+				{
+					next = cursor;
+					//Jumping to an unrelated vertex means the cache no longer holds anything useful
+					if (result.size() / 3 < triangleCount)
+					{
+						clusterStarts.push_back(result.size() / 3);
+					}
+				}
+				cursor++;
+			}
+		}
+		fanning = next;
+	}
+
+	indices.swap(result);
+}
+
+void OptimizeOverdraw(vector<unsigned int>& indices, const vector<Vertex>& vertices, const vector<unsigned int>& clusterStarts, float threshold)
+{
+	const size_t triangleCount = indices.size() / 3;
+	if (triangleCount == 0 || clusterStarts.empty())
+	{
+		return;
+	}
+
+	//Split the hard clusters wherever the cache efficiency so far is close enough to the whole mesh
+	const float targetACMR = AnalyzeVertexCache(indices, vertices.size()).ACMR * threshold;
+	vector<unsigned int> starts;
+	vector<unsigned int> cacheTime(vertices.size(), 0);
+	unsigned int time = VERTEX_CACHE_SIZE + 1;
+	for (size_t c = 0; c < clusterStarts.size(); c++)
+	{
+		size_t end = c + 1 < clusterStarts.size() ? clusterStarts[c + 1] : triangleCount;
+		size_t start = clusterStarts[c];
+		starts.push_back(start);
+
+		//Flush the cache so each cluster is measured on its own, as it would be once it has been moved
+		time += VERTEX_CACHE_SIZE + 1;
+		unsigned int misses = 0;
+		for (size_t t = start; t < end; t++)
+		{
+			for (unsigned int k = 0; k < 3; k++)
+			{
+				unsigned int v = indices[t * 3 + k];
+				if (time - cacheTime[v] > VERTEX_CACHE_SIZE)
+				{
+					cacheTime[v] = time++;
+					misses++;
+				}
+			}
+			size_t clusterTriangles = t + 1 - starts.back();
+			if (t + 1 < end && float(misses) <= targetACMR * float(clusterTriangles))
+			{
+				starts.push_back(t + 1);
+				time += VERTEX_CACHE_SIZE + 1;
+				misses = 0;
+			}
+		}
+	}
+
+	//Area weighted centroid of the whole mesh
+	struct Cluster
+	{
+		unsigned int start;
+		unsigned int end;
+		float sortKey;
+	};
+	vector<vec3> centroids(starts.size(), vec3(0.0f));
+	vector<vec3> normals(starts.size(), vec3(0.0f));
+	vector<float> areas(starts.size(), 0.0f);
+	vec3 meshCentroid = vec3(0.0f);
+	float meshArea = 0.0f;
+	for (size_t c = 0; c < starts.size(); c++)
+	{
+		size_t end = c + 1 < starts.size() ? starts[c + 1] : triangleCount;
+		for (size_t t = starts[c]; t < end; t++)
+		{
+			const vec3& p0 = vertices[indices[t * 3 + 0]].Position;
+			const vec3& p1 = vertices[indices[t * 3 + 1]].Position;
+			const vec3& p2 = vertices[indices[t * 3 + 2]].Position;
+			vec3 normal = cross(p1 - p0, p2 - p0); //length is twice the triangle area
+			float area = length(normal);
+			centroids[c] += (p0 + p1 + p2) * (area / 3.0f);
+			normals[c] += normal;
+			areas[c] += area;
+		}
+		meshCentroid += centroids[c];
+		meshArea += areas[c];
+	}
+	if (meshArea > 0.0f)
+	{
+		meshCentroid /= meshArea;
+	}
+
+	//Clusters that face away from the centre are the outer surface and are likely to occlude everything else
+	vector<Cluster> clusters(starts.size());
+	for (size_t c = 0; c < starts.size(); c++)
+	{
+		clusters[c].start = starts[c];
+		clusters[c].end = c + 1 < starts.size() ? starts[c + 1] : triangleCount;
+		clusters[c].sortKey = 0.0f;
+		float normalLength = length(normals[c]);
+		if (areas[c] > 0.0f && normalLength > 0.0f)
+		{
+			vec3 centroid = centroids[c] / areas[c];
+			clusters[c].sortKey = dot(centroid - meshCentroid, normals[c] / normalLength);
+		}
+	}
+	stable_sort(clusters.begin(), clusters.end(), [](const Cluster& a, const Cluster& b) { return a.sortKey > b.sortKey; });
+
+	vector<unsigned int> result;
+	result.reserve(indices.size());
+	for (size_t c = 0; c < clusters.size(); c++)
+	{
+		result.insert(result.end(), indices.begin() + clusters[c].start * 3, indices.begin() + clusters[c].end * 3);
+	}
+	indices.swap(result);
+}
+
+void OptimizeVertexFetch(vector<Vertex>& vertices, vector<unsigned int>& indices)
+{
+	const unsigned int unused = ~0u;
+	vector<unsigned int> remap(vertices.size(), unused);
+	vector<Vertex> result;
+	result.reserve(vertices.size());
+	for (size_t i = 0; i < indices.size(); i++)
+	{
+		unsigned int& index = indices[i];
+		if (remap[index] == unused)
+		{
+			remap[index] = result.size();
+			result.push_back(vertices[index]);
+		}
+		index = remap[index];
+	}
+	vertices.swap(result);
+}
+
+void OptimizeMesh(vector<Vertex>& vertices, vector<unsigned int>& indices, const string& name)
+{
+	//Nothing to reorder without complete triangles
+	if (indices.size() < 3 || indices.size() % 3 != 0)
+	{
+		return;
+	}
+
+	size_t sourceVertexCount = vertices.size();
+	VertexCacheStatistics before = AnalyzeVertexCache(indices, vertices.size());
+
+	WeldVertices(vertices, indices);
+	vector<unsigned int> clusterStarts;
+	OptimizeVertexCache(indices, vertices.size(), clusterStarts);
+	OptimizeOverdraw(indices, vertices, clusterStarts);
+	OptimizeVertexFetch(vertices, indices);
+
+	VertexCacheStatistics after = AnalyzeVertexCache(indices, vertices.size());
+	cout << "Optimized mesh " << name << ": " << sourceVertexCount << " -> " << vertices.size() << " vertices, "
+		<< "ACMR " << before.ACMR << " -> " << after.ACMR << ", ATVR " << before.ATVR << " -> " << after.ATVR << endl;
+}
@@ -0,0 +1,37 @@
+#pragma once
+#include <string>
+#include <vector>
+
+#include "Mesh.h"
+
+using namespace std;
+
+//Size of the simulated post-transform cache used when ordering and measuring triangles
+#define VERTEX_CACHE_SIZE 16
+
+/* Post-transform cache efficiency of an index buffer */
+struct VertexCacheStatistics
+{
+	float ACMR; //average cache miss ratio, vertex shader invocations per triangle. 0.5 is the best possible
+	float ATVR; //average transformed vertex ratio, vertex shader invocations per vertex. 1.0 is the best possible
+};
+
+/* Simulate a FIFO post-transform cache over the index buffer */
+VertexCacheStatistics AnalyzeVertexCache(const vector<unsigned int>& indices, size_t vertexCount, unsigned int cacheSize = VERTEX_CACHE_SIZE);
+
+/* Merge vertices whose attributes are bit for bit identical and rewrite the indices to match */
+void WeldVertices(vector<Vertex>& vertices, vector<unsigned int>& indices);
+
+/* Reorder triangles for post-transform cache locality using Tipsify (Sander et al. 2007).
+clusterStarts receives the first triangle of every run that begins after a cache flush */
+void OptimizeVertexCache(vector<unsigned int>& indices, size_t vertexCount, vector<unsigned int>& clusterStarts);
+
+/* Reorder clusters of triangles so outward facing surfaces are drawn first, which reduces overdraw.
+Clusters are split further as long as their own cache efficiency stays within threshold of the whole mesh */
+void OptimizeOverdraw(vector<unsigned int>& indices, const vector<Vertex>& vertices, const vector<unsigned int>& clusterStarts, float threshold = 1.05f);
+
+/* Reorder vertices in the order they are first referenced so vertex fetch reads memory linearly. Unused vertices are removed */
+void OptimizeVertexFetch(vector<Vertex>& vertices, vector<unsigned int>& indices);
+
+/* Run every stage above on a mesh and print its cache statistics before and after */
+void OptimizeMesh(vector<Vertex>& vertices, vector<unsigned int>& indices, const string& name);
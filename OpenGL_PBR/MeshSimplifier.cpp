@@ -0,0 +1,446 @@
+#include <algorithm>
+#include <unordered_map>
+#include <cstring>
+#include <cmath>
+#include "MeshSimplifier.h"
+#include "MeshOptimizer.h"
+
+/* Symmetric 4x4 matrix that sums squared distances to a set of weighted planes */
+struct Quadric
+{
+	double a2, ab, ac, ad;
+	double b2, bc, bd;
+	double c2, cd;
+	double d2;
+	double weight;
+};
+
+/* How freely a group of vertices that share a position may be collapsed */
+enum EVertexKind
+{
+	MANIFOLD, //every edge is shared by two triangles
+	BORDER, //on a single open border, may only collapse along it
+	LOCKED //non-manifold or where borders meet
+};
+
+/* Collapse of every vertex at one position onto a neighbouring position */
+struct Collapse
+{
+	unsigned int from; //any vertex at the position that is removed
+	unsigned int to; //any vertex at the position that is kept
+	float cost;
+};
+
+static void addPlane(Quadric& q, vec3 normal, float distance, float weight)
+{
+	double a = normal.x, b = normal.y, c = normal.z, d = distance, w = weight;
+	q.a2 += w * a * a; q.ab += w * a * b; q.ac += w * a * c; q.ad += w * a * d;
+	q.b2 += w * b * b; q.bc += w * b * c; q.bd += w * b * d;
+	q.c2 += w * c * c; q.cd += w * c * d;
+	q.d2 += w * d * d;
+	q.weight += w;
+}
+
+static void addQuadric(Quadric& q, const Quadric& other)
+{
+	q.a2 += other.a2; q.ab += other.ab; q.ac += other.ac; q.ad += other.ad;
+	q.b2 += other.b2; q.bc += other.bc; q.bd += other.bd;
+	q.c2 += other.c2; q.cd += other.cd;
+	q.d2 += other.d2;
+	q.weight += other.weight;
+}
+
+//Weighted mean squared distance from point to the planes of q
+static float quadricError(const Quadric& q, vec3 point)
+{
+	double x = point.x, y = point.y, z = point.z;
+	double error = q.a2 * x * x + 2.0 * q.ab * x * y + 2.0 * q.ac * x * z + 2.0 * q.ad * x
+		+ q.b2 * y * y + 2.0 * q.bc * y * z + 2.0 * q.bd * y
+		+ q.c2 * z * z + 2.0 * q.cd * z
+		+ q.d2;
+	return q.weight > 0.0 ? float(fabs(error) / q.weight) : 0.0f;
+}
+
+static unsigned long long edgeKey(unsigned int a, unsigned int b)
+{
+	return a < b ? ((unsigned long long)a << 32) | b : ((unsigned long long)b << 32) | a;
+}
+
+/* Map every vertex to the first vertex with the same position, and link vertices at the same position into rings */
+static void buildPositionGroups(const vector<Vertex>& vertices, vector<unsigned int>& positionRemap, vector<unsigned int>& wedges)
+{
+	size_t tableSize = 1;
+	while (tableSize < vertices.size() * 2)
+	{
+		tableSize *= 2;
+	}
+	const unsigned int empty = ~0u;
+	vector<unsigned int> table(tableSize, empty);
+
+	positionRemap.resize(vertices.size());
+	wedges.resize(vertices.size());
+	for (size_t i = 0; i < vertices.size(); i++)
+	{
+		unsigned int words[3];
+		memcpy(words, &vertices[i].Position, sizeof(words));
+		unsigned int hash = (words[0] * 73856093u) ^ (words[1] * 19349663u) ^ (words[2] * 83492791u);
+		size_t slot = hash & (tableSize - 1);
+		while (table[slot] != empty && memcmp(&vertices[table[slot]].Position, &vertices[i].Position, sizeof(vec3)) != 0)
+		{
+			slot = (slot + 1) & (tableSize - 1);
+		}
+		if (table[slot] == empty)
+		{
+			table[slot] = i;
+			positionRemap[i] = i;
+			wedges[i] = i;
+		}
+		else
+		{
+			//Insert into the ring after the first vertex at this position
+			unsigned int first = table[slot];
+			positionRemap[i] = first;
+			wedges[i] = wedges[first];
+			wedges[first] = i;
+		}
+	}
+}
+
+vector<unsigned int> SimplifyMesh(const vector<Vertex>& vertices, const vector<unsigned int>& indices, size_t targetIndexCount, float& error)
+{
+	error = 0.0f;
+	const size_t vertexCount = vertices.size();
+
+	vector<unsigned int> positionRemap;
+	vector<unsigned int> wedges;
+	buildPositionGroups(vertices, positionRemap, wedges);
+
+	//Drop triangles that are already degenerate
+	vector<unsigned int> result;
+	result.reserve(indices.size());
+	for (size_t i = 0; i + 2 < indices.size(); i += 3)
+	{
+		unsigned int p0 = positionRemap[indices[i]], p1 = positionRemap[indices[i + 1]], p2 = positionRemap[indices[i + 2]];
+		if (p0 != p1 && p1 != p2 && p0 != p2)
+		{
+			result.insert(result.end(), indices.begin() + i, indices.begin() + i + 3);
+		}
+	}
+
+	//Every position starts out with the planes of the triangles around it, weighted by area
+	Quadric zero;
+	memset(&zero, 0, sizeof(zero));
+	vector<Quadric> quadrics(vertexCount, zero);
+	for (size_t i = 0; i < result.size(); i += 3)
+	{
+		vec3 p0 = vertices[result[i]].Position, p1 = vertices[result[i + 1]].Position, p2 = vertices[result[i + 2]].Position;
+		vec3 normal = cross(p1 - p0, p2 - p0);
+		float area = length(normal);
+		if (area <= 0.0f)
+		{
+			continue;
+		}
+		normal /= area;
+		for (unsigned int k = 0; k < 3; k++)
+		{
+			addPlane(quadrics[positionRemap[result[i + k]]], normal, -dot(normal, p0), area * 0.5f);
+		}
+	}
+
+	unordered_map<unsigned long long, unsigned int> edgeCounts;
+	vector<unsigned char> kinds(vertexCount);
+	vector<unsigned char> borderEdges(vertexCount);
+	vector<unsigned int> triangleOffsets(vertexCount + 1);
+	vector<unsigned int> vertexTriangles;
+	vector<Collapse> collapses;
+	vector<bool> bIsCollapseLocked(vertexCount);
+	vector<unsigned int> vertexRemap(vertexCount);
+	bool bAreBorderPlanesAdded = false;
+
+	while (result.size() > targetIndexCount)
+	{
+		//Classify positions by how many triangles share each of their edges
+		edgeCounts.clear();
+		for (size_t i = 0; i < result.size(); i += 3)
+		{
+			for (unsigned int k = 0; k < 3; k++)
+			{
+				edgeCounts[edgeKey(positionRemap[result[i + k]], positionRemap[result[i + (k + 1) % 3]])]++;
+			}
+		}
+		fill(kinds.begin(), kinds.end(), (unsigned char)MANIFOLD);
+		fill(borderEdges.begin(), borderEdges.end(), (unsigned char)0);
+		for (unordered_map<unsigned long long, unsigned int>::iterator it = edgeCounts.begin(); it != edgeCounts.end(); ++it)
+		{
+			unsigned int a = (unsigned int)(it->first >> 32), b = (unsigned int)(it->first & 0xFFFFFFFF);
+			if (it->second > 2)
+			{
+				kinds[a] = kinds[b] = LOCKED;
+			}
+			else if (it->second == 1)
+			{
+				borderEdges[a]++;
+				borderEdges[b]++;
+			}
+		}
+		for (size_t i = 0; i < vertexCount; i++)
+		{
+			if (kinds[i] != LOCKED && borderEdges[i] > 0)
+			{
+				kinds[i] = borderEdges[i] == 2 ? BORDER : LOCKED;
+			}
+		}
+
+		//Borders get an extra plane at right angles to the surface so collapsing along them keeps their shape
+		if (!bAreBorderPlanesAdded)
+		{
+			for (size_t i = 0; i < result.size(); i += 3)
+			{
+				vec3 p0 = vertices[result[i]].Position, p1 = vertices[result[i + 1]].Position, p2 = vertices[result[i + 2]].Position;
+				vec3 normal = cross(p1 - p0, p2 - p0);
+				if (length(normal) <= 0.0f)
+				{
+					continue;
+				}
+				normal = normalize(normal);
+				for (unsigned int k = 0; k < 3; k++)
+				{
+					unsigned int a = positionRemap[result[i + k]], b = positionRemap[result[i + (k + 1) % 3]];
+					if (edgeCounts[edgeKey(a, b)] != 1)
+					{
+						continue;
+					}
+					vec3 edge = vertices[b].Position - vertices[a].Position;
+					float edgeLength = length(edge);
+					vec3 edgeNormal = normalize(cross(edge, normal));
+					addPlane(quadrics[a], edgeNormal, -dot(edgeNormal, vertices[a].Position), edgeLength * edgeLength * 10.0f);
+					addPlane(quadrics[b], edgeNormal, -dot(edgeNormal, vertices[a].Position), edgeLength * edgeLength * 10.0f);
+				}
+			}
+			bAreBorderPlanesAdded = true;
+		}
+
+		//Vertex to triangle adjacency of the current index buffer
+		fill(triangleOffsets.begin(), triangleOffsets.end(), 0);
+		for (size_t i = 0; i < result.size(); i++)
+		{
+			triangleOffsets[result[i] + 1]++;
+		}
+		for (size_t i = 0; i < vertexCount; i++)
+		{
+			triangleOffsets[i + 1] += triangleOffsets[i];
+		}
+		vertexTriangles.resize(result.size());
+		vector<unsigned int> fillOffsets(triangleOffsets.begin(), triangleOffsets.end() - 1);
+		for (size_t i = 0; i < result.size(); i++)
+		{
+			vertexTriangles[fillOffsets[result[i]]++] = i / 3;
+		}
+
+		//Cost of moving each position onto each of its neighbours
+		collapses.clear();
+		for (size_t i = 0; i < result.size(); i += 3)
+		{
+			for (unsigned int k = 0; k < 6; k++)
+			{
+				unsigned int from = result[i + k % 3];
+				unsigned int to = result[i + (k < 3 ? (k + 1) % 3 : (k + 2) % 3)];
+				unsigned int fromPosition = positionRemap[from], toPosition = positionRemap[to];
+				if (kinds[fromPosition] == LOCKED)
+				{
+					continue;
+				}
+				if (kinds[fromPosition] == BORDER && (kinds[toPosition] == MANIFOLD || edgeCounts[edgeKey(fromPosition, toPosition)] != 1))
+				{
+					continue;
+				}
+				Quadric combined = quadrics[fromPosition];
+				addQuadric(combined, quadrics[toPosition]);
+				Collapse collapse;
+				collapse.from = from;
+				collapse.to = to;
+				collapse.cost = quadricError(combined, vertices[to].Position);
+				collapses.push_back(collapse);
+			}
+		}
+		sort(collapses.begin(), collapses.end(), [](const Collapse& a, const Collapse& b) { return a.cost < b.cost; });
+
+		//Apply the cheapest collapses that do not touch each other
+		fill(bIsCollapseLocked.begin(), bIsCollapseLocked.end(), false);
+		for (size_t i = 0; i < vertexCount; i++)
+		{
+			vertexRemap[i] = i;
+		}
+		size_t triangleCount = result.size() / 3;
+		size_t targetTriangleCount = targetIndexCount / 3;
+		size_t removedTriangles = 0;
+		size_t appliedCollapses = 0;
+		float passError = 0.0f;
+		for (size_t c = 0; c < collapses.size() && triangleCount - removedTriangles > targetTriangleCount; c++)
+		{
+			const Collapse& collapse = collapses[c];
+			unsigned int fromPosition = positionRemap[collapse.from], toPosition = positionRemap[collapse.to];
+			if (bIsCollapseLocked[fromPosition] || bIsCollapseLocked[toPosition])
+			{
+				continue;
+			}
+
+			//Every vertex at the removed position has to move onto exactly one vertex it already shares an edge with,
+			//otherwise attributes would be smeared across a seam
+			bool bIsValid = true;
+			unsigned int wedge = fromPosition;
+			do
+			{
+				unsigned int target = ~0u;
+				for (unsigned int t = triangleOffsets[wedge]; t < triangleOffsets[wedge + 1] && bIsValid; t++)
+				{
+					const unsigned int* triangle = &result[vertexTriangles[t] * 3];
+					for (unsigned int k = 0; k < 3; k++)
+					{
+						if (positionRemap[triangle[k]] != toPosition)
+						{
+							continue;
+						}
+						if (target != ~0u && target != triangle[k])
+						{
+							bIsValid = false;
+						}
+						target = triangle[k];
+					}
+				}
+				//Vertices that are no longer referenced can be ignored
+				if (triangleOffsets[wedge] != triangleOffsets[wedge + 1])
+				{
+					if (target == ~0u)
+					{
+						bIsValid = false;
+					}
+					vertexRemap[wedge] = target;
+				}
+				wedge = wedges[wedge];
+			} while (wedge != fromPosition && bIsValid);
+
+			//Reject collapses that would flip any of the remaining triangles
+			size_t collapsedTriangles = 0;
+			vec3 newPosition = vertices[toPosition].Position;
+			wedge = fromPosition;
+			do
+			{
+				for (unsigned int t = triangleOffsets[wedge]; t < triangleOffsets[wedge + 1] && bIsValid; t++)
+				{
+					const unsigned int* triangle = &result[vertexTriangles[t] * 3];
+					vec3 before[3], after[3];
+					bool bIsCollapsed = false;
+					for (unsigned int k = 0; k < 3; k++)
+					{
+						unsigned int position = positionRemap[triangle[k]];
+						bIsCollapsed |= position == toPosition;
+						before[k] = vertices[position].Position;
+						after[k] = position == fromPosition ? newPosition : before[k];
+					}
+					if (bIsCollapsed)
+					{
+						collapsedTriangles++;
+						continue;
+					}
+					vec3 normalBefore = cross(before[1] - before[0], before[2] - before[0]);
+					vec3 normalAfter = cross(after[1] - after[0], after[2] - after[0]);
+					if (dot(normalBefore, normalAfter) <= 0.0f)
+					{
+						bIsValid = false;
+					}
+				}
+				wedge = wedges[wedge];
+			} while (wedge != fromPosition && bIsValid);
+
+			if (!bIsValid)
+			{
+				//Undo any remapping done while validating
+				wedge = fromPosition;
+				do
+				{
+					vertexRemap[wedge] = wedge;
+					wedge = wedges[wedge];
+				} while (wedge != fromPosition);
+				continue;
+			}
+
+			//Lock the whole neighbourhood so the adjacency stays correct for the rest of the pass
+			wedge = fromPosition;
+			do
+			{
+				for (unsigned int t = triangleOffsets[wedge]; t < triangleOffsets[wedge + 1]; t++)
+				{
+					const unsigned int* triangle = &result[vertexTriangles[t] * 3];
+					for (unsigned int k = 0; k < 3; k++)
+					{
+						bIsCollapseLocked[positionRemap[triangle[k]]] = true;
+					}
+				}
+				wedge = wedges[wedge];
+			} while (wedge != fromPosition);
+			bIsCollapseLocked[fromPosition] = true;
+			bIsCollapseLocked[toPosition] = true;
+
+			addQuadric(quadrics[toPosition], quadrics[fromPosition]);
+			removedTriangles += collapsedTriangles;
+			passError = std::max(passError, collapse.cost);
+			appliedCollapses++;
+		}
+
+		if (appliedCollapses == 0)
+		{
+			break;
+		}
+		error = std::max(error, passError);
+
+		//Rewrite the index buffer and drop triangles that collapsed to nothing
+		size_t write = 0;
+		for (size_t i = 0; i < result.size(); i += 3)
+		{
+			unsigned int v0 = vertexRemap[result[i]], v1 = vertexRemap[result[i + 1]], v2 = vertexRemap[result[i + 2]];
+			unsigned int p0 = positionRemap[v0], p1 = positionRemap[v1], p2 = positionRemap[v2];
+			if (p0 != p1 && p1 != p2 && p0 != p2)
+			{
+				result[write++] = v0;
+				result[write++] = v1;
+				result[write++] = v2;
+			}
+		}
+		result.resize(write);
+	}
+
+	//Costs are squared distances
+	error = sqrt(error);
+	return result;
+}
+
+void GenerateLodChain(const vector<Vertex>& vertices, const vector<unsigned int>& indices, unsigned int lodCount,
+	vector<vector<unsigned int>>& lodIndices, vector<float>& lodErrors)
+{
+	lodIndices.clear();
+	lodErrors.clear();
+	size_t previousIndexCount = indices.size();
+	float previousError = 0.0f;
+	for (unsigned int lod = 1; lod < lodCount; lod++)
+	{
+		//Each level starts from the full detail mesh so errors do not build up through the chain
+		size_t targetIndexCount = (indices.size() >> lod) / 3 * 3;
+		float error = 0.0f;
+		vector<unsigned int> simplified = SimplifyMesh(vertices, indices, targetIndexCount, error);
+
+		//Not worth another level if the mesh could barely be simplified further
+		if (simplified.size() < 3 || simplified.size() > previousIndexCount * 4 / 5)
+		{
+			break;
+		}
+
+		vector<unsigned int> clusterStarts;
+		OptimizeVertexCache(simplified, vertices.size(), clusterStarts);
+
+		previousError = std::max(previousError, error);
+		previousIndexCount = simplified.size();
+		lodIndices.push_back(simplified);
+		lodErrors.push_back(previousError);
+	}
+}
@@ -0,0 +1,18 @@
+#pragma once
+#include <vector>
+
+#include "Mesh.h"
+
+using namespace std;
+
+/* Simplify a mesh with quadric error metrics (Garland and Heckbert 1997) by collapsing vertices onto their neighbours.
+No vertices are created or moved, so the result indexes the same vertex buffer as the input. Vertices that share a position
+but not their attributes collapse together, open borders only collapse along themselves and non-manifold vertices are left alone.
+Stops once the index count reaches targetIndexCount or nothing else can be collapsed. error receives the largest
+distance, in object space, between the simplified and the original surface */
+vector<unsigned int> SimplifyMesh(const vector<Vertex>& vertices, const vector<unsigned int>& indices, size_t targetIndexCount, float& error);
+
+/* Build a chain of up to lodCount - 1 coarser index buffers, each roughly half the triangles of the previous one.
+The chain ends early once simplification stops making meaningful progress. Errors never decrease along the chain */
+void GenerateLodChain(const vector<Vertex>& vertices, const vector<unsigned int>& indices, unsigned int lodCount,
+	vector<vector<unsigned int>>& lodIndices, vector<float>& lodErrors);
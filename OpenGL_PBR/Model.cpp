@@ -1,69 +1,265 @@
 #include <assimp/Importer.hpp>
 #include <assimp/postprocess.h>
-#include <STB/stb_image.h>
 #include <algorithm>
+#include <cfloat>
 #include "Model.h"
+#include "MeshOptimizer.h"
+#include "VertexPacking.h"
+#include "MeshSimplifier.h"
+#include "FrustumCulling.h"
 
 using namespace Assimp;
 
+LodView Model::lodView;
+
+/* Local translation, rotation and scale of transform, as the transform hierarchy stores them */
+static CookedNode makeCookedNode(const aiMatrix4x4& transform, int parent)
+{
+	aiVector3D scaling, position;
+	aiQuaternion rotation;
+	transform.Decompose(scaling, rotation, position);
+	CookedNode cookedNode;
+	cookedNode.rotation = vec4(rotation.x, rotation.y, rotation.z, rotation.w);
+	cookedNode.translation = vec3(position.x, position.y, position.z);
+	cookedNode.parent = parent;
+	cookedNode.scale = vec3(scaling.x, scaling.y, scaling.z);
+	cookedNode.padding = 0;
+	return cookedNode;
+}
+
+/* The part of transform an exporter's unit and axis conversion can be: a rotation that only swaps and flips axes, and a uniform
+scale. Translation, any other rotation and non-uniform scale belong to the model and are left out */
+static aiMatrix4x4 getConversion(const aiMatrix4x4& transform)
+{
+	aiVector3D scaling, position;
+	aiQuaternion rotation;
+	transform.Decompose(scaling, rotation, position);
+	aiMatrix4x4 conversion;
+	aiMatrix3x3 axes = rotation.GetMatrix();
+	bool bIsAxisSwap = true;
+	for (unsigned int i = 0; i < 3; i++)
+	{
+		for (unsigned int j = 0; j < 3; j++)
+		{
+			float value = std::abs(axes[i][j]);
+			bIsAxisSwap = bIsAxisSwap && (value < 1e-3f || value > 1.0f - 1e-3f);
+		}
+	}
+	if (bIsAxisSwap)
+	{
+		conversion = aiMatrix4x4(axes);
+	}
+	float tolerance = 1e-3f * std::abs(scaling.x);
+	if (std::abs(scaling.y - scaling.x) <= tolerance && std::abs(scaling.z - scaling.x) <= tolerance)
+	{
+		aiMatrix4x4 scale;
+		conversion = conversion * aiMatrix4x4::Scaling(scaling, scale);
+	}
+	return conversion;
+}
+
+/* Unit and axis conversion an exporter put on the root, followed by the one it put on every top level node if they all share it */
+static aiMatrix4x4 findImportFrame(const aiNode* root)
+{
+	aiMatrix4x4 frame = getConversion(root->mTransformation);
+	if (root->mNumChildren == 0)
+	{
+		return frame;
+	}
+	aiMatrix4x4 shared = getConversion(root->mChildren[0]->mTransformation);
+	for (unsigned int i = 1; i < root->mNumChildren; i++)
+	{
+		if (!getConversion(root->mChildren[i]->mTransformation).Equal(shared, 1e-3f))
+		{
+			return frame;
+		}
+	}
+	return frame * shared;
+}
+
+LodView::LodView()
+	: position(0.0f), projectionScale(0.0f), pixelError(1.0f), bias(1.0f)
+{
+}
+
+LodView::LodView(vec3 position, float fov, float viewportHeight, float pixelError, float bias)
+	: position(position), projectionScale(viewportHeight / (2.0f * tan(fov * 0.5f))), pixelError(pixelError), bias(bias)
+{
+}
+
 Model::Model()
-	: bIsInstanced(false)
+	: instancePool(nullptr)
 {
 }
 
 Model::Model(const char* path)
+	: instancePool(nullptr)
 {
 	loadModel(path);
 }
 
-void Model::Draw(Shader& shader, int meshToDraw, bool bInstanced)
+void Model::Draw(Shader&, int meshToDraw)
 {
 	//Loop over each mesh in the model and render it to the screen
 	if (meshToDraw < meshes.size())
 	{
-		meshes[meshToDraw].Draw(shader, bInstanced);
+		meshes[meshToDraw].Draw(0, instancePool, getMeshTransform(meshToDraw, mat4(1.0f)));
 		return;
 	}
 	for (unsigned int i = 0; i < meshes.size(); i++)
 	{
-		meshes[i].Draw(shader, bInstanced);
+		meshes[i].Draw(0, instancePool, getMeshTransform(i, mat4(1.0f)));
 	}
 
 }
 
+void Model::Draw(Shader&, const mat4& transform, int meshToDraw)
+{
+	unsigned int first = meshToDraw >= 0 && meshToDraw < (int)meshes.size() ? meshToDraw : 0;
+	unsigned int last = meshToDraw >= 0 && meshToDraw < (int)meshes.size() ? meshToDraw + 1 : meshes.size();
+	for (unsigned int i = first; i < last; i++)
+	{
+		mat4 model = getMeshTransform(i, transform);
+		//One LOD has to suit every instance, so instanced models stay at full detail
+		meshes[i].Draw(instancePool ? 0 : selectLod(meshes[i], model), instancePool, model);
+	}
+}
+
+void Model::Draw(DrawList& drawList, const mat4& transform, int meshToDraw)
+{
+	unsigned int first = meshToDraw >= 0 && meshToDraw < (int)meshes.size() ? meshToDraw : 0;
+	unsigned int last = meshToDraw >= 0 && meshToDraw < (int)meshes.size() ? meshToDraw + 1 : meshes.size();
+	for (unsigned int i = first; i < last; i++)
+	{
+		if (instancePool)
+		{
+			//The whole pool goes out as one instanced draw, a culling draw list then tests every instance on its own
+			mat4 poolTransform = getMeshTransform(i, transform);
+			drawList.Add(meshes[i], 0, poolTransform, instancePool, viewDepth(meshes[i], poolTransform));
+			continue;
+		}
+		mat4 model = getMeshTransform(i, transform);
+		drawList.Add(meshes[i], selectLod(meshes[i], model), model, nullptr, viewDepth(meshes[i], model));
+	}
+}
+
+void Model::RequestShaderVariants(ShaderVariants& variants) const
+{
+	for (unsigned int i = 0; i < meshes.size(); i++)
+	{
+		variants.Request(meshes[i].shaderFeatures | (instancePool ? SHADER_INSTANCED : 0));
+	}
+}
+
+BoundingBox Model::GetBounds(const mat4& transform, int meshToDraw) const
+{
+	BoundingBox bounds;
+	unsigned int first = meshToDraw >= 0 && meshToDraw < (int)meshes.size() ? meshToDraw : 0;
+	unsigned int last = meshToDraw >= 0 && meshToDraw < (int)meshes.size() ? meshToDraw + 1 : meshes.size();
+	for (unsigned int i = first; i < last; i++)
+	{
+		BoundingBox meshBounds(meshes[i].boundsMin, meshes[i].boundsMax);
+		if (!instancePool)
+		{
+			bounds.Expand(meshBounds.Transformed(getMeshTransform(i, transform)));
+			continue;
+		}
+		const vector<mat4>& instanceTransforms = instancePool->GetTransforms();
+		for (size_t j = 0; j < instanceTransforms.size(); j++)
+		{
+			bounds.Expand(meshBounds.Transformed(getMeshTransform(i, transform) * instanceTransforms[j]));
+		}
+	}
+	return bounds;
+}
+
+InstancePool* Model::CreateInstancePool(unsigned int capacity)
+{
+	if (!instancePool)
+	{
+		instancePool = InstanceManager::Get().CreatePool(capacity);
+	}
+	return instancePool;
+}
+
+InstancePool* Model::GetInstancePool() const
+{
+	return instancePool;
+}
+
+mat4 Model::getMeshTransform(unsigned int mesh, const mat4& transform) const
+{
+	return transform * nodes.GetWorld(meshNodes[mesh]);
+}
+
+unsigned int Model::selectLod(const Mesh& mesh, const mat4& transform) const
+{
+	//Largest scale of the transform, so errors are never underestimated
+	float scale = std::max(length(vec3(transform[0])), std::max(length(vec3(transform[1])), length(vec3(transform[2]))));
+	if (lodView.projectionScale <= 0.0f || scale <= 0.0f)
+	{
+		return 0;
+	}
+	//Distance to the closest point of the mesh's bounding sphere
+	vec3 center = vec3(transform * vec4(vec3(mesh.boundingSphere), 1.0f));
+	float radius = mesh.boundingSphere.w * scale;
+	float distance = std::max(length(center - lodView.position) - radius, 0.001f);
+	//Screen space error to object space: pixels * distance / projectionScale gives world units
+	float maxError = lodView.pixelError * lodView.bias * distance / (lodView.projectionScale * scale);
+	return mesh.SelectLod(maxError);
+}
+
+float Model::viewDepth(const Mesh& mesh, const mat4& transform) const
+{
+	vec3 center = vec3(transform * vec4(vec3(mesh.boundingSphere), 1.0f));
+	return length(center - lodView.position);
+}
+
+void Model::SetLodView(const LodView& view)
+{
+	lodView = view;
+}
+
 void Model::setDiffuseDirectory(const string& directory)
 {
 	this->diffuseDirectory = directory;
+	TextureCache::Get().Prefetch(directory);
 }
 
 void Model::setRoughnessDirectory(const string& directory)
 {
 	this->roughnessDirectory = directory;
+	TextureCache::Get().Prefetch(directory);
 }
 
 void Model::setOpacityDirectory(const string& directory)
 {
 	this->opacityDirectory = directory;
+	TextureCache::Get().Prefetch(directory);
 }
 
 void Model::setMetallicDirectory(const string& directory)
 {
 	this->metallicDirectory = directory;
+	TextureCache::Get().Prefetch(directory);
 }
 
 void Model::setNormalDirectory(const string& directory)
 {
 	this->normalDirectory = directory;
+	TextureCache::Get().Prefetch(directory);
 }
 
 void Model::setAODirectory(const string& directory)
 {
 	this->aoDirectory = directory;
+	TextureCache::Get().Prefetch(directory);
 }
 
 void Model::setEmissiveDirectory(const string& directory)
 {
 	this->emissiveDirectory = directory;
+	TextureCache::Get().Prefetch(directory);
 }
 
 unsigned int Model::GetVAO()
@@ -78,9 +274,18 @@ vector<unsigned int> Model::GetIndices()
 
 void Model::loadModel(string path)
 {
-	Importer importer;
 	//Force model to load as triangles 
-	const aiScene* scene = importer.ReadFile(path, aiProcess_Triangulate | aiProcess_FlipUVs | aiProcess_CalcTangentSpace);
+	const unsigned int importFlags = aiProcess_Triangulate | aiProcess_FlipUVs | aiProcess_CalcTangentSpace;
+	directory = path.substr(0, path.find_last_of("/"));
+
+	//Skip Assimp entirely if the model has already been imported before
+	if (loadCookedModel(path, importFlags))
+	{
+		return;
+	}
+
+	Importer importer;
+	const aiScene* scene = importer.ReadFile(path, importFlags);
 
 	//Make sure the passed through model has been read correctly
 	if (!scene || scene->mFlags & AI_SCENE_FLAGS_INCOMPLETE || !scene->mRootNode)
@@ -88,90 +293,215 @@ void Model::loadModel(string path)
 		cout << "ERRROR::ASSIMP::" << importer.GetErrorString() << endl;
 		return;
 	}
-	directory = path.substr(0, path.find_last_of("/"));
 
-	processNode(scene->mRootNode, scene);
+	CookedModel cooked;
+	processNode(scene->mRootNode, scene, cooked);
+	//Exporters put their unit and axis conversion on the root or on every top level node (FBX from Blender is rotated -90
+	//degrees and scaled by 100, Collada files carry their unit on the root). Take only that back out above the root, so the
+	//model is in the units and axes of its vertices with every part still where it was. A conversion is an axis swap and a
+	//uniform scale, so the root still splits into translation, rotation and scale without shearing anything
+	aiMatrix4x4 frame = findImportFrame(scene->mRootNode);
+	cooked.nodes[0] = makeCookedNode(frame.Inverse() * scene->mRootNode->mTransformation, -1);
+
+	createMeshes(cooked.ranges.data(), cooked.ranges.size(), cooked.vertices.data(), cooked.indexData.data(), cooked.nodes.data(), cooked.nodes.size());
+	//One line for the whole model, how far the LOD chains got summed over every mesh
+	size_t fullTriangles = 0;
+	size_t coarsestTriangles = 0;
+	for (unsigned int i = 0; i < cooked.ranges.size(); i++)
+	{
+		fullTriangles += cooked.ranges[i].lods[0].indexCount / 3;
+		coarsestTriangles += cooked.ranges[i].lods[cooked.ranges[i].lodCount - 1].indexCount / 3;
+	}
+	cout << "Cooked " << path << ": " << cooked.ranges.size() << " meshes, " << fullTriangles << " triangles, " << coarsestTriangles
+		<< " at the coarsest LOD" << endl;
+	//Store the result so the next launch does not have to import the model again
+	if (!MeshCache::Write(path, importFlags, cooked))
+	{
+		cout << "ERROR::MESHCACHE::Failed to write " << MeshCache::GetCachePath(path) << endl;
+	}
+}
+
+bool Model::loadCookedModel(const string& path, unsigned int importFlags)
+{
+	MeshCache cache;
+	if (!cache.Open(path, importFlags))
+	{
+		return false;
+	}
+	//Buffers are filled directly from the mapped file
+	createMeshes(cache.GetRanges(), cache.GetHeader().meshCount, cache.GetVertices(), cache.GetIndexData(), cache.GetNodes(), cache.GetHeader().nodeCount);
+	cout << MeshCache::GetCachePath(path) << " loaded" << endl;
+	return true;
 }
 
-void Model::processNode(aiNode* node, const aiScene* scene)
+void Model::processNode(aiNode* node, const aiScene* scene, CookedModel& cooked, int parent)
 {
+	//Keep the node's transform relative to its parent, nodes are added before their children
+	int nodeIndex = cooked.nodes.size();
+	cooked.nodes.push_back(makeCookedNode(node->mTransformation, parent));
+
 	//process all nodes meshes
 	for (unsigned int i = 0; i < node->mNumMeshes; i++)
 	{
 		aiMesh* mesh = scene->mMeshes[node->mMeshes[i]];
-		//remove mesh from array once it has been processed
-		meshes.push_back(processMesh(mesh, scene));
+		processMesh(mesh, cooked, nodeIndex);
 	}
 	//go to next child
 	for (unsigned int i = 0; i < node->mNumChildren; i++)
 	{
-		processNode(node->mChildren[i], scene);
+		processNode(node->mChildren[i], scene, cooked, nodeIndex);
 	}
 }
 
-Mesh Model::processMesh(aiMesh* mesh, const aiScene* scene)
+void Model::processMesh(aiMesh* mesh, CookedModel& cooked, unsigned int node)
 {
-	vector<Vertex> vertices;
-	vector<unsigned int> indices;
-	vector<MTexture> textures;
+	CookedMeshRange range;
+	range.node = node;
+	range.vertexOffset = cooked.vertices.size();
+	range.materialIndex = mesh->mMaterialIndex;
+	range.boundsMin = vec3(FLT_MAX);
+	range.boundsMax = vec3(-FLT_MAX);
 
 	//setup vertices 
+	vector<Vertex> vertices(mesh->mNumVertices);
 	for (unsigned int i = 0; i < mesh->mNumVertices; i++)
 	{
-		Vertex vertex;
+		Vertex& vertex = vertices[i];
 
 		//get position of vertex
-		vec3 vector;
-		vector.x = mesh->mVertices[i].x;
-		vector.y = mesh->mVertices[i].y;
-		vector.z = mesh->mVertices[i].z;
-		vertex.Position = vector;
+		vertex.Position = vec3(mesh->mVertices[i].x, mesh->mVertices[i].y, mesh->mVertices[i].z);
+		range.boundsMin = min(range.boundsMin, vertex.Position);
+		range.boundsMax = max(range.boundsMax, vertex.Position);
 		
 		//get normals of vertices
-		vector.x = mesh->mNormals[i].x;
-		vector.y = mesh->mNormals[i].y;
-		vector.z = mesh->mNormals[i].z;
-		vertex.Normal = vector;
+		if (mesh->mNormals)
+		{
+			vertex.Normal = vec3(mesh->mNormals[i].x, mesh->mNormals[i].y, mesh->mNormals[i].z);
+		}
+		else
+		{
+			vertex.Normal = vec3(0.0, 0.0, 0.0);
+		}
 
 		//get texture coordinates of vertex
 		if (mesh->mTextureCoords[0]) //Does the imported mesh contain texture coordinates
 		{
-			vec2 vec;
-			vec.x = mesh->mTextureCoords[0][i].x;
-			vec.y = mesh->mTextureCoords[0][i].y;
-			vertex.TexCoords = vec;
-
-			//calculate incoming tangent and bit-tangent
-			vector.x = mesh->mTangents[i].x;
-			vector.y = mesh->mTangents[i].y;
-			vector.z = mesh->mTangents[i].z;
-			vertex.Tangent = vector;
+			vertex.TexCoords = vec2(mesh->mTextureCoords[0][i].x, mesh->mTextureCoords[0][i].y);
 
 			//calculate incoming tangent and bit-tangent
-			vector.x = mesh->mBitangents[i].x;
-			vector.y = mesh->mBitangents[i].y;
-			vector.z = mesh->mBitangents[i].z;
-			vertex.Bitangent = vector;
-
+			vertex.Tangent = vec3(mesh->mTangents[i].x, mesh->mTangents[i].y, mesh->mTangents[i].z);
+			vertex.Bitangent = vec3(mesh->mBitangents[i].x, mesh->mBitangents[i].y, mesh->mBitangents[i].z);
 		} 
 		else
 		{
 			vertex.TexCoords = vec2(0.0, 0.0);
+			vertex.Tangent = vec3(0.0, 0.0, 0.0);
+			vertex.Bitangent = vec3(0.0, 0.0, 0.0);
 		}
-
-		vertices.push_back(vertex);
 	}
 
 	//setup indices
+	vector<unsigned int> indices;
+	indices.reserve(mesh->mNumFaces * 3);
 	for (unsigned int i = 0; i < mesh->mNumFaces; i++)
 	{
-		aiFace face = mesh->mFaces[i];
+		const aiFace& face = mesh->mFaces[i];
 		for (unsigned int j = 0; j < face.mNumIndices; j++) //As triangulate is set, there should be 3 indices per face
 		{
 			indices.push_back(face.mIndices[j]);
 		}
 	}
 
+	//Weld duplicates and reorder for the vertex cache, overdraw and fetch before the mesh is cooked
+	OptimizeMesh(vertices, indices, mesh->mName.C_Str());
+
+	if (mesh->mNumVertices == 0)
+	{
+		range.boundsMin = vec3(0.0);
+		range.boundsMax = vec3(0.0);
+	}
+	//Usually much tighter than the sphere around the bounds for long thin meshes such as the swords
+	range.boundingSphere = vertices.empty() ? vec4(0.0f) : ComputeBoundingSphere(&vertices[0].Position, vertices.size(), sizeof(Vertex));
+
+	//Quantize the vertices against the mesh bounds
+	range.vertexCount = vertices.size();
+	cooked.vertices.resize(range.vertexOffset + vertices.size());
+	PackVertices(vertices.data(), vertices.size(), range.boundsMin, range.boundsMax, cooked.vertices.data() + range.vertexOffset);
+
+	//Coarser index buffers that share the same vertices
+	vector<vector<unsigned int>> lodIndices;
+	vector<float> lodErrors;
+	GenerateLodChain(vertices, indices, MAX_MESH_LODS, lodIndices, lodErrors);
+	lodIndices.insert(lodIndices.begin(), indices);
+	lodErrors.insert(lodErrors.begin(), 0.0f);
+
+	//Halve the index buffer whenever every index fits in 16 bits
+	range.indexType = vertices.size() < 65536 ? GL_UNSIGNED_SHORT : GL_UNSIGNED_INT;
+	size_t indexSize = range.indexType == GL_UNSIGNED_SHORT ? sizeof(unsigned short) : sizeof(unsigned int);
+	range.lodCount = lodIndices.size();
+	for (unsigned int lod = 0; lod < range.lodCount; lod++)
+	{
+		const vector<unsigned int>& lodIndexData = lodIndices[lod];
+		MeshLod& level = range.lods[lod];
+		level.indexOffset = (cooked.indexData.size() + 3) & ~size_t(3);
+		level.indexCount = lodIndexData.size();
+		level.error = lodErrors[lod];
+		cooked.indexData.resize(level.indexOffset + lodIndexData.size() * indexSize);
+		unsigned char* indexData = cooked.indexData.data() + level.indexOffset;
+		for (size_t i = 0; i < lodIndexData.size(); i++)
+		{
+			if (range.indexType == GL_UNSIGNED_SHORT)
+			{
+				((unsigned short*)indexData)[i] = (unsigned short)lodIndexData[i];
+			}
+			else
+			{
+				((unsigned int*)indexData)[i] = lodIndexData[i];
+			}
+		}
+	}
+
+	cooked.ranges.push_back(range);
+}
+
+void Model::createMeshes(const CookedMeshRange* ranges, unsigned int meshCount, const PackedVertex* vertices, const unsigned char* indexData,
+	const CookedNode* cookedNodes, unsigned int nodeCount)
+{
+	//Node transforms never change after loading, so the world matrices are worked out once here
+	unsigned int firstNode = nodes.GetCount();
+	for (unsigned int i = 0; i < nodeCount; i++)
+	{
+		const CookedNode& node = cookedNodes[i];
+		nodes.Add(node.parent >= 0 ? firstNode + node.parent : -1, node.translation,
+			quat(node.rotation.w, node.rotation.x, node.rotation.y, node.rotation.z), node.scale);
+	}
+	nodes.Update();
+
+	meshes.reserve(meshes.size() + meshCount);
+	for (unsigned int i = 0; i < meshCount; i++)
+	{
+		const CookedMeshRange& range = ranges[i];
+		//The mesh gets its own index buffer, so make the LOD offsets relative to the first level
+		MeshLod lods[MAX_MESH_LODS];
+		unsigned int lodCount = std::min(range.lodCount, (unsigned int)MAX_MESH_LODS);
+		for (unsigned int lod = 0; lod < lodCount; lod++)
+		{
+			lods[lod] = range.lods[lod];
+			lods[lod].indexOffset -= range.lods[0].indexOffset;
+		}
+		Mesh mesh(vertices + range.vertexOffset, range.vertexCount, indexData + range.lods[0].indexOffset, lods, lodCount, range.indexType,
+			range.boundsMin, range.boundsMax, loadMeshTextures());
+		mesh.materialIndex = range.materialIndex;
+		mesh.boundingSphere = range.boundingSphere;
+		meshes.push_back(mesh);
+		meshNodes.push_back(firstNode + range.node);
+	}
+}
+
+vector<MTexture> Model::loadMeshTextures()
+{
+	vector<MTexture> textures;
+
 	//Setup materials
 	/*if (mesh->mMaterialIndex >= 0) //Does the imported mesh contain material indexes
 	{
@@ -187,68 +517,46 @@ Mesh Model::processMesh(aiMesh* mesh, const aiScene* scene)
 	*/
 
 	//Setup texture directly, ignoring the .mtl file
-
-	//diffuse
-	TextureLoadReturn texture = loadTexture(aiTextureType_DIFFUSE, diffuseDirectory, "diffuse");
-	if (texture.bIsNewTexture)
+	//Every mesh of the model shares the same set of maps, so only acquire them once
+	if (!materialTextures.empty())
 	{
-		textures.push_back(texture.texture);
+		return materialTextures;
 	}
+
+	//diffuse
+	textures.push_back(loadTexture(diffuseDirectory, "diffuse"));
 	//specular
 	if (!roughnessDirectory.empty())
 	{
-		texture = loadTexture(aiTextureType_SPECULAR, roughnessDirectory, "roughness");
-			if (texture.bIsNewTexture)
-			{
-			textures.push_back(texture.texture);
-			}
+		textures.push_back(loadTexture(roughnessDirectory, "roughness"));
 	}
 	//opacity
 	if (!opacityDirectory.empty())
 	{
-		texture = loadTexture(aiTextureType_OPACITY, opacityDirectory, "opacity");
-		if (texture.bIsNewTexture)
-		{
-			textures.push_back(texture.texture);
-		}
+		textures.push_back(loadTexture(opacityDirectory, "opacity"));
 	}
 	//metallic
 	if (!metallicDirectory.empty())
 	{
-		texture = loadTexture(aiTextureType_METALNESS, metallicDirectory, "metallic");
-		if (texture.bIsNewTexture)
-		{
-			textures.push_back(texture.texture);
-		}
+		textures.push_back(loadTexture(metallicDirectory, "metallic"));
 	}
 	if (!normalDirectory.empty())
 	{
-		texture = loadTexture(aiTextureType_NORMALS, normalDirectory, "normal");
-		if (texture.bIsNewTexture)
-		{
-			textures.push_back(texture.texture);
-		}
+		textures.push_back(loadTexture(normalDirectory, "normal"));
 	}
 
 	if (!aoDirectory.empty())
 	{
-		texture = loadTexture(aiTextureType_AMBIENT_OCCLUSION, aoDirectory, "ao");
-		if (texture.bIsNewTexture)
-		{
-			textures.push_back(texture.texture);
-		}
+		textures.push_back(loadTexture(aoDirectory, "ao"));
 	}
 
 	if (!emissiveDirectory.empty())
 	{
-		texture = loadTexture(aiTextureType_EMISSIVE, emissiveDirectory, "emissive");
-		if (texture.bIsNewTexture)
-		{
-			textures.push_back(texture.texture);
-		}
+		textures.push_back(loadTexture(emissiveDirectory, "emissive"));
 	}
-	
-	return Mesh(vertices, indices, textures, bIsInstanced);
+
+	materialTextures = textures;
+	return textures;
 }
 
 vector<MTexture> Model::loadMaterialTextures(aiMaterial* mat, aiTextureType type, string typeName)
@@ -258,101 +566,21 @@ vector<MTexture> Model::loadMaterialTextures(aiMaterial* mat, aiTextureType type
 	{
 		aiString str;
 		mat->GetTexture(type, i, &str);
-		bool skip = false;
-		for (unsigned int j = 0; j < textures_loaded.size(); j++)
-		{
-			if (strcmp(textures_loaded[j].path.data(), str.C_Str()) == 0) //Compare current texture path to all currently loaded textures
-			{
-				textures.push_back(textures_loaded[j]);
-				skip = true;
-				break;
-			}
-		}
-		if (!skip)
-		{
-			//If the texture has not been loaded before
-			MTexture texture;
-			texture.id = TextureFromFile(str.C_Str(), directory); //load texture
-			texture.type = typeName; //set texture name for use with fragment shader
-			texture.path = str.C_Str();
-			textures.push_back(texture);
-			textures_loaded.push_back(texture); //add to loaded textures
-		}
-		
+		//The texture cache makes sure textures that have already been loaded are shared instead of loaded again
+		textures.push_back(loadTexture(directory + '/' + str.C_Str(), typeName));
 	}
 
 	return textures;
 }
 
-TextureLoadReturn Model::loadTexture(aiTextureType type, string pathToTexture, string typeName)
+MTexture Model::loadTexture(string pathToTexture, string typeName)
 {
-	//vector<MTexture> textures;
-	TextureLoadReturn texture;
-	texture.bIsNewTexture = true;
-
-	//MTexture texture;
-	//Check to make sure we have not already loaded the texture
-	texture.texture.path = pathToTexture;
-	bool b = any_of(textures_loaded.begin(), textures_loaded.end(), [texture](MTexture x) { return texture.texture.path == x.path; });
-	//have we already loaded this texture before
-	if (b)
-	{
-		//if we have, return nothing
-		texture.bIsNewTexture = false;
-		return texture;
-	}
-	//load texture to textures_loaded
-	texture.texture.id = TextureFromFile(pathToTexture.c_str(), directory);
-	texture.texture.type = typeName;
-	textures_loaded.push_back(texture.texture);
+	MTexture texture;
+	//Shared with any other model that has loaded the same image, the pixels are streamed in over the next frames
+	texture.handle = TextureCache::Get().Acquire(pathToTexture, TextureSettings(GL_REPEAT));
+	texture.id = texture.handle->ID;
+	texture.type = typeName;
+	texture.path = pathToTexture;
 
 	return texture;
 }
-
-unsigned int Model::TextureFromFile(const char* path, const string& directory, bool gamma)
-{
-	string filename = string(path);
-	filename = directory + '/' + filename;
-
-	stbi_set_flip_vertically_on_load(false);
-
-	unsigned int textureID;
-	glGenTextures(1, &textureID);
-
-	int width = 0, height = 0, nrComponents = 0;
-	unsigned char* data = stbi_load(path, &width, &height, &nrComponents, 0);
-	if (data)
-	{
-		GLenum format;
-		if (nrComponents == 1)
-			format = GL_RED;
-		else if (nrComponents == 3)
-			format = GL_RGB;
-		else if (nrComponents == 4)
-			//format = GL_SRGB_ALPHA; //Specifying we are using sRGB textures. Only do this for diffuse otherwise lighting will have undesirable results
-			format = GL_RGBA;
-
-		glBindTexture(GL_TEXTURE_2D, textureID);
-		glTexImage2D(GL_TEXTURE_2D, 0, format, width, height, 0, format, GL_UNSIGNED_BYTE, data);
-		glGenerateMipmap(GL_TEXTURE_2D);
-
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-
-		free(data);
-
-		glBindTexture(GL_TEXTURE_2D, 0);
-
-		cout << filename << " loaded" << endl;
-	}
-	else
-	{
-		std::cout << "Texture failed to load at path: " << path << std::endl;
-		cout << stbi_failure_reason() << endl;
-		free(data);
-	}
-
-	return textureID;
-}
@@ -3,13 +3,24 @@
 #include <vector>
 
 #include "Mesh.h"
+#include "MeshCache.h"
 #include "Shader.h"
 #include "Texture.h"
+#include "TextureCache.h"
+#include "DrawList.h"
+#include "FrustumCulling.h"
+#include "TransformHierarchy.h"
 
-struct TextureLoadReturn
+/* The view mesh LODs are picked for. A LOD is used once its error projects to fewer than pixelError * bias pixels */
+struct LodView
 {
-	MTexture texture;
-	bool bIsNewTexture;
+	vec3 position; //world space position of the eye
+	float projectionScale; //pixels covered by one world unit at a distance of one world unit
+	float pixelError;
+	float bias; //scales the allowed error, passes that need less detail use larger values
+
+	LodView();
+	LodView(vec3 position, float fov, float viewportHeight, float pixelError = 1.0f, float bias = 1.0f);
 };
 
 class Model
@@ -21,8 +32,26 @@ public:
 
 	Model(const char* path);
 	/* meshToDraw is to be used when only a certain mesh from a model wants to be drawn. Leave as default to render every mesh. 
-	If the value given is too high, then default behaviour of drawing the whole mesh is used*/
-	void Draw(Shader& shader, int meshToDraw = -1, bool bInstanced = false);
+	If the value given is too high, then default behaviour of drawing the whole mesh is used. Meshes are placed by the model's nodes only*/
+	void Draw(Shader& shader, int meshToDraw = -1);
+	/* Sets the model matrix and draws each mesh at the coarsest LOD that is accurate enough from the current LOD view */
+	void Draw(Shader& shader, const mat4& transform, int meshToDraw = -1);
+	/* Same as above but queues the meshes on drawList instead of drawing them straight away. The model must outlive the submit.
+	An instanced model queues one instanced draw per mesh, with every instance placed relative to transform. When the list
+	culls, instances are culled one by one on the GPU and only the visible ones are drawn */
+	void Draw(DrawList& drawList, const mat4& transform, int meshToDraw = -1);
+	/* Start compiling the variants of variants every mesh draws with, call once the instance pool has been created */
+	void RequestShaderVariants(ShaderVariants& variants) const;
+	/* World space box around the meshes that the same arguments would draw, including every instance */
+	BoundingBox GetBounds(const mat4& transform, int meshToDraw = -1) const;
+
+	/* Draw the model once per instance in the returned pool from now on. capacity is a hint for how many instances will be added */
+	InstancePool* CreateInstancePool(unsigned int capacity = 0);
+	/* nullptr unless the model is instanced */
+	InstancePool* GetInstancePool() const;
+
+	/* View used to pick LODs for every following Draw call that is given a transform */
+	static void SetLodView(const LodView& view);
 
 	void loadModel(string path);
 
@@ -34,15 +63,27 @@ public:
 	void setAODirectory(const string& directory);
 	void setEmissiveDirectory(const string& directory);
 
-	bool bIsInstanced;
 
 	unsigned int GetVAO();
 	vector<unsigned int> GetIndices();
 
 private:
+	static LodView lodView;
+
+	InstancePool* instancePool; //owned by the instance manager
+
+	/* Where mesh sits once the model is placed with transform, which includes the transform of the node it hangs off */
+	mat4 getMeshTransform(unsigned int mesh, const mat4& transform) const;
+	/* Coarsest LOD of mesh that is accurate enough from the current LOD view when drawn with transform */
+	unsigned int selectLod(const Mesh& mesh, const mat4& transform) const;
+	/* Distance from the LOD view to the centre of mesh drawn with transform, what draws are sorted front to back by */
+	float viewDepth(const Mesh& mesh, const mat4& transform) const;
+
 	//model data
 	vector<Mesh> meshes;
-	vector<MTexture> textures_loaded; //stores loaded textures 
+	TransformHierarchy nodes; //node tree from the source file
+	vector<unsigned int> meshNodes; //node of each mesh
+	vector<MTexture> materialTextures; //maps shared by every mesh of this model
 	string directory;
 
 	string diffuseDirectory;
@@ -53,12 +94,19 @@ private:
 	string aoDirectory;
 	string emissiveDirectory;
 
-	void processNode(aiNode* node, const aiScene* scene);
-	Mesh processMesh(aiMesh* mesh, const aiScene* scene);
+	/* Build meshes from a cooked file if it exists and is up to date. Returns false if the model needs importing */
+	bool loadCookedModel(const string& path, unsigned int importFlags);
+	/* Append node and its meshes to the cooked model, then do the same for its children */
+	void processNode(aiNode* node, const aiScene* scene, CookedModel& cooked, int parent = -1);
+	/* Append the vertices and indices of an imported mesh hanging off node to the cooked model */
+	void processMesh(aiMesh* mesh, CookedModel& cooked, unsigned int node);
+	/* Create GL meshes for every cooked range and the node tree they hang off */
+	void createMeshes(const CookedMeshRange* ranges, unsigned int meshCount, const PackedVertex* vertices, const unsigned char* indexData,
+		const CookedNode* cookedNodes, unsigned int nodeCount);
+	/* Textures for the next created mesh */
+	vector<MTexture> loadMeshTextures();
 	vector<MTexture> loadMaterialTextures(aiMaterial* mat, aiTextureType type, string typeName);
 
-	TextureLoadReturn loadTexture(aiTextureType type, string pathToTexture, string typeName);
-
-	unsigned int TextureFromFile(const char* path, const string& directory, bool gamma = false);
+	MTexture loadTexture(string pathToTexture, string typeName);
 };
 
@@ -8,11 +8,31 @@
 #include <STB/stb_image.h>
 #include <assimp/config.h>
 #include <map>
+#include <algorithm>
 
 #include "Shader.h"
 #include "Camera.h"
 #include "Texture.h"
 #include "Model.h"
+#include "TextureStreamer.h"
+#include "TextureCache.h"
+#include "GeometryArena.h"
+#include "DrawList.h"
+#include "GpuCulling.h"
+#include "FrustumCulling.h"
+#include "InstanceManager.h"
+#include "TransformHierarchy.h"
+#include "EntityStore.h"
+#include "RenderQueue.h"
+#include "GLStateCache.h"
+#include "IBLCache.h"
+#include "ShaderConstants.h"
+#include "MaterialTable.h"
+#include "ProgramCache.h"
+#include "ShaderCompiler.h"
+#include "ShaderReloader.h"
+#include "ShaderVariants.h"
+#include "SphericalHarmonics.h"
 
 using namespace std;
 using namespace glm;
@@ -28,8 +48,14 @@ void framebuffer_size_callback(GLFWwindow* window, int width, int height);
 void processInput(GLFWwindow* window);
 /* Initialize OpenGL window as well as GLFW and glad libraries*/
 void initWindow(GLFWwindow*& window);
-/* Render polygon to screen */
-void display(Shader shaderToUse, Model m);
+/* Queue and draw a pass. When frustum is given, only scene objects that intersect it are drawn. With variants, the opaque meshes
+and the windows are drawn with the variant they need instead of shaderToUse */
+void display(Shader& shaderToUse, const Frustum* frustum = nullptr, ShaderVariants* variants = nullptr);
+/* Render queue packets, index is the draw list for the opaque pass or the entity's slot in its component array */
+void renderOpaque(unsigned int index);
+void renderLight(unsigned int index);
+void renderSkybox(unsigned int index);
+void renderTransparent(unsigned int index);
 
 void mouseCallback(GLFWwindow* window, double xPosition, double yPosition);
 
@@ -40,20 +66,6 @@ void loadHDRI(const char* path);
 /* Bind cube to passed through VAO*/
 void bindCubeToVAO(unsigned int& vao);
 
-vec3 pointLightPositions[] = {
-	vec3(0.7f,  0.2f,  2.0f),
-	vec3(2.3f, -3.3f, -4.0f),
-	vec3(-4.0f,  2.0f, -12.0f),
-	vec3(0.0f,  0.0f, -3.0f)
-};
-
-vec3 pointLightColorss[] = {
-	vec3(0.2f,  0.0f,  0.0f),
-	vec3(0.0f, 1.0f, 0.0f),
-	vec3(0.0f,  0.0f, 1.0f),
-	vec3(1.0f,  0.0f, 1.0f)
-};
-
 // Vertex Array Objects for easy to access models
 unsigned int cubeVAO; //3D cube vertices and texture coords
 unsigned int vegetationVAO; //2D Square vertices and texture coords
@@ -69,12 +81,30 @@ unique_ptr<Texture> grassTexture(new Texture()); //Holds texture for the window
 unsigned int cubemapTexture; //Holds pre-mapped cubemap
 
 //Model pointers
-unique_ptr<Model> windowModel(new Model());
 unique_ptr<Model> floorModel(new Model());
 unique_ptr<Model> swordModel(new Model());
 unique_ptr<Model> carModel(new Model());
 unique_ptr<Model> samuraiSwordModel(new Model());
 
+DrawList opaqueDrawList; //Filled and submitted by display() for every pass
+
+EntityStore scene; //Every object, light and window that gets drawn
+SceneBVH sceneBVH; //Built over the entities with a model, refit every frame and rebuilt when they change
+vector<Entity> bvhEntities; //Entity of each object in sceneBVH
+vector<BoundingBox> bvhBounds; //World space box of each object in sceneBVH
+unsigned int bvhMeshVersion = 0; //Version of scene.meshes that sceneBVH was built over
+vector<unsigned int> visibleObjects; //Filled by culling sceneBVH every pass
+
+//Uniforms set for every packet
+const UniformId LIGHT_COLOR_UNIFORM("lightColor");
+const UniformId VIEW_UNIFORM("view");
+
+RenderQueue renderQueue; //Every draw of a pass, sorted by state and depth before it is submitted
+//What the render queue's packets draw with, set by display() before it submits
+Shader* passShader;
+ShaderVariants* passVariants; //nullptr when the pass draws everything with passShader
+mat4 passView;
+
 //Used with performance metrics
 float deltaTime = 0.0f; //Time between current and last frame;
 float lastFrame = 0.0f; //Time of last frame
@@ -89,19 +119,18 @@ float cachedTime;
 float delay = 1.f; //Time to delay for
 
 //Shader class pointers
-unique_ptr<Shader> PBRShader(new Shader());
+//Main pass, one program per combination of material maps, instancing and alpha testing
+unique_ptr<ShaderVariants> PBRVariants(new ShaderVariants("shaders/vertexShader.vert", "shaders/PBR.frag"));
 unique_ptr<Shader> blurShader(new Shader());
 unique_ptr<Shader> lightShader(new Shader());
 unique_ptr<Shader> skyboxShader(new Shader());
 unique_ptr<Shader> normalFaceShader(new Shader());
 unique_ptr<Shader> newSkyboxShader(new Shader());
-unique_ptr<Shader> convolutionShader(new Shader());
 unique_ptr<Shader> filterShader(new Shader());
 unique_ptr<Shader> BRDFshader(new Shader());
 unique_ptr<Shader> shadowMapShader(new Shader());
 unique_ptr<Shader> screenSpaceShader(new Shader());
 
-map<float, vec3> sortedWindows; //Holds a sorted map of window positions so that they can be drawn in the correct order
 
 //Framebuffers to convert multi-sample into single-sample
 unsigned int framebuffer; //custom framebuffer delcaration
@@ -114,10 +143,11 @@ unsigned int colorBuffer; //Normal output texture that gets passed to screen spa
 unsigned int depthCubemap; //Holds highest depth map values for shadow
 
 unsigned int HDRIMap;  //Complete incoming texture before cubemapping
+const char* const HDRI_PATH = "../textures/construction.hdr"; //Environment the image based lighting is baked from
 
 unsigned int captureFBO, captureRBO; //Frambuffers for converting HDRI to cubemap
 unsigned int envCubemap; //Holds the converted HDRI into cubemap
-unsigned int irradianceMap; //Holds a blurred version of the cubemap 
+vec3 irradianceSH[SH_COEFFICIENT_COUNT]; //Diffuse lighting of the environment, projected from the HDRI
 
 unsigned int prefilterMap; //Mip-Mapped cubemap for varying roughness values
 unsigned int BRDFLUTtexture; //bidirectional reflectance distribution function which defined how light is reflected 
@@ -125,6 +155,7 @@ unsigned int bloomTexture; //Holds fragments which pass the bloom gate check
 //Shadows
 vector<mat4> shadowTransforms; //Holds direction vectors for each side of a point light 
 const unsigned int SHADOW_WIDTH = 1024, SHADOW_HEIGHT = 1024; //Resolution of the shadow map
+float shadowLodBias = 4.0f; //Shadow maps are soft and low resolution, so they can switch to coarser LODs much sooner
 //Cloest and furthest distance for shadows
 float near = 1.0f;
 float far = 25.f;
@@ -139,8 +170,19 @@ bool horizontal; //Whether Guassian Blur is moving vertically or horizontally
 //Extraction functions
 /* Call constructors for all shaders */
 void SetupShaders();
+/* Wait for the programs SetupShaders submitted, then check and report them */
+void FinishShaders();
 //Setup Textures and load models that will be rendered
 void SetupModels();
+/* Place the loaded models and lights in the scene and build the hierarchy used to cull them */
+void SetupScene();
+/* Create an entity that draws model, or only one mesh of it, and casts shadows */
+Entity AddModelEntity(Model* model, int meshToDraw, Entity parent = INVALID_ENTITY, vec3 translation = vec3(0.0f),
+	quat rotation = quat(1.0f, 0.0f, 0.0f, 0.0f), vec3 scale = vec3(1.0f));
+/* Refresh the bounds of every entity with a model and rebuild sceneBVH over them */
+void BuildSceneBVH();
+/* Rebuild sceneBVH when entities with a model came or went, otherwise refit it to where they are now */
+void UpdateSceneBVH();
 /* Setup and bind window meshes to VAO*/
 void GenerateWindowVAO();
 void SetupBlendedWindows();
@@ -160,24 +202,46 @@ void GenerateShadowMapFramebuffer();
 void SetupGuassianBlurFramebuffers();
 /* Use a framebuffer to convert an incoming texture into a cubemap texture using trigonometry*/
 void HDRItoCubemap();
-/* Convert cubemap to a blur of colours which is then used to alter the base colour of a meshes fragment */
-void SetupIrradianceMap();
 /* Create lower resolution versions of the cubemap to be used with different incoming roughness values*/
 void MipMapSkybox();
 /* pre-filter the environment map to save on performance*/
 void BRDFScene();
+/* Bake the maps above and project the HDRI's irradiance, or load them from the IBL cache when the HDRI and the baking shaders have not changed */
+void SetupImageBasedLighting();
 /* Slightly adjust the colour of a fragment in alternating directions for a given number of times*/
 void GuassianBlurImplementation();
 /* Render the scene and store the depth values in the shadow map framebuffer*/
-void fillShadowBuffer(mat4 lightViewMatrix, Model* backpack);
+void fillShadowBuffer(mat4 lightViewMatrix);
 /* Calculate and log the frames per second and frametime*/
 void CalculatePerformanceMetrics();
 
-int main() {
+int main(int argc, char** argv) {
+
+	//Benchmarks run on their own without opening a window
+	bool bAllowBindless = true;
+	for (int i = 1; i < argc; i++)
+	{
+		if (string(argv[i]) == "--no-bindless")
+		{
+			bAllowBindless = false; //exercise the texture array path on hardware with bindless support
+		}
+		if (string(argv[i]) == "--bench-culling")
+		{
+			RunCullingBenchmark();
+			return 0;
+		}
+		if (string(argv[i]) == "--bench-transforms")
+		{
+			RunTransformBenchmark();
+			return 0;
+		}
+	}
 
 	//Initialize window and set it to main viewport
 	GLFWwindow* window;
 	initWindow(window);
+	MaterialTable::Get().Initialize((GLADloadproc)glfwGetProcAddress, bAllowBindless);
+	ShaderCompiler::Get().Initialize((GLADloadproc)glfwGetProcAddress);
 
 	// Assign callback function for whenever the user adjusts the viewport size
 	glfwSetFramebufferSizeCallback(window, framebuffer_size_callback);
@@ -199,8 +263,16 @@ int main() {
 
 	SetupModels();
 
+	SetupScene();
+
 	SetupBlendedWindows();
 
+	//Everything below draws, so this is as long as the programs can be left compiling
+	FinishShaders();
+
+	TextureCache::Get().PrintStatistics();
+	GeometryArena::Get().PrintStatistics();
+
 	GenerateMultisampledFramebuffer();
 
 	MultisampleToNormalFramebuffer();
@@ -221,22 +293,7 @@ int main() {
 
 	SetupGuassianBlurFramebuffers();
 
-	HDRItoCubemap();
-
-	SetupIrradianceMap();
-
-	//Setup irradiance map to main shader
-	PBRShader->use();
-	PBRShader->setInt("irradianceMap", 7);
-	glActiveTexture(GL_TEXTURE7);
-	glBindTexture(GL_TEXTURE_CUBE_MAP, irradianceMap);
-
-	//Activate new texture to not accidentally affect the irradiance map
-	glActiveTexture(GL_TEXTURE8);
-
-	MipMapSkybox();
-
-	BRDFScene();
+	SetupImageBasedLighting();
 
 	//Run the window until explicitly told to stop
 	while (!glfwWindowShouldClose(window))  //Check if the window has been instructed to close
@@ -248,29 +305,42 @@ int main() {
 
 		processInput(window); //Process user inputs
 
+		//Swap in shaders that were edited and finished recompiling, edits start compiling in the background
+		ShaderReloader::Get().Update();
+
+		//Spend this frame's upload budget on any textures that are still streaming in
+		TextureStreamer::Get().Update();
+		//Give textures that finished streaming their place in the material records
+		MaterialTable::Get().Update();
+		//Upload instance transforms that changed since last frame
+		InstanceManager::Get().Update();
+		//Only objects that moved since last frame, and anything attached to them, are recomputed
+		scene.UpdateTransforms();
+		UpdateSceneBVH();
+
 		//Tell OpenGL to enable multisample buffers
-		glEnable(GL_MULTISAMPLE);
+		GLStateCache::Get().Enable(GL_MULTISAMPLE);
 
 		//glEnable(GL_FRAMEBUFFER_SRGB); //Using OpenGL's built in gamma correction sRGB tool
 
 		//First render to shadow map
 
-		glEnable(GL_DEPTH_TEST); //Tell OpenGL to use Z-Buffer
-		glDepthFunc(GL_LEQUAL); //Needed for skybox otherwise it has z-conflict with normal background
+		GLStateCache::Get().Enable(GL_DEPTH_TEST); //Tell OpenGL to use Z-Buffer
+		GLStateCache::Get().DepthFunc(GL_LEQUAL); //Needed for skybox otherwise it has z-conflict with normal background
 
-		glEnable(GL_STENCIL_TEST); //Enable stencil testing to add outlines to lights
+		GLStateCache::Get().Enable(GL_STENCIL_TEST); //Enable stencil testing to add outlines to lights
 
-		glStencilOp(GL_KEEP, GL_REPLACE, GL_REPLACE); //Decides what to do when a stencil buffer either passes or fails
+		GLStateCache::Get().StencilOp(GL_KEEP, GL_REPLACE, GL_REPLACE); //Decides what to do when a stencil buffer either passes or fails
 		/* if the stencil test fails, do nothing. If the depth test fails, keep the stencil buffer object the same. This will
 		* result in the outline staying as an outline when hidden behind other objects that are not in the buffer. If both the stencil
 		* and depth test pass, then do the same as when the depth test fails except this time the original object will be in view.
 		*/
 
-		glEnable(GL_BLEND); //Allow for blending between colours with transparency
-		glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+		GLStateCache::Get().Enable(GL_BLEND); //Allow for blending between colours with transparency
+		GLStateCache::Get().BlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
 		//glBlendFuncSeparate(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA, GL_ONE, GL_ZERO); //Only allow blending to affect alpha values
 
-		glEnable(GL_PROGRAM_POINT_SIZE); //Vizualize vertex points
+		GLStateCache::Get().Enable(GL_PROGRAM_POINT_SIZE); //Vizualize vertex points
 
 		//Clear colour buffer and depth buffer every frame before rendering
 		glClearColor(0.2f, 0.3f, 0.3f, 1.0f);
@@ -285,29 +355,31 @@ int main() {
 		mat4 lightViewMatrix = lightProjection * lightView;
 
 		//cull front faces to deal with the peter panning effect
-		glEnable(GL_CULL_FACE); //enable face culling
-		glCullFace(GL_FRONT); //Cull front faces
+		GLStateCache::Get().Enable(GL_CULL_FACE); //enable face culling
+		GLStateCache::Get().CullFace(GL_FRONT); //Cull front faces
 
-		fillShadowBuffer(lightViewMatrix, samuraiSwordModel.get());
+		fillShadowBuffer(lightViewMatrix);
 		
 		//draw scene into offscreen frame buffer
-		glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+		GLStateCache::Get().BindFramebuffer(GL_FRAMEBUFFER, framebuffer);
 		//glBindTexture(GL_TEXTURE_2D, shadowMap);
 
 		//Clear colour buffer and depth buffer every frame before rendering
 		glClearColor(0.2f, 0.3f, 0.3f, 1.0f);
 		glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT | GL_STENCIL_BUFFER_BIT);
 
-		glDisable(GL_CULL_FACE);
-		glCullFace(GL_BACK); //Cull front faces
+		GLStateCache::Get().Disable(GL_CULL_FACE);
+		GLStateCache::Get().CullFace(GL_BACK); //Cull front faces
 		
 		//Draw scene as normal with PBR shader to "framebuffer" framebuffer
-		PBRShader->use();
-		PBRShader->setFloat("far_plane", far);
-		glActiveTexture(GL_TEXTURE6);
-		glBindTexture(GL_TEXTURE_CUBE_MAP, depthCubemap);
-		PBRShader->setInt("shadowMapCube", 6);
-		display(*PBRShader, *samuraiSwordModel);
+		GLStateCache::Get().ActiveTexture(GL_TEXTURE6);
+		GLStateCache::Get().BindTexture(GL_TEXTURE_CUBE_MAP, depthCubemap);
+		Model::SetLodView(LodView(camera->GetPosition(), camera->GetFOV(), VIEWPORTHEIGHT));
+		//Same projection display() puts in the matrices uniform buffer
+		mat4 cameraViewProjection = perspective(camera->GetFOV(), (float)VIEWPORTWIDTH / (float)VIEWPORTHEIGHT, 0.1f, 100.f) * camera->GetViewMatrix();
+		opaqueDrawList.SetCullingView(CullingView(cameraViewProjection, true));
+		Frustum cameraFrustum(cameraViewProjection);
+		display(PBRVariants->Get(0), &cameraFrustum, PBRVariants.get());
 
 		//Blit multisampled frameburffer to default framebuffer seperating the colour attachments
 		/* GL_COLOR_ATTACHMENT0 holds the normal output whereas GL_COLOR_ATTACHMENT1 holds fragments above a certain threshold for bloom*/
@@ -322,17 +394,17 @@ int main() {
 		GuassianBlurImplementation();
 
 		//Go to default framebuffer and draw the final output texture to the viewport
-		glBindFramebuffer(GL_FRAMEBUFFER, 0);
+		GLStateCache::Get().BindFramebuffer(GL_FRAMEBUFFER, 0);
 		screenSpaceShader->use(); //use screen space shader
 		glClear(GL_COLOR_BUFFER_BIT); //clear color bit of original buffer
-		glDisable(GL_DEPTH_TEST); //there will be no depth to destroy in 2D screen space
-		glDisable(GL_CULL_FACE); //disable culling otherwise screenQuad will be automatically destroyed as it is too close to the viewer
+		GLStateCache::Get().Disable(GL_DEPTH_TEST); //there will be no depth to destroy in 2D screen space
+		GLStateCache::Get().Disable(GL_CULL_FACE); //disable culling otherwise screenQuad will be automatically destroyed as it is too close to the viewer
 		//render the quad to which the texture will be displayed
-		glBindVertexArray(screenQuadVAO);
-		glActiveTexture(GL_TEXTURE0);
-		glBindTexture(GL_TEXTURE_2D, colorBuffer); //Holds the normal scene output with lighting calculations
-		glActiveTexture(GL_TEXTURE1);
-		glBindTexture(GL_TEXTURE_2D, pingpongBuffers[!horizontal]); //Holds the blurred bloom output
+		GLStateCache::Get().BindVertexArray(screenQuadVAO);
+		GLStateCache::Get().ActiveTexture(GL_TEXTURE0);
+		GLStateCache::Get().BindTexture(GL_TEXTURE_2D, colorBuffer); //Holds the normal scene output with lighting calculations
+		GLStateCache::Get().ActiveTexture(GL_TEXTURE1);
+		GLStateCache::Get().BindTexture(GL_TEXTURE_2D, pingpongBuffers[!horizontal]); //Holds the blurred bloom output
 		screenSpaceShader->setInt("screenTexture", 0);
 		screenSpaceShader->setInt("bloomBlur", 1);
 		screenSpaceShader->setFloat("exposure", 1.0); //HDR exposure
@@ -385,16 +457,16 @@ void initWindow(GLFWwindow*& window)
 		return;
 	}
 
-	glViewport(0, 0, VIEWPORTWIDTH, VIEWPORTHEIGHT);
+	GLStateCache::Get().Viewport(0, 0, VIEWPORTWIDTH, VIEWPORTHEIGHT);
 }
 
-void display(Shader shaderToUse, Model m)
+void display(Shader& shaderToUse, const Frustum* frustum, ShaderVariants* variants)
 {
 	//Wireframe Mode
 	//glPolygonMode(GL_FRONT_AND_BACK, GL_LINE);
 
 	//Do not write to the stencil buffer for undesired objects (loaded models)
-	glStencilMask(0x00); //0x00 just means that we cannot update the stencil buffer
+	GLStateCache::Get().StencilMask(0x00); //0x00 just means that we cannot update the stencil buffer
 
 	//Adjust uniform color value over time
 	float systemTime = glfwGetTime();
@@ -411,15 +483,21 @@ void display(Shader shaderToUse, Model m)
 
 	//Basic Rendering
 	shaderToUse.use();
-	shaderToUse.setBool("bIsTransparent", false);
 	//glUniform4f(vertexColorLocation, 0.0f, greenValue, 0.0f, 1.0f);
-	glBindVertexArray(cubeVAO);
+	GLStateCache::Get().BindVertexArray(cubeVAO);
 
-	for (int i = 0; i < 4; i++)
+	//Lights, camera and far plane go up in one write. The shader has room for 4 lights, unused ones stay black
+	const Entity* lightEntities = scene.lights.GetEntities();
+	FrameConstants frameConstants;
+	for (size_t i = 0; i < MAX_FRAME_LIGHTS; i++)
 	{
-		shaderToUse.setVec3("lightPositions[" + to_string(i) + "]", pointLightPositions[i]);
-		shaderToUse.setVec3("lightColors[" + to_string(i) + "]", pointLightColorss[i]);
+		bool bIsLight = i < scene.lights.Size();
+		frameConstants.lightPositions[i] = bIsLight ? scene.GetWorld(lightEntities[i])[3] : vec4(0.0f);
+		frameConstants.lightColors[i] = bIsLight ? vec4(scene.lights.GetComponents()[i].color, 1.0f) : vec4(0.0f);
 	}
+	frameConstants.viewPos = camera->GetPosition();
+	frameConstants.far_plane = far;
+	GetFrameConstants().Update(frameConstants);
 
 	//adjust light colour over time
 	vec3 lightColor = vec3(1.0, 1.0, 1.0);
@@ -430,34 +508,45 @@ void display(Shader shaderToUse, Model m)
 	vec3 diffuseColor = lightColor * vec3(0.8f);
 	vec3 ambientColor = diffuseColor * vec3(0.7f);
 
-	shaderToUse.setVec3("viewPos", camera->GetPosition());
 
-	//Draw sword
-	mat4 model = mat4(1.0);
-	model = scale(model, vec3(3.0, 3.0, 3.0));
-	model = rotate(model, (float)radians(90.f), vec3(1.0f, 0.0, 0.0));
-	shaderToUse.setMat4("model", model);
-	m.Draw(shaderToUse, 0);
-	//Draw sheathe
-	model = translate(model, vec3(0.2, 0.0, 0.0));
-	shaderToUse.setMat4("model", model);
-	m.Draw(shaderToUse, 1);
+	//Queue the entities that can be seen, the shadow pass sees all around the light so it takes every shadow caster
+	if (frustum)
+	{
+		visibleObjects.clear();
+		sceneBVH.Cull(*frustum, visibleObjects);
+		//Keep the order objects were added in so batches come out the same every frame
+		sort(visibleObjects.begin(), visibleObjects.end());
+		for (size_t i = 0; i < visibleObjects.size(); i++)
+		{
+			Entity entity = bvhEntities[visibleObjects[i]];
+			const MeshComponent& mesh = scene.meshes.Get(entity);
+			mesh.model->Draw(opaqueDrawList, scene.GetWorld(entity), mesh.meshToDraw);
+		}
+	}
+	else
+	{
+		const Entity* casters = scene.shadowCasters.GetEntities();
+		for (size_t i = 0; i < scene.shadowCasters.Size(); i++)
+		{
+			if (!scene.meshes.Has(casters[i]) || !scene.meshes.Get(casters[i]).model)
+			{
+				continue;
+			}
+			const MeshComponent& mesh = scene.meshes.Get(casters[i]);
+			mesh.model->Draw(opaqueDrawList, scene.GetWorld(casters[i]), mesh.meshToDraw);
+		}
+	}
 
-	//Draw Second Sword
-	model = mat4(1.0);
-	model = translate(model, vec3(-0.6, 0.0, 0.0));
-	model = rotate(model, (float)radians(90.f), vec3(-1.0f, 0.0, 0.0));
-	shaderToUse.setMat4("model", model);
-	swordModel->Draw(shaderToUse);
+	//Depth in the sort keys runs from the eye to the far plane
+	const float farPlane = 100.0f;
+	passShader = &shaderToUse;
+	passVariants = variants;
+	passView = view;
+	//Windows only show their opacity map, which the alpha tested variant does at compile time
+	unsigned int transparentProgram = variants ? variants->Get(SHADER_ALPHA_TEST).ID : shaderToUse.ID;
 
-	model = mat4(1.0);
-	model = translate(model, vec3(2.0, -1.8, 0.0));
-	model = scale(model, vec3(0.006, 0.006, 0.006));
-	model = rotate(model, (float)radians(45.f), vec3(0.0f, -1.0, 0.0));
-	shaderToUse.setMat4("model", model);
-	carModel->Draw(shaderToUse);
-	
-	floorModel->Draw(shaderToUse, -1, true);
+	//Every opaque model above goes out in one multi-draw per shader variant and index type
+	renderQueue.Add(MakeSortKey(RENDER_PASS_OPAQUE, shaderToUse.ID, 0, 0, 0.0f), shaderToUse.ID, 0, 0, renderOpaque, 0);
 
 	//Draw sword again but this time with the geometry normal shader
 	/*
@@ -472,77 +561,104 @@ void display(Shader shaderToUse, Model m)
 	m.Draw(*normalFaceShader, 1);
 	*/
 
-	//Use different shader for the source of the light
-	lightShader->use();
-	//Draw 4 cube lights at different positions with different colours
-	for (unsigned int i = 0; i < 4; i++)
+	//Use different shader for the source of the light, every light is a cube of its colour
+	for (size_t i = 0; i < scene.lights.Size(); i++)
 	{
-		//Draw objects as normal but writing them to the stencil buffer
-
-		//Add cubes to stencil buffer
-		glStencilFunc(GL_ALWAYS, 1, 0xFF); //All stencils will pass the stencil test
-		glStencilMask(0xFF); //enable writing to the stencil buffer
-
-		//Scale light and move it in world space
-		mat4 model(1.0f);
-		model = translate(model, pointLightPositions[i]);
-		model = scale(model, vec3(0.2f));
-		lightShader->setMat4("model", model);
-		//Set colour of the light object
-		lightShader->setVec3("lightColor", pointLightColorss[i]);
-		//call VAO that holds the buffer and draw it to the screen
-		glBindVertexArray(cubeVAO);
-		glDrawArrays(GL_TRIANGLES, 0, 36);
+		float depth = length(camera->GetPosition() - vec3(scene.GetWorld(lightEntities[i])[3])) / farPlane;
+		renderQueue.Add(MakeSortKey(RENDER_PASS_LIGHTS, lightShader->ID, 0, cubeVAO, depth), lightShader->ID, 0, cubeVAO, renderLight, i);
+	}
 
-		//Draw scaled cube around object to act as an outline but not writing these to the stencil buffer
-		glStencilFunc(GL_NOTEQUAL, 1, 0xFF); //Pass if depth value is not equal to the stored depth
-		glStencilMask(0x00); //disable writing to the stencil buffer
-		glDisable(GL_DEPTH_TEST);
-		// Set colour of outline
-		lightShader->setVec3("lightColor", pointLightColorss[i] * vec3(0.5f)); //Get outline tint based on original colour
-		//Increase size of the cube
-		model = scale(model, vec3(1.2f));
-		lightShader->setMat4("model", model);
-		lightShader->use();
-		//Draw cube
-		glBindVertexArray(cubeVAO);
-		glDrawArrays(GL_TRIANGLES, 0, 36);
+	//Draw skybox as late as possible to minimize repeated calls
+	renderQueue.Add(MakeSortKey(RENDER_PASS_SKYBOX, newSkyboxShader->ID, envCubemap, skyboxVAO, 1.0f), newSkyboxShader->ID, 0, skyboxVAO, renderSkybox, 0);
 
-		glStencilMask(0xFF);
-		glStencilFunc(GL_ALWAYS, 0, 0xFF);
-		glEnable(GL_DEPTH_TEST);
+	//This fixes the skybox transparency issue but still results in repeated calls with the skybox
+	//Transparent entities, the queue sorts them so the furthest away are always drawn first from wherever the camera is
+	const Entity* materialEntities = scene.materials.GetEntities();
+	const MaterialComponent* materials = scene.materials.GetComponents();
+	for (size_t i = 0; i < scene.materials.Size(); i++)
+	{
+		if (materials[i].bIsTransparent && scene.meshes.Has(materialEntities[i]))
+		{
+			float depth = length(camera->GetPosition() - vec3(scene.GetWorld(materialEntities[i])[3])) / farPlane;
+			unsigned int vao = scene.meshes.Get(materialEntities[i]).vao;
+			//The texture is reached through the material, so the queue has nothing to bind for it
+			renderQueue.Add(MakeSortKey(RENDER_PASS_TRANSPARENT, transparentProgram, materials[i].material, vao, depth), transparentProgram, 0, vao,
+				renderTransparent, i);
+		}
 	}
 
+	renderQueue.Submit();
+}
 
-	//Draw skybox as late as possible to minimize repeated calls
-	newSkyboxShader->use();
-	mat4 skyboxView = mat4(mat3(view));
-	newSkyboxShader->setMat4("view", skyboxView);
-	glBindVertexArray(skyboxVAO);
-	glBindTexture(GL_TEXTURE_CUBE_MAP, envCubemap);
-	glDrawArrays(GL_TRIANGLES, 0, 36);
-	glDepthMask(GL_TRUE);
+void renderOpaque(unsigned int)
+{
+	if (passVariants)
+	{
+		opaqueDrawList.Submit(*passVariants);
+	}
+	else
+	{
+		opaqueDrawList.Submit(*passShader);
+	}
 
-	//This fixes the skybox transparency issue but still results in repeated calls with the skybox
-	//load multiple transparent grass
-	shaderToUse.use();
-	glBindVertexArray(vegetationVAO);
-	glActiveTexture(GL_TEXTURE0);
-	glBindTexture(GL_TEXTURE_2D, grassTexture->GetID());
-	shaderToUse.setInt("grassTexture", 0);
-	shaderToUse.setBool("bIsTransparent", true);
-	//Loop through window position in the reverse order so that the furthest away windows are always drawn first
-	for (map<float, vec3>::reverse_iterator it = sortedWindows.rbegin(); it != sortedWindows.rend(); ++it)
+	//Only opaque geometry is an occluder, so the depth pyramid for the next frame is taken before the lights and windows
+	if (opaqueDrawList.IsCulling() && opaqueDrawList.GetCullingView().bUseOcclusion)
 	{
-		//This currently only works during loading, as the vector is never re-sorted during runtime, resulting in windows 
-		//being in the wrong order once the player starts moving
-		model = mat4(1.0f);
-		model = translate(model, it->second);
-		shaderToUse.setMat4("model", model);
-		glDrawArrays(GL_TRIANGLES, 0, 6);
-		//This fixes the problem of windows not accounting for other windows that are behind them
+		GpuCulling::Get().BuildHiZ(framebuffer, VIEWPORTWIDTH, VIEWPORTHEIGHT, opaqueDrawList.GetCullingView().viewProjections[0]);
 	}
-	shaderToUse.setBool("bIsTransparent", false);
+}
+
+void renderLight(unsigned int index)
+{
+	const LightComponent& light = scene.lights.GetComponents()[index];
+
+	//Draw objects as normal but writing them to the stencil buffer
+
+	//Add cubes to stencil buffer
+	GLStateCache::Get().StencilFunc(GL_ALWAYS, 1, 0xFF); //All stencils will pass the stencil test
+	GLStateCache::Get().StencilMask(0xFF); //enable writing to the stencil buffer
+
+	//Scale light and move it in world space
+	mat4 model = scene.GetWorld(scene.lights.GetEntities()[index]);
+	model = scale(model, vec3(light.markerSize));
+	GetObjectConstants().Update(ObjectConstants(model));
+	//Set colour of the light object
+	lightShader->setVec3(LIGHT_COLOR_UNIFORM, light.color);
+	glDrawArrays(GL_TRIANGLES, 0, 36);
+
+	//Draw scaled cube around object to act as an outline but not writing these to the stencil buffer
+	GLStateCache::Get().StencilFunc(GL_NOTEQUAL, 1, 0xFF); //Pass if depth value is not equal to the stored depth
+	GLStateCache::Get().StencilMask(0x00); //disable writing to the stencil buffer
+	GLStateCache::Get().Disable(GL_DEPTH_TEST);
+	// Set colour of outline
+	lightShader->setVec3(LIGHT_COLOR_UNIFORM, light.color * vec3(0.5f)); //Get outline tint based on original colour
+	//Increase size of the cube
+	model = scale(model, vec3(1.2f));
+	GetObjectConstants().Update(ObjectConstants(model));
+	//Draw cube
+	glDrawArrays(GL_TRIANGLES, 0, 36);
+
+	GLStateCache::Get().StencilMask(0xFF);
+	GLStateCache::Get().StencilFunc(GL_ALWAYS, 0, 0xFF);
+	GLStateCache::Get().Enable(GL_DEPTH_TEST);
+}
+
+void renderSkybox(unsigned int)
+{
+	mat4 skyboxView = mat4(mat3(passView));
+	newSkyboxShader->setMat4(VIEW_UNIFORM, skyboxView);
+	GLStateCache::Get().BindTextureUnit(0, GL_TEXTURE_CUBE_MAP, envCubemap);
+	glDrawArrays(GL_TRIANGLES, 0, 36);
+	GLStateCache::Get().DepthMask(GL_TRUE);
+}
+
+void renderTransparent(unsigned int index)
+{
+	Entity entity = scene.materials.GetEntities()[index];
+	mat4 model = scene.GetWorld(entity);
+	//The window quad's positions are not quantized
+	GetObjectConstants().Update(ObjectConstants(model, vec3(0.0f), vec3(1.0f), -1, scene.materials.GetComponents()[index].material));
+	glDrawArrays(GL_TRIANGLES, 0, scene.meshes.Get(entity).vertexCount);
 }
 
 void bindCubeToVAO(unsigned int& vao)
@@ -595,7 +711,7 @@ void bindCubeToVAO(unsigned int& vao)
 
 	//Basic VAO 
 	glGenVertexArrays(1, &vao);
-	glBindVertexArray(vao); //Bind VAO to store any subsequent VBO & EBO calls
+	GLStateCache::Get().BindVertexArray(vao); //Bind VAO to store any subsequent VBO & EBO calls
 
 	//Basic VBO Setup for vertices
 	unsigned int VBO;
@@ -614,7 +730,7 @@ void bindCubeToVAO(unsigned int& vao)
 	glEnableVertexAttribArray(2);
 
 	//Unbind VAO, EBO and VBO. MUST UNBIND VAO FIRST
-	glBindVertexArray(0);
+	GLStateCache::Get().BindVertexArray(0);
 	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
 	glBindBuffer(GL_ARRAY_BUFFER, 0);
 }
@@ -631,43 +747,77 @@ void scrollCallback(GLFWwindow* window, double xOffset, double yOffset)
 
 void SetupShaders()
 {
+	//Only submitted here, the driver compiles them while the models and textures load and FinishShaders collects them
 	//Bind light shader
-	lightShader->LoadShader("shaders/lightShader.vert", "shaders/lightShader.frag");
+	ShaderCompiler::Get().Submit(*lightShader, "shaders/lightShader.vert", "shaders/lightShader.frag");
+
+	ShaderCompiler::Get().Submit(*screenSpaceShader, "shaders/screenSpaceShader.vert", "shaders/screenSpaceShader.frag");
 
-	screenSpaceShader->LoadShader("shaders/screenSpaceShader.vert", "shaders/screenSpaceShader.frag");
+	ShaderCompiler::Get().Submit(*normalFaceShader, "shaders/visibleNormals.vert", "shaders/visibleNormals.frag", "shaders/geometryShader.geom");
 
-	normalFaceShader->LoadShader("shaders/visibleNormals.vert", "shaders/visibleNormals.frag", "shaders/geometryShader.geom");
+	ShaderCompiler::Get().Submit(*shadowMapShader, "shaders/shadowMap.vert", "shaders/shadowMap.frag", "shaders/shadowMap.geom");
 
-	shadowMapShader->LoadShader("shaders/shadowMap.vert", "shaders/shadowMap.frag", "shaders/shadowMap.geom");
+	ShaderCompiler::Get().Submit(*blurShader, "shaders/gaussianBlur.vert", "shaders/gaussianBlur.frag");
 
-	blurShader->LoadShader("shaders/gaussianBlur.vert", "shaders/gaussianBlur.frag");
+	//Material handles are baked into the main pass variants, so the table has to be set up before any is requested
+	PBRVariants->SetDefines(MaterialTable::Get().IsBindless() ? "#define MATERIAL_BINDLESS\n" : "");
+	PBRVariants->SetFeatures(ShadowFilterFeatures(SHADOW_FILTER_PCF), SHADER_NORMAL_MAP | SHADER_AO | SHADER_EMISSIVE | SHADER_INSTANCED |
+		SHADER_ALPHA_TEST);
+	PBRVariants->Request(0);
+	PBRVariants->Request(SHADER_ALPHA_TEST);
 
-	PBRShader->LoadShader("shaders/vertexShader.vert", "shaders/PBR.frag");
+	ShaderCompiler::Get().Submit(*newSkyboxShader, "shaders/newSkybox.vert", "shaders/newSkybox.frag");
 
-	loadHDRI("../textures/construction.hdr");
+	ShaderCompiler::Get().Submit(*filterShader, "shaders/newSkybox.vert", "shaders/preFilter.frag");
 
-	newSkyboxShader->LoadShader("shaders/newSkybox.vert", "shaders/newSkybox.frag");
+	ShaderCompiler::Get().Submit(*BRDFshader, "shaders/gaussianBlur.vert", "shaders/BRDF.frag");
 
-	convolutionShader->LoadShader("shaders/newSkybox.vert", "shaders/cubemapConvolution.frag");
+	ShaderCompiler::Get().Submit(*skyboxShader, "shaders/skybox.vert", "shaders/skybox.frag");
+}
 
-	filterShader->LoadShader("shaders/newSkybox.vert", "shaders/preFilter.frag");
+void FinishShaders()
+{
+	//What the models need is only known once they have loaded and the instance pools exist
+	floorModel->RequestShaderVariants(*PBRVariants);
+	swordModel->RequestShaderVariants(*PBRVariants);
+	carModel->RequestShaderVariants(*PBRVariants);
+	samuraiSwordModel->RequestShaderVariants(*PBRVariants);
+
+	ShaderCompiler::Get().WaitAll();
+
+	//The constant blocks have to line up with their C++ mirrors
+	ValidateShaderConstants(*lightShader);
+	ValidateShaderConstants(*shadowMapShader);
+	const map<unsigned int, unique_ptr<Shader>>& variants = PBRVariants->GetVariants();
+	for (map<unsigned int, unique_ptr<Shader>>::const_iterator it = variants.begin(); it != variants.end(); it++)
+	{
+		ValidateShaderConstants(*it->second);
+	}
+	cout << "PBR shader: " << PBRVariants->GetCount() << " variants" << endl;
 
-	BRDFshader->LoadShader("shaders/gaussianBlur.vert", "shaders/BRDF.frag");
+	ShaderCompiler::Get().PrintStatistics();
+	ProgramCache::Get().PrintStatistics();
 
-	skyboxShader->LoadShader("shaders/skybox.vert", "shaders/skybox.frag");
+	//Edits to any shader from here on are compiled and swapped in while running, the main pass variants watch themselves
+	ShaderReloader::Get().AddDirectory("shaders");
+	ShaderReloader::Get().AddDirectory("shaders/include");
+	Shader* watchedShaders[] = { lightShader.get(), screenSpaceShader.get(), normalFaceShader.get(), shadowMapShader.get(), blurShader.get(),
+		newSkyboxShader.get(), filterShader.get(), BRDFshader.get(), skyboxShader.get() };
+	for (unsigned int i = 0; i < sizeof(watchedShaders) / sizeof(watchedShaders[0]); i++)
+	{
+		ShaderReloader::Get().Watch(*watchedShaders[i]);
+	}
 }
 
 void SetupModels()
 {
+	//Set every texture directory before loading any model so that all maps decode in parallel while the models import
 	floorModel->setDiffuseDirectory("../textures/floor_diffuse.png");
-	floorModel->bIsInstanced = true; //Tell Model class that this should be instanced
-	floorModel->loadModel("../textures/floor.obj");
 
 	swordModel->setDiffuseDirectory("../textures/chevaliar/textures/albedo.jpg");
 	swordModel->setMetallicDirectory("../textures/chevaliar/textures/metallic.jpg");
 	swordModel->setNormalDirectory("../textures/chevaliar/textures/normal.png");
 	swordModel->setRoughnessDirectory("../textures/chevaliar/textures/roughness.jpg");
-	swordModel->loadModel("../textures/chevaliar/model.dae");
 
 	carModel->setDiffuseDirectory("../textures/carTextures/Vehicle_basecolor.png");
 	carModel->setMetallicDirectory("../textures/carTextures/Vehicle_metallic.png");
@@ -675,17 +825,114 @@ void SetupModels()
 	carModel->setRoughnessDirectory("../textures/carTextures/Vehicle_roughness.png");
 	carModel->setAODirectory("../textures/carTextures/Vehicle_ao.png");
 	carModel->setEmissiveDirectory("../textures/carTextures/Vehicle_emissive.png");
-	carModel->loadModel("../textures/cybercar.fbx");
 
 	//load model textures
 	samuraiSwordModel->setDiffuseDirectory("../textures/swordTextures/Albedo.png");
 	samuraiSwordModel->setRoughnessDirectory("../textures/swordTextures/Roughness.png");
 	samuraiSwordModel->setMetallicDirectory("../textures/swordTextures/Metallic.png");
 	samuraiSwordModel->setNormalDirectory("../textures/swordTextures/Normal.png");
-	//load model into buffers
+
+	//load models into buffers
+	floorModel->loadModel("../textures/floor.obj");
+	swordModel->loadModel("../textures/chevaliar/model.dae");
+	carModel->loadModel("../textures/cybercar.fbx");
 	samuraiSwordModel->loadModel("../textures/Katana_export.fbx");
 }
 
+void SetupScene()
+{
+	//Sword
+	Entity sword = AddModelEntity(samuraiSwordModel.get(), 0, INVALID_ENTITY, vec3(0.0), angleAxis(radians(90.f), vec3(1.0f, 0.0, 0.0)), vec3(3.0, 3.0, 3.0));
+	//Sheathe, attached to the sword so it follows it around
+	AddModelEntity(samuraiSwordModel.get(), 1, sword, vec3(0.2, 0.0, 0.0));
+
+	//Second Sword
+	AddModelEntity(swordModel.get(), -1, INVALID_ENTITY, vec3(-0.6, 0.0, 0.0), angleAxis(radians(90.f), vec3(-1.0f, 0.0, 0.0)));
+
+	AddModelEntity(carModel.get(), -1, INVALID_ENTITY, vec3(2.0, -1.8, 0.0), angleAxis(radians(45.f), vec3(0.0f, -1.0, 0.0)), vec3(0.006, 0.006, 0.006));
+
+	//Floor, 10 x 10 tiles drawn as one instanced draw, culled tile by tile on the GPU
+	int floorWidth = 10; //How many tiles wide the floor is
+	InstancePool* floorTiles = floorModel->CreateInstancePool(100);
+	for (int i = 0; i < 100; i++)
+	{
+		int row = i / floorWidth;
+		int column = i % floorWidth;
+		mat4 model = mat4(1.0);
+		model = translate(model, vec3(5.0 - column, -1.8, 8.0 - 1.5 * (row + 1)));
+		model = scale(model, vec3(0.3, 0.3, 0.3));
+		floorTiles->Add(model);
+	}
+	AddModelEntity(floorModel.get(), -1);
+
+	//Point lights, the first one also casts the shadows
+	vec3 pointLightPositions[] = {
+		vec3(0.7f,  0.2f,  2.0f),
+		vec3(2.3f, -3.3f, -4.0f),
+		vec3(-4.0f,  2.0f, -12.0f),
+		vec3(0.0f,  0.0f, -3.0f)
+	};
+	vec3 pointLightColors[] = {
+		vec3(0.2f,  0.0f,  0.0f),
+		vec3(0.0f, 1.0f, 0.0f),
+		vec3(0.0f,  0.0f, 1.0f),
+		vec3(1.0f,  0.0f, 1.0f)
+	};
+	for (int i = 0; i < 4; i++)
+	{
+		Entity light = scene.Create();
+		scene.AddTransform(light, INVALID_ENTITY, pointLightPositions[i]);
+		scene.lights.Add(light, { pointLightColors[i], 0.2f });
+	}
+
+	BuildSceneBVH();
+}
+
+Entity AddModelEntity(Model* model, int meshToDraw, Entity parent, vec3 translation, quat rotation, vec3 scale)
+{
+	Entity entity = scene.Create();
+	scene.AddTransform(entity, parent, translation, rotation, scale);
+	scene.meshes.Add(entity, { model, meshToDraw, 0, 0 });
+	scene.shadowCasters.Add(entity, ShadowCasterComponent());
+	return entity;
+}
+
+void BuildSceneBVH()
+{
+	scene.UpdateTransforms();
+	bvhBounds.clear();
+	bvhEntities.clear();
+	const Entity* entities = scene.meshes.GetEntities();
+	for (size_t i = 0; i < scene.meshes.Size(); i++)
+	{
+		if (!scene.meshes.GetComponents()[i].model)
+		{
+			continue;
+		}
+		scene.UpdateBounds(entities[i]);
+		bvhBounds.push_back(scene.bounds.Get(entities[i]));
+		bvhEntities.push_back(entities[i]);
+	}
+	sceneBVH.Build(bvhBounds);
+	bvhMeshVersion = scene.meshes.GetVersion();
+	cout << "Scene: " << scene.GetCount() << " entities, " << bvhEntities.size() << " in " << sceneBVH.GetNodeCount() << " BVH nodes" << endl;
+}
+
+void UpdateSceneBVH()
+{
+	if (scene.meshes.GetVersion() != bvhMeshVersion)
+	{
+		BuildSceneBVH();
+		return;
+	}
+	for (size_t i = 0; i < bvhEntities.size(); i++)
+	{
+		scene.UpdateBounds(bvhEntities[i]);
+		bvhBounds[i] = scene.bounds.Get(bvhEntities[i]);
+	}
+	sceneBVH.Refit(bvhBounds);
+}
+
 void SetupBlendedWindows()
 {
 	vector<vec3> vegetation; //Hold locations of the windows
@@ -710,7 +957,7 @@ void SetupBlendedWindows()
 	vegetation.push_back(vec3(0.5f, 0.0f, -0.6f));
 
 	glGenVertexArrays(1, &vegetationVAO);
-	glBindVertexArray(vegetationVAO); //Bind VAO to store any subsequent VBO & EBO calls
+	GLStateCache::Get().BindVertexArray(vegetationVAO); //Bind VAO to store any subsequent VBO & EBO calls
 
 	unsigned int VBO;
 	glGenBuffers(1, &VBO); //Create a single buffer for the VBO
@@ -724,19 +971,23 @@ void SetupBlendedWindows()
 	glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, 5 * sizeof(float), (void*)(3 * sizeof(float)));
 	glEnableVertexAttribArray(2);
 
-	glBindVertexArray(0);
+	GLStateCache::Get().BindVertexArray(0);
 	glBindBuffer(GL_ARRAY_BUFFER, 0);
 
 	grassTexture->LoadTexture("../textures/blending_transparent_window.png");
+	MaterialDesc windowDesc;
+	windowDesc.textures[MATERIAL_OPACITY] = grassTexture->GetID();
+	unsigned int windowMaterial = MaterialTable::Get().Register(windowDesc);
 
-	//Sort locations into a sorted order form the location of the camera
-	//NEED TO CHANGE:: CURRENTLY IS ONLY SET ONCE AT THE BEGINNING OF THE RENDER AND NEVER UPDATED. NEEDS MORE CHECKING AND PERFORMANCE
-	//CONSIDERATIONS BEFORE PUTTING INSIDE THE RENDER LOOP AS MAP BECOMES A MEMORY HOG
+	//Every window is a transparent entity, display() sorts them from the camera each pass
 	for (int i = 0; i < vegetation.size(); i++)
 	{
-		float distance = length(camera->GetPosition() - vegetation[i]); //get distance from camera to window position
-		sortedWindows[distance] = vegetation[i];
+		Entity window = scene.Create();
+		scene.AddTransform(window, INVALID_ENTITY, vegetation[i]);
+		scene.meshes.Add(window, { nullptr, -1, vegetationVAO, 6 });
+		scene.materials.Add(window, { grassTexture->GetID(), windowMaterial, true });
 	}
+	scene.UpdateTransforms();
 	//Generate VAO for easy access to objects
 	GenerateWindowVAO();
 }
@@ -757,14 +1008,14 @@ void GenerateWindowVAO()
 	unsigned int quadVBO;
 	glGenVertexArrays(1, &screenQuadVAO);
 	glGenBuffers(1, &quadVBO);
-	glBindVertexArray(screenQuadVAO);
+	GLStateCache::Get().BindVertexArray(screenQuadVAO);
 	glBindBuffer(GL_ARRAY_BUFFER, quadVBO);
 	glBufferData(GL_ARRAY_BUFFER, sizeof(quadVertices), &quadVertices, GL_STATIC_DRAW);
 	glEnableVertexAttribArray(0);
 	glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, 4 * sizeof(float), (void*)0);
 	glEnableVertexAttribArray(1);
 	glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, 4 * sizeof(float), (void*)(2 * sizeof(float)));
-	glBindVertexArray(0);
+	GLStateCache::Get().BindVertexArray(0);
 	glBindBuffer(GL_ARRAY_BUFFER, 0);
 }
 
@@ -772,12 +1023,12 @@ void GenerateMultisampledFramebuffer()
 {
 	//Create custom framebuffer
 	glGenFramebuffers(1, &framebuffer);
-	glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+	GLStateCache::Get().BindFramebuffer(GL_FRAMEBUFFER, framebuffer);
 	//Create attachment for framebuffer. Basically memory location buffer such as VAO
 
 	//texture attachment 
 	glGenTextures(1, &textureColorbuffer);
-	glBindTexture(GL_TEXTURE_2D_MULTISAMPLE, textureColorbuffer);
+	GLStateCache::Get().BindTexture(GL_TEXTURE_2D_MULTISAMPLE, textureColorbuffer);
 
 	//allocate memory for texture but do not fill it. Also set texture to size of viewport
 	//Using floating point lighitng values to exceed the LDR range
@@ -788,7 +1039,7 @@ void GenerateMultisampledFramebuffer()
 
 	unsigned int bloomMTexture;
 	glGenTextures(1, &bloomMTexture);
-	glBindTexture(GL_TEXTURE_2D_MULTISAMPLE, bloomMTexture);
+	GLStateCache::Get().BindTexture(GL_TEXTURE_2D_MULTISAMPLE, bloomMTexture);
 	glTexImage2DMultisample(GL_TEXTURE_2D_MULTISAMPLE, 4, GL_RGBA16F, VIEWPORTWIDTH, VIEWPORTHEIGHT, GL_TRUE);
 	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT1, GL_TEXTURE_2D_MULTISAMPLE, bloomMTexture, 0);
 
@@ -812,7 +1063,7 @@ void GenerateMultisampledFramebuffer()
 		cout << "ERROR::FRAMEBUFFER:: Framebuffer is not complete" << glCheckFramebufferStatus(GL_FRAMEBUFFER) << endl;
 	}
 
-	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+	GLStateCache::Get().BindFramebuffer(GL_FRAMEBUFFER, 0);
 	//End of framebuffer
 }
 
@@ -820,10 +1071,10 @@ void MultisampleToNormalFramebuffer()
 {
 	//Create intermediate framebuffer with only a color buffer
 	glGenFramebuffers(1, &intermediateFramebuffer);
-	glBindFramebuffer(GL_FRAMEBUFFER, intermediateFramebuffer);
+	GLStateCache::Get().BindFramebuffer(GL_FRAMEBUFFER, intermediateFramebuffer);
 
 	glGenTextures(1, &colorBuffer);
-	glBindTexture(GL_TEXTURE_2D, colorBuffer);
+	GLStateCache::Get().BindTexture(GL_TEXTURE_2D, colorBuffer);
 
 	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA16F, VIEWPORTWIDTH, VIEWPORTHEIGHT, 0, GL_RGBA, GL_FLOAT, nullptr);
 
@@ -836,7 +1087,7 @@ void MultisampleToNormalFramebuffer()
 
 	//Bind second texture for bloom
 	glGenTextures(1, &bloomTexture);
-	glBindTexture(GL_TEXTURE_2D, bloomTexture);
+	GLStateCache::Get().BindTexture(GL_TEXTURE_2D, bloomTexture);
 	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB16F, VIEWPORTWIDTH, VIEWPORTHEIGHT, 0, GL_RGBA, GL_FLOAT, NULL);
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
@@ -847,7 +1098,7 @@ void MultisampleToNormalFramebuffer()
 	unsigned int attachments[2] = { GL_COLOR_ATTACHMENT0, GL_COLOR_ATTACHMENT1 };
 	glDrawBuffers(2, attachments);
 
-	glBindTexture(GL_TEXTURE_2D, 0);
+	GLStateCache::Get().BindTexture(GL_TEXTURE_2D, 0);
 
 
 	//Check that the current frambuffer checks the minimum requirements 
@@ -856,7 +1107,7 @@ void MultisampleToNormalFramebuffer()
 		cout << "ERROR::FRAMEBUFFER:: Intermediate Framebuffer is not complete" << glCheckFramebufferStatus(GL_FRAMEBUFFER) << endl;
 	}
 
-	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+	GLStateCache::Get().BindFramebuffer(GL_FRAMEBUFFER, 0);
 }
 
 void AssignSkyboxToCubeMap()
@@ -919,7 +1170,7 @@ void AssignSkyboxToCubeMap()
 
 	//Create cubemap texture
 	glGenTextures(1, &cubemapTexture);
-	glBindTexture(GL_TEXTURE_CUBE_MAP, cubemapTexture);
+	GLStateCache::Get().BindTexture(GL_TEXTURE_CUBE_MAP, cubemapTexture);
 
 	//Assign each texture location to its corresponding texture target
 	int width, height, nrChannels;
@@ -947,20 +1198,20 @@ void AssignSkyboxToCubeMap()
 	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
 	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
 
-	glBindTexture(GL_TEXTURE_CUBE_MAP, 0);
+	GLStateCache::Get().BindTexture(GL_TEXTURE_CUBE_MAP, 0);
 
 	//Bind VAO to skybox vertices
 	unsigned int skyboxVBO;
 	glGenVertexArrays(1, &skyboxVAO);
 	glGenBuffers(1, &skyboxVBO);
-	glBindVertexArray(skyboxVAO);
+	GLStateCache::Get().BindVertexArray(skyboxVAO);
 	glBindBuffer(GL_ARRAY_BUFFER, skyboxVBO);
 	glBufferData(GL_ARRAY_BUFFER, sizeof(skyboxVertices), &skyboxVertices, GL_STATIC_DRAW);
 	//Only using vertices for the skybox
 	glEnableVertexAttribArray(0);
 	glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(float), (void*)0);
 	//Unbind VAO and VBO
-	glBindVertexArray(0);
+	GLStateCache::Get().BindVertexArray(0);
 	glBindBuffer(GL_ARRAY_BUFFER, 0);
 }
 
@@ -978,7 +1229,7 @@ void loadHDRI(const char* path)
 	float* data = stbi_loadf(filename.c_str(), &width, &height, &nrComponents, 0);
 	if (data)
 	{
-		glBindTexture(GL_TEXTURE_2D, HDRIMap);
+		GLStateCache::Get().BindTexture(GL_TEXTURE_2D, HDRIMap);
 		glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB16F, width, height, 0, GL_RGB, GL_FLOAT, data);
 		glGenerateMipmap(GL_TEXTURE_2D);
 		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
@@ -986,6 +1237,11 @@ void loadHDRI(const char* path)
 		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
 		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
 
+		//The diffuse lighting comes straight from the full precision pixels, no convolution pass needed
+		double projectStart = glfwGetTime();
+		ProjectIrradianceSH(data, width, height, nrComponents, irradianceSH);
+		cout << "Irradiance SH: projected " << width << "x" << height << " in " << (glfwGetTime() - projectStart) * 1000.0 << "ms" << endl;
+
 		free(data);
 	}
 	else
@@ -1050,7 +1306,7 @@ void GenerateShadowMapFramebuffer()
 
 	unsigned int shadowMap;
 	glGenTextures(1, &shadowMap);
-	glBindTexture(GL_TEXTURE_2D, shadowMap);
+	GLStateCache::Get().BindTexture(GL_TEXTURE_2D, shadowMap);
 	glTexImage2D(GL_TEXTURE_2D, 0, GL_DEPTH_COMPONENT, SHADOW_WIDTH, SHADOW_HEIGHT, 0,
 		GL_DEPTH_COMPONENT, GL_FLOAT, NULL); //Texture that only stores the depth value of each fragment
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
@@ -1059,16 +1315,16 @@ void GenerateShadowMapFramebuffer()
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_BORDER);
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_BORDER);
 	glTexParameterfv(GL_TEXTURE_2D, GL_TEXTURE_BORDER_COLOR, borderColor);
-	glBindFramebuffer(GL_FRAMEBUFFER, shadowMapFB);
+	GLStateCache::Get().BindFramebuffer(GL_FRAMEBUFFER, shadowMapFB);
 	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, shadowMap, 0);
 	//Tell OpenGL this framebuffer will not be used for any rendering
 	glDrawBuffer(GL_NONE);
 	glReadBuffer(GL_NONE);
-	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+	GLStateCache::Get().BindFramebuffer(GL_FRAMEBUFFER, 0);
 
 	//Omnidirectional shadows using a depth cubemap
 	glGenTextures(1, &depthCubemap);
-	glBindTexture(GL_TEXTURE_CUBE_MAP, depthCubemap);
+	GLStateCache::Get().BindTexture(GL_TEXTURE_CUBE_MAP, depthCubemap);
 	for (int i = 0; i < 6; ++i)
 	{
 		glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + i, 0, GL_DEPTH_COMPONENT, SHADOW_WIDTH,
@@ -1080,11 +1336,11 @@ void GenerateShadowMapFramebuffer()
 	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
 	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
 	//Override old framebuffer GL_DEPTH_ATTACHMENT value
-	glBindFramebuffer(GL_FRAMEBUFFER, shadowMapFB);
+	GLStateCache::Get().BindFramebuffer(GL_FRAMEBUFFER, shadowMapFB);
 	glFramebufferTexture(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, depthCubemap, 0);
 	glDrawBuffer(GL_NONE);
 	glReadBuffer(GL_NONE);
-	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+	GLStateCache::Get().BindFramebuffer(GL_FRAMEBUFFER, 0);
 
 	//Set direction for each cubemap plane
 	float aspect = (float)SHADOW_WIDTH / (float)SHADOW_HEIGHT;
@@ -1110,8 +1366,8 @@ void SetupGuassianBlurFramebuffers()
 	glGenTextures(2, pingpongBuffers);
 	for (int i = 0; i < 2; i++)
 	{
-		glBindFramebuffer(GL_FRAMEBUFFER, pingpongFBO[i]);
-		glBindTexture(GL_TEXTURE_2D, pingpongBuffers[i]);
+		GLStateCache::Get().BindFramebuffer(GL_FRAMEBUFFER, pingpongFBO[i]);
+		GLStateCache::Get().BindTexture(GL_TEXTURE_2D, pingpongBuffers[i]);
 		glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA16F, VIEWPORTWIDTH, VIEWPORTHEIGHT, 0, GL_RGB, GL_FLOAT, NULL);
 		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
 		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
@@ -1127,13 +1383,13 @@ void HDRItoCubemap()
 	glGenFramebuffers(1, &captureFBO);
 	glGenRenderbuffers(1, &captureRBO);
 
-	glBindFramebuffer(GL_FRAMEBUFFER, captureFBO);
+	GLStateCache::Get().BindFramebuffer(GL_FRAMEBUFFER, captureFBO);
 	glBindRenderbuffer(GL_RENDERBUFFER, captureRBO);
 	glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, 512, 512); //allocate storage to renderbuffer
 	glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, captureRBO);
 
 	glGenTextures(1, &envCubemap);
-	glBindTexture(GL_TEXTURE_CUBE_MAP, envCubemap);
+	GLStateCache::Get().BindTexture(GL_TEXTURE_CUBE_MAP, envCubemap);
 	for (int i = 0; i < 6; ++i)
 	{
 		glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + i, 0, GL_RGB16F, 512, 512, 0, GL_RGB, GL_FLOAT, nullptr);
@@ -1158,74 +1414,33 @@ void HDRItoCubemap()
 	skyboxShader->use();
 	skyboxShader->setInt("HDRImap", 0);
 	skyboxShader->setMat4("projection", captureProjection);
-	glActiveTexture(GL_TEXTURE0);
-	glBindTexture(GL_TEXTURE_2D, HDRIMap);
+	GLStateCache::Get().ActiveTexture(GL_TEXTURE0);
+	GLStateCache::Get().BindTexture(GL_TEXTURE_2D, HDRIMap);
 	//Change viewport to size of incoming framebuffer
-	glViewport(0, 0, 512, 512);
-	glBindFramebuffer(GL_FRAMEBUFFER, captureFBO);
+	GLStateCache::Get().Viewport(0, 0, 512, 512);
+	GLStateCache::Get().BindFramebuffer(GL_FRAMEBUFFER, captureFBO);
 	for (int i = 0; i < 6; ++i)
 	{
 		skyboxShader->setMat4("view", captureViews[i]);
 		glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_CUBE_MAP_POSITIVE_X + i, envCubemap, 0);
 		glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
-		glBindVertexArray(skyboxVAO);
+		GLStateCache::Get().BindVertexArray(skyboxVAO);
 		glDrawArrays(GL_TRIANGLES, 0, 36);
 	}
-	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+	GLStateCache::Get().BindFramebuffer(GL_FRAMEBUFFER, 0);
 
 	//generate mipmap levels from first face
-	glBindTexture(GL_TEXTURE_CUBE_MAP, envCubemap);
+	GLStateCache::Get().BindTexture(GL_TEXTURE_CUBE_MAP, envCubemap);
 	glGenerateMipmap(GL_TEXTURE_CUBE_MAP);
 
 }
 
-void SetupIrradianceMap()
-{
-	//Setup irradiance cubemap
-	glGenTextures(1, &irradianceMap);
-	glBindTexture(GL_TEXTURE_CUBE_MAP, irradianceMap);
-	for (int i = 0; i < 6; ++i)
-	{
-		// Store irradiance map at a low resolution
-		glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + i, 0, GL_RGB16F, 32, 32, 0, GL_RGB, GL_FLOAT, nullptr);
-	}
-	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
-	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-
-	//Re-scale the render buffer to now accurately portray the new memory requirements
-	glBindFramebuffer(GL_FRAMEBUFFER, captureFBO);
-	glBindRenderbuffer(GL_RENDERBUFFER, captureRBO);
-	glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, 32, 32);
-	//render new cubemap to framebuffer
-	convolutionShader->use();
-	convolutionShader->setInt("skyboxMap", 0);
-	convolutionShader->setMat4("projection", captureProjection);
-	glActiveTexture(GL_TEXTURE0);
-	glBindTexture(GL_TEXTURE_CUBE_MAP, envCubemap);
-
-	glViewport(0, 0, 32, 32);
-	glBindFramebuffer(GL_FRAMEBUFFER, captureFBO);
-	for (int i = 0; i < 6; ++i)
-	{
-		convolutionShader->setMat4("view", captureViews[i]);
-		glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_CUBE_MAP_POSITIVE_X + i, irradianceMap, 0);
-		glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-
-		glBindVertexArray(skyboxVAO);
-		glDrawArrays(GL_TRIANGLES, 0, 36);
-	}
-	glBindFramebuffer(GL_FRAMEBUFFER, 0);
-}
-
 void MipMapSkybox()
 {
 	//Pre-Filtering the HDR environment map
 	glGenTextures(1, &prefilterMap);
-	glBindTexture(GL_TEXTURE_CUBE_MAP, prefilterMap);
+	GLStateCache::Get().BindTexture(GL_TEXTURE_CUBE_MAP, prefilterMap);
 	for (int i = 0; i < 6; ++i)
 	{
 		//128 x 128 reflection resolution
@@ -1243,10 +1458,10 @@ void MipMapSkybox()
 	filterShader->use();
 	filterShader->setInt("skyboxMap", 0);
 	filterShader->setMat4("projection", captureProjection);
-	glActiveTexture(GL_TEXTURE0);
-	glBindTexture(GL_TEXTURE_CUBE_MAP, envCubemap);
+	GLStateCache::Get().ActiveTexture(GL_TEXTURE0);
+	GLStateCache::Get().BindTexture(GL_TEXTURE_CUBE_MAP, envCubemap);
 
-	glBindFramebuffer(GL_FRAMEBUFFER, captureFBO);
+	GLStateCache::Get().BindFramebuffer(GL_FRAMEBUFFER, captureFBO);
 	unsigned int maxMipLevels = 5;
 	for (int mip = 0; mip < maxMipLevels; ++mip)
 	{
@@ -1255,7 +1470,7 @@ void MipMapSkybox()
 		unsigned int mipHeight = 128 * pow(0.5, mip);
 		glBindRenderbuffer(GL_RENDERBUFFER, captureRBO);
 		glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, mipWidth, mipHeight);
-		glViewport(0, 0, mipWidth, mipHeight);
+		GLStateCache::Get().Viewport(0, 0, mipWidth, mipHeight);
 
 		float roughness = (float)mip / (float)(maxMipLevels - 1);
 		filterShader->setFloat("roughness", roughness);
@@ -1266,14 +1481,11 @@ void MipMapSkybox()
 				prefilterMap, mip);
 			glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
-			glBindVertexArray(skyboxVAO);
+			GLStateCache::Get().BindVertexArray(skyboxVAO);
 			glDrawArrays(GL_TRIANGLES, 0, 36);
 		}
 	}
-	glBindFramebuffer(GL_FRAMEBUFFER, 0);
-
-	//Filter cubemap faces to remove seams around the edges
-	glEnable(GL_TEXTURE_CUBE_MAP_SEAMLESS);
+	GLStateCache::Get().BindFramebuffer(GL_FRAMEBUFFER, 0);
 }
 
 void BRDFScene()
@@ -1282,7 +1494,7 @@ void BRDFScene()
 	glGenTextures(1, &BRDFLUTtexture);
 
 	//pre-allocate memory for LUT texture
-	glBindTexture(GL_TEXTURE_2D, BRDFLUTtexture);
+	GLStateCache::Get().BindTexture(GL_TEXTURE_2D, BRDFLUTtexture);
 	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB16F, 512, 512, 0, GL_RG, GL_FLOAT, 0);
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
@@ -1290,24 +1502,69 @@ void BRDFScene()
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
 
 	//re-use framebuffer over screen-space quad
-	glBindFramebuffer(GL_FRAMEBUFFER, captureFBO);
+	GLStateCache::Get().BindFramebuffer(GL_FRAMEBUFFER, captureFBO);
 	glBindRenderbuffer(GL_RENDERBUFFER, captureRBO);
 	glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, 512, 512);
 	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, BRDFLUTtexture, 0);
 
-	glViewport(0, 0, 512, 512);
+	GLStateCache::Get().Viewport(0, 0, 512, 512);
 	BRDFshader->use();
 	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-	glBindVertexArray(screenQuadVAO);
+	GLStateCache::Get().BindVertexArray(screenQuadVAO);
 	glDrawArrays(GL_TRIANGLES, 0, 6);
 
-	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+	GLStateCache::Get().BindFramebuffer(GL_FRAMEBUFFER, 0);
+}
+
+void SetupImageBasedLighting()
+{
+	//Every file the baking programs were built from goes into the key along with the HDRI
+	vector<string> bakeSources;
+	Shader* bakeShaders[] = { skyboxShader.get(), filterShader.get(), BRDFshader.get() };
+	for (unsigned int i = 0; i < sizeof(bakeShaders) / sizeof(bakeShaders[0]); i++)
+	{
+		vector<string> files = bakeShaders[i]->GetSourceFiles();
+		bakeSources.insert(bakeSources.end(), files.begin(), files.end());
+	}
+	unsigned long long key = IBLCache::Get().MakeKey(HDRI_PATH, bakeSources);
+
+	GLuint maps[3];
+	const unsigned int shFloats = SH_COEFFICIENT_COUNT * 3;
+	if (IBLCache::Get().Load(key, maps, 3, &irradianceSH[0].x, shFloats))
+	{
+		envCubemap = maps[0];
+		prefilterMap = maps[1];
+		BRDFLUTtexture = maps[2];
+	}
+	else
+	{
+		loadHDRI(HDRI_PATH);
+		HDRItoCubemap();
+		MipMapSkybox();
+		BRDFScene();
+		maps[0] = envCubemap;
+		maps[1] = prefilterMap;
+		maps[2] = BRDFLUTtexture;
+		IBLCache::Get().Store(key, maps, 3, &irradianceSH[0].x, shFloats);
+	}
+	IBLCache::Get().PrintStatistics();
+
+	//The irradiance coefficients live in a uniform block instead of a cube map
+	EnvironmentConstants environment;
+	for (unsigned int i = 0; i < SH_COEFFICIENT_COUNT; i++)
+	{
+		environment.irradianceSH[i] = vec4(irradianceSH[i], 0.0f);
+	}
+	GetEnvironmentConstants().Update(environment);
+
+	//Prefilter map and BRDF lookup table go on the units PBR.frag declares for them
+	GLStateCache::Get().ActiveTexture(GL_TEXTURE8);
+	GLStateCache::Get().BindTexture(GL_TEXTURE_CUBE_MAP, prefilterMap);
+	GLStateCache::Get().ActiveTexture(GL_TEXTURE9);
+	GLStateCache::Get().BindTexture(GL_TEXTURE_2D, BRDFLUTtexture);
 
-	PBRShader->use();
-	glActiveTexture(GL_TEXTURE8);
-	glBindTexture(GL_TEXTURE_CUBE_MAP, prefilterMap);
-	PBRShader->setInt("prefilterMap", 8);
-	glBindTexture(GL_TEXTURE_2D, BRDFLUTtexture);
+	//Filter cubemap faces to remove seams around the edges
+	GLStateCache::Get().Enable(GL_TEXTURE_CUBE_MAP_SEAMLESS);
 }
 
 void GuassianBlurImplementation()
@@ -1319,19 +1576,19 @@ void GuassianBlurImplementation()
 	blurShader->use();
 	for (int i = 0; i < amount; i++)
 	{
-		glBindFramebuffer(GL_FRAMEBUFFER, pingpongFBO[horizontal]);
+		GLStateCache::Get().BindFramebuffer(GL_FRAMEBUFFER, pingpongFBO[horizontal]);
 		blurShader->setInt("horizontal", horizontal);
 		if (first_iteration)
 		{
-			glBindTexture(GL_TEXTURE_2D, bloomTexture);
+			GLStateCache::Get().BindTexture(GL_TEXTURE_2D, bloomTexture);
 			first_iteration = false;
 		}
 		else
 		{
-			glBindTexture(GL_TEXTURE_2D, pingpongBuffers[!horizontal]);
+			GLStateCache::Get().BindTexture(GL_TEXTURE_2D, pingpongBuffers[!horizontal]);
 		}
-		glBindVertexArray(screenQuadVAO);
-		glDisable(GL_DEPTH_TEST);
+		GLStateCache::Get().BindVertexArray(screenQuadVAO);
+		GLStateCache::Get().Disable(GL_DEPTH_TEST);
 		glDrawArrays(GL_TRIANGLES, 0, 6);
 
 		horizontal = !horizontal;
@@ -1339,23 +1596,25 @@ void GuassianBlurImplementation()
 
 }
 
-void fillShadowBuffer(mat4 lightViewMatrix, Model* backpack)
+void fillShadowBuffer(mat4 lightViewMatrix)
 {
-	glViewport(0, 0, SHADOW_WIDTH, SHADOW_HEIGHT); //Change viewport to size of shadow map
-	glBindFramebuffer(GL_FRAMEBUFFER, shadowMapFB);
+	GLStateCache::Get().Viewport(0, 0, SHADOW_WIDTH, SHADOW_HEIGHT); //Change viewport to size of shadow map
+	GLStateCache::Get().BindFramebuffer(GL_FRAMEBUFFER, shadowMapFB);
 	glClear(GL_DEPTH_BUFFER_BIT);
 	shadowMapShader->use();
 	//bind shadowTransforms vector to shader
-	for (int i = 0; i < 6; ++i)
-	{
-		shadowMapShader->setMat4("shadowMatrices[" + to_string(i) + "]", shadowTransforms.at(i));
-	}
+	shadowMapShader->setMat4Array("shadowMatrices", shadowTransforms.data(), 6);
+	vec3 lightPos = vec3(0.7f, 0.2f, 2.0f);
 	shadowMapShader->setFloat("far_plane", far);
-	shadowMapShader->setVec3("lightPos", vec3(0.7f, 0.2f, 2.0f));
+	shadowMapShader->setVec3("lightPos", lightPos);
 	shadowMapShader->setMat4("lightSpaceMatrix", lightViewMatrix);
-	display(*shadowMapShader, *backpack);
+	//Each cube face is a 90 degree view from the light
+	Model::SetLodView(LodView(lightPos, radians(90.0f), SHADOW_HEIGHT, 1.0f, shadowLodBias));
+	//Culled once per cube face, the geometry shader then only emits the faces each draw is visible in
+	opaqueDrawList.SetCullingView(CullingView(shadowTransforms));
+	display(*shadowMapShader);
 
-	glViewport(0, 0, VIEWPORTWIDTH, VIEWPORTHEIGHT); //Reset viewport size
+	GLStateCache::Get().Viewport(0, 0, VIEWPORTWIDTH, VIEWPORTHEIGHT); //Reset viewport size
 }
 
 void CalculatePerformanceMetrics()
@@ -1378,6 +1637,13 @@ void CalculatePerformanceMetrics()
 	{
 		cout << fps << " fps" << endl;
 		cout << "Frametime: " << frameTime << "ms" << endl;
+		//Last submitted pass is the camera's
+		renderQueue.PrintStatistics();
+		GLStateCache::Get().PrintStatistics();
+		GLStateCache::Get().ResetStatistics();
+		MaterialTable::Get().PrintStatistics();
+		cout << "Draw list: " << opaqueDrawList.GetDrawCount() << " draws, batch changes " << opaqueDrawList.GetUnsortedBatchChanges() << " unsorted -> "
+			<< opaqueDrawList.GetBatchCount() << " sorted" << endl;
 		fps = 0; //Reset FPS counter
 		delay = 1; //Reset timer
 		frameTime = 0; //Reset framtime
@@ -1424,8 +1690,8 @@ void processInput(GLFWwindow* window)
 /* Called whenever the user resizes the window containing the viewport*/
 void framebuffer_size_callback(GLFWwindow* window, int width, int height)
 {
-	glViewport(0, 0, width, height);
-	glBindTexture(GL_TEXTURE_2D, textureColorbuffer);
+	GLStateCache::Get().Viewport(0, 0, width, height);
+	GLStateCache::Get().BindTexture(GL_TEXTURE_2D, textureColorbuffer);
 	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
 
 	glBindRenderbuffer(GL_RENDERBUFFER, rbo);
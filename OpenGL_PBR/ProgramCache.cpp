@@ -0,0 +1,212 @@
+#ifdef _WIN32
+#include <direct.h>
+#else
+#include <sys/stat.h>
+#include <sys/types.h>
+#endif
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <vector>
+#include "ProgramCache.h"
+
+//Identifies a cached program file
+static const char PROGRAM_CACHE_MAGIC[4] = { 'P', 'R', 'G', 'B' };
+static const unsigned long long FNV_OFFSET_BASIS = 14695981039346656037ull;
+
+/* 64 bit FNV-1a of size bytes of data, carrying on from hash */
+static unsigned long long HashBytes(const void* data, size_t size, unsigned long long hash = FNV_OFFSET_BASIS)
+{
+	const unsigned char* bytes = (const unsigned char*)data;
+	for (size_t i = 0; i < size; i++)
+	{
+		hash = (hash ^ bytes[i]) * 1099511628211ull;
+	}
+	return hash;
+}
+
+/* Hash a string including its terminator, so "ab" + "c" and "a" + "bc" differ */
+static unsigned long long HashString(const char* text, unsigned long long hash)
+{
+	return text ? HashBytes(text, strlen(text) + 1, hash) : HashBytes("", 1, hash);
+}
+
+ProgramCache& ProgramCache::Get()
+{
+	static ProgramCache cache;
+	return cache;
+}
+
+ProgramCache::ProgramCache()
+	: driverHash(0), bIsInitialized(false), bIsSupported(false), hits(0), misses(0), rejections(0)
+{
+}
+
+unsigned long long ProgramCache::MakeKey(const char* const* sources, unsigned int count)
+{
+	if (!bIsInitialized)
+	{
+		initialize();
+	}
+	unsigned long long key = HashBytes(&count, sizeof(count), driverHash);
+	for (unsigned int i = 0; i < count; i++)
+	{
+		key = HashString(sources[i], key);
+	}
+	return key;
+}
+
+GLuint ProgramCache::Load(unsigned long long key)
+{
+	if (!bIsInitialized)
+	{
+		initialize();
+	}
+	if (!bIsSupported)
+	{
+		misses++;
+		return 0;
+	}
+
+	string path = getPath(key);
+	ifstream in(path, ios::binary);
+	ProgramCacheHeader header;
+	if (!in || !in.read((char*)&header, sizeof(header)) || memcmp(header.magic, PROGRAM_CACHE_MAGIC, sizeof(PROGRAM_CACHE_MAGIC)) != 0 ||
+		header.version != PROGRAM_CACHE_VERSION || header.key != key)
+	{
+		misses++;
+		return 0;
+	}
+	vector<char> binary(header.binarySize);
+	if (!in.read(binary.data(), binary.size()))
+	{
+		misses++;
+		return 0;
+	}
+	in.close();
+
+	GLuint program = glCreateProgram();
+	glProgramBinary(program, header.binaryFormat, binary.data(), (GLsizei)binary.size());
+	GLint success = 0;
+	glGetProgramiv(program, GL_LINK_STATUS, &success);
+	if (!success)
+	{
+		//Drivers can refuse a binary even with matching strings, it will be written again once the source has been linked
+		glDeleteProgram(program);
+		remove(path.c_str());
+		rejections++;
+		return 0;
+	}
+	hits++;
+	return program;
+}
+
+bool ProgramCache::Store(unsigned long long key, GLuint program)
+{
+	if (!bIsSupported)
+	{
+		return false;
+	}
+	GLint binarySize = 0;
+	glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &binarySize);
+	if (binarySize <= 0)
+	{
+		return false;
+	}
+
+	ProgramCacheHeader header;
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, PROGRAM_CACHE_MAGIC, sizeof(PROGRAM_CACHE_MAGIC));
+	header.version = PROGRAM_CACHE_VERSION;
+	header.key = key;
+	vector<char> binary(binarySize);
+	GLenum format = 0;
+	glGetProgramBinary(program, binarySize, &binarySize, &format, binary.data());
+	header.binaryFormat = format;
+	header.binarySize = (unsigned int)binarySize;
+
+#ifdef _WIN32
+	_mkdir(PROGRAM_CACHE_DIRECTORY);
+#else
+	mkdir(PROGRAM_CACHE_DIRECTORY, 0755);
+#endif
+	//Write to a temporary file first so a crash never leaves a half written binary behind
+	string path = getPath(key);
+	string tempPath = path + ".tmp";
+	{
+		ofstream out(tempPath, ios::binary | ios::trunc);
+		if (!out)
+		{
+			return false;
+		}
+		out.write((const char*)&header, sizeof(header));
+		out.write(binary.data(), header.binarySize);
+		if (!out)
+		{
+			out.close();
+			remove(tempPath.c_str());
+			return false;
+		}
+	}
+	remove(path.c_str());
+	if (rename(tempPath.c_str(), path.c_str()) != 0)
+	{
+		remove(tempPath.c_str());
+		return false;
+	}
+	return true;
+}
+
+unsigned int ProgramCache::GetHits() const
+{
+	return hits;
+}
+
+unsigned int ProgramCache::GetMisses() const
+{
+	return misses;
+}
+
+unsigned int ProgramCache::GetRejections() const
+{
+	return rejections;
+}
+
+void ProgramCache::PrintStatistics() const
+{
+	if (!bIsSupported)
+	{
+		cout << "Program cache: driver has no program binary formats, " << misses << " programs compiled" << endl;
+		return;
+	}
+	cout << "Program cache: " << hits << " hits, " << misses << " misses, " << rejections << " rejected binaries" << endl;
+}
+
+void ProgramCache::initialize()
+{
+	bIsInitialized = true;
+	driverHash = HashString((const char*)glGetString(GL_VENDOR), FNV_OFFSET_BASIS);
+	driverHash = HashString((const char*)glGetString(GL_RENDERER), driverHash);
+	driverHash = HashString((const char*)glGetString(GL_VERSION), driverHash);
+
+	//A binary is only ever read back by a driver offering the same formats it was written with
+	GLint formatCount = 0;
+	glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formatCount);
+	bIsSupported = formatCount > 0;
+	if (bIsSupported)
+	{
+		vector<GLint> formats(formatCount);
+		glGetIntegerv(GL_PROGRAM_BINARY_FORMATS, formats.data());
+		driverHash = HashBytes(formats.data(), formats.size() * sizeof(GLint), driverHash);
+	}
+	unsigned int version = PROGRAM_CACHE_VERSION;
+	driverHash = HashBytes(&version, sizeof(version), driverHash);
+}
+
+string ProgramCache::getPath(unsigned long long key)
+{
+	char name[17];
+	snprintf(name, sizeof(name), "%016llx", key);
+	return string(PROGRAM_CACHE_DIRECTORY) + "/" + name + ".progbin";
+}
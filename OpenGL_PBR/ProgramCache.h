@@ -0,0 +1,60 @@
+#pragma once
+#include <glad/glad.h>
+#include <string>
+
+using namespace std;
+
+//Bump whenever the layout of a cached program file changes so older files are ignored
+#define PROGRAM_CACHE_VERSION 1
+//Directory the program binaries are written to, relative to the working directory like the shaders
+#define PROGRAM_CACHE_DIRECTORY "shadercache"
+
+/* Fixed size header at the start of every cached program file */
+struct ProgramCacheHeader
+{
+	char magic[4];
+	unsigned int version;
+	unsigned long long key; //files are named after the key, this catches a file written under a different one
+	unsigned int binaryFormat;
+	unsigned int binarySize; //in bytes, the binary follows the header
+};
+
+/* On-disk cache of linked program binaries. Programs are keyed by a hash of every stage's source together with the
+driver's vendor, renderer and version strings and the binary formats it offers, so a driver update or an edited
+shader simply misses. A binary the driver still rejects is deleted and the program is compiled from source again */
+class ProgramCache
+{
+public:
+	static ProgramCache& Get();
+
+	/* Key of a program made from count stages of source, in the order they are attached. Needs a current context */
+	unsigned long long MakeKey(const char* const* sources, unsigned int count);
+
+	/* Linked program made from the cached binary for key, 0 if there is none or the driver would not take it */
+	GLuint Load(unsigned long long key);
+	/* Write the binary of a linked program. It has to be linked with GL_PROGRAM_BINARY_RETRIEVABLE_HINT set */
+	bool Store(unsigned long long key, GLuint program);
+
+	/* Programs that were loaded, compiled because there was no binary, and compiled because the binary was rejected */
+	unsigned int GetHits() const;
+	unsigned int GetMisses() const;
+	unsigned int GetRejections() const;
+	void PrintStatistics() const;
+
+private:
+	ProgramCache();
+
+	/* Hash the driver strings and check that the driver has any binary format at all */
+	void initialize();
+	static string getPath(unsigned long long key);
+
+	unsigned long long driverHash;
+	bool bIsInitialized;
+	bool bIsSupported; //false when the driver offers no program binary formats
+	unsigned int hits;
+	unsigned int misses;
+	unsigned int rejections;
+
+	ProgramCache(const ProgramCache&) = delete;
+	ProgramCache& operator=(const ProgramCache&) = delete;
+};
@@ -0,0 +1,186 @@
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+#include "RenderQueue.h"
+#include "GLStateCache.h"
+
+unsigned long long MakeSortKey(RenderPass pass, unsigned int program, unsigned int material, unsigned int vao, float depth)
+{
+	const unsigned long long depthMax = (1ull << RENDER_KEY_DEPTH_BITS) - 1;
+	unsigned long long depthBits = (unsigned long long)(glm::clamp(depth, 0.0f, 1.0f) * depthMax);
+	unsigned long long programBits = program & ((1u << RENDER_KEY_PROGRAM_BITS) - 1);
+	unsigned long long materialBits = material & ((1u << RENDER_KEY_MATERIAL_BITS) - 1);
+	unsigned long long vaoBits = vao & ((1u << RENDER_KEY_VAO_BITS) - 1);
+	unsigned long long key = (unsigned long long)pass << (64 - RENDER_KEY_PASS_BITS);
+	if (pass == RENDER_PASS_TRANSPARENT)
+	{
+		//Furthest first, state only breaks ties between draws at the same depth
+		key |= (depthMax - depthBits) << (64 - RENDER_KEY_PASS_BITS - RENDER_KEY_DEPTH_BITS);
+		key |= programBits << (RENDER_KEY_MATERIAL_BITS + RENDER_KEY_VAO_BITS);
+		key |= materialBits << RENDER_KEY_VAO_BITS;
+		key |= vaoBits;
+	}
+	else
+	{
+		key |= programBits << (RENDER_KEY_MATERIAL_BITS + RENDER_KEY_VAO_BITS + RENDER_KEY_DEPTH_BITS);
+		key |= materialBits << (RENDER_KEY_VAO_BITS + RENDER_KEY_DEPTH_BITS);
+		key |= vaoBits << RENDER_KEY_DEPTH_BITS;
+		key |= depthBits;
+	}
+	return key;
+}
+
+void RadixSort(const vector<unsigned long long>& keys, vector<unsigned int>& order)
+{
+	size_t count = keys.size();
+	order.resize(count);
+	for (size_t i = 0; i < count; i++)
+	{
+		order[i] = i;
+	}
+	if (count < 2)
+	{
+		return;
+	}
+
+	//Bytes that are the same in every key would not move anything
+	unsigned long long differing = 0;
+	for (size_t i = 1; i < count; i++)
+	{
+		differing |= keys[i] ^ keys[0];
+	}
+
+	vector<unsigned int> scratch(count);
+	for (int shift = 0; shift < 64; shift += 8)
+	{
+		if (((differing >> shift) & 0xFF) == 0)
+		{
+			continue;
+		}
+		unsigned int offsets[256];
+		memset(offsets, 0, sizeof(offsets));
+		for (size_t i = 0; i < count; i++)
+		{
+			offsets[(keys[order[i]] >> shift) & 0xFF]++;
+		}
+		unsigned int total = 0;
+		for (int digit = 0; digit < 256; digit++)
+		{
+			unsigned int digitCount = offsets[digit];
+			offsets[digit] = total;
+			total += digitCount;
+		}
+		for (size_t i = 0; i < count; i++)
+		{
+			scratch[offsets[(keys[order[i]] >> shift) & 0xFF]++] = order[i];
+		}
+		order.swap(scratch);
+	}
+}
+
+RenderStateChanges::RenderStateChanges()
+	: programs(0), textures(0), vaos(0)
+{
+}
+
+unsigned int RenderStateChanges::GetTotal() const
+{
+	return programs + textures + vaos;
+}
+
+RenderQueue::RenderQueue()
+	: packetCount(0)
+{
+}
+
+void RenderQueue::Add(unsigned long long key, unsigned int program, unsigned int texture, unsigned int vao, RenderFunction render, unsigned int index)
+{
+	Packet packet;
+	packet.key = key;
+	packet.program = program;
+	packet.texture = texture;
+	packet.vao = vao;
+	packet.render = render;
+	packet.index = index;
+	packets.push_back(packet);
+	keys.push_back(key);
+}
+
+void RenderQueue::Submit()
+{
+	unsortedOrder.resize(packets.size());
+	for (size_t i = 0; i < packets.size(); i++)
+	{
+		unsortedOrder[i] = i;
+	}
+	unsortedChanges = countChanges(unsortedOrder);
+	RadixSort(keys, order);
+	sortedChanges = countChanges(order);
+
+	//The state cache drops whatever is already bound, including state left over from the previous packet
+	GLStateCache& state = GLStateCache::Get();
+	for (size_t i = 0; i < order.size(); i++)
+	{
+		const Packet& packet = packets[order[i]];
+		if (packet.program)
+		{
+			state.UseProgram(packet.program);
+		}
+		if (packet.texture)
+		{
+			state.BindTextureUnit(0, GL_TEXTURE_2D, packet.texture);
+		}
+		if (packet.vao)
+		{
+			state.BindVertexArray(packet.vao);
+		}
+		packet.render(packet.index);
+	}
+
+	packetCount = packets.size();
+	packets.clear();
+	keys.clear();
+}
+
+RenderStateChanges RenderQueue::countChanges(const vector<unsigned int>& order) const
+{
+	RenderStateChanges changes;
+	unsigned int program = 0, texture = 0, vao = 0;
+	for (size_t i = 0; i < order.size(); i++)
+	{
+		const Packet& packet = packets[order[i]];
+		if (packet.program && packet.program != program)
+		{
+			changes.programs++;
+			program = packet.program;
+		}
+		if (packet.texture && packet.texture != texture)
+		{
+			changes.textures++;
+			texture = packet.texture;
+		}
+		if (packet.vao && packet.vao != vao)
+		{
+			changes.vaos++;
+			vao = packet.vao;
+		}
+	}
+	return changes;
+}
+
+const RenderStateChanges& RenderQueue::GetUnsortedChanges() const
+{
+	return unsortedChanges;
+}
+
+const RenderStateChanges& RenderQueue::GetSortedChanges() const
+{
+	return sortedChanges;
+}
+
+void RenderQueue::PrintStatistics() const
+{
+	cout << "Render queue: " << packetCount << " packets, state changes " << unsortedChanges.GetTotal() << " unsorted -> " << sortedChanges.GetTotal()
+		<< " sorted (programs " << unsortedChanges.programs << " -> " << sortedChanges.programs << ", textures " << unsortedChanges.textures << " -> "
+		<< sortedChanges.textures << ", VAOs " << unsortedChanges.vaos << " -> " << sortedChanges.vaos << ")" << endl;
+}
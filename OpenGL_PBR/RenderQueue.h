@@ -0,0 +1,86 @@
+#pragma once
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+#include <vector>
+
+using namespace std;
+using namespace glm;
+
+/* Passes in the order they are drawn, the top bits of every sort key */
+enum RenderPass
+{
+	RENDER_PASS_OPAQUE = 0,
+	RENDER_PASS_LIGHTS = 1, //light cubes draw their outlines over everything opaque
+	RENDER_PASS_SKYBOX = 2,
+	RENDER_PASS_TRANSPARENT = 3
+};
+
+//Widths of the sort key fields, 64 bits in total
+#define RENDER_KEY_PASS_BITS 4
+#define RENDER_KEY_PROGRAM_BITS 8
+#define RENDER_KEY_MATERIAL_BITS 16
+#define RENDER_KEY_VAO_BITS 12
+#define RENDER_KEY_DEPTH_BITS 24
+
+/* Pack a sort key. Opaque passes sort by program, then material, then VAO and finally front to back, so state only changes
+when it has to. The transparent pass has to blend in order, so depth comes straight after the pass and runs back to front.
+depth is 0 at the eye and 1 at the far plane */
+unsigned long long MakeSortKey(RenderPass pass, unsigned int program, unsigned int material, unsigned int vao, float depth);
+
+/* Write the indices of keys to order in ascending key order. Least significant digit radix sort, one byte per pass,
+skipping bytes that every key has in common. The sort is stable */
+void RadixSort(const vector<unsigned long long>& keys, vector<unsigned int>& order);
+
+/* GL state switches a list of draws needs */
+struct RenderStateChanges
+{
+	unsigned int programs;
+	unsigned int textures;
+	unsigned int vaos;
+
+	RenderStateChanges();
+	unsigned int GetTotal() const;
+};
+
+/* Called to draw packet index once its program, texture and VAO are bound */
+typedef void (*RenderFunction)(unsigned int index);
+
+/* Draw packets collected over a frame and drawn in sort key order. The queue binds each packet's program, texture
+(on unit 0) and VAO only when they differ from the previous packet, the render function does the rest */
+class RenderQueue
+{
+public:
+	RenderQueue();
+
+	/* 0 for program, texture or vao leaves that state alone */
+	void Add(unsigned long long key, unsigned int program, unsigned int texture, unsigned int vao, RenderFunction render, unsigned int index);
+	/* Sort and draw every packet, then clear the queue */
+	void Submit();
+
+	/* State changes the last Submit would have made in the order packets were added, and the ones it made after sorting */
+	const RenderStateChanges& GetUnsortedChanges() const;
+	const RenderStateChanges& GetSortedChanges() const;
+	void PrintStatistics() const;
+
+private:
+	struct Packet
+	{
+		unsigned long long key;
+		unsigned int program;
+		unsigned int texture;
+		unsigned int vao;
+		RenderFunction render;
+		unsigned int index;
+	};
+
+	/* Count the switches drawing packets in order would take */
+	RenderStateChanges countChanges(const vector<unsigned int>& order) const;
+
+	vector<Packet> packets;
+	vector<unsigned long long> keys;
+	vector<unsigned int> order;
+	vector<unsigned int> unsortedOrder;
+	RenderStateChanges unsortedChanges;
+	RenderStateChanges sortedChanges;
+	unsigned int packetCount; //drawn by the last Submit
+};
@@ -1,189 +1,494 @@
+#include <algorithm>
 #include "Shader.h"
+#include "GLStateCache.h"
+#include "ProgramCache.h"
+#include "ShaderCompiler.h"
+#include "ShaderPreprocessor.h"
+
+/* Stage name used in compile errors */
+static const char* stageName(GLenum type)
+{
+	switch (type)
+	{
+	case GL_VERTEX_SHADER:
+		return "VERTEX";
+	case GL_FRAGMENT_SHADER:
+		return "FRAGMENT";
+	case GL_GEOMETRY_SHADER:
+		return "GEOMETRY";
+	default:
+		return "COMPUTE";
+	}
+}
+
+/* Copy the value of a uniform outside any block from one program to another, where it has the same type */
+static void copyUniform(GLuint from, GLint fromLocation, GLuint to, GLint toLocation, GLenum type)
+{
+	GLfloat floats[16];
+	GLint ints[4];
+	GLuint uints[4];
+	switch (type)
+	{
+	case GL_FLOAT:
+		glGetUniformfv(from, fromLocation, floats);
+		glProgramUniform1fv(to, toLocation, 1, floats);
+		break;
+	case GL_FLOAT_VEC2:
+		glGetUniformfv(from, fromLocation, floats);
+		glProgramUniform2fv(to, toLocation, 1, floats);
+		break;
+	case GL_FLOAT_VEC3:
+		glGetUniformfv(from, fromLocation, floats);
+		glProgramUniform3fv(to, toLocation, 1, floats);
+		break;
+	case GL_FLOAT_VEC4:
+		glGetUniformfv(from, fromLocation, floats);
+		glProgramUniform4fv(to, toLocation, 1, floats);
+		break;
+	case GL_FLOAT_MAT3:
+		glGetUniformfv(from, fromLocation, floats);
+		glProgramUniformMatrix3fv(to, toLocation, 1, GL_FALSE, floats);
+		break;
+	case GL_FLOAT_MAT4:
+		glGetUniformfv(from, fromLocation, floats);
+		glProgramUniformMatrix4fv(to, toLocation, 1, GL_FALSE, floats);
+		break;
+	case GL_UNSIGNED_INT:
+		glGetUniformuiv(from, fromLocation, uints);
+		glProgramUniform1uiv(to, toLocation, 1, uints);
+		break;
+	default: //ints, bools and samplers, which is every other type the shaders use
+		glGetUniformiv(from, fromLocation, ints);
+		glProgramUniform1iv(to, toLocation, 1, ints);
+		break;
+	}
+}
+
+/* Which file each source string number in a compile log is, when there is more than one */
+static string listSourceFiles(const vector<string>& files)
+{
+	if (files.size() < 2)
+	{
+		return "";
+	}
+	string list = "Source strings:";
+	for (size_t i = 0; i < files.size(); i++)
+	{
+		list += " " + to_string(i) + " " + files[i];
+	}
+	return list + "\n";
+}
 
 void Shader::ReadSourceFile(string& vertexFile,string& fragmentFile, string& geometryFile, const char* vertexPath, const char* fragmentPath, const char* geometryPath)
 {
-	ifstream vShaderFile;
-	ifstream fShaderFile;
-	ifstream gShaderFile;
-	//Check for exceptions to throw the function
-	vShaderFile.exceptions(ifstream::failbit | ifstream::badbit);
-	fShaderFile.exceptions(ifstream::failbit | ifstream::badbit);
-	try
-	{
-		//Open Files
-		vShaderFile.open(vertexPath);
-		fShaderFile.open(fragmentPath);
-		stringstream vShaderStream, fShaderStream, gShaderStream;
-		//Put file contents into streams
-		vShaderStream << vShaderFile.rdbuf();
-		fShaderStream << fShaderFile.rdbuf();
-		//Close File handlers
-		vShaderFile.close();
-		fShaderFile.close();
-		//Convert stream to string
-		vertexFile = vShaderStream.str();
-		fragmentFile = fShaderStream.str();
-	}
-	catch (ifstream::failure e)
-	{
-		cout << "ERROR::SHADER::FILE_NOT_READ " << e.what() <<  endl;
-	}
-	//convert string to char*
-	const char* vShaderCode = vertexFile.c_str();
-	const char* fShaderCode = fragmentFile.c_str();
+	//Includes are expanded and the defines put in before anything reaches the driver
+	PreprocessShader(vertexPath, defines, vertexFile, sourceFiles[0]);
+	PreprocessShader(fragmentPath, defines, fragmentFile, sourceFiles[1]);
 	if (geometryPath) //passed through geometry shader
 	{
-		gShaderFile.open(geometryPath);
-		stringstream gShaderStream;
-		gShaderStream << gShaderFile.rdbuf();
-		gShaderFile.close();
-		geometryFile = gShaderStream.str();
-		const char* gShaderCode = geometryFile.c_str();
-		CompileShaders(vShaderCode, fShaderCode, gShaderCode);
+		PreprocessShader(geometryPath, defines, geometryFile, sourceFiles[2]);
 	}
-	else //Use default geometry shader
+	else
 	{
-		CompileShaders(vShaderCode, fShaderCode, geometryPath);
+		sourceFiles[2].clear();
 	}
-
 }
 
 void Shader::CompileShaders(const char* vertexCode, const char* fragmentCode, const char* geometryCode)
 {
-	unsigned int vertex, fragment;
-	unsigned int geometry = 0; //as we do not always use the geometry shader, we need to make sure to initialize it here
-	int success;
-	GLint logLength = 0; //Specifies the length of the log
-	string infoLog = ""; //Where output log is stored
-
-
-	//vertex shader
-	vertex = glCreateShader(GL_VERTEX_SHADER);
-	glShaderSource(vertex, 1, &vertexCode, NULL);
-	glCompileShader(vertex);
-	glGetShaderiv(vertex, GL_COMPILE_STATUS, &success);
-	if (!success)
-	{
-		glGetShaderiv(vertex, GL_INFO_LOG_LENGTH, &logLength); //Get length of output log
-		infoLog.resize(logLength); //Resize string to its desired length
-		glGetShaderInfoLog(vertex, logLength, &logLength, &infoLog[0]);
-		cout << "ERROR::SHADER:VERTEX:COMPILATION::FAILED\n" << infoLog << endl;
-		//Empty and reset string to empty ready for next call
-		infoLog = infoLog.empty(); 
-		infoLog.resize(0);
-	}
-	fragment = glCreateShader(GL_FRAGMENT_SHADER);
-	glShaderSource(fragment, 1, &fragmentCode, NULL);
-	glCompileShader(fragment);
-	glGetShaderiv(fragment, GL_COMPILE_STATUS, &success);
-	if (!success)
-	{
-		glGetShaderiv(fragment, GL_INFO_LOG_LENGTH, &logLength); //Get length of output log
-		infoLog.resize(logLength);
-		glGetShaderInfoLog(fragment, logLength, &logLength, &infoLog[0]);
-		cout << "ERROR::SHADER:FRAGMENT:COMPILATION::FAILED\n" << infoLog << endl;
-		infoLog = infoLog.empty();
-		infoLog.resize(0);
-	}
-	
-	if (geometryCode)
-	{
-		geometry = glCreateShader(GL_GEOMETRY_SHADER);
-		glShaderSource(geometry, 1, &geometryCode, NULL);
-		glCompileShader(geometry);
-		glGetShaderiv(geometry, GL_COMPILE_STATUS, &success);
-		if (!success)
-		{
-			glGetShaderiv(geometry, GL_INFO_LOG_LENGTH, &logLength); //Get length of output log
-			infoLog.resize(logLength);
-			glGetShaderInfoLog(geometry, logLength, &logLength, &infoLog[0]);
-			cout << "ERROR::SHADER:GEOMETRY:COMPILATION::FAILED\n" << infoLog << endl;
-			infoLog = infoLog.empty();
-			infoLog.resize(0);
-		}
-	}
-	
+	const GLenum types[] = { GL_VERTEX_SHADER, GL_FRAGMENT_SHADER, GL_GEOMETRY_SHADER };
+	const char* sources[] = { vertexCode, fragmentCode, geometryCode };
+	submitStages(types, sources, geometryCode ? 3 : 2);
+}
 
-	//Attach shaders
-	ID = glCreateProgram();
-	glAttachShader(ID, vertex);
-	glAttachShader(ID, fragment);
-	if (geometryCode)
+void Shader::submitStages(const GLenum* types, const char* const* sources, unsigned int count)
+{
+	bIsCompiling = true;
+	stageCount = 0;
+
+	//Warm starts link straight from the driver's binary and never compile any GLSL
+	cacheKey = ProgramCache::Get().MakeKey(sources, count);
+	ID = ProgramCache::Get().Load(cacheKey);
+	bIsFromCache = ID != 0;
+	if (bIsFromCache)
 	{
-		glAttachShader(ID, geometry);
+		return;
 	}
-	
-	glLinkProgram(ID);
-	//Check for linking errors
-	glGetProgramiv(ID, GL_LINK_STATUS, &success);
-	if (!success)
+
+	//No status is asked for here, so the driver can compile every stage and link while the caller gets on with something else
+	for (unsigned int i = 0; i < count; i++)
 	{
-		glGetProgramiv(ID, GL_INFO_LOG_LENGTH, &logLength); //Get length of output log
-		infoLog.resize(logLength);
-		glGetProgramInfoLog(ID, logLength, &logLength, &infoLog[0]);
-		cout << "ERROR::SHADER::PROGRAM::LINKING_FAILED\n" << infoLog << endl;
-		infoLog = infoLog.empty();
-		infoLog.resize(0);
+		stages[i] = glCreateShader(types[i]);
+		stageTypes[i] = types[i];
+		glShaderSource(stages[i], 1, &sources[i], NULL);
+		glCompileShader(stages[i]);
 	}
-	
-	//Delete shaders upon successful linking
-	glDeleteShader(vertex);
-	glDeleteShader(fragment);
-	if (geometryCode)
+	stageCount = count;
+
+	//Attach shaders
+	ID = glCreateProgram();
+	glProgramParameteri(ID, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+	for (unsigned int i = 0; i < stageCount; i++)
 	{
-		glDeleteShader(geometry);
+		glAttachShader(ID, stages[i]);
 	}
-	//glDeleteShader(geometry);
+	glLinkProgram(ID);
 }
 
 Shader::Shader(const char* vertexPath, const char* fragmentPath, const char* geometryPath)
+	: stageCount(0), cacheKey(0), bIsCompiling(false), bIsFromCache(false), bIsCompute(false), bIsLinked(false), ID(0)
 {
-	string vertexCode;
-	string fragmentCode;
-	string geometryCode;
-	ReadSourceFile(vertexCode, fragmentCode, geometryCode, vertexPath, fragmentPath, geometryPath);
+	LoadShader(vertexPath, fragmentPath, geometryPath);
 }
 
 Shader::Shader()
+	: stageCount(0), cacheKey(0), bIsCompiling(false), bIsFromCache(false), bIsCompute(false), bIsLinked(false), ID(0)
 {
 
 }
 
 void Shader::use()
 {
-	glUseProgram(ID);
+	GLStateCache::Get().UseProgram(ID);
 }
 
 void Shader::LoadShader(const char* vertexPath, const char* fragmentPath, const char* geometryPath)
+{
+	SubmitShader(vertexPath, fragmentPath, geometryPath);
+	FinishCompile();
+}
+
+void Shader::SubmitShader(const char* vertexPath, const char* fragmentPath, const char* geometryPath)
 {
 	string vertexCode;
 	string fragmentCode;
 	string geometryCode;
+	sourcePaths[0] = vertexPath;
+	sourcePaths[1] = fragmentPath;
+	sourcePaths[2] = geometryPath ? geometryPath : "";
+	bIsCompute = false;
 	ReadSourceFile(vertexCode, fragmentCode, geometryCode, vertexPath, fragmentPath, geometryPath);
+	CompileShaders(vertexCode.c_str(), fragmentCode.c_str(), geometryPath ? geometryCode.c_str() : nullptr);
+}
+
+bool Shader::IsCompiled() const
+{
+	if (!bIsCompiling || stageCount == 0)
+	{
+		return true;
+	}
+	//Without parallel compile support any status query waits for the driver, so only FinishCompile asks
+	if (!ShaderCompiler::Get().IsParallel())
+	{
+		return false;
+	}
+	GLint bIsComplete = GL_FALSE;
+	glGetProgramiv(ID, GL_COMPLETION_STATUS_KHR, &bIsComplete);
+	return bIsComplete == GL_TRUE;
+}
+
+void Shader::FinishCompile()
+{
+	if (!bIsCompiling)
+	{
+		return;
+	}
+	bIsCompiling = false;
+	bIsLinked = true; //a cached binary was already checked when it was loaded
+
+	if (stageCount > 0)
+	{
+		int success;
+		GLint logLength = 0; //Specifies the length of the log
+		string infoLog = ""; //Where output log is stored
+		for (unsigned int i = 0; i < stageCount; i++)
+		{
+			glGetShaderiv(stages[i], GL_COMPILE_STATUS, &success);
+			if (!success)
+			{
+				glGetShaderiv(stages[i], GL_INFO_LOG_LENGTH, &logLength); //Get length of output log
+				infoLog.resize(logLength); //Resize string to its desired length
+				glGetShaderInfoLog(stages[i], logLength, &logLength, &infoLog[0]);
+				cout << "ERROR::SHADER:" << stageName(stageTypes[i]) << ":COMPILATION::FAILED\n" << listSourceFiles(sourceFiles[i]) << infoLog << endl;
+				infoLog.resize(0);
+			}
+		}
+
+		//Check for linking errors
+		glGetProgramiv(ID, GL_LINK_STATUS, &success);
+		if (!success)
+		{
+			glGetProgramiv(ID, GL_INFO_LOG_LENGTH, &logLength); //Get length of output log
+			infoLog.resize(logLength);
+			glGetProgramInfoLog(ID, logLength, &logLength, &infoLog[0]);
+			cout << "ERROR::SHADER::PROGRAM::LINKING_FAILED\n" << infoLog << endl;
+			infoLog.resize(0);
+			bIsLinked = false;
+		}
+		else
+		{
+			ProgramCache::Get().Store(cacheKey, ID);
+		}
+
+		//Delete shaders upon successful linking
+		for (unsigned int i = 0; i < stageCount; i++)
+		{
+			glDeleteShader(stages[i]);
+		}
+		stageCount = 0;
+	}
+
+	reflect();
+}
+
+bool Shader::IsFromCache() const
+{
+	return bIsFromCache;
+}
+
+void Shader::SetDefines(const string& defines)
+{
+	this->defines = defines;
 }
 
-void Shader::setBool(const string& name, bool value) const
+void Shader::LoadComputeShader(const char* computePath)
 {
-	glUniform1i(glGetUniformLocation(ID, name.c_str()), (int)value);
+	SubmitComputeShader(computePath);
+	FinishCompile();
 }
 
-void Shader::setInt(const string& name, int value) const
+void Shader::SubmitComputeShader(const char* computePath)
 {
-	glUniform1i(glGetUniformLocation(ID, name.c_str()), value);
+	sourcePaths[0] = computePath;
+	sourcePaths[1] = "";
+	sourcePaths[2] = "";
+	bIsCompute = true;
+	sourceFiles[1].clear();
+	sourceFiles[2].clear();
+	string computeCode;
+	PreprocessShader(computePath, defines, computeCode, sourceFiles[0]);
+	const char* cShaderCode = computeCode.c_str();
+
+	const GLenum type = GL_COMPUTE_SHADER;
+	submitStages(&type, &cShaderCode, 1);
 }
 
-void Shader::setFloat(const string& name, float value) const
+bool Shader::IsLinked() const
 {
-	glUniform1f(glGetUniformLocation(ID, name.c_str()), value);
+	return bIsLinked;
 }
 
-void Shader::setMat4(const string& name, mat4& matrix) const
+vector<string> Shader::GetSourceFiles() const
+{
+	//Stages share includes, each file is only listed once
+	vector<string> files;
+	for (unsigned int stage = 0; stage < 3; stage++)
+	{
+		for (size_t i = 0; i < sourceFiles[stage].size(); i++)
+		{
+			if (find(files.begin(), files.end(), sourceFiles[stage][i]) == files.end())
+			{
+				files.push_back(sourceFiles[stage][i]);
+			}
+		}
+	}
+	return files;
+}
+
+const string& Shader::GetName() const
+{
+	return bIsCompute ? sourcePaths[0] : sourcePaths[1];
+}
+
+void Shader::SubmitReload(Shader& reloaded) const
+{
+	reloaded.SetDefines(defines);
+	if (bIsCompute)
+	{
+		reloaded.SubmitComputeShader(sourcePaths[0].c_str());
+		return;
+	}
+	reloaded.SubmitShader(sourcePaths[0].c_str(), sourcePaths[1].c_str(), sourcePaths[2].empty() ? nullptr : sourcePaths[2].c_str());
+}
+
+bool Shader::Adopt(Shader& reloaded)
+{
+	if (!reloaded.bIsLinked)
+	{
+		glDeleteProgram(reloaded.ID);
+		reloaded.ID = 0;
+		return false;
+	}
+
+	//Values set on the old program would otherwise fall back to zero, samplers included
+	for (unordered_map<unsigned int, UniformInfo>::const_iterator it = reloaded.uniforms.begin(); it != reloaded.uniforms.end(); it++)
+	{
+		const UniformInfo* old = GetUniform(UniformId(it->first));
+		if (it->second.location >= 0 && old && old->location >= 0 && old->type == it->second.type)
+		{
+			copyUniform(ID, old->location, reloaded.ID, it->second.location, it->second.type);
+		}
+	}
+	//Blocks bound in code instead of with a layout qualifier keep their binding
+	for (unordered_map<unsigned int, UniformBlockInfo>::iterator it = reloaded.blocks.begin(); it != reloaded.blocks.end(); it++)
+	{
+		const UniformBlockInfo* old = GetBlock(UniformId(it->first));
+		if (old && old->binding != it->second.binding)
+		{
+			glUniformBlockBinding(reloaded.ID, it->second.index, old->binding);
+			it->second.binding = old->binding;
+		}
+	}
+
+	GLStateCache::Get().ForgetProgram(ID);
+	glDeleteProgram(ID);
+	ID = reloaded.ID;
+	reloaded.ID = 0;
+	uniforms.swap(reloaded.uniforms);
+	blocks.swap(reloaded.blocks);
+	reflectedNames.swap(reloaded.reflectedNames);
+	for (unsigned int stage = 0; stage < 3; stage++)
+	{
+		sourceFiles[stage].swap(reloaded.sourceFiles[stage]);
+	}
+	cacheKey = reloaded.cacheKey;
+	bIsFromCache = reloaded.bIsFromCache;
+	return true;
+}
+
+const UniformInfo* Shader::GetUniform(UniformId id) const
+{
+	unordered_map<unsigned int, UniformInfo>::const_iterator it = uniforms.find(id.hash);
+	return it != uniforms.end() ? &it->second : nullptr;
+}
+
+const UniformBlockInfo* Shader::GetBlock(UniformId id) const
+{
+	unordered_map<unsigned int, UniformBlockInfo>::const_iterator it = blocks.find(id.hash);
+	return it != blocks.end() ? &it->second : nullptr;
+}
+
+GLint Shader::GetLocation(UniformId id) const
+{
+	const UniformInfo* info = GetUniform(id);
+	return info ? info->location : -1;
+}
+
+void Shader::setBool(UniformId id, bool value) const
+{
+	glProgramUniform1i(ID, GetLocation(id), (int)value);
+}
+
+void Shader::setInt(UniformId id, int value) const
+{
+	glProgramUniform1i(ID, GetLocation(id), value);
+}
+
+void Shader::setFloat(UniformId id, float value) const
+{
+	glProgramUniform1f(ID, GetLocation(id), value);
+}
+
+void Shader::setMat4(UniformId id, const mat4& matrix) const
 {
 	//pas through as transposed 4x4 matrix
-	glUniformMatrix4fv(glGetUniformLocation(ID, name.c_str()), 1, GL_FALSE, &matrix[0][0]);
+	glProgramUniformMatrix4fv(ID, GetLocation(id), 1, GL_FALSE, &matrix[0][0]);
+}
+
+void Shader::setMat4Array(UniformId id, const mat4* matrices, unsigned int count) const
+{
+	glProgramUniformMatrix4fv(ID, GetLocation(id), count, GL_FALSE, &matrices[0][0][0]);
+}
+
+void Shader::setMat3(UniformId id, const mat3& matrix) const
+{
+	glProgramUniformMatrix3fv(ID, GetLocation(id), 1, GL_FALSE, &matrix[0][0]);
+}
+
+void Shader::setVec3(UniformId id, vec3 value) const
+{
+	glProgramUniform3fv(ID, GetLocation(id), 1, &value[0]);
+}
+
+void Shader::setVec2(UniformId id, vec2 value) const
+{
+	glProgramUniform2fv(ID, GetLocation(id), 1, &value[0]);
 }
 
-void Shader::setVec3(const string& name, vec3 value) const
+void Shader::setUint(UniformId id, unsigned int value) const
 {
-	glUniform3fv(glGetUniformLocation(ID, name.c_str()), 1, &value[0]);
+	glProgramUniform1ui(ID, GetLocation(id), value);
+}
+
+void Shader::reflect()
+{
+	uniforms.clear();
+	blocks.clear();
+	reflectedNames.clear();
+
+	GLint uniformCount = 0;
+	glGetProgramInterfaceiv(ID, GL_UNIFORM, GL_ACTIVE_RESOURCES, &uniformCount);
+	const GLenum uniformProperties[] = { GL_NAME_LENGTH, GL_LOCATION, GL_BLOCK_INDEX, GL_OFFSET, GL_ARRAY_STRIDE, GL_ARRAY_SIZE, GL_TYPE };
+	string name;
+	for (GLint i = 0; i < uniformCount; i++)
+	{
+		GLint values[7];
+		glGetProgramResourceiv(ID, GL_UNIFORM, i, 7, uniformProperties, 7, nullptr, values);
+		name.resize(values[0]);
+		glGetProgramResourceName(ID, GL_UNIFORM, i, values[0], nullptr, &name[0]);
+		name.resize(values[0] - 1); //the length counts the terminator
+
+		UniformInfo info;
+		info.location = values[1];
+		info.blockIndex = values[2];
+		info.offset = values[3];
+		info.arrayStride = values[4];
+		info.type = (GLenum)values[6];
+		addUniform(name, info);
+
+		//Arrays are reported once as "name[0]", so the bare name and every other element are added here
+		if (name.size() > 3 && name.compare(name.size() - 3, 3, "[0]") == 0)
+		{
+			string arrayName = name.substr(0, name.size() - 3);
+			addUniform(arrayName, info);
+			for (GLint element = 1; element < values[5]; element++)
+			{
+				UniformInfo elementInfo = info;
+				//Elements of an array outside a block take consecutive locations
+				elementInfo.location = info.location >= 0 ? info.location + element : -1;
+				elementInfo.offset = info.offset >= 0 ? info.offset + element * info.arrayStride : -1;
+				addUniform(arrayName + "[" + to_string(element) + "]", elementInfo);
+			}
+		}
+	}
+
+	GLint blockCount = 0;
+	glGetProgramInterfaceiv(ID, GL_UNIFORM_BLOCK, GL_ACTIVE_RESOURCES, &blockCount);
+	const GLenum blockProperties[] = { GL_NAME_LENGTH, GL_BUFFER_BINDING, GL_BUFFER_DATA_SIZE };
+	for (GLint i = 0; i < blockCount; i++)
+	{
+		GLint values[3];
+		glGetProgramResourceiv(ID, GL_UNIFORM_BLOCK, i, 3, blockProperties, 3, nullptr, values);
+		name.resize(values[0]);
+		glGetProgramResourceName(ID, GL_UNIFORM_BLOCK, i, values[0], nullptr, &name[0]);
+		name.resize(values[0] - 1);
+
+		UniformBlockInfo info;
+		info.index = i;
+		info.binding = values[1];
+		info.dataSize = values[2];
+		blocks[UniformId(name).hash] = info;
+	}
+}
+
+void Shader::addUniform(const string& name, const UniformInfo& info)
+{
+	unsigned int hash = UniformId(name).hash;
+	unordered_map<unsigned int, string>::iterator it = reflectedNames.find(hash);
+	if (it != reflectedNames.end() && it->second != name)
+	{
+		cout << "WARNING::SHADER::UNIFORM_HASH_COLLISION " << it->second << " and " << name << endl;
+	}
+	reflectedNames[hash] = name;
+	uniforms[hash] = info;
 }
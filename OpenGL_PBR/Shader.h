@@ -5,18 +5,77 @@
 #include <fstream>
 #include <sstream>
 #include <iostream>
+#include <unordered_map>
+#include <vector>
 #include <glm/gtc/matrix_transform.hpp>
 
 using namespace std;
 using namespace glm;
 
+/* FNV-1a hash of a uniform or block name. hash lets a name be hashed in pieces, a struct prefix then the member */
+constexpr unsigned int HashUniformName(const char* name, unsigned int hash = 2166136261u)
+{
+	return *name ? HashUniformName(name + 1, (hash ^ (unsigned char)*name) * 16777619u) : hash;
+}
+
+/* Uniform or block name as its hash, which is all a program looks names up by. Keep ids of names used every frame
+in constants so the hash is only worked out once */
+struct UniformId
+{
+	unsigned int hash;
+
+	constexpr UniformId(const char* name) : hash(HashUniformName(name)) {}
+	UniformId(const string& name) : hash(HashUniformName(name.c_str())) {}
+	explicit constexpr UniformId(unsigned int hash) : hash(hash) {}
+};
+
+/* Where a uniform lives, from reflecting the linked program */
+struct UniformInfo
+{
+	GLint location; //-1 inside a block
+	GLint blockIndex; //-1 outside a block
+	GLint offset; //in bytes from the start of the block, -1 outside a block
+	GLint arrayStride; //bytes between array elements inside a block
+	GLenum type; //GL_FLOAT_VEC3, GL_SAMPLER_2D, ...
+};
+
+/* Uniform block of a linked program */
+struct UniformBlockInfo
+{
+	GLint index;
+	GLint binding;
+	GLint dataSize; //in bytes, as laid out by the driver
+};
+
 class Shader
 {
 private:
+	/* Look up every uniform and uniform block of the linked program so setting one never asks the driver */
+	void reflect();
+	/* Remember info under name, warning if a different name already has its hash */
+	void addUniform(const string& name, const UniformInfo& info);
+
+	unordered_map<unsigned int, UniformInfo> uniforms;
+	unordered_map<unsigned int, UniformBlockInfo> blocks;
+	unordered_map<unsigned int, string> reflectedNames; //to tell hash collisions apart from the same name twice
 
 	void ReadSourceFile(string& vertexFile, string& fragmentFile, string& geometryFile, const char* vertexPath, const char* fragmentPath, const char* geometryPath);
 
 	void CompileShaders(const char* vertexCode, const char* fragmentCode, const char* geometryCode);
+	/* Start compiling and linking count stages, or load the program's cached binary, without waiting on the driver */
+	void submitStages(const GLenum* types, const char* const* sources, unsigned int count);
+
+	unsigned int stages[3]; //shader objects attached to the program until FinishCompile
+	GLenum stageTypes[3];
+	unsigned int stageCount; //0 once finished, or when the program came from the binary cache
+	unsigned long long cacheKey;
+	bool bIsCompiling; //submitted and FinishCompile has not run yet
+	bool bIsFromCache;
+	string defines; //put after the #version line of every stage
+	vector<string> sourceFiles[3]; //files that went into each stage, by source string number
+	string sourcePaths[3]; //what the program was loaded from, only the first for a compute shader
+	bool bIsCompute;
+	bool bIsLinked;
 
 public:
 	unsigned int ID;
@@ -29,11 +88,47 @@ public:
 	void use();
 
 	void LoadShader(const char* vertexPath, const char* fragmentPath, const char* geometryPath = nullptr);
+	/* LoadShader split in two so the driver can compile in the background. SubmitShader reads the sources and starts
+	compiling, IsCompiled polls without blocking and FinishCompile checks the result and reflects the program */
+	void SubmitShader(const char* vertexPath, const char* fragmentPath, const char* geometryPath = nullptr);
+	bool IsCompiled() const;
+	void FinishCompile();
+	/* Was the program loaded from the program binary cache instead of being compiled */
+	bool IsFromCache() const;
+	/* #define lines every stage is compiled with, takes effect from the next load */
+	void SetDefines(const string& defines);
+	/* Load a program made of a single compute shader */
+	void LoadComputeShader(const char* computePath);
+	/* LoadComputeShader without waiting, finish with FinishCompile */
+	void SubmitComputeShader(const char* computePath);
+
+	/* Did the last program compile and link. Only known once FinishCompile has run */
+	bool IsLinked() const;
+	/* Every file the last program was built from, includes counted */
+	vector<string> GetSourceFiles() const;
+	/* Fragment or compute shader the program was loaded from, for logging */
+	const string& GetName() const;
+	/* Start compiling the last program's sources again, with the same defines, into reloaded */
+	void SubmitReload(Shader& reloaded) const;
+	/* Swap in reloaded's program if it linked, carrying over the values of uniforms outside blocks and the bindings of
+	uniform blocks that both programs have. The old program, or reloaded's if it failed, is deleted */
+	bool Adopt(Shader& reloaded);
+
+	/* Reflected uniform and block info, nullptr when the program has no such uniform or block */
+	const UniformInfo* GetUniform(UniformId id) const;
+	const UniformBlockInfo* GetBlock(UniformId id) const;
+	/* Location of a uniform outside any block, -1 if there is none. Array elements are found as "name[i]" */
+	GLint GetLocation(UniformId id) const;
 
-	//uniform query functions
-	void setBool(const string& name, bool value) const;
-	void setInt(const string& name, int value) const;
-	void setFloat(const string& name, float value) const;
-	void setMat4(const string& name, mat4& matrix) const;
-	void setVec3(const string& name, vec3 value) const;
+	//uniform setters, work whether or not the program is in use
+	void setBool(UniformId id, bool value) const;
+	void setInt(UniformId id, int value) const;
+	void setFloat(UniformId id, float value) const;
+	void setMat4(UniformId id, const mat4& matrix) const;
+	/* count elements of a mat4 array from its first, in one call */
+	void setMat4Array(UniformId id, const mat4* matrices, unsigned int count) const;
+	void setMat3(UniformId id, const mat3& matrix) const;
+	void setVec3(UniformId id, vec3 value) const;
+	void setVec2(UniformId id, vec2 value) const;
+	void setUint(UniformId id, unsigned int value) const;
 };
\ No newline at end of file
@@ -0,0 +1,145 @@
+#include <chrono>
+#include <cstring>
+#include <iostream>
+#include "ShaderCompiler.h"
+
+typedef void (APIENTRYP PFNGLMAXSHADERCOMPILERTHREADSKHRPROC)(GLuint count);
+
+static bool hasExtension(const char* name)
+{
+	GLint count = 0;
+	glGetIntegerv(GL_NUM_EXTENSIONS, &count);
+	for (GLint i = 0; i < count; i++)
+	{
+		const char* extension = (const char*)glGetStringi(GL_EXTENSIONS, i);
+		if (extension && strcmp(extension, name) == 0)
+		{
+			return true;
+		}
+	}
+	return false;
+}
+
+static double millisecondsSince(chrono::steady_clock::time_point start)
+{
+	return chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+}
+
+ShaderCompiler& ShaderCompiler::Get()
+{
+	static ShaderCompiler compiler;
+	return compiler;
+}
+
+ShaderCompiler::ShaderCompiler()
+	: waitMilliseconds(0.0), bIsParallel(false)
+{
+}
+
+void ShaderCompiler::Initialize(GLADloadproc loader)
+{
+	//The ARB extension is the same one under its older name
+	bool bIsKHR = hasExtension("GL_KHR_parallel_shader_compile");
+	if (!bIsKHR && !hasExtension("GL_ARB_parallel_shader_compile"))
+	{
+		return;
+	}
+	PFNGLMAXSHADERCOMPILERTHREADSKHRPROC maxShaderCompilerThreads =
+		(PFNGLMAXSHADERCOMPILERTHREADSKHRPROC)loader(bIsKHR ? "glMaxShaderCompilerThreadsKHR" : "glMaxShaderCompilerThreadsARB");
+	if (maxShaderCompilerThreads)
+	{
+		maxShaderCompilerThreads(0xFFFFFFFFu); //as many threads as the driver wants
+	}
+	bIsParallel = true;
+}
+
+void ShaderCompiler::Submit(Shader& shader, const char* vertexPath, const char* fragmentPath, const char* geometryPath)
+{
+	chrono::steady_clock::time_point start = chrono::steady_clock::now();
+	shader.SubmitShader(vertexPath, fragmentPath, geometryPath);
+
+	PendingProgram program;
+	program.shader = &shader;
+	program.name = fragmentPath; //every program has its own fragment shader
+	program.submitMilliseconds = millisecondsSince(start);
+	pending.push_back(program);
+}
+
+size_t ShaderCompiler::Poll()
+{
+	for (size_t i = 0; i < pending.size();)
+	{
+		if (pending[i].shader->IsCompiled())
+		{
+			finish(pending[i]);
+			pending.erase(pending.begin() + i);
+		}
+		else
+		{
+			i++;
+		}
+	}
+	return pending.size();
+}
+
+void ShaderCompiler::WaitAll()
+{
+	chrono::steady_clock::time_point start = chrono::steady_clock::now();
+	//Whatever finished in the background first, then block on the rest in the order they were submitted
+	Poll();
+	for (size_t i = 0; i < pending.size(); i++)
+	{
+		finish(pending[i]);
+	}
+	pending.clear();
+	waitMilliseconds += millisecondsSince(start);
+}
+
+void ShaderCompiler::Finish(Shader& shader)
+{
+	for (size_t i = 0; i < pending.size(); i++)
+	{
+		if (pending[i].shader == &shader)
+		{
+			chrono::steady_clock::time_point start = chrono::steady_clock::now();
+			finish(pending[i]);
+			pending.erase(pending.begin() + i);
+			waitMilliseconds += millisecondsSince(start);
+			return;
+		}
+	}
+}
+
+bool ShaderCompiler::IsParallel() const
+{
+	return bIsParallel;
+}
+
+void ShaderCompiler::PrintStatistics() const
+{
+	double submitTotal = 0.0;
+	double finishTotal = 0.0;
+	for (size_t i = 0; i < timings.size(); i++)
+	{
+		const ProgramTiming& timing = timings[i];
+		cout << "  " << timing.name << ": submit " << timing.submitMilliseconds << "ms, finish " << timing.finishMilliseconds << "ms"
+			<< (timing.bIsFromCache ? " (cached)" : "") << endl;
+		submitTotal += timing.submitMilliseconds;
+		finishTotal += timing.finishMilliseconds;
+	}
+	cout << "Shader compiler: " << timings.size() << " programs, " << (bIsParallel ? "parallel" : "serial") << ", submit " << submitTotal
+		<< "ms, finish " << finishTotal << "ms, blocked " << waitMilliseconds << "ms waiting" << endl;
+}
+
+void ShaderCompiler::finish(const PendingProgram& program)
+{
+	chrono::steady_clock::time_point start = chrono::steady_clock::now();
+	program.shader->FinishCompile();
+
+	ProgramTiming timing;
+	timing.name = program.name;
+	timing.submitMilliseconds = program.submitMilliseconds;
+	timing.finishMilliseconds = millisecondsSince(start);
+	timing.bIsFromCache = program.shader->IsFromCache();
+	timings.push_back(timing);
+}
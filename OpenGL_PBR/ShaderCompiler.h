@@ -0,0 +1,66 @@
+#pragma once
+#include <glad/glad.h>
+#include <string>
+#include <vector>
+
+#include "Shader.h"
+
+using namespace std;
+
+//From GL_KHR_parallel_shader_compile, glad was generated without extensions
+#ifndef GL_COMPLETION_STATUS_KHR
+#define GL_COMPLETION_STATUS_KHR 0x91B1
+#endif
+
+/* Compiles a batch of programs at once. Every stage of every program is handed to the driver before any status is
+asked for, so a driver with GL_KHR_parallel_shader_compile compiles them on its own threads while loading carries on.
+Completion is polled with GL_COMPLETION_STATUS_KHR, without the extension programs are only checked in WaitAll */
+class ShaderCompiler
+{
+public:
+	static ShaderCompiler& Get();
+
+	/* Look for parallel compile support through loader and let the driver pick its thread count. Needs a current context */
+	void Initialize(GLADloadproc loader);
+
+	/* Read shader's sources and start compiling it, it cannot be used until it has been finished by Poll or WaitAll */
+	void Submit(Shader& shader, const char* vertexPath, const char* fragmentPath, const char* geometryPath = nullptr);
+	/* Finish every program the driver is done with, returns how many are still compiling */
+	size_t Poll();
+	/* Finish every submitted program, blocking on the ones that are still compiling */
+	void WaitAll();
+	/* Finish shader straight away if it is still pending, blocking on it if the driver is not done */
+	void Finish(Shader& shader);
+
+	bool IsParallel() const;
+	/* Time each program took to submit and to finish, and how long WaitAll blocked for */
+	void PrintStatistics() const;
+
+private:
+	ShaderCompiler();
+
+	struct PendingProgram
+	{
+		Shader* shader;
+		string name;
+		double submitMilliseconds;
+	};
+
+	struct ProgramTiming
+	{
+		string name;
+		double submitMilliseconds; //reading the sources and handing them to the driver
+		double finishMilliseconds; //checking the result, including any wait for the driver
+		bool bIsFromCache;
+	};
+
+	void finish(const PendingProgram& program);
+
+	vector<PendingProgram> pending;
+	vector<ProgramTiming> timings;
+	double waitMilliseconds;
+	bool bIsParallel;
+
+	ShaderCompiler(const ShaderCompiler&) = delete;
+	ShaderCompiler& operator=(const ShaderCompiler&) = delete;
+};
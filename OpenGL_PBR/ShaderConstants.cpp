@@ -0,0 +1,88 @@
+#include "ShaderConstants.h"
+
+const UniformMember* FrameConstants::GetMembers(unsigned int& count)
+{
+	static const UniformMember members[] = {
+		{ "lightPositions", offsetof(FrameConstants, lightPositions) },
+		{ "lightColors", offsetof(FrameConstants, lightColors) },
+		{ "viewPos", offsetof(FrameConstants, viewPos) },
+		{ "far_plane", offsetof(FrameConstants, far_plane) }
+	};
+	count = sizeof(members) / sizeof(members[0]);
+	return members;
+}
+
+ObjectConstants::ObjectConstants(const mat4& model, vec3 dequantizeOffset, vec3 dequantizeScale, int firstInstance, unsigned int materialIndex)
+	: model(model), dequantizeOffset(dequantizeOffset), firstInstance(firstInstance), dequantizeScale(dequantizeScale), materialIndex(materialIndex)
+{
+	mat3 normal = transpose(inverse(mat3(model)));
+	for (int i = 0; i < 3; i++)
+	{
+		normalMatrix[i] = vec4(normal[i], 0.0f);
+	}
+}
+
+const UniformMember* ObjectConstants::GetMembers(unsigned int& count)
+{
+	static const UniformMember members[] = {
+		{ "model", offsetof(ObjectConstants, model) },
+		{ "normalMatrix", offsetof(ObjectConstants, normalMatrix) },
+		{ "dequantizeOffset", offsetof(ObjectConstants, dequantizeOffset) },
+		{ "firstInstance", offsetof(ObjectConstants, firstInstance) },
+		{ "dequantizeScale", offsetof(ObjectConstants, dequantizeScale) },
+		{ "materialIndex", offsetof(ObjectConstants, materialIndex) }
+	};
+	count = sizeof(members) / sizeof(members[0]);
+	return members;
+}
+
+const UniformMember* EnvironmentConstants::GetMembers(unsigned int& count)
+{
+	static const UniformMember members[] = {
+		{ "irradianceSH", offsetof(EnvironmentConstants, irradianceSH) }
+	};
+	count = sizeof(members) / sizeof(members[0]);
+	return members;
+}
+
+UniformBuffer<FrameConstants>& GetFrameConstants()
+{
+	//Never destroyed, like the geometry arena, so nothing deletes it after the context is gone
+	static UniformBuffer<FrameConstants>* buffer = nullptr;
+	if (!buffer)
+	{
+		buffer = new UniformBuffer<FrameConstants>();
+		buffer->Create(FRAME_CONSTANTS_BINDING);
+	}
+	return *buffer;
+}
+
+UniformBuffer<ObjectConstants>& GetObjectConstants()
+{
+	static UniformBuffer<ObjectConstants>* buffer = nullptr;
+	if (!buffer)
+	{
+		buffer = new UniformBuffer<ObjectConstants>();
+		buffer->Create(OBJECT_CONSTANTS_BINDING);
+	}
+	return *buffer;
+}
+
+UniformBuffer<EnvironmentConstants>& GetEnvironmentConstants()
+{
+	static UniformBuffer<EnvironmentConstants>* buffer = nullptr;
+	if (!buffer)
+	{
+		buffer = new UniformBuffer<EnvironmentConstants>();
+		buffer->Create(ENVIRONMENT_CONSTANTS_BINDING);
+	}
+	return *buffer;
+}
+
+bool ValidateShaderConstants(const Shader& shader)
+{
+	bool bIsFrameValid = GetFrameConstants().Validate(shader, "FrameConstants", "FrameConstants");
+	bool bIsObjectValid = GetObjectConstants().Validate(shader, "ObjectConstants", "ObjectConstants");
+	bool bIsEnvironmentValid = GetEnvironmentConstants().Validate(shader, "EnvironmentConstants", "EnvironmentConstants");
+	return bIsFrameValid && bIsObjectValid && bIsEnvironmentValid;
+}
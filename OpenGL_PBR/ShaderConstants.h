@@ -0,0 +1,77 @@
+#pragma once
+#include <cstddef>
+#include <glm/glm.hpp>
+
+#include "UniformBuffer.h"
+
+using namespace std;
+using namespace glm;
+
+//Uniform buffer bindings, 0 is the Matrices block
+#define FRAME_CONSTANTS_BINDING 1
+#define OBJECT_CONSTANTS_BINDING 2
+#define ENVIRONMENT_CONSTANTS_BINDING 3
+//Lights the PBR shader has room for
+#define MAX_FRAME_LIGHTS 4
+
+/* Mirror of the FrameConstants block in PBR.frag, written once per pass. std140 pads array elements to 16 bytes,
+so the light arrays are vec4s with w unused */
+struct FrameConstants
+{
+	vec4 lightPositions[MAX_FRAME_LIGHTS];
+	vec4 lightColors[MAX_FRAME_LIGHTS];
+	vec3 viewPos;
+	float far_plane; //packs into the last 4 bytes of viewPos's 16
+
+	static const UniformMember* GetMembers(unsigned int& count);
+};
+
+static_assert(offsetof(FrameConstants, lightPositions) == 0, "FrameConstants.lightPositions must match std140");
+static_assert(offsetof(FrameConstants, lightColors) == 64, "FrameConstants.lightColors must match std140");
+static_assert(offsetof(FrameConstants, viewPos) == 128, "FrameConstants.viewPos must match std140");
+static_assert(offsetof(FrameConstants, far_plane) == 140, "FrameConstants.far_plane must match std140");
+static_assert(sizeof(FrameConstants) % 16 == 0, "std140 blocks are a whole number of vec4s");
+
+/* Mirror of the ObjectConstants block in vertexShader.vert, shadowMap.vert and lightShader.vert, for draws that do not
+go through a DrawList. std140 stores a mat3 as three vec4 columns */
+struct ObjectConstants
+{
+	mat4 model;
+	vec4 normalMatrix[3];
+	vec3 dequantizeOffset;
+	int firstInstance; //-1 when not instanced
+	vec3 dequantizeScale;
+	unsigned int materialIndex; //entry in the MaterialTable
+
+	/* Everything for a draw with model, the normal matrix is worked out here */
+	ObjectConstants(const mat4& model = mat4(1.0f), vec3 dequantizeOffset = vec3(0.0f), vec3 dequantizeScale = vec3(1.0f), int firstInstance = -1,
+		unsigned int materialIndex = 0);
+	static const UniformMember* GetMembers(unsigned int& count);
+};
+
+static_assert(offsetof(ObjectConstants, model) == 0, "ObjectConstants.model must match std140");
+static_assert(offsetof(ObjectConstants, normalMatrix) == 64, "ObjectConstants.normalMatrix must match std140");
+static_assert(offsetof(ObjectConstants, dequantizeOffset) == 112, "ObjectConstants.dequantizeOffset must match std140");
+static_assert(offsetof(ObjectConstants, firstInstance) == 124, "ObjectConstants.firstInstance must match std140");
+static_assert(offsetof(ObjectConstants, dequantizeScale) == 128, "ObjectConstants.dequantizeScale must match std140");
+static_assert(offsetof(ObjectConstants, materialIndex) == 140, "ObjectConstants.materialIndex must match std140");
+static_assert(sizeof(ObjectConstants) % 16 == 0, "std140 blocks are a whole number of vec4s");
+
+/* Mirror of the EnvironmentConstants block in PBR.frag, written once the image based lighting is set up. Each
+coefficient of the irradiance spherical harmonic is a vec4 with w unused, std140 pads vec3 array elements to 16 bytes */
+struct EnvironmentConstants
+{
+	vec4 irradianceSH[9];
+
+	static const UniformMember* GetMembers(unsigned int& count);
+};
+
+static_assert(offsetof(EnvironmentConstants, irradianceSH) == 0, "EnvironmentConstants.irradianceSH must match std140");
+static_assert(sizeof(EnvironmentConstants) % 16 == 0, "std140 blocks are a whole number of vec4s");
+
+/* Constant buffers shared by every program, created the first time they are asked for */
+UniformBuffer<FrameConstants>& GetFrameConstants();
+UniformBuffer<ObjectConstants>& GetObjectConstants();
+UniformBuffer<EnvironmentConstants>& GetEnvironmentConstants();
+/* Check the constant blocks shader declares against their mirrors */
+bool ValidateShaderConstants(const Shader& shader);
@@ -0,0 +1,88 @@
+#include <fstream>
+#include <iostream>
+#include <set>
+#include "ShaderPreprocessor.h"
+
+/* Path inside the quotes if line is an #include directive */
+static bool parseInclude(const string& line, string& includePath)
+{
+	size_t start = line.find_first_not_of(" \t");
+	if (start == string::npos || line.compare(start, 8, "#include") != 0)
+	{
+		return false;
+	}
+	size_t open = line.find('"', start + 8);
+	size_t close = open == string::npos ? string::npos : line.find('"', open + 1);
+	if (close == string::npos)
+	{
+		return false;
+	}
+	includePath = line.substr(open + 1, close - open - 1);
+	return true;
+}
+
+static bool isVersion(const string& line)
+{
+	size_t start = line.find_first_not_of(" \t");
+	return start != string::npos && line.compare(start, 8, "#version") == 0;
+}
+
+/* Append path to code with its includes expanded, defines go after the #version line when they are given */
+static bool expandFile(const string& path, const string* defines, string& code, vector<string>& files, set<string>& included)
+{
+	ifstream file(path);
+	if (!file)
+	{
+		cout << "ERROR::SHADER::FILE_NOT_READ " << path << endl;
+		return false;
+	}
+	string fileIndex = to_string(files.size());
+	files.push_back(path);
+	string directory = path.substr(0, path.find_last_of("/\\") + 1);
+
+	string line;
+	unsigned int lineNumber = 0;
+	while (getline(file, line))
+	{
+		lineNumber++;
+		string includePath;
+		if (parseInclude(line, includePath))
+		{
+			string fullPath = directory + includePath;
+			if (included.insert(fullPath).second)
+			{
+				code += "#line 1 " + to_string(files.size()) + "\n";
+				if (!expandFile(fullPath, nullptr, code, files, included))
+				{
+					cout << "ERROR::SHADER::INCLUDE_FAILED " << path << "(" << lineNumber << ")" << endl;
+					return false;
+				}
+				code += "#line " + to_string(lineNumber + 1) + " " + fileIndex + "\n";
+			}
+			else
+			{
+				code += "\n"; //already included, the empty line keeps the numbering
+			}
+			continue;
+		}
+
+		code += line;
+		code += '\n';
+		if (defines && isVersion(line))
+		{
+			code += *defines;
+			code += "#line " + to_string(lineNumber + 1) + " " + fileIndex + "\n";
+			defines = nullptr;
+		}
+	}
+	return true;
+}
+
+bool PreprocessShader(const string& path, const string& defines, string& code, vector<string>& files)
+{
+	code.clear();
+	files.clear();
+	set<string> included;
+	included.insert(path);
+	return expandFile(path, defines.empty() ? nullptr : &defines, code, files, included);
+}
@@ -0,0 +1,10 @@
+#pragma once
+#include <string>
+#include <vector>
+
+using namespace std;
+
+/* Expand every #include "file" in the GLSL file at path and put defines straight after its #version line. Included
+paths are relative to the file including them, and a file is only ever included once so includes need no guards.
+#line directives keep compile errors pointing at the right line, files lists every file by its source string number */
+bool PreprocessShader(const string& path, const string& defines, string& code, vector<string>& files);
@@ -0,0 +1,222 @@
+#ifdef __linux__
+#include <sys/inotify.h>
+#include <unistd.h>
+#endif
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <iostream>
+#include <set>
+#include "ShaderReloader.h"
+#include "ShaderCompiler.h"
+#include "ShaderConstants.h"
+
+/* Modification time of path, -1 if it cannot be read */
+static long long modifiedTime(const string& path)
+{
+	struct stat info;
+	if (stat(path.c_str(), &info) != 0)
+	{
+		return -1;
+	}
+	return (long long)info.st_mtime;
+}
+
+ShaderReloader& ShaderReloader::Get()
+{
+	static ShaderReloader reloader;
+	return reloader;
+}
+
+ShaderReloader::ShaderReloader()
+	: watchDescriptor(-1), lastPoll(chrono::steady_clock::now()), reloadCount(0), failureCount(0)
+{
+#ifdef __linux__
+	watchDescriptor = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+#endif
+}
+
+ShaderReloader::~ShaderReloader()
+{
+#ifdef __linux__
+	if (watchDescriptor >= 0)
+	{
+		close(watchDescriptor);
+	}
+#endif
+}
+
+void ShaderReloader::AddDirectory(const string& directory)
+{
+	string path = directory;
+	while (path.size() > 1 && (path[path.size() - 1] == '/' || path[path.size() - 1] == '\\'))
+	{
+		path.erase(path.size() - 1);
+	}
+	directories.push_back(path);
+#ifdef __linux__
+	if (watchDescriptor >= 0)
+	{
+		//Editors either write the file in place or write a new one and move it over the old
+		int watch = inotify_add_watch(watchDescriptor, path.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO);
+		if (watch < 0)
+		{
+			cout << "ERROR::SHADER_RELOADER::CANNOT_WATCH " << path << endl;
+			return;
+		}
+		watchDirectories[watch] = path;
+	}
+#endif
+}
+
+void ShaderReloader::Watch(Shader& shader)
+{
+	shaders.push_back(&shader);
+}
+
+void ShaderReloader::Update()
+{
+	vector<string> changed;
+	readChanges(changed);
+	if (!changed.empty())
+	{
+		//Only programs built from a changed file are reloaded, each once however many of its files changed
+		set<string> changedFiles(changed.begin(), changed.end());
+		for (size_t i = 0; i < shaders.size(); i++)
+		{
+			vector<string> files = shaders[i]->GetSourceFiles();
+			for (size_t j = 0; j < files.size(); j++)
+			{
+				if (changedFiles.count(files[j]))
+				{
+					reload(*shaders[i]);
+					break;
+				}
+			}
+		}
+	}
+
+	for (size_t i = 0; i < pending.size();)
+	{
+		if (!finish(pending[i]))
+		{
+			i++;
+			continue;
+		}
+		Shader* shader = pending[i].shader;
+		bool bIsStale = pending[i].bIsStale;
+		pending.erase(pending.begin() + i);
+		if (bIsStale)
+		{
+			reload(*shader);
+		}
+	}
+}
+
+unsigned int ShaderReloader::GetReloadCount() const
+{
+	return reloadCount;
+}
+
+unsigned int ShaderReloader::GetFailureCount() const
+{
+	return failureCount;
+}
+
+void ShaderReloader::readChanges(vector<string>& changed)
+{
+	if (watchDescriptor >= 0)
+	{
+#ifdef __linux__
+		//Events are read until the queue is empty, the descriptor never blocks
+		char buffer[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+		ssize_t length;
+		while ((length = read(watchDescriptor, buffer, sizeof(buffer))) > 0)
+		{
+			for (char* event = buffer; event < buffer + length;)
+			{
+				const inotify_event* info = (const inotify_event*)event;
+				map<int, string>::const_iterator directory = watchDirectories.find(info->wd);
+				if (info->len > 0 && directory != watchDirectories.end())
+				{
+					changed.push_back(directory->second + "/" + info->name);
+				}
+				event += sizeof(inotify_event) + info->len;
+			}
+		}
+#endif
+		return;
+	}
+
+	if (chrono::duration<double>(chrono::steady_clock::now() - lastPoll).count() < SHADER_RELOAD_POLL_INTERVAL)
+	{
+		return;
+	}
+	lastPoll = chrono::steady_clock::now();
+	//Files seen for the first time, such as a new include, are only remembered
+	for (size_t i = 0; i < shaders.size(); i++)
+	{
+		vector<string> files = shaders[i]->GetSourceFiles();
+		for (size_t j = 0; j < files.size(); j++)
+		{
+			long long time = modifiedTime(files[j]);
+			map<string, long long>::iterator it = modifiedTimes.find(files[j]);
+			if (it == modifiedTimes.end())
+			{
+				modifiedTimes[files[j]] = time;
+			}
+			else if (it->second != time)
+			{
+				it->second = time;
+				changed.push_back(files[j]);
+			}
+		}
+	}
+}
+
+void ShaderReloader::reload(Shader& shader)
+{
+	for (size_t i = 0; i < pending.size(); i++)
+	{
+		if (pending[i].shader == &shader)
+		{
+			pending[i].bIsStale = true;
+			return;
+		}
+	}
+	cout << "Reloading " << shader.GetName() << endl;
+	PendingReload entry;
+	entry.shader = &shader;
+	entry.reloaded.reset(new Shader());
+	entry.bIsStale = false;
+	shader.SubmitReload(*entry.reloaded);
+	pending.push_back(move(entry));
+}
+
+bool ShaderReloader::finish(PendingReload& entry)
+{
+	//Without parallel compiles the status can only be had by waiting, so that is done straight away
+	if (ShaderCompiler::Get().IsParallel() && !entry.reloaded->IsCompiled())
+	{
+		return false;
+	}
+	entry.reloaded->FinishCompile();
+
+	//A program whose constant blocks no longer match their mirrors would read garbage, so it is treated like a failed link
+	if (entry.reloaded->IsLinked() && !ValidateShaderConstants(*entry.reloaded))
+	{
+		cout << "ERROR::SHADER_RELOADER::CONSTANTS_MISMATCH " << entry.shader->GetName() << endl;
+		glDeleteProgram(entry.reloaded->ID);
+		entry.reloaded->ID = 0;
+		failureCount++;
+		return true;
+	}
+	if (!entry.shader->Adopt(*entry.reloaded))
+	{
+		cout << "ERROR::SHADER_RELOADER::KEEPING_OLD_PROGRAM " << entry.shader->GetName() << endl;
+		failureCount++;
+		return true;
+	}
+	cout << "Reloaded " << entry.shader->GetName() << endl;
+	reloadCount++;
+	return true;
+}
@@ -0,0 +1,67 @@
+#pragma once
+#include <chrono>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "Shader.h"
+
+using namespace std;
+
+//How often source files are checked for changes where there is no file watcher, in seconds
+#define SHADER_RELOAD_POLL_INTERVAL 0.5
+
+/* Recompiles programs when their source files change, so shaders can be edited without restarting. Changes are picked
+up with inotify on Linux and by polling modification times elsewhere. A changed program is compiled in the background
+next to the one in use, which is only replaced once the new one links and its constant blocks line up */
+class ShaderReloader
+{
+public:
+	static ShaderReloader& Get();
+
+	/* Watch the files directly inside directory with inotify, includes in a sub directory need it added as well. Without
+	inotify the source files of every watched program are polled instead, wherever they are */
+	void AddDirectory(const string& directory);
+	/* Reload shader whenever one of its sources changes. shader has to stay at the same address while it is watched */
+	void Watch(Shader& shader);
+
+	/* Start reloading programs whose sources changed and swap in the ones that finished. Never waits on the driver
+	when it can compile in parallel */
+	void Update();
+
+	/* Programs swapped in and reloads that failed and kept the old program */
+	unsigned int GetReloadCount() const;
+	unsigned int GetFailureCount() const;
+
+private:
+	ShaderReloader();
+	~ShaderReloader();
+
+	struct PendingReload
+	{
+		Shader* shader;
+		unique_ptr<Shader> reloaded;
+		bool bIsStale; //a source changed again while compiling, reload once more when done
+	};
+
+	/* Paths of files changed since the last call */
+	void readChanges(vector<string>& changed);
+	/* Start reloading shader, or mark its reload stale if one is already compiling */
+	void reload(Shader& shader);
+	/* Swap in entry's program if it can be used, returns false if it is still compiling */
+	bool finish(PendingReload& entry);
+
+	vector<string> directories;
+	vector<Shader*> shaders;
+	vector<PendingReload> pending;
+	int watchDescriptor; //inotify instance, -1 without one
+	map<int, string> watchDirectories; //directory of every inotify watch
+	map<string, long long> modifiedTimes; //last seen modification time of every polled file
+	chrono::steady_clock::time_point lastPoll;
+	unsigned int reloadCount;
+	unsigned int failureCount;
+
+	ShaderReloader(const ShaderReloader&) = delete;
+	ShaderReloader& operator=(const ShaderReloader&) = delete;
+};
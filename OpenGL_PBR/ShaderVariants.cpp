@@ -0,0 +1,102 @@
+#include "ShaderVariants.h"
+#include "ShaderCompiler.h"
+#include "ShaderReloader.h"
+
+unsigned int ShadowFilterFeatures(ShadowFilterMode mode)
+{
+	return ((unsigned int)mode << SHADER_SHADOW_FILTER_SHIFT) & SHADER_SHADOW_FILTER_MASK;
+}
+
+string MakeShaderDefines(unsigned int features)
+{
+	string defines;
+	if (features & SHADER_NORMAL_MAP)
+	{
+		defines += "#define HAS_NORMAL_MAP\n";
+	}
+	if (features & SHADER_AO)
+	{
+		defines += "#define HAS_AO\n";
+	}
+	if (features & SHADER_EMISSIVE)
+	{
+		defines += "#define HAS_EMISSIVE\n";
+	}
+	if (features & SHADER_INSTANCED)
+	{
+		defines += "#define INSTANCED\n";
+	}
+	if (features & SHADER_ALPHA_TEST)
+	{
+		defines += "#define ALPHA_TEST\n";
+	}
+	defines += "#define SHADOW_FILTER_MODE " + to_string((features & SHADER_SHADOW_FILTER_MASK) >> SHADER_SHADOW_FILTER_SHIFT) + "\n";
+	return defines;
+}
+
+ShaderVariants::ShaderVariants(const char* vertexPath, const char* fragmentPath, const char* geometryPath)
+	: vertexPath(vertexPath), fragmentPath(fragmentPath), geometryPath(geometryPath ? geometryPath : ""), bHasGeometry(geometryPath != nullptr),
+	baseFeatures(0), supportedFeatures(~0u)
+{
+}
+
+void ShaderVariants::SetDefines(const string& defines)
+{
+	this->defines = defines;
+}
+
+void ShaderVariants::SetFeatures(unsigned int baseFeatures, unsigned int supportedFeatures)
+{
+	this->baseFeatures = baseFeatures;
+	this->supportedFeatures = supportedFeatures;
+}
+
+unsigned int ShaderVariants::Resolve(unsigned int features) const
+{
+	//A mode in the base features wins over one asked for, the two bits cannot be or'ed together
+	unsigned int resolved = features & supportedFeatures;
+	if (baseFeatures & SHADER_SHADOW_FILTER_MASK)
+	{
+		resolved &= ~SHADER_SHADOW_FILTER_MASK;
+	}
+	return resolved | baseFeatures;
+}
+
+void ShaderVariants::Request(unsigned int features)
+{
+	unsigned int resolved = Resolve(features);
+	if (variants.find(resolved) != variants.end())
+	{
+		return;
+	}
+	unique_ptr<Shader> variant(new Shader());
+	variant->SetDefines(defines + MakeShaderDefines(resolved));
+	ShaderCompiler::Get().Submit(*variant, vertexPath.c_str(), fragmentPath.c_str(), bHasGeometry ? geometryPath.c_str() : nullptr);
+	ShaderReloader::Get().Watch(*variant);
+	variants.insert(make_pair(resolved, move(variant)));
+}
+
+Shader& ShaderVariants::Get(unsigned int features)
+{
+	unsigned int resolved = Resolve(features);
+	map<unsigned int, unique_ptr<Shader>>::iterator it = variants.find(resolved);
+	if (it == variants.end())
+	{
+		//Compiling here stalls the frame, the variant should have been requested while loading
+		cout << "WARNING::SHADER_VARIANTS::COMPILED_ON_DEMAND " << fragmentPath << " features 0x" << hex << resolved << dec << endl;
+		Request(features);
+		it = variants.find(resolved);
+	}
+	ShaderCompiler::Get().Finish(*it->second);
+	return *it->second;
+}
+
+const map<unsigned int, unique_ptr<Shader>>& ShaderVariants::GetVariants() const
+{
+	return variants;
+}
+
+size_t ShaderVariants::GetCount() const
+{
+	return variants.size();
+}
@@ -0,0 +1,73 @@
+#pragma once
+#include <map>
+#include <memory>
+#include <string>
+
+#include "Shader.h"
+
+using namespace std;
+
+/* Compile time features of a program, each bit turns into a #define the sources test with #ifdef */
+enum ShaderFeature
+{
+	SHADER_NORMAL_MAP = 1 << 0, //HAS_NORMAL_MAP
+	SHADER_AO = 1 << 1, //HAS_AO
+	SHADER_EMISSIVE = 1 << 2, //HAS_EMISSIVE
+	SHADER_INSTANCED = 1 << 3, //INSTANCED, positions go through the instance records
+	SHADER_ALPHA_TEST = 1 << 4 //ALPHA_TEST
+};
+
+/* How shadows are filtered, SHADOW_FILTER_MODE in the sources. Stored in the feature bits from SHADER_SHADOW_FILTER_SHIFT */
+enum ShadowFilterMode
+{
+	SHADOW_FILTER_NONE = 0,
+	SHADOW_FILTER_HARD = 1, //one sample
+	SHADOW_FILTER_PCF = 2 //20 samples around the fragment
+};
+
+#define SHADER_SHADOW_FILTER_SHIFT 5
+#define SHADER_SHADOW_FILTER_MASK (3u << SHADER_SHADOW_FILTER_SHIFT)
+
+/* Feature bits of a shadow filter mode */
+unsigned int ShadowFilterFeatures(ShadowFilterMode mode);
+/* #define lines for every feature in features */
+string MakeShaderDefines(unsigned int features);
+
+/* Every compiled permutation of one set of sources, keyed by feature bits. Branches on material and pass settings are
+made at compile time instead of on uniforms, a draw just picks the variant for its features. Variants are compiled
+through the ShaderCompiler, so requesting them all before the first frame lets the driver build them in parallel */
+class ShaderVariants
+{
+public:
+	ShaderVariants(const char* vertexPath, const char* fragmentPath, const char* geometryPath = nullptr);
+
+	/* #define lines every variant gets on top of its features, only variants requested afterwards use them */
+	void SetDefines(const string& defines);
+	/* baseFeatures are in every variant. Only bits in supportedFeatures are kept from a request, so a feature the sources
+	do not act on never makes a duplicate program */
+	void SetFeatures(unsigned int baseFeatures, unsigned int supportedFeatures);
+	/* The variant features end up drawing with */
+	unsigned int Resolve(unsigned int features) const;
+
+	/* Start compiling the variant for features unless there already is one. Variants are reloaded when their sources change */
+	void Request(unsigned int features);
+	/* Compiled variant for features. One still compiling is finished first, one never requested is compiled on the spot */
+	Shader& Get(unsigned int features);
+
+	/* Every variant by its resolved features, compiled or not */
+	const map<unsigned int, unique_ptr<Shader>>& GetVariants() const;
+	size_t GetCount() const;
+
+private:
+	string vertexPath;
+	string fragmentPath;
+	string geometryPath;
+	bool bHasGeometry;
+	string defines;
+	unsigned int baseFeatures;
+	unsigned int supportedFeatures;
+	map<unsigned int, unique_ptr<Shader>> variants;
+
+	ShaderVariants(const ShaderVariants&) = delete;
+	ShaderVariants& operator=(const ShaderVariants&) = delete;
+};
@@ -0,0 +1,175 @@
+#include <algorithm>
+#include <cmath>
+#include <thread>
+#include <vector>
+#include "SphericalHarmonics.h"
+
+#ifdef SH_SSE
+#include <immintrin.h>
+#endif
+
+using namespace std;
+
+static const float SH_PI = 3.14159265358979f;
+
+//Normalisation of each basis function, in the order evaluateBasis and PBR.frag use
+static const float SH_Y00 = 0.282095f;
+static const float SH_Y1 = 0.488603f;
+static const float SH_Y2 = 1.092548f;
+static const float SH_Y20 = 0.315392f;
+static const float SH_Y22 = 0.546274f;
+
+/* The 9 basis functions at unit direction (x, y, z) */
+static void evaluateBasis(float x, float y, float z, float basis[SH_COEFFICIENT_COUNT])
+{
+	basis[0] = SH_Y00;
+	basis[1] = SH_Y1 * y;
+	basis[2] = SH_Y1 * z;
+	basis[3] = SH_Y1 * x;
+	basis[4] = SH_Y2 * x * y;
+	basis[5] = SH_Y2 * y * z;
+	basis[6] = SH_Y20 * (3.0f * z * z - 1.0f);
+	basis[7] = SH_Y2 * x * z;
+	basis[8] = SH_Y22 * (x * x - y * y);
+}
+
+/* Add every pixel of row times the basis at its direction to sums. Every pixel of a row covers the same solid angle,
+so that is left to the caller */
+static void projectRow(const float* row, int width, int channels, float y, float cosLatitude, const float* cosLongitude,
+	const float* sinLongitude, float sums[SH_COEFFICIENT_COUNT][3])
+{
+	//Single channel images are grey
+	int green = channels > 1 ? 1 : 0;
+	int blue = channels > 2 ? 2 : 0;
+	int column = 0;
+#ifdef SH_SSE
+	__m128 red4[SH_COEFFICIENT_COUNT];
+	__m128 green4[SH_COEFFICIENT_COUNT];
+	__m128 blue4[SH_COEFFICIENT_COUNT];
+	for (int i = 0; i < SH_COEFFICIENT_COUNT; i++)
+	{
+		red4[i] = _mm_setzero_ps();
+		green4[i] = _mm_setzero_ps();
+		blue4[i] = _mm_setzero_ps();
+	}
+	const __m128 y4 = _mm_set1_ps(y);
+	const __m128 cosLatitude4 = _mm_set1_ps(cosLatitude);
+	for (; column + 4 <= width; column += 4)
+	{
+		__m128 x4 = _mm_mul_ps(cosLatitude4, _mm_loadu_ps(cosLongitude + column));
+		__m128 z4 = _mm_mul_ps(cosLatitude4, _mm_loadu_ps(sinLongitude + column));
+		__m128 basis[SH_COEFFICIENT_COUNT];
+		basis[0] = _mm_set1_ps(SH_Y00);
+		basis[1] = _mm_mul_ps(_mm_set1_ps(SH_Y1), y4);
+		basis[2] = _mm_mul_ps(_mm_set1_ps(SH_Y1), z4);
+		basis[3] = _mm_mul_ps(_mm_set1_ps(SH_Y1), x4);
+		basis[4] = _mm_mul_ps(_mm_set1_ps(SH_Y2), _mm_mul_ps(x4, y4));
+		basis[5] = _mm_mul_ps(_mm_set1_ps(SH_Y2), _mm_mul_ps(y4, z4));
+		basis[6] = _mm_mul_ps(_mm_set1_ps(SH_Y20), _mm_sub_ps(_mm_mul_ps(_mm_set1_ps(3.0f), _mm_mul_ps(z4, z4)), _mm_set1_ps(1.0f)));
+		basis[7] = _mm_mul_ps(_mm_set1_ps(SH_Y2), _mm_mul_ps(x4, z4));
+		basis[8] = _mm_mul_ps(_mm_set1_ps(SH_Y22), _mm_sub_ps(_mm_mul_ps(x4, x4), _mm_mul_ps(y4, y4)));
+
+		//Pixels are interleaved, gather each channel of the 4 into its own register
+		const float* p = row + column * channels;
+		__m128 r = _mm_setr_ps(p[0], p[channels], p[2 * channels], p[3 * channels]);
+		__m128 g = _mm_setr_ps(p[green], p[channels + green], p[2 * channels + green], p[3 * channels + green]);
+		__m128 b = _mm_setr_ps(p[blue], p[channels + blue], p[2 * channels + blue], p[3 * channels + blue]);
+		for (int i = 0; i < SH_COEFFICIENT_COUNT; i++)
+		{
+			red4[i] = _mm_add_ps(red4[i], _mm_mul_ps(basis[i], r));
+			green4[i] = _mm_add_ps(green4[i], _mm_mul_ps(basis[i], g));
+			blue4[i] = _mm_add_ps(blue4[i], _mm_mul_ps(basis[i], b));
+		}
+	}
+	for (int i = 0; i < SH_COEFFICIENT_COUNT; i++)
+	{
+		float lanes[4];
+		_mm_storeu_ps(lanes, red4[i]);
+		sums[i][0] += lanes[0] + lanes[1] + lanes[2] + lanes[3];
+		_mm_storeu_ps(lanes, green4[i]);
+		sums[i][1] += lanes[0] + lanes[1] + lanes[2] + lanes[3];
+		_mm_storeu_ps(lanes, blue4[i]);
+		sums[i][2] += lanes[0] + lanes[1] + lanes[2] + lanes[3];
+	}
+#endif
+	//Whatever is left over, or every pixel without SSE
+	for (; column < width; column++)
+	{
+		float basis[SH_COEFFICIENT_COUNT];
+		evaluateBasis(cosLatitude * cosLongitude[column], y, cosLatitude * sinLongitude[column], basis);
+		const float* p = row + column * channels;
+		for (int i = 0; i < SH_COEFFICIENT_COUNT; i++)
+		{
+			sums[i][0] += basis[i] * p[0];
+			sums[i][1] += basis[i] * p[green];
+			sums[i][2] += basis[i] * p[blue];
+		}
+	}
+}
+
+void ProjectIrradianceSH(const float* pixels, int width, int height, int channels, vec3 coefficients[SH_COEFFICIENT_COUNT])
+{
+	for (int i = 0; i < SH_COEFFICIENT_COUNT; i++)
+	{
+		coefficients[i] = vec3(0.0f);
+	}
+	if (!pixels || width <= 0 || height <= 0 || channels <= 0)
+	{
+		return;
+	}
+
+	//Same mapping as SampleSphericalMap in skybox.frag, u = atan(z, x) / 2pi + 0.5 and v = asin(y) / pi + 0.5
+	vector<float> cosLongitude(width);
+	vector<float> sinLongitude(width);
+	for (int column = 0; column < width; column++)
+	{
+		float longitude = ((column + 0.5f) / width - 0.5f) * 2.0f * SH_PI;
+		cosLongitude[column] = cos(longitude);
+		sinLongitude[column] = sin(longitude);
+	}
+
+	//Every thread sums its own rows in double, so adding thousands of rows together loses nothing
+	unsigned int threadCount = std::max(thread::hardware_concurrency(), 1u);
+	threadCount = std::min(threadCount, (unsigned int)height);
+	vector<vector<double>> threadSums(threadCount, vector<double>(SH_COEFFICIENT_COUNT * 3, 0.0));
+	vector<thread> workers;
+	for (unsigned int t = 0; t < threadCount; t++)
+	{
+		workers.push_back(thread([&, t]()
+		{
+			int firstRow = (int)((long long)height * t / threadCount);
+			int lastRow = (int)((long long)height * (t + 1) / threadCount);
+			for (int rowIndex = firstRow; rowIndex < lastRow; rowIndex++)
+			{
+				float latitude = ((rowIndex + 0.5f) / height - 0.5f) * SH_PI;
+				float cosLatitude = cos(latitude);
+				//Pixels shrink towards the poles, every one in the row covers the same solid angle
+				double solidAngle = (2.0 * SH_PI / width) * (SH_PI / height) * cosLatitude;
+				float sums[SH_COEFFICIENT_COUNT][3] = {};
+				projectRow(pixels + (size_t)rowIndex * width * channels, width, channels, sin(latitude), cosLatitude, cosLongitude.data(),
+					sinLongitude.data(), sums);
+				for (int i = 0; i < SH_COEFFICIENT_COUNT; i++)
+				{
+					for (int c = 0; c < 3; c++)
+					{
+						threadSums[t][i * 3 + c] += sums[i][c] * solidAngle;
+					}
+				}
+			}
+		}));
+	}
+	for (size_t t = 0; t < workers.size(); t++)
+	{
+		workers[t].join();
+	}
+
+	//Convolving with the clamped cosine scales each band by pi, 2pi / 3 and pi / 4, the divide by pi leaves 1, 2 / 3 and 1 / 4
+	const float bandScale[SH_COEFFICIENT_COUNT] = { 1.0f, 2.0f / 3.0f, 2.0f / 3.0f, 2.0f / 3.0f, 0.25f, 0.25f, 0.25f, 0.25f, 0.25f };
+	for (unsigned int t = 0; t < threadCount; t++)
+	{
+		for (int i = 0; i < SH_COEFFICIENT_COUNT; i++)
+		{
+			coefficients[i] += vec3((float)threadSums[t][i * 3], (float)threadSums[t][i * 3 + 1], (float)threadSums[t][i * 3 + 2]) * bandScale[i];
+		}
+	}
+}
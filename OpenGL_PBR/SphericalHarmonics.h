@@ -0,0 +1,18 @@
+#pragma once
+#include <glm/glm.hpp>
+
+using namespace glm;
+
+//SSE is always there on x64
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define SH_SSE 1
+#endif
+
+//Coefficients of a 9 term, 3 band, spherical harmonic
+#define SH_COEFFICIENT_COUNT 9
+
+/* Project the irradiance of an equirectangular environment onto 3 band spherical harmonics. pixels are laid out like the
+HDRI texture the skybox samples, bottom row first with channels floats per pixel, so the directions match the cube maps
+baked from it. The cosine lobe is folded in and the result divided by pi, evaluating it at a normal gives what a
+convolved irradiance map holds there. Rows are split across every core and each row is projected 4 pixels at a time */
+void ProjectIrradianceSH(const float* pixels, int width, int height, int channels, vec3 coefficients[SH_COEFFICIENT_COUNT]);
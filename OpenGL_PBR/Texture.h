@@ -2,6 +2,7 @@
 
 #include <iostream>
 #include <glad/glad.h>
+#include "TextureCache.h"
 
 using namespace std;
 
@@ -9,6 +10,7 @@ class Texture
 {
 private:
 	unsigned int ID;
+	TextureHandle handle; //shared with anything else that loaded the same image
 
 	string type;
 
@@ -0,0 +1,113 @@
+#include <iostream>
+#include "TextureCache.h"
+#include "TextureStreamer.h"
+#include "GLStateCache.h"
+
+TextureSettings::TextureSettings(GLenum wrapMode, bool bFlipVertically)
+	: wrapMode(wrapMode), bFlipVertically(bFlipVertically)
+{
+}
+
+TextureResource::TextureResource(unsigned int ID, const string& path)
+	: ID(ID), path(path)
+{
+}
+
+TextureResource::~TextureResource()
+{
+	glDeleteTextures(1, &ID);
+	GLStateCache::Get().ForgetTexture(ID);
+}
+
+bool TextureCache::CacheKey::operator<(const CacheKey& other) const
+{
+	if (contentHash != other.contentHash)
+		return contentHash < other.contentHash;
+	if (size != other.size)
+		return size < other.size;
+	if (wrapMode != other.wrapMode)
+		return wrapMode < other.wrapMode;
+	return bFlipVertically < other.bFlipVertically;
+}
+
+TextureCache& TextureCache::Get()
+{
+	static TextureCache cache;
+	return cache;
+}
+
+TextureCache::TextureCache()
+	: hits(0), misses(0)
+{
+}
+
+void TextureCache::Prefetch(const string& path)
+{
+	if (path.empty() || pendingReads.count(path))
+	{
+		return;
+	}
+	pendingReads[path] = TextureDecodePool::Get().Read(path);
+}
+
+TextureHandle TextureCache::Acquire(const string& path, const TextureSettings& settings)
+{
+	//Only the read and hash has to finish here, decoding carries on in the background
+	Prefetch(path);
+	map<string, EncodedImageFuture>::iterator pending = pendingReads.find(path);
+	shared_ptr<EncodedImage> file = pending->second.get();
+	pendingReads.erase(pending);
+
+	CacheKey key;
+	key.contentHash = file->contentHash;
+	key.size = file->bytes.size();
+	key.wrapMode = settings.wrapMode;
+	key.bFlipVertically = settings.bFlipVertically;
+
+	//Unreadable files are never shared so each failure still gets reported
+	if (file->bWasRead)
+	{
+		map<CacheKey, weak_ptr<TextureResource>>::iterator entry = entries.find(key);
+		if (entry != entries.end())
+		{
+			TextureHandle texture = entry->second.lock();
+			if (texture)
+			{
+				hits++;
+				return texture;
+			}
+		}
+	}
+
+	misses++;
+	unsigned int textureID = TextureStreamer::Get().Queue(TextureDecodePool::Get().Decode(file, settings.bFlipVertically), settings.wrapMode);
+	TextureHandle texture = make_shared<TextureResource>(textureID, path);
+	if (file->bWasRead)
+	{
+		entries[key] = texture;
+	}
+	return texture;
+}
+
+unsigned int TextureCache::GetHits() const
+{
+	return hits;
+}
+
+unsigned int TextureCache::GetMisses() const
+{
+	return misses;
+}
+
+void TextureCache::PrintStatistics() const
+{
+	unsigned int alive = 0;
+	for (map<CacheKey, weak_ptr<TextureResource>>::const_iterator it = entries.begin(); it != entries.end(); ++it)
+	{
+		if (!it->second.expired())
+		{
+			alive++;
+		}
+	}
+	cout << "Texture cache: " << hits << " hits, " << misses << " misses, " << alive << " textures loaded" << endl;
+}
@@ -0,0 +1,78 @@
+#pragma once
+#include <glad/glad.h>
+#include <string>
+#include <map>
+#include <memory>
+
+#include "TextureDecoder.h"
+
+using namespace std;
+
+/* Sampler and format settings, two loads of the same image only share a texture if these match as well */
+struct TextureSettings
+{
+	GLenum wrapMode;
+	bool bFlipVertically;
+
+	TextureSettings(GLenum wrapMode = GL_REPEAT, bool bFlipVertically = false);
+};
+
+/* GL texture shared between every user of the same image. The texture is deleted with the last handle */
+class TextureResource
+{
+public:
+	unsigned int ID;
+	string path; //path the texture was first loaded from
+
+	TextureResource(unsigned int ID, const string& path);
+	~TextureResource();
+
+private:
+	TextureResource(const TextureResource&) = delete;
+	TextureResource& operator=(const TextureResource&) = delete;
+};
+
+typedef shared_ptr<TextureResource> TextureHandle;
+
+/* Process wide registry of loaded textures keyed by a hash of the file contents plus the settings they were created
+with, so the same image is only decoded and uploaded once no matter how many models or paths refer to it */
+class TextureCache
+{
+public:
+	static TextureCache& Get();
+
+	/* Start reading and hashing a file on the decode pool so a later Acquire does not have to wait for it */
+	void Prefetch(const string& path);
+
+	/* Get a handle to the texture for path, loading it if no identical image has been loaded yet */
+	TextureHandle Acquire(const string& path, const TextureSettings& settings = TextureSettings());
+
+	unsigned int GetHits() const;
+	unsigned int GetMisses() const;
+	/* Print hit/miss counts and how many textures are currently alive */
+	void PrintStatistics() const;
+
+private:
+	struct CacheKey
+	{
+		unsigned long long contentHash;
+		size_t size;
+		GLenum wrapMode;
+		bool bFlipVertically;
+
+		bool operator<(const CacheKey& other) const;
+	};
+
+	//Files that are being read and hashed, keyed by path
+	map<string, EncodedImageFuture> pendingReads;
+	//Entries do not keep textures alive, they expire once every handle has been released
+	map<CacheKey, weak_ptr<TextureResource>> entries;
+
+	unsigned int hits;
+	unsigned int misses;
+
+	TextureCache();
+
+	TextureCache(const TextureCache&) = delete;
+	TextureCache& operator=(const TextureCache&) = delete;
+};
@@ -0,0 +1,171 @@
+#include <STB/stb_image.h>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include "TextureDecoder.h"
+
+DecodedImage::DecodedImage()
+	: data(nullptr), width(0), height(0), channels(0)
+{
+}
+
+DecodedImage::~DecodedImage()
+{
+	// Have to call free() as stbi_image_free() crashes with .jpg files
+	free(data);
+}
+
+EncodedImage::EncodedImage()
+	: contentHash(0), bWasRead(false)
+{
+}
+
+/* 64 bit hash of a block of memory, consumes 8 bytes per step so hashing stays far cheaper than decoding */
+static unsigned long long HashBytes(const unsigned char* data, size_t size)
+{
+	const unsigned long long prime = 0x9E3779B97F4A7C15ull;
+	unsigned long long hash = 0xCBF29CE484222325ull ^ (size * prime);
+	size_t i = 0;
+	for (; i + 8 <= size; i += 8)
+	{
+		unsigned long long value;
+		memcpy(&value, data + i, sizeof(value));
+		hash = (hash ^ value) * prime;
+		hash ^= hash >> 29;
+	}
+	for (; i < size; i++)
+	{
+		hash = (hash ^ data[i]) * 0x100000001B3ull;
+	}
+	//final avalanche so nearby inputs spread over the whole range
+	hash ^= hash >> 33;
+	hash *= 0xFF51AFD7ED558CCDull;
+	hash ^= hash >> 33;
+	return hash;
+}
+
+/* Load a whole file into memory and hash it */
+static shared_ptr<EncodedImage> ReadImageFile(const string& path)
+{
+	shared_ptr<EncodedImage> file = make_shared<EncodedImage>();
+	file->path = path;
+	ifstream stream(path, ios::binary | ios::ate);
+	if (stream)
+	{
+		streamsize size = stream.tellg();
+		stream.seekg(0, ios::beg);
+		file->bytes.resize((size_t)size);
+		file->bWasRead = size > 0 && stream.read((char*)file->bytes.data(), size).good();
+	}
+	if (file->bWasRead)
+	{
+		file->contentHash = HashBytes(file->bytes.data(), file->bytes.size());
+	}
+	return file;
+}
+
+static shared_ptr<DecodedImage> DecodeImageFile(const EncodedImage& file, bool bFlipVertically)
+{
+	shared_ptr<DecodedImage> image = make_shared<DecodedImage>();
+	image->path = file.path;
+	if (!file.bWasRead)
+	{
+		image->failureReason = "can't fopen";
+		return image;
+	}
+	//The global flip flag is shared with the GL thread, so only change it for this worker
+	stbi_set_flip_vertically_on_load_thread(bFlipVertically);
+	image->data = stbi_load_from_memory(file.bytes.data(), (int)file.bytes.size(), &image->width, &image->height, &image->channels, 0);
+	if (!image->data)
+	{
+		const char* reason = stbi_failure_reason();
+		image->failureReason = reason ? reason : "";
+	}
+	return image;
+}
+
+TextureDecodePool& TextureDecodePool::Get()
+{
+	//Leave one core for the GL thread, which keeps importing models while the workers decode
+	unsigned int cores = thread::hardware_concurrency();
+	static TextureDecodePool pool(cores > 1 ? cores - 1 : 1);
+	return pool;
+}
+
+TextureDecodePool::TextureDecodePool(unsigned int threadCount)
+	: bIsStopping(false)
+{
+	for (unsigned int i = 0; i < threadCount; i++)
+	{
+		workers.emplace_back(&TextureDecodePool::WorkerLoop, this);
+	}
+}
+
+TextureDecodePool::~TextureDecodePool()
+{
+	{
+		lock_guard<mutex> lock(jobMutex);
+		bIsStopping = true;
+	}
+	jobCondition.notify_all();
+	for (thread& worker : workers)
+	{
+		worker.join();
+	}
+}
+
+template<typename T>
+shared_future<T> TextureDecodePool::Enqueue(function<T()> job)
+{
+	shared_ptr<packaged_task<T()>> task = make_shared<packaged_task<T()>>(job);
+	shared_future<T> result = task->get_future().share();
+
+	{
+		lock_guard<mutex> lock(jobMutex);
+		jobs.push([task]() { (*task)(); });
+	}
+	jobCondition.notify_one();
+	return result;
+}
+
+EncodedImageFuture TextureDecodePool::Read(const string& path)
+{
+	return Enqueue<shared_ptr<EncodedImage>>([path]() { return ReadImageFile(path); });
+}
+
+DecodedImageFuture TextureDecodePool::Decode(shared_ptr<EncodedImage> file, bool bFlipVertically)
+{
+	return Enqueue<shared_ptr<DecodedImage>>([file, bFlipVertically]() { return DecodeImageFile(*file, bFlipVertically); });
+}
+
+DecodedImageFuture TextureDecodePool::Decode(const string& path, bool bFlipVertically)
+{
+	return Enqueue<shared_ptr<DecodedImage>>([path, bFlipVertically]()
+		{
+			return DecodeImageFile(*ReadImageFile(path), bFlipVertically);
+		});
+}
+
+unsigned int TextureDecodePool::GetThreadCount() const
+{
+	return workers.size();
+}
+
+void TextureDecodePool::WorkerLoop()
+{
+	while (true)
+	{
+		function<void()> job;
+		{
+			unique_lock<mutex> lock(jobMutex);
+			jobCondition.wait(lock, [this]() { return bIsStopping || !jobs.empty(); });
+			if (bIsStopping && jobs.empty())
+			{
+				return;
+			}
+			job = move(jobs.front());
+			jobs.pop();
+		}
+		job();
+	}
+}
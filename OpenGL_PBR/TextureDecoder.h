@@ -0,0 +1,82 @@
+#pragma once
+#include <string>
+#include <vector>
+#include <queue>
+#include <memory>
+#include <future>
+#include <thread>
+#include <mutex>
+#include <functional>
+#include <condition_variable>
+
+using namespace std;
+
+/* Pixels of an image file decoded by stb_image. Memory is released when the last reference goes away */
+struct DecodedImage
+{
+	unsigned char* data;
+	int width;
+	int height;
+	int channels;
+	string path;
+	string failureReason; //stb failure reasons are per thread, so keep a copy for the GL thread
+
+	DecodedImage();
+	~DecodedImage();
+
+	DecodedImage(const DecodedImage&) = delete;
+	DecodedImage& operator=(const DecodedImage&) = delete;
+};
+
+/* Raw bytes of an image file, hashed so identical images can be shared no matter which path they came from */
+struct EncodedImage
+{
+	vector<unsigned char> bytes;
+	string path;
+	unsigned long long contentHash;
+	bool bWasRead;
+
+	EncodedImage();
+};
+
+typedef shared_future<shared_ptr<DecodedImage>> DecodedImageFuture;
+typedef shared_future<shared_ptr<EncodedImage>> EncodedImageFuture;
+
+/* Pool of worker threads that decode image files in parallel. Only decoding happens on the workers,
+uploading the pixels to OpenGL is left to the thread that owns the context */
+class TextureDecodePool
+{
+public:
+	/* Process wide pool sized to the number of cores */
+	static TextureDecodePool& Get();
+
+	~TextureDecodePool();
+
+	/* Queue an image file to be read and hashed */
+	EncodedImageFuture Read(const string& path);
+
+	/* Queue an image that has already been read to be decoded. The future becomes ready once the worker has finished */
+	DecodedImageFuture Decode(shared_ptr<EncodedImage> file, bool bFlipVertically = false);
+
+	/* Read and decode an image file in a single job */
+	DecodedImageFuture Decode(const string& path, bool bFlipVertically = false);
+
+	unsigned int GetThreadCount() const;
+
+private:
+	vector<thread> workers;
+	queue<function<void()>> jobs;
+	mutex jobMutex;
+	condition_variable jobCondition;
+	bool bIsStopping;
+
+	TextureDecodePool(unsigned int threadCount);
+	void WorkerLoop();
+
+	/* Run a job on the next free worker */
+	template<typename T>
+	shared_future<T> Enqueue(function<T()> job);
+
+	TextureDecodePool(const TextureDecodePool&) = delete;
+	TextureDecodePool& operator=(const TextureDecodePool&) = delete;
+};
@@ -0,0 +1,217 @@
+#include <iostream>
+#include <cstring>
+#include <chrono>
+#include <algorithm>
+#include "TextureStreamer.h"
+
+//Default number of bytes streamed per frame, which is also the size of a single ring segment
+#define DEFAULT_FRAME_BUDGET (8 * 1024 * 1024)
+
+TextureStreamer& TextureStreamer::Get()
+{
+	static TextureStreamer streamer;
+	return streamer;
+}
+
+TextureStreamer::TextureStreamer()
+	: pbo(0), mappedRing(nullptr), frameBudget(DEFAULT_FRAME_BUDGET), currentSegment(0)
+{
+	for (int i = 0; i < STREAMING_RING_SEGMENTS; i++)
+	{
+		segmentFences[i] = nullptr;
+	}
+	//GL objects are left for the driver to clean up, the context is already gone by the time statics are destroyed
+}
+
+unsigned int TextureStreamer::Queue(DecodedImageFuture image, GLenum wrapMode)
+{
+	unsigned int textureID;
+	glCreateTextures(GL_TEXTURE_2D, 1, &textureID);
+	glTextureParameteri(textureID, GL_TEXTURE_WRAP_S, wrapMode);
+	glTextureParameteri(textureID, GL_TEXTURE_WRAP_T, wrapMode);
+	glTextureParameteri(textureID, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+	glTextureParameteri(textureID, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	//Only sample the base level until the mip chain has been generated
+	glTextureParameteri(textureID, GL_TEXTURE_MAX_LEVEL, 0);
+
+	PendingUpload upload;
+	upload.texture = textureID;
+	upload.future = image;
+	upload.format = GL_RGBA;
+	upload.levels = 1;
+	upload.nextRow = 0;
+	uploads.push_back(upload);
+
+	return textureID;
+}
+
+void TextureStreamer::Update()
+{
+	if (uploads.empty())
+	{
+		return;
+	}
+	if (!pbo)
+	{
+		createRing();
+	}
+
+	//This segment was last written STREAMING_RING_SEGMENTS frames ago, skip a frame rather than stall if the GPU is still reading it
+	GLsync& fence = segmentFences[currentSegment];
+	if (fence)
+	{
+		if (glClientWaitSync(fence, 0, 0) == GL_TIMEOUT_EXPIRED)
+		{
+			return;
+		}
+		glDeleteSync(fence);
+		fence = nullptr;
+	}
+
+	size_t segmentOffset = currentSegment * frameBudget;
+	size_t used = 0;
+
+	glBindBuffer(GL_PIXEL_UNPACK_BUFFER, pbo);
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 1); //rows of RGB and single channel images are not 4 byte aligned
+	for (deque<PendingUpload>::iterator it = uploads.begin(); it != uploads.end() && used < frameBudget;)
+	{
+		PendingUpload& upload = *it;
+		if (!upload.image)
+		{
+			//Still decoding on a worker thread, move on to the next texture
+			if (upload.future.wait_for(chrono::seconds(0)) != future_status::ready)
+			{
+				++it;
+				continue;
+			}
+			if (!beginUpload(upload))
+			{
+				it = uploads.erase(it);
+				continue;
+			}
+		}
+
+		//Copy as many whole rows as fit in what is left of this frame's budget
+		const DecodedImage& image = *upload.image;
+		size_t rowSize = (size_t)image.width * image.channels;
+		int rows = (int)min((size_t)(image.height - upload.nextRow), (frameBudget - used) / rowSize);
+		if (rows <= 0)
+		{
+			break;
+		}
+		memcpy(mappedRing + segmentOffset + used, image.data + upload.nextRow * rowSize, rows * rowSize);
+		glTextureSubImage2D(upload.texture, 0, 0, upload.nextRow, image.width, rows, upload.format, GL_UNSIGNED_BYTE,
+			(void*)(segmentOffset + used));
+		used += (rows * rowSize + 3) & ~(size_t)3;
+		upload.nextRow += rows;
+
+		if (upload.nextRow == image.height)
+		{
+			finishUpload(upload);
+			it = uploads.erase(it);
+		}
+		else
+		{
+			++it;
+		}
+	}
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+	glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+
+	if (used > 0)
+	{
+		//Protect this segment until the GPU has consumed the copies
+		fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+		currentSegment = (currentSegment + 1) % STREAMING_RING_SEGMENTS;
+	}
+}
+
+void TextureStreamer::SetFrameBudget(size_t bytes)
+{
+	if (pbo)
+	{
+		cout << "ERROR::TEXTURESTREAMER::Frame budget can not change once streaming has started" << endl;
+		return;
+	}
+	//Has to fit at least one row of the widest texture
+	frameBudget = max(bytes, (size_t)(1024 * 1024));
+}
+
+bool TextureStreamer::IsIdle() const
+{
+	return uploads.empty();
+}
+
+bool TextureStreamer::IsStreaming(unsigned int texture) const
+{
+	for (deque<PendingUpload>::const_iterator it = uploads.begin(); it != uploads.end(); ++it)
+	{
+		if (it->texture == texture)
+		{
+			return true;
+		}
+	}
+	return false;
+}
+
+void TextureStreamer::createRing()
+{
+	size_t ringSize = frameBudget * STREAMING_RING_SEGMENTS;
+	const GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+
+	glCreateBuffers(1, &pbo);
+	glNamedBufferStorage(pbo, ringSize, nullptr, flags);
+	//Stays mapped for the lifetime of the program, coherent so no explicit flushes are needed
+	mappedRing = (unsigned char*)glMapNamedBufferRange(pbo, 0, ringSize, flags);
+}
+
+bool TextureStreamer::beginUpload(PendingUpload& upload)
+{
+	upload.image = upload.future.get();
+	const DecodedImage& image = *upload.image;
+	if (!image.data)
+	{
+		cout << "Texture failed to load at path: " << image.path << endl;
+		cout << image.failureReason << endl;
+		return false;
+	}
+
+	GLenum internalFormat;
+	switch (image.channels)
+	{
+	case 1:
+		upload.format = GL_RED;
+		internalFormat = GL_R8;
+		break;
+	case 2:
+		upload.format = GL_RG;
+		internalFormat = GL_RG8;
+		break;
+	case 3:
+		upload.format = GL_RGB;
+		internalFormat = GL_RGB8;
+		break;
+	default:
+		upload.format = GL_RGBA;
+		internalFormat = GL_RGBA8;
+		break;
+	}
+
+	//Full mip chain so the texture can be generated in place once level 0 is complete
+	upload.levels = 1;
+	for (int size = max(image.width, image.height); size > 1; size /= 2)
+	{
+		upload.levels++;
+	}
+	glTextureStorage2D(upload.texture, upload.levels, internalFormat, image.width, image.height);
+	return true;
+}
+
+void TextureStreamer::finishUpload(PendingUpload& upload)
+{
+	glGenerateTextureMipmap(upload.texture);
+	glTextureParameteri(upload.texture, GL_TEXTURE_MAX_LEVEL, upload.levels - 1);
+	cout << upload.image->path << " loaded" << endl;
+	//Decoded pixels are no longer needed
+	upload.image.reset();
+}
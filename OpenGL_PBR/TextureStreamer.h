@@ -0,0 +1,65 @@
+#pragma once
+#include <glad/glad.h>
+#include <deque>
+#include <memory>
+
+#include "TextureDecoder.h"
+
+using namespace std;
+
+//Number of frames that can have uploads in flight before the ring has to wait for the GPU
+#define STREAMING_RING_SEGMENTS 3
+
+/* Streams decoded images into immutable textures over several frames. Pixels are copied into a persistently mapped
+pixel unpack buffer split into one segment per frame, each guarded by a fence, and only a fixed number of bytes are
+uploaded per frame so loading never stalls the render loop */
+class TextureStreamer
+{
+public:
+	/* Process wide streamer, must only be used from the thread that owns the GL context */
+	static TextureStreamer& Get();
+
+	/* Create a texture name straight away and fill it once the image has finished decoding.
+	The texture samples as black until its first rows arrive */
+	unsigned int Queue(DecodedImageFuture image, GLenum wrapMode);
+
+	/* Upload up to the per frame budget of pending pixels. Call once per frame */
+	void Update();
+
+	/* Maximum number of bytes copied to the GPU per frame. Takes effect before the first upload */
+	void SetFrameBudget(size_t bytes);
+
+	/* Have all queued textures finished uploading */
+	bool IsIdle() const;
+	/* Is texture still waiting for, or in the middle of, its upload */
+	bool IsStreaming(unsigned int texture) const;
+
+private:
+	struct PendingUpload
+	{
+		unsigned int texture;
+		DecodedImageFuture future;
+		shared_ptr<DecodedImage> image;
+		GLenum format;
+		int levels;
+		int nextRow; //first row of level 0 that has not been uploaded yet
+	};
+
+	deque<PendingUpload> uploads;
+
+	unsigned int pbo;
+	unsigned char* mappedRing;
+	size_t frameBudget;
+	unsigned int currentSegment;
+	GLsync segmentFences[STREAMING_RING_SEGMENTS];
+
+	TextureStreamer();
+
+	void createRing();
+	/* Allocate immutable storage once the size of the image is known */
+	bool beginUpload(PendingUpload& upload);
+	void finishUpload(PendingUpload& upload);
+
+	TextureStreamer(const TextureStreamer&) = delete;
+	TextureStreamer& operator=(const TextureStreamer&) = delete;
+};
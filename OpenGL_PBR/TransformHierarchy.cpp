@@ -0,0 +1,423 @@
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+#include <random>
+#include "TransformHierarchy.h"
+
+#ifdef TRANSFORMS_AVX2
+#include <immintrin.h>
+
+//MSVC allows FMA with /arch:AVX2, gcc and clang want -mfma as well
+#if defined(__FMA__) || defined(_MSC_VER)
+#define TRANSFORMS_FMA(a, b, c) _mm256_fmadd_ps(a, b, c)
+#else
+#define TRANSFORMS_FMA(a, b, c) _mm256_add_ps(_mm256_mul_ps(a, b), c)
+#endif
+
+/* out = a * b. Works on two columns of the result at once: each half of a register holds one column of a, multiplied by
+the matching element of b's column, which a permute spreads across its half */
+static inline void MultiplyAVX2(const mat4& a, const mat4& b, mat4& out)
+{
+	__m256 a0 = _mm256_broadcast_ps((const __m128*)&a[0][0]);
+	__m256 a1 = _mm256_broadcast_ps((const __m128*)&a[1][0]);
+	__m256 a2 = _mm256_broadcast_ps((const __m128*)&a[2][0]);
+	__m256 a3 = _mm256_broadcast_ps((const __m128*)&a[3][0]);
+	for (int column = 0; column < 4; column += 2)
+	{
+		__m256 bColumns = _mm256_loadu_ps(&b[column][0]);
+		__m256 result = _mm256_mul_ps(a0, _mm256_permute_ps(bColumns, _MM_SHUFFLE(0, 0, 0, 0)));
+		result = TRANSFORMS_FMA(a1, _mm256_permute_ps(bColumns, _MM_SHUFFLE(1, 1, 1, 1)), result);
+		result = TRANSFORMS_FMA(a2, _mm256_permute_ps(bColumns, _MM_SHUFFLE(2, 2, 2, 2)), result);
+		result = TRANSFORMS_FMA(a3, _mm256_permute_ps(bColumns, _MM_SHUFFLE(3, 3, 3, 3)), result);
+		_mm256_storeu_ps(&out[column][0], result);
+	}
+}
+#endif
+
+TransformHierarchy::TransformHierarchy()
+	: bIsDirty(false)
+{
+}
+
+unsigned int TransformHierarchy::Add(int parent, vec3 translation, quat rotation, vec3 scale)
+{
+	//Only existing nodes can be parents, which is what keeps parents before their children
+	if (parent < 0 || (unsigned int)parent >= parents.size() || freeNodes.count(parent))
+	{
+		parent = -1;
+	}
+	//Reuse the first removed node after the parent, anything before it would break the order
+	set<unsigned int>::iterator freeNode = freeNodes.lower_bound((unsigned int)(parent + 1));
+	unsigned int node;
+	if (freeNode != freeNodes.end())
+	{
+		node = *freeNode;
+		freeNodes.erase(freeNode);
+	}
+	else
+	{
+		node = parents.size();
+		parents.push_back(-1);
+		childCounts.push_back(0);
+		translationX.push_back(0.0f);
+		translationY.push_back(0.0f);
+		translationZ.push_back(0.0f);
+		rotationX.push_back(0.0f);
+		rotationY.push_back(0.0f);
+		rotationZ.push_back(0.0f);
+		rotationW.push_back(1.0f);
+		scaleX.push_back(1.0f);
+		scaleY.push_back(1.0f);
+		scaleZ.push_back(1.0f);
+		locals.push_back(mat4(1.0f));
+		worlds.push_back(mat4(1.0f));
+		localDirty.push_back(0);
+		worldDirty.push_back(0);
+	}
+	parents[node] = parent;
+	if (parent >= 0)
+	{
+		childCounts[parent]++;
+	}
+	SetTranslation(node, translation);
+	SetRotation(node, rotation);
+	SetScale(node, scale);
+	worldDirty[node] = 1;
+	return node;
+}
+
+void TransformHierarchy::Remove(unsigned int node)
+{
+	if (node >= parents.size() || freeNodes.count(node))
+	{
+		return;
+	}
+	int parent = parents[node];
+	vec3 translation = GetTranslation(node);
+	quat rotation = GetRotation(node);
+	vec3 scale = GetScale(node);
+	//Children always come after their parent, stop looking once the last one has been found
+	for (size_t i = node + 1; i < parents.size() && childCounts[node] > 0; i++)
+	{
+		if (parents[i] != (int)node)
+		{
+			continue;
+		}
+		SetTranslation(i, translation + rotation * (scale * GetTranslation(i)));
+		SetRotation(i, rotation * GetRotation(i));
+		SetScale(i, scale * GetScale(i));
+		parents[i] = parent;
+		childCounts[node]--;
+		if (parent >= 0)
+		{
+			childCounts[parent]++;
+		}
+	}
+	if (parent >= 0)
+	{
+		childCounts[parent]--;
+	}
+
+	//A removed node is a root that never changes, so Update passes over it
+	parents[node] = -1;
+	SetTranslation(node, vec3(0.0f));
+	SetRotation(node, quat(1.0f, 0.0f, 0.0f, 0.0f));
+	SetScale(node, vec3(1.0f));
+	localDirty[node] = 0;
+	worldDirty[node] = 0;
+	locals[node] = mat4(1.0f);
+	worlds[node] = mat4(1.0f);
+	freeNodes.insert(node);
+}
+
+void TransformHierarchy::Clear()
+{
+	parents.clear();
+	childCounts.clear();
+	freeNodes.clear();
+	translationX.clear();
+	translationY.clear();
+	translationZ.clear();
+	rotationX.clear();
+	rotationY.clear();
+	rotationZ.clear();
+	rotationW.clear();
+	scaleX.clear();
+	scaleY.clear();
+	scaleZ.clear();
+	locals.clear();
+	worlds.clear();
+	localDirty.clear();
+	worldDirty.clear();
+	bIsDirty = false;
+}
+
+void TransformHierarchy::SetTranslation(unsigned int node, vec3 translation)
+{
+	translationX[node] = translation.x;
+	translationY[node] = translation.y;
+	translationZ[node] = translation.z;
+	localDirty[node] = 1;
+	bIsDirty = true;
+}
+
+void TransformHierarchy::SetRotation(unsigned int node, quat rotation)
+{
+	rotationX[node] = rotation.x;
+	rotationY[node] = rotation.y;
+	rotationZ[node] = rotation.z;
+	rotationW[node] = rotation.w;
+	localDirty[node] = 1;
+	bIsDirty = true;
+}
+
+void TransformHierarchy::SetScale(unsigned int node, vec3 scale)
+{
+	scaleX[node] = scale.x;
+	scaleY[node] = scale.y;
+	scaleZ[node] = scale.z;
+	localDirty[node] = 1;
+	bIsDirty = true;
+}
+
+vec3 TransformHierarchy::GetTranslation(unsigned int node) const
+{
+	return vec3(translationX[node], translationY[node], translationZ[node]);
+}
+
+quat TransformHierarchy::GetRotation(unsigned int node) const
+{
+	return quat(rotationW[node], rotationX[node], rotationY[node], rotationZ[node]);
+}
+
+vec3 TransformHierarchy::GetScale(unsigned int node) const
+{
+	return vec3(scaleX[node], scaleY[node], scaleZ[node]);
+}
+
+int TransformHierarchy::GetParent(unsigned int node) const
+{
+	return parents[node];
+}
+
+const mat4& TransformHierarchy::GetWorld(unsigned int node) const
+{
+	return worlds[node];
+}
+
+size_t TransformHierarchy::GetCount() const
+{
+	return parents.size();
+}
+
+size_t TransformHierarchy::GetFreeCount() const
+{
+	return freeNodes.size();
+}
+
+size_t TransformHierarchy::Update(bool bUseSimd)
+{
+	if (!bIsDirty)
+	{
+		return 0;
+	}
+
+	//A node is out of date if it changed or its parent is out of date. Parents come first, so their flag is already final
+	dirtyLocals.clear();
+	dirtyWorlds.clear();
+	for (size_t i = 0; i < parents.size(); i++)
+	{
+		int parent = parents[i];
+		unsigned char bIsWorldDirty = localDirty[i] | worldDirty[i] | (parent >= 0 ? worldDirty[parent] : 0);
+		worldDirty[i] = bIsWorldDirty;
+		if (localDirty[i])
+		{
+			dirtyLocals.push_back(i);
+			localDirty[i] = 0;
+		}
+		if (bIsWorldDirty)
+		{
+			dirtyWorlds.push_back(i);
+		}
+	}
+
+	composeLocals(dirtyLocals.data(), dirtyLocals.size(), bUseSimd);
+
+	//In order, so every parent's world matrix is final before its children read it
+	for (size_t i = 0; i < dirtyWorlds.size(); i++)
+	{
+		unsigned int node = dirtyWorlds[i];
+		int parent = parents[node];
+		if (parent < 0)
+		{
+			worlds[node] = locals[node];
+		}
+#ifdef TRANSFORMS_AVX2
+		else if (bUseSimd)
+		{
+			MultiplyAVX2(worlds[parent], locals[node], worlds[node]);
+		}
+#endif
+		else
+		{
+			worlds[node] = worlds[parent] * locals[node];
+		}
+	}
+	//Cleared afterwards, children still needed to see their parent's flag above
+	for (size_t i = 0; i < dirtyWorlds.size(); i++)
+	{
+		worldDirty[dirtyWorlds[i]] = 0;
+	}
+	bIsDirty = false;
+	return dirtyWorlds.size();
+}
+
+void TransformHierarchy::composeLocal(unsigned int node)
+{
+	//Translation * rotation * scale written out directly, the rotation is the usual unit quaternion to matrix
+	float x = rotationX[node], y = rotationY[node], z = rotationZ[node], w = rotationW[node];
+	mat4& local = locals[node];
+	local[0] = vec4((1.0f - 2.0f * (y * y + z * z)) * scaleX[node], 2.0f * (x * y + w * z) * scaleX[node], 2.0f * (x * z - w * y) * scaleX[node], 0.0f);
+	local[1] = vec4(2.0f * (x * y - w * z) * scaleY[node], (1.0f - 2.0f * (x * x + z * z)) * scaleY[node], 2.0f * (y * z + w * x) * scaleY[node], 0.0f);
+	local[2] = vec4(2.0f * (x * z + w * y) * scaleZ[node], 2.0f * (y * z - w * x) * scaleZ[node], (1.0f - 2.0f * (x * x + y * y)) * scaleZ[node], 0.0f);
+	local[3] = vec4(translationX[node], translationY[node], translationZ[node], 1.0f);
+}
+
+void TransformHierarchy::composeLocals(const unsigned int* nodes, size_t count, bool bUseSimd)
+{
+	size_t i = 0;
+#ifdef TRANSFORMS_AVX2
+	if (bUseSimd)
+	{
+		const __m256 one = _mm256_set1_ps(1.0f);
+		const __m256 two = _mm256_set1_ps(2.0f);
+		float elements[12][8]; //the 12 non-constant elements of eight matrices, in column order
+		for (; i + 8 <= count; i += 8)
+		{
+			//Gather eight nodes' components from wherever they are in the arrays
+			__m256i index = _mm256_loadu_si256((const __m256i*)(nodes + i));
+			__m256 x = _mm256_i32gather_ps(rotationX.data(), index, 4);
+			__m256 y = _mm256_i32gather_ps(rotationY.data(), index, 4);
+			__m256 z = _mm256_i32gather_ps(rotationZ.data(), index, 4);
+			__m256 w = _mm256_i32gather_ps(rotationW.data(), index, 4);
+			__m256 sx = _mm256_i32gather_ps(scaleX.data(), index, 4);
+			__m256 sy = _mm256_i32gather_ps(scaleY.data(), index, 4);
+			__m256 sz = _mm256_i32gather_ps(scaleZ.data(), index, 4);
+
+			__m256 xx = _mm256_mul_ps(x, x), yy = _mm256_mul_ps(y, y), zz = _mm256_mul_ps(z, z);
+			__m256 xy = _mm256_mul_ps(x, y), xz = _mm256_mul_ps(x, z), yz = _mm256_mul_ps(y, z);
+			__m256 wx = _mm256_mul_ps(w, x), wy = _mm256_mul_ps(w, y), wz = _mm256_mul_ps(w, z);
+
+			_mm256_storeu_ps(elements[0], _mm256_mul_ps(_mm256_sub_ps(one, _mm256_mul_ps(two, _mm256_add_ps(yy, zz))), sx));
+			_mm256_storeu_ps(elements[1], _mm256_mul_ps(_mm256_mul_ps(two, _mm256_add_ps(xy, wz)), sx));
+			_mm256_storeu_ps(elements[2], _mm256_mul_ps(_mm256_mul_ps(two, _mm256_sub_ps(xz, wy)), sx));
+			_mm256_storeu_ps(elements[3], _mm256_mul_ps(_mm256_mul_ps(two, _mm256_sub_ps(xy, wz)), sy));
+			_mm256_storeu_ps(elements[4], _mm256_mul_ps(_mm256_sub_ps(one, _mm256_mul_ps(two, _mm256_add_ps(xx, zz))), sy));
+			_mm256_storeu_ps(elements[5], _mm256_mul_ps(_mm256_mul_ps(two, _mm256_add_ps(yz, wx)), sy));
+			_mm256_storeu_ps(elements[6], _mm256_mul_ps(_mm256_mul_ps(two, _mm256_add_ps(xz, wy)), sz));
+			_mm256_storeu_ps(elements[7], _mm256_mul_ps(_mm256_mul_ps(two, _mm256_sub_ps(yz, wx)), sz));
+			_mm256_storeu_ps(elements[8], _mm256_mul_ps(_mm256_sub_ps(one, _mm256_mul_ps(two, _mm256_add_ps(xx, yy))), sz));
+			_mm256_storeu_ps(elements[9], _mm256_i32gather_ps(translationX.data(), index, 4));
+			_mm256_storeu_ps(elements[10], _mm256_i32gather_ps(translationY.data(), index, 4));
+			_mm256_storeu_ps(elements[11], _mm256_i32gather_ps(translationZ.data(), index, 4));
+
+			for (int lane = 0; lane < 8; lane++)
+			{
+				mat4& local = locals[nodes[i + lane]];
+				local[0] = vec4(elements[0][lane], elements[1][lane], elements[2][lane], 0.0f);
+				local[1] = vec4(elements[3][lane], elements[4][lane], elements[5][lane], 0.0f);
+				local[2] = vec4(elements[6][lane], elements[7][lane], elements[8][lane], 0.0f);
+				local[3] = vec4(elements[9][lane], elements[10][lane], elements[11][lane], 1.0f);
+			}
+		}
+	}
+#else
+	(void)bUseSimd; //only the AVX2 path can be switched off
+#endif
+	//Whatever is left over, or everything without AVX2
+	for (; i < count; i++)
+	{
+		composeLocal(nodes[i]);
+	}
+}
+
+void RunTransformBenchmark()
+{
+	typedef chrono::high_resolution_clock Clock;
+	const unsigned int nodeCount = 100000;
+	const int iterations = 50;
+
+#ifdef TRANSFORMS_AVX2
+	cout << "Transform benchmark, AVX2" << endl;
+#else
+	cout << "Transform benchmark, scalar only" << endl;
+#endif
+
+	//Random forest: a few hundred roots, every other node hangs off a random earlier node
+	mt19937 random(1234);
+	uniform_real_distribution<float> unit(-1.0f, 1.0f);
+	TransformHierarchy hierarchy;
+	for (unsigned int i = 0; i < nodeCount; i++)
+	{
+		int parent = i < 256 ? -1 : (int)(random() % i);
+		quat rotation = normalize(quat(unit(random), unit(random), unit(random), unit(random)));
+		hierarchy.Add(parent, vec3(unit(random), unit(random), unit(random)) * 10.0f, rotation, vec3(1.0f + 0.1f * unit(random)));
+	}
+	hierarchy.Update(false);
+	//A copy that always goes through the scalar path, to check the SIMD results against
+	TransformHierarchy reference = hierarchy;
+
+	//Nodes that get moved each iteration of the partial update, about 1% of the tree
+	vector<unsigned int> moving;
+	for (unsigned int i = 0; i < nodeCount / 100; i++)
+	{
+		moving.push_back(random() % nodeCount);
+	}
+
+	for (int pass = 0; pass < 2; pass++)
+	{
+		bool bUseSimd = pass == 1;
+		TransformHierarchy& target = bUseSimd ? hierarchy : reference;
+
+		//Every node changes, so every local and world matrix is recomputed
+		double fullTime = 0.0;
+		for (int iteration = 0; iteration < iterations; iteration++)
+		{
+			for (unsigned int i = 0; i < nodeCount; i++)
+			{
+				target.SetRotation(i, target.GetRotation(i));
+			}
+			Clock::time_point start = Clock::now();
+			target.Update(bUseSimd);
+			fullTime += chrono::duration<double, milli>(Clock::now() - start).count();
+		}
+
+		//A few nodes change, their subtrees are recomputed
+		double partialTime = 0.0;
+		size_t partialNodes = 0;
+		for (int iteration = 0; iteration < iterations; iteration++)
+		{
+			for (size_t i = 0; i < moving.size(); i++)
+			{
+				target.SetTranslation(moving[i], target.GetTranslation(moving[i]) + vec3(0.01f * iteration));
+			}
+			Clock::time_point start = Clock::now();
+			partialNodes += target.Update(bUseSimd);
+			partialTime += chrono::duration<double, milli>(Clock::now() - start).count();
+		}
+
+		cout << (bUseSimd ? "  simd:   " : "  scalar: ") << "full update " << fullTime / iterations << "ms, partial update of "
+			<< partialNodes / iterations << " nodes " << partialTime / iterations << "ms" << endl;
+	}
+
+	float maxError = 0.0f;
+	for (unsigned int i = 0; i < nodeCount; i++)
+	{
+		for (int column = 0; column < 4; column++)
+		{
+			vec4 difference = abs(hierarchy.GetWorld(i)[column] - reference.GetWorld(i)[column]);
+			maxError = std::max(maxError, std::max(std::max(difference.x, difference.y), std::max(difference.z, difference.w)));
+		}
+	}
+	cout << nodeCount << " nodes, largest difference between the scalar and simd results " << maxError << endl;
+}
@@ -0,0 +1,72 @@
+#pragma once
+#include <glm/glm.hpp>
+#include <glm/gtc/quaternion.hpp>
+#include <set>
+#include <vector>
+
+using namespace std;
+using namespace glm;
+
+//AVX2 kernels only when the compiler is allowed to use them (/arch:AVX2 or -mavx2 -mfma)
+#if defined(__AVX2__)
+#define TRANSFORMS_AVX2 1
+#endif
+
+/* Tree of local translation, rotation and scale transforms and the world matrices they add up to.
+Nodes can only be parented to nodes that already exist, so parents always sit before their children and one pass in
+order updates the whole tree. Changing a node marks it dirty, and Update only recomputes dirty nodes and everything
+below them. The local transforms are kept as separate arrays per component so eight can be composed at once.
+Removed nodes are reused by later Adds, but only for children of nodes before them so the order still holds */
+class TransformHierarchy
+{
+public:
+	TransformHierarchy();
+
+	/* Add a node under parent, or a root when parent is -1. Returns the new node */
+	unsigned int Add(int parent, vec3 translation = vec3(0.0f), quat rotation = quat(1.0f, 0.0f, 0.0f, 0.0f), vec3 scale = vec3(1.0f));
+	/* Free node for a later Add. Its children move up to its parent with its transform folded into theirs, so they stay
+	where they are in the world as long as node's scale is uniform */
+	void Remove(unsigned int node);
+	void Clear();
+
+	void SetTranslation(unsigned int node, vec3 translation);
+	void SetRotation(unsigned int node, quat rotation);
+	void SetScale(unsigned int node, vec3 scale);
+	vec3 GetTranslation(unsigned int node) const;
+	quat GetRotation(unsigned int node) const;
+	vec3 GetScale(unsigned int node) const;
+
+	int GetParent(unsigned int node) const;
+	/* World matrix as of the last Update */
+	const mat4& GetWorld(unsigned int node) const;
+	/* Number of nodes, including removed ones waiting to be reused */
+	size_t GetCount() const;
+	size_t GetFreeCount() const;
+
+	/* Recompute the local matrix of every changed node and the world matrix of every node at or below one.
+	Uses the AVX2 kernels when they are compiled in unless bUseSimd is false. Returns how many world matrices were updated */
+	size_t Update(bool bUseSimd = true);
+
+private:
+	/* Local matrix of each of nodes from its translation, rotation and scale, eight at a time with AVX2 */
+	void composeLocals(const unsigned int* nodes, size_t count, bool bUseSimd);
+	void composeLocal(unsigned int node);
+
+	vector<int> parents;
+	vector<unsigned int> childCounts; //so removing a node only looks for children when it has some
+	set<unsigned int> freeNodes; //removed, ordered so Add can find the first one after a parent
+	//local transforms, one array per component
+	vector<float> translationX, translationY, translationZ;
+	vector<float> rotationX, rotationY, rotationZ, rotationW;
+	vector<float> scaleX, scaleY, scaleZ;
+	vector<mat4> locals;
+	vector<mat4> worlds;
+	vector<unsigned char> localDirty; //translation, rotation or scale changed
+	vector<unsigned char> worldDirty; //world matrix is out of date, set by Update for everything below a changed node
+	vector<unsigned int> dirtyLocals; //scratch lists reused by Update
+	vector<unsigned int> dirtyWorlds;
+	bool bIsDirty;
+};
+
+/* Time full and partial updates of a 100k node hierarchy with and without the SIMD kernels and print the results */
+void RunTransformBenchmark();
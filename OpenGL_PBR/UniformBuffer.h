@@ -0,0 +1,96 @@
+#pragma once
+#include <glad/glad.h>
+#include <iostream>
+
+#include "Shader.h"
+
+using namespace std;
+
+/* Member of a std140 mirror struct and the offset the C++ struct puts it at */
+struct UniformMember
+{
+	const char* name;
+	unsigned int offset;
+};
+
+/* Uniform buffer holding one T, which mirrors a std140 block member for member. T provides
+static const UniformMember* GetMembers(unsigned int& count) so the layout can be checked against a linked program */
+template <typename T>
+class UniformBuffer
+{
+public:
+	UniformBuffer()
+		: buffer(0), binding(0)
+	{
+	}
+
+	~UniformBuffer()
+	{
+		if (buffer)
+		{
+			glDeleteBuffers(1, &buffer);
+		}
+	}
+
+	/* Make the buffer and attach it to binding, where the blocks it mirrors are declared */
+	void Create(unsigned int binding)
+	{
+		this->binding = binding;
+		glCreateBuffers(1, &buffer);
+		glNamedBufferStorage(buffer, sizeof(T), nullptr, GL_DYNAMIC_STORAGE_BIT);
+		glBindBufferBase(GL_UNIFORM_BUFFER, binding, buffer);
+	}
+
+	/* Replace every value in the block with one write */
+	void Update(const T& data)
+	{
+		glNamedBufferSubData(buffer, 0, sizeof(T), &data);
+	}
+
+	/* Check block in shader against T. Blocks the program does not use are fine, a wrong binding, a size T cannot
+	hold or a member at a different offset is printed and fails */
+	bool Validate(const Shader& shader, UniformId block, const char* blockName) const
+	{
+		const UniformBlockInfo* info = shader.GetBlock(block);
+		if (!info)
+		{
+			return true;
+		}
+		bool bIsValid = true;
+		if (info->binding != (GLint)binding)
+		{
+			cout << "ERROR::UNIFORM_BUFFER::" << blockName << " is at binding " << info->binding << " instead of " << binding << endl;
+			bIsValid = false;
+		}
+		if (info->dataSize > (GLint)sizeof(T))
+		{
+			cout << "ERROR::UNIFORM_BUFFER::" << blockName << " is " << info->dataSize << " bytes but its mirror only " << sizeof(T) << endl;
+			bIsValid = false;
+		}
+		unsigned int memberCount = 0;
+		const UniformMember* members = T::GetMembers(memberCount);
+		for (unsigned int i = 0; i < memberCount; i++)
+		{
+			const UniformInfo* member = shader.GetUniform(members[i].name);
+			if (member && member->offset != (GLint)members[i].offset)
+			{
+				cout << "ERROR::UNIFORM_BUFFER::" << blockName << "." << members[i].name << " is at offset " << member->offset << " instead of "
+					<< members[i].offset << endl;
+				bIsValid = false;
+			}
+		}
+		return bIsValid;
+	}
+
+	unsigned int GetBuffer() const
+	{
+		return buffer;
+	}
+
+private:
+	unsigned int buffer;
+	unsigned int binding;
+
+	UniformBuffer(const UniformBuffer&) = delete;
+	UniformBuffer& operator=(const UniformBuffer&) = delete;
+};
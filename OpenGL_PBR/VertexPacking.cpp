@@ -0,0 +1,65 @@
+#include <glm/gtc/packing.hpp>
+#include <cmath>
+#include "VertexPacking.h"
+
+//Directions that cannot be normalized still need a valid encoding
+static vec3 safeNormalize(vec3 direction, vec3 fallback)
+{
+	float directionLength = length(direction);
+	return directionLength > 0.0f ? direction / directionLength : fallback;
+}
+
+vec2 OctahedralEncode(vec3 direction)
+{
+	//Project onto the octahedron, then fold the lower hemisphere over the diagonals
+	direction /= abs(direction.x) + abs(direction.y) + abs(direction.z);
+	vec2 encoded = vec2(direction.x, direction.y);
+	if (direction.z < 0.0f)
+	{
+		encoded = (vec2(1.0f) - abs(vec2(direction.y, direction.x))) * vec2(encoded.x >= 0.0f ? 1.0f : -1.0f, encoded.y >= 0.0f ? 1.0f : -1.0f);
+	}
+	return encoded;
+}
+
+vec3 OctahedralDecode(vec2 encoded)
+{
+	vec3 direction = vec3(encoded.x, encoded.y, 1.0f - abs(encoded.x) - abs(encoded.y));
+	float fold = glm::max(-direction.z, 0.0f);
+	direction.x += direction.x >= 0.0f ? -fold : fold;
+	direction.y += direction.y >= 0.0f ? -fold : fold;
+	return normalize(direction);
+}
+
+void PackVertices(const Vertex* vertices, size_t vertexCount, vec3 boundsMin, vec3 boundsMax, PackedVertex* packed)
+{
+	//Flat axes are stored as 0 and come back as boundsMin
+	vec3 extent = boundsMax - boundsMin;
+	vec3 inverseExtent = vec3(extent.x > 0.0f ? 1.0f / extent.x : 0.0f, extent.y > 0.0f ? 1.0f / extent.y : 0.0f, extent.z > 0.0f ? 1.0f / extent.z : 0.0f);
+
+	for (size_t i = 0; i < vertexCount; i++)
+	{
+		const Vertex& vertex = vertices[i];
+		PackedVertex& out = packed[i];
+
+		vec3 position = (vertex.Position - boundsMin) * inverseExtent;
+		out.Position[0] = packUnorm1x16(position.x);
+		out.Position[1] = packUnorm1x16(position.y);
+		out.Position[2] = packUnorm1x16(position.z);
+
+		vec3 normal = safeNormalize(vertex.Normal, vec3(0.0f, 0.0f, 1.0f));
+		vec3 tangent = safeNormalize(vertex.Tangent, vec3(1.0f, 0.0f, 0.0f));
+		//Only the handedness of the bitangent is kept, the shader rebuilds it from the normal and tangent
+		bool bIsMirrored = dot(cross(normal, tangent), vertex.Bitangent) < 0.0f;
+		out.Position[3] = bIsMirrored ? 0 : 65535;
+
+		vec2 encodedNormal = OctahedralEncode(normal);
+		out.Normal[0] = (short)packSnorm1x16(encodedNormal.x);
+		out.Normal[1] = (short)packSnorm1x16(encodedNormal.y);
+		vec2 encodedTangent = OctahedralEncode(tangent);
+		out.Tangent[0] = (short)packSnorm1x16(encodedTangent.x);
+		out.Tangent[1] = (short)packSnorm1x16(encodedTangent.y);
+
+		out.TexCoords[0] = packHalf1x16(vertex.TexCoords.x);
+		out.TexCoords[1] = packHalf1x16(vertex.TexCoords.y);
+	}
+}
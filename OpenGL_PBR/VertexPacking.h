@@ -0,0 +1,15 @@
+#pragma once
+#include <glm/glm.hpp>
+
+#include "Mesh.h"
+
+using namespace glm;
+
+/* Octahedral encoding of a unit vector into two components in [-1, 1] */
+vec2 OctahedralEncode(vec3 direction);
+/* Inverse of OctahedralEncode, matches octDecode in the vertex shaders */
+vec3 OctahedralDecode(vec2 encoded);
+
+/* Quantize full precision vertices into the packed format used on the GPU. Positions are stored relative to the
+mesh bounds, which the vertex shader needs again as dequantizeOffset and dequantizeScale */
+void PackVertices(const Vertex* vertices, size_t vertexCount, vec3 boundsMin, vec3 boundsMax, PackedVertex* packed);
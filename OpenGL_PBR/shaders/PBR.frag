@@ -1,4 +1,8 @@
 #version 460
+//Variants are built from a feature set, see ShaderVariants: HAS_NORMAL_MAP, HAS_AO, HAS_EMISSIVE, ALPHA_TEST and SHADOW_FILTER_MODE
+#ifdef MATERIAL_BINDLESS
+#extension GL_ARB_bindless_texture : require
+#endif
 //Used with multiple color attachments in the incoming framebuffer
 layout (location = 0) out vec4 FragColor;
 layout (location = 1) out vec4 BloomColor;
@@ -14,32 +18,35 @@ in VS_OUT
 	//vec3 TangentViewPos;
 	//vec3 TangentFragPos;
 	mat3 TBN;
+	flat uint materialID; //entry in the material records
 } fs_in;
 
-struct Material
+#include "include/materials.glsl"
+
+//Per-pass values, mirrored by FrameConstants in ShaderConstants.h
+layout (std140, binding = 1) uniform FrameConstants
 {
-	sampler2D diffuse; 
-	sampler2D roughness;
-	sampler2D emissive;
-	sampler2D opacity;
-	sampler2D metallic;
-	sampler2D normal;
-	sampler2D ao;
+	vec4 lightPositions[4]; //xyz, w unused
+	vec4 lightColors[4];
+	vec3 viewPos;
+	float far_plane;
 };
 
-uniform Material material;
-uniform vec3 viewPos;
-uniform vec3 lightPositions[4];
-uniform vec3 lightColors[4];
+//Diffuse environment lighting, mirrored by EnvironmentConstants in ShaderConstants.h
+layout (std140, binding = 3) uniform EnvironmentConstants
+{
+	vec4 irradianceSH[9]; //3 band spherical harmonic of the irradiance over pi, w unused
+};
 
-uniform samplerCube irradianceMap;
-uniform samplerCube prefilterMap; //MipMaped environment
-uniform sampler2D BRDFLUT; //indirect specular integral
+//Bound to fixed units so every variant samples them without being told where they are
+layout (binding = 8) uniform samplerCube prefilterMap; //MipMaped environment
+layout (binding = 9) uniform sampler2D BRDFLUT; //indirect specular integral
 
-uniform samplerCube shadowMapCube;
-uniform float far_plane;
+layout (binding = 6) uniform samplerCube shadowMapCube;
 
-uniform bool bIsTransparent;
+#ifndef SHADOW_FILTER_MODE
+#define SHADOW_FILTER_MODE 2
+#endif
 
 //Temp values for PBR testing
 //const vec3 albedo = vec3(0.5f, 0.0f, 0.0f);
@@ -56,19 +63,28 @@ float GeometrySmith(vec3 N, vec3 V, vec3 L, float roughness); // Geometry Functi
 float DistributionGGX(vec3 N, vec3 H, float roughness); //Normal Distribution 
 float GeometrySchlickGGX(float NdotV, float roughness);
 float ShadowCalculation(vec3 fragPos);
+vec3 IrradianceSH(vec3 N); //Diffuse environment light arriving at a surface facing N
 
 void main()
 {
 	//texture properties
-	vec3 albedo = texture(material.diffuse, fs_in.texCoord).rgb;
-	float metallic = texture(material.metallic, fs_in.texCoord).r;
-	float roughness = texture(material.roughness, fs_in.texCoord).r;
-	vec3 norm = texture(material.normal, fs_in.texCoord).rgb;
-	float ao = texture(material.ao, fs_in.texCoord).r;
+	vec3 albedo = sampleMaterial(fs_in.materialID, MATERIAL_DIFFUSE, fs_in.texCoord).rgb;
+	float metallic = sampleMaterial(fs_in.materialID, MATERIAL_METALLIC, fs_in.texCoord).r;
+	float roughness = sampleMaterial(fs_in.materialID, MATERIAL_ROUGHNESS, fs_in.texCoord).r;
+#ifdef HAS_AO
+	float ao = sampleMaterial(fs_in.materialID, MATERIAL_AO, fs_in.texCoord).r;
+#else
+	const float ao = 1.0;
+#endif
+#ifdef HAS_NORMAL_MAP
+	vec3 norm = sampleMaterial(fs_in.materialID, MATERIAL_NORMAL, fs_in.texCoord).rgb;
 	//Tranform normal into range [-1, 1]
 	//norm = normalize(norm * 2.0 - 1.0);
 	norm = norm * 2.0 - 1.0;
 	norm = normalize(fs_in.TBN * norm);
+#else
+	vec3 norm = fs_in.Normal; //a flat normal map leaves the surface normal as it is
+#endif
 	
 	//Start of basic PBR
 	vec3 N = normalize(norm); //Normal in world space
@@ -85,11 +101,11 @@ void main()
 	for (int i = 0; i < 4; i++)
 	{
 		//per light radiance
-		vec3 L = normalize(lightPositions[i] - fs_in.FragPos);
+		vec3 L = normalize(lightPositions[i].xyz - fs_in.FragPos);
 		vec3 H = normalize(V + L);
-		float distance = length(lightPositions[i] - fs_in.FragPos);
+		float distance = length(lightPositions[i].xyz - fs_in.FragPos);
 		float attenuation = 1.0 / (distance * distance);
-		vec3 radiance = lightColors[i] * attenuation;
+		vec3 radiance = lightColors[i].rgb * attenuation;
 
 		//Cook-Torrance BRDF
 		vec3 F = fresnelSchlick(max(dot(H, V), 0.0), F0);
@@ -115,7 +131,7 @@ void main()
 	vec3 kD = 1.0 - kS;
 	kD *= 1.0 - metallic;
 
-	vec3 irradiance = texture(irradianceMap, N).rgb;
+	vec3 irradiance = IrradianceSH(N);
 	vec3 diffuse = irradiance * albedo;
 
     const float MAX_REFLECTION_LOD = 4.0;
@@ -128,7 +144,11 @@ void main()
 	vec3 lightingDif = (1.0 - shadow) * diffuse;
 
 	//emissive calculation
-	vec3 emissive = texture(material.emissive, fs_in.texCoord).rgb;
+#ifdef HAS_EMISSIVE
+	vec3 emissive = sampleMaterial(fs_in.materialID, MATERIAL_EMISSIVE, fs_in.texCoord).rgb;
+#else
+	const vec3 emissive = vec3(0.0);
+#endif
 	
 	vec3 ambient = (kD * diffuse + specular + emissive) * ao;
 	vec3 color = ambient + Lo + lightingDif;
@@ -149,11 +169,26 @@ void main()
         BloomColor = vec4(0.0, 0.0, 0.0, 1.0);
 
 	//Transparency
-	if (bIsTransparent)
-	{
-		vec4 texColor = texture(material.opacity, fs_in.texCoord);
-		FragColor = texColor;
-	}
+#ifdef ALPHA_TEST
+	vec4 texColor = sampleMaterial(fs_in.materialID, MATERIAL_OPACITY, fs_in.texCoord);
+	FragColor = texColor;
+#endif
+}
+
+vec3 IrradianceSH(vec3 N)
+{
+	//Same basis order as ProjectIrradianceSH, the cosine convolution is already folded into the coefficients
+	vec3 irradiance = irradianceSH[0].rgb * 0.282095;
+	irradiance += irradianceSH[1].rgb * (0.488603 * N.y);
+	irradiance += irradianceSH[2].rgb * (0.488603 * N.z);
+	irradiance += irradianceSH[3].rgb * (0.488603 * N.x);
+	irradiance += irradianceSH[4].rgb * (1.092548 * N.x * N.y);
+	irradiance += irradianceSH[5].rgb * (1.092548 * N.y * N.z);
+	irradiance += irradianceSH[6].rgb * (0.315392 * (3.0 * N.z * N.z - 1.0));
+	irradiance += irradianceSH[7].rgb * (1.092548 * N.x * N.z);
+	irradiance += irradianceSH[8].rgb * (0.546274 * (N.x * N.x - N.y * N.y));
+	//Ringing can dip below zero opposite very bright lights
+	return max(irradiance, vec3(0.0));
 }
 
 vec3 fresnelSchlickRoughness(float cosTheta, vec3 F0, float roughness)
@@ -201,8 +236,12 @@ float GeometrySmith(vec3 N, vec3 V, vec3 L, float roughness)
 	return ggx1 * ggx2;
 }
 
+//SHADOW_FILTER_MODE 0 has no shadows, 1 takes a single hard sample and 2 filters 20 samples around it
 float ShadowCalculation(vec3 fragPos)
 {
+#if SHADOW_FILTER_MODE == 0
+	return 0.0;
+#else
 	//Perpendicular directions of the cubemap to reduce redundant calls
 	vec3 sampleOffsetDirections[20] = vec3[]
 	(
@@ -212,8 +251,12 @@ float ShadowCalculation(vec3 fragPos)
 	vec3( 1,  0,  1), vec3(-1,  0,  1), vec3( 1,  0, -1), vec3(-1,  0, -1),
 	vec3( 0,  1,  1), vec3( 0, -1,  1), vec3( 0, -1, -1), vec3( 0,  1, -1)
 	);   
-	vec3 fragToLight = fragPos - lightPositions[0];
+	vec3 fragToLight = fragPos - lightPositions[0].xyz;
 	float currentDepth = length(fragToLight);
+#if SHADOW_FILTER_MODE == 1
+	float closestDepth = texture(shadowMapCube, fragToLight).r * far_plane;
+	return currentDepth - 0.15 > closestDepth ? 1.0 : 0.0;
+#else
 	float viewDistance = length(viewPos - fragPos);
 	//Make shadows sharper when player is close to shadow
 	float diskRadius = (1.0 + (viewDistance / far_plane)) / 25.0;
@@ -234,4 +277,6 @@ float ShadowCalculation(vec3 fragPos)
 
 
 	return shadow;
+#endif
+#endif
 }
\ No newline at end of file
@@ -1,42 +0,0 @@
-#version 460
-out vec4 FragColor;
-
-in vec3 localPos; //Local position that acts as face direction
-
-uniform samplerCube skyboxMap;
-
-const float PI = 3.14159265359;
-
-void main()
-{    
-    //Sample direction 
-    vec3 normal = normalize(localPos);
-
-    vec3 irradiance = vec3(0.0);
-
-    vec3 up = vec3(0.0, 1.0, 0.0);
-    vec3 right = normalize(cross(up, normal));
-    up = normalize(cross(normal, right));
-
-    float sampleDelta = 0.025; //Difference between steps that are traversed in the hemisphere
-    float nrSamples = 0.0;
-
-    for (float phi = 0.0; phi < 2.0 * PI; phi += sampleDelta)
-    {
-        for (float theta = 0.0; theta < 0.5 * PI; theta += sampleDelta)
-        {
-            //spherical to cartesian
-            vec3 tangentSample = vec3(sin(theta) * cos(phi), sin(theta) * sin(phi), cos(theta));
-            //tangent to world
-            vec3 sampleVec = tangentSample.x * right + tangentSample.y * up + tangentSample.z * normal;
-
-            //sample the cubemap from the given offset
-            irradiance += texture(skyboxMap, sampleVec).rgb * cos(theta) * sin(theta);
-            nrSamples++;
-        }
-    }
-    irradiance = PI * irradiance * (1.0 / float(nrSamples));
-
-    FragColor = vec4(irradiance, 1.0);
-
-}
@@ -0,0 +1,80 @@
+//Views the culling passes test against, set by GpuCulling
+uniform uint faceCount;
+uniform mat4 viewProjections[6];
+
+//Depth pyramid from the previous frame and the matrix it was rendered with
+uniform bool bUseOcclusion;
+uniform mat4 hiZViewProjection;
+uniform sampler2D hiZ;
+uniform vec2 hiZSize;
+uniform int hiZLevels;
+
+//Bit per clip plane the point is outside of
+uint outcode(vec4 clip)
+{
+	uint code = 0u;
+	code |= clip.x < -clip.w ? 1u : 0u;
+	code |= clip.x > clip.w ? 2u : 0u;
+	code |= clip.y < -clip.w ? 4u : 0u;
+	code |= clip.y > clip.w ? 8u : 0u;
+	code |= clip.z < -clip.w ? 16u : 0u;
+	code |= clip.z > clip.w ? 32u : 0u;
+	return code;
+}
+
+bool isOccluded(vec3 corners[8])
+{
+	vec3 ndcMin = vec3(1.0);
+	vec3 ndcMax = vec3(-1.0);
+	for (int i = 0; i < 8; i++)
+	{
+		vec4 clip = hiZViewProjection * vec4(corners[i], 1.0);
+		//Crosses the near plane, too close to say anything
+		if (clip.w <= 0.0)
+		{
+			return false;
+		}
+		vec3 ndc = clip.xyz / clip.w;
+		ndcMin = min(ndcMin, ndc);
+		ndcMax = max(ndcMax, ndc);
+	}
+	vec2 uvMin = clamp(ndcMin.xy * 0.5 + 0.5, 0.0, 1.0);
+	vec2 uvMax = clamp(ndcMax.xy * 0.5 + 0.5, 0.0, 1.0);
+	float closestDepth = ndcMin.z * 0.5 + 0.5;
+
+	//Pick the level where the box covers at most two texels in each direction, so four samples see all of it
+	vec2 extent = (uvMax - uvMin) * hiZSize;
+	float level = ceil(log2(max(max(extent.x, extent.y), 1.0)));
+	level = clamp(level, 0.0, float(hiZLevels - 1));
+
+	float furthestDepth = textureLod(hiZ, uvMin, level).r;
+	furthestDepth = max(furthestDepth, textureLod(hiZ, vec2(uvMax.x, uvMin.y), level).r);
+	furthestDepth = max(furthestDepth, textureLod(hiZ, vec2(uvMin.x, uvMax.y), level).r);
+	furthestDepth = max(furthestDepth, textureLod(hiZ, uvMax, level).r);
+	return closestDepth > furthestDepth;
+}
+
+//Faces that see the box with world space corners, 0 when it is outside all of them or hidden in the depth pyramid
+uint cullBox(vec3 corners[8])
+{
+	//A face sees the box unless every corner is outside the same plane
+	uint faceMask = 0u;
+	for (uint face = 0u; face < faceCount; face++)
+	{
+		uint outside = 63u;
+		for (int i = 0; i < 8; i++)
+		{
+			outside &= outcode(viewProjections[face] * vec4(corners[i], 1.0));
+		}
+		if (outside == 0u)
+		{
+			faceMask |= 1u << face;
+		}
+	}
+
+	if (faceMask != 0u && bUseOcclusion && isOccluded(corners))
+	{
+		faceMask = 0u;
+	}
+	return faceMask;
+}
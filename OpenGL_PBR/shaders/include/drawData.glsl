@@ -0,0 +1,36 @@
+#include "instanceRecord.glsl"
+
+//Per-draw values when drawn through a DrawList, indexed by gl_BaseInstance. Mirrored by DrawData in DrawList.h
+struct DrawData
+{
+	InstanceRecord transform;
+	vec4 dequantizeOffset;
+	vec4 dequantizeScale;
+	uint materialIndex; //entry in the MaterialTable
+	uint lod;
+	uint faceMask; //cube map faces the draw is visible in, written by the culling pass
+	uint batch;
+	int firstInstance;
+	int visibleInstanceStart; //first of the pool's entries in visibleInstances, -1 when every instance is drawn
+	uint visibleInstanceCount; //counted by the instance culling pass
+	uint padding;
+};
+
+//Only the culling pass writes draw data, it defines DRAW_DATA_ACCESS as nothing before including this
+#ifndef DRAW_DATA_ACCESS
+#define DRAW_DATA_ACCESS readonly
+#endif
+
+layout (std430, binding = 2) DRAW_DATA_ACCESS buffer DrawDataBuffer
+{
+	DrawData draws[];
+};
+
+//Instances of pooled draws that survived culling, each the instance's index in its pool above the faces it is visible in
+const uint VISIBLE_INSTANCE_FACE_BITS = 6u;
+const uint VISIBLE_INSTANCE_FACE_MASK = (1u << VISIBLE_INSTANCE_FACE_BITS) - 1u;
+
+layout (std430, binding = 8) DRAW_DATA_ACCESS buffer VisibleInstances
+{
+	uint visibleInstances[];
+};
@@ -0,0 +1,13 @@
+//Same layout as InstanceRecord, a 3x4 world matrix and the normal matrix worked out on the CPU
+struct InstanceRecord
+{
+	vec4 worldRows[3];
+	vec4 normalColumns[3];
+};
+
+//World space position of p under a packed world matrix
+vec3 transformPoint(InstanceRecord record, vec3 p)
+{
+	vec4 point = vec4(p, 1.0);
+	return vec3(dot(record.worldRows[0], point), dot(record.worldRows[1], point), dot(record.worldRows[2], point));
+}
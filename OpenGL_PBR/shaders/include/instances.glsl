@@ -0,0 +1,7 @@
+#include "instanceRecord.glsl"
+
+//Records of every instance pool, see InstanceManager
+layout (std430, binding = 1) readonly buffer InstanceRecords
+{
+	InstanceRecord instances[];
+};
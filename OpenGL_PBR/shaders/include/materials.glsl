@@ -0,0 +1,35 @@
+//Texture slots of a material, same order as MaterialSlot in MaterialTable.h
+const uint MATERIAL_DIFFUSE = 0;
+const uint MATERIAL_ROUGHNESS = 1;
+const uint MATERIAL_EMISSIVE = 2;
+const uint MATERIAL_OPACITY = 3;
+const uint MATERIAL_METALLIC = 4;
+const uint MATERIAL_NORMAL = 5;
+const uint MATERIAL_AO = 6;
+
+//Every material, mirrored by MaterialRecord. A slot is a bindless handle, or the texture array and layer without bindless support
+struct MaterialRecord
+{
+	uvec2 textures[8];
+};
+
+layout (std430, binding = 7) readonly buffer MaterialRecords
+{
+	MaterialRecord materials[];
+};
+
+//MATERIAL_BINDLESS is defined by the program when the MaterialTable holds bindless handles, it also has to enable the extension
+#ifndef MATERIAL_BINDLESS
+layout (binding = 16) uniform sampler2DArray materialArrays[8];
+#endif
+
+//Sample slot of material. The material is the same across a draw, so indexing the arrays with it is dynamically uniform
+vec4 sampleMaterial(uint material, uint slot, vec2 uv)
+{
+	uvec2 entry = materials[material].textures[slot];
+#ifdef MATERIAL_BINDLESS
+	return texture(sampler2D(entry), uv);
+#else
+	return texture(materialArrays[entry.x], vec3(uv, float(entry.y)));
+#endif
+}
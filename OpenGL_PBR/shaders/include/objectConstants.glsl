@@ -0,0 +1,10 @@
+//Per-object values for draws that are not part of a DrawList, mirrored by ObjectConstants in ShaderConstants.h
+layout (std140, binding = 2) uniform ObjectConstants
+{
+	mat4 model;
+	mat3 normalMatrix; //transpose(inverse(mat3(model))), set along with model
+	vec3 dequantizeOffset; //quantized positions are stored relative to the mesh bounds
+	int firstInstance; //where the instances of the model drawn start in instances, -1 when it is not instanced
+	vec3 dequantizeScale;
+	uint materialIndex; //entry in the MaterialTable
+};
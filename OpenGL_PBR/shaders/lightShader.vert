@@ -7,7 +7,7 @@ layout (location = 2) in vec2 aTexCoord;
 out vec3 vertexColor;
 out vec2 texCoord;
 
-uniform mat4 model;
+#include "include/objectConstants.glsl"
 
 layout (std140) uniform Matrices
 {
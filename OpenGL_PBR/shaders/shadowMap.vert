@@ -1,11 +1,47 @@
 #version 460
-layout (location = 0) in vec3 aPos;
+layout (location = 0) in vec4 aPackedPos; //xyz unorm inside the mesh bounds
+
+#include "include/objectConstants.glsl"
 
 uniform mat4 lightSpaceMatrix;
-uniform mat4 model;
+
+#include "include/drawData.glsl"
+
+uniform bool bDrawList = false;
+
+#include "include/instances.glsl"
+
+//Lets the geometry shader skip cube faces the draw, or for a culled pool the instance, was culled from
+flat out uint faceMask;
 
 void main()
 {
+	faceMask = 0x3Fu;
+	vec3 aPos = dequantizeOffset + aPackedPos.xyz * dequantizeScale;
+	int instanceBase = firstInstance;
+	uint instanceIndex = gl_InstanceID;
+	if (bDrawList)
+	{
+		aPos = draws[gl_BaseInstance].dequantizeOffset.xyz + aPackedPos.xyz * draws[gl_BaseInstance].dequantizeScale.xyz;
+		instanceBase = draws[gl_BaseInstance].firstInstance;
+		faceMask = draws[gl_BaseInstance].faceMask;
+		int visibleStart = draws[gl_BaseInstance].visibleInstanceStart;
+		if (visibleStart >= 0)
+		{
+			uint visible = visibleInstances[visibleStart + gl_InstanceID];
+			instanceIndex = visible >> VISIBLE_INSTANCE_FACE_BITS;
+			faceMask = visible & VISIBLE_INSTANCE_FACE_MASK;
+		}
+	}
+	if (instanceBase >= 0)
+	{
+		aPos = transformPoint(instances[instanceBase + instanceIndex], aPos);
+	}
+	if (bDrawList)
+	{
+		gl_Position = vec4(transformPoint(draws[gl_BaseInstance].transform, aPos), 1.0);
+		return;
+	}
 	//gl_Position = lightSpaceMatrix * model * vec4(aPos, 1.0);
 	gl_Position = model * vec4(aPos, 1.0);
 }
\ No newline at end of file
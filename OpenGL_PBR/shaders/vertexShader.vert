@@ -1,13 +1,14 @@
 #version 460
+//INSTANCED is defined for variants drawing instance pools, see ShaderVariants
 
-layout (location = 0) in vec3 aPos;
-layout (location = 1) in vec3 aNormal;
+layout (location = 0) in vec4 aPackedPos; //xyz unorm inside the mesh bounds, w is the bitangent sign
+layout (location = 1) in vec2 aPackedNormal; //octahedral
 layout (location = 2) in vec2 aTexCoord;
 //layout (location = 3) in mat4 instanceMatrix; //Used with instancing, takes up slot 3, 4, 5 and 6
-layout (location = 3) in vec3 aTangent;
-layout (location = 4) in vec3 aBitangent;
+layout (location = 3) in vec2 aPackedTangent; //octahedral
+
+#include "include/objectConstants.glsl"
 
-uniform mat4 model;
 uniform mat4 lightSpaceMatrix; //Depth value from shadow map
 //uniform mat4 view;
 //uniform mat4 projection;
@@ -20,10 +21,9 @@ layout (std140) uniform Matrices
 	mat4 view;
 };
 
-layout (std430, binding = 1) buffer ModelMatrices
-{
-	mat4 modelMatrix[];
-};
+#include "include/instances.glsl"
+#include "include/drawData.glsl"
+#include "include/packing.glsl"
 
 //Group up all output values inside an interface
 out VS_OUT
@@ -37,30 +37,63 @@ out VS_OUT
 	//vec3 TangentViewPos;
 	//vec3 TangentFragPos;
 	mat3 TBN;
+	flat uint materialID; //entry in the material records
 } vs_out;
 
-uniform bool bInstance = false;
+uniform bool bDrawList = false;
 
 void main()
 {
-	if (!bInstance)
+	bool bDrawn = bDrawList; //DrawData is only valid when drawn through a DrawList
+	DrawData draw;
+	int instanceBase = firstInstance;
+	uint material = materialIndex;
+	vec3 aPos = dequantizeOffset + aPackedPos.xyz * dequantizeScale;
+	if (bDrawn)
 	{
-		gl_Position = projection * view * model * vec4(aPos, 1.0f);
-		vs_out.Normal = mat3(transpose(inverse(model))) * aNormal; //this calculation deals with non-uniform scaling 
-		vs_out.FragPos = vec3(model * vec4(aPos, 1.0)); //Position value in world space coordinates that can be used by the fragment shader
+		draw = draws[gl_BaseInstance];
+		aPos = draw.dequantizeOffset.xyz + aPackedPos.xyz * draw.dequantizeScale.xyz;
+		instanceBase = draw.firstInstance;
+		material = draw.materialIndex;
+	}
+	vec3 aNormal = octDecode(aPackedNormal);
+	vec3 aTangent = octDecode(aPackedTangent);
+	float bitangentSign = aPackedPos.w * 2.0 - 1.0;
+
+	//Instance transform first, then the draw's own. Normal matrices are all precomputed, nothing is inverted per vertex
+	vec3 worldPos = aPos;
+	mat3 worldNormalMatrix = mat3(1.0);
+#ifdef INSTANCED
+	//Only variants built for instance pools read the records, everything else skips the branch altogether.
+	//A culled pool only draws its visible instances, which the culling pass listed for the draw
+	uint instanceIndex = gl_InstanceID;
+	if (bDrawn && draw.visibleInstanceStart >= 0)
+	{
+		instanceIndex = visibleInstances[draw.visibleInstanceStart + gl_InstanceID] >> VISIBLE_INSTANCE_FACE_BITS;
+	}
+	InstanceRecord instance = instances[instanceBase + instanceIndex];
+	worldPos = transformPoint(instance, worldPos);
+	worldNormalMatrix = mat3(instance.normalColumns[0].xyz, instance.normalColumns[1].xyz, instance.normalColumns[2].xyz);
+#endif
+	if (bDrawn)
+	{
+		worldPos = transformPoint(draw.transform, worldPos);
+		worldNormalMatrix = mat3(draw.transform.normalColumns[0].xyz, draw.transform.normalColumns[1].xyz, draw.transform.normalColumns[2].xyz) * worldNormalMatrix;
 	}
 	else
 	{
-		gl_Position = projection * view * modelMatrix[gl_InstanceID] * vec4(aPos, 1.0f);
-		vs_out.Normal = mat3(transpose(inverse(modelMatrix[gl_InstanceID]))) * aNormal; //this calculation deals with non-uniform scaling 
-		vs_out.FragPos = vec3(modelMatrix[gl_InstanceID] * vec4(aPos, 1.0)); //Position value in world space coordinates that can be used by the fragment shader
+		worldPos = vec3(model * vec4(worldPos, 1.0));
+		worldNormalMatrix = normalMatrix * worldNormalMatrix;
 	}
+
+	gl_Position = projection * view * vec4(worldPos, 1.0f);
+	vs_out.Normal = worldNormalMatrix * aNormal; //the normal matrix deals with non-uniform scaling
+	vs_out.FragPos = worldPos; //Position value in world space coordinates that can be used by the fragment shader
 	//Transforming light and view positions into tangent space
-	mat3 normalMatrix = transpose(inverse(mat3(model)));
-	vec3 T = normalize(normalMatrix * aTangent);
-	vec3 N = normalize(normalMatrix * aNormal);
+	vec3 T = normalize(worldNormalMatrix * aTangent);
+	vec3 N = normalize(worldNormalMatrix * aNormal);
 	T = normalize(T - dot(T, N) * N);
-	vec3 B = cross(N, T);
+	vec3 B = cross(N, T) * bitangentSign;
 
 	vs_out.TBN = transpose(mat3(T, B, N));
 	//vs_out.TangentLightPos = TBN * lightPos;
@@ -69,6 +102,7 @@ void main()
 
 	//vs_out.FragPosLightSpace = lightSpaceMatrix * vec4(vs_out.FragPos, 1.0); //Vertex Position from the direction of the light source
 	vs_out.texCoord = aTexCoord;
+	vs_out.materialID = material;
 	//mulitply position of incoming vertex by the model matrix
 	//Increase point size the further away the camera is
 	gl_PointSize = gl_Position.z;
@@ -1,7 +1,11 @@
 #version 460
 
-layout (location = 0) in vec3 aPos;
-layout (location = 1) in vec3 aNormal;
+layout (location = 0) in vec4 aPackedPos; //xyz unorm inside the mesh bounds
+layout (location = 1) in vec2 aPackedNormal; //octahedral
+
+//Quantized positions are stored relative to the mesh bounds
+uniform vec3 dequantizeOffset;
+uniform vec3 dequantizeScale;
 
 uniform mat4 model;
 
@@ -16,8 +20,20 @@ out GS_OUT { //Values passed through to geometry Shader
 	mat4 projection;
 } gm_out;
 
+//Unpack an octahedral encoded unit vector
+vec3 octDecode(vec2 e)
+{
+	vec3 v = vec3(e, 1.0 - abs(e.x) - abs(e.y));
+	float t = max(-v.z, 0.0);
+	v.xy += vec2(v.x >= 0.0 ? -t : t, v.y >= 0.0 ? -t : t);
+	return normalize(v);
+}
+
 void main()
 {
+	vec3 aPos = dequantizeOffset + aPackedPos.xyz * dequantizeScale;
+	vec3 aNormal = octDecode(aPackedNormal);
+
 	gl_Position = view * model * vec4(aPos, 1.0);
 	mat3 normalMatrix = mat3(transpose(inverse(view * model))); //Accomodate for scaling and rotation to the normal vertex
 	gm_out.normal = normalize(vec3(vec4(normalMatrix * aNormal, 0.0)));